@@ -16,6 +16,9 @@
 #include <ctype.h>
 #include <stdbool.h>
 #include <stdarg.h>
+#include <stdint.h>
+#include <limits.h>
+#include <math.h>
 
 #define MAX_LINE 4096
 #define MAX_VARS 1024
@@ -30,7 +33,8 @@ typedef enum {
     MODE_RAW,
     MODE_DEBUG,
     MODE_DEBUG_OPT,
-    MODE_DEBUG_RAW
+    MODE_DEBUG_RAW,
+    MODE_CHECKED        /* optimized + list index checks */
 } CompileMode;
 
 typedef enum {
@@ -47,13 +51,27 @@ typedef enum {
     TYPE_LIST,
     TYPE_DICT,
     TYPE_TUPLE,
+    TYPE_SET,
+    TYPE_DEQUE,
+    TYPE_HEAP,
+    TYPE_ORDMAP,
+    TYPE_LRU,
+    TYPE_BLOOM,
+    TYPE_CMS,
+    TYPE_HASHER,
+    TYPE_RNG,
+    TYPE_TDIGEST,
+    TYPE_REGEX,
     TYPE_UNKNOWN
 } VarType;
 
 typedef struct {
     char name[256];
     VarType type;
+    VarType elem_type;
     bool is_const;
+    bool is_sorted;     /* list declared 'sorted': membership uses binary search */
+    bool is_shared;     /* list that may share storage with another (list B = A) */
 } Variable;
 
 typedef struct {
@@ -62,12 +80,40 @@ typedef struct {
     char type[32];
     bool closed_by_end;
     bool uses_braces;
+    int extra_braces;   /* scopes opened around the loop header, closed with the block */
 } Block;
 
+#define MAX_PARAMS 16
+
+typedef enum {
+    INLINE_AUTO,        /* 'static inline' when the body is small */
+    INLINE_ALWAYS,      /* @inline */
+    INLINE_NEVER        /* @noinline */
+} InlineMode;
+
 typedef struct {
     char name[256];
     char body[65536];
     int body_len;
+    char params[1024];              /* C parameter list, "void" when empty */
+    char ret_c[32];
+    VarType ret;
+    VarType ret_elem;
+    int arity;
+    VarType param_types[MAX_PARAMS];
+    VarType param_elems[MAX_PARAMS];
+    char param_names[MAX_PARAMS][64];
+    InlineMode inline_mode;
+    char attrs[128];                /* GCC attributes from @hot, @cold and @opt */
+    bool is_generator;              /* the body yields (see Generators) */
+    int yields;
+    char* frame;                    /* fields of the generator's frame struct */
+    char* source;                   /* body lines as written, for compile-time evaluation */
+    size_t source_len, source_cap;
+    bool source_done;
+    char** ct_lines;                /* source split into statements on first evaluation */
+    int* ct_indents;
+    int ct_line_count;
 } Function;
 
 typedef struct {
@@ -76,6 +122,34 @@ typedef struct {
     char severity[16];
 } CompilerError;
 
+/* Generic function templates (see Generic Functions) */
+#define MAX_GENERICS 64
+#define MAX_TYPE_PARAMS 4
+#define MAX_INSTANCES 256
+
+typedef struct {
+    char name[256];
+    char type_params[MAX_TYPE_PARAMS][32];
+    int type_param_count;
+    char param_types[MAX_PARAMS][64];
+    char param_names[MAX_PARAMS][64];
+    int arity;
+    char ret[64];               /* empty: no return value */
+    int indent;
+    int line_num;
+    InlineMode inline_mode;
+    char attrs[128];
+    char* body;                 /* template lines, newline separated */
+    size_t body_len, body_cap;
+} Generic;
+
+typedef struct {
+    int generic;
+    char type_args[MAX_TYPE_PARAMS][32];
+    char name[256];
+    bool compiled;
+} GenericInstance;
+
 /* ============== Globals ============== */
 
 static Variable g_vars[MAX_VARS];
@@ -95,13 +169,22 @@ static CompileMode g_mode = MODE_OPTIMIZED;
 static LogMode g_log_mode = LOG_NONE;
 static bool g_in_function = false;
 static int g_func_indent = 0;
+static InlineMode g_pending_inline = INLINE_AUTO;    /* set by @inline / @noinline */
+static char g_pending_attrs[128] = "";              /* set by @hot / @cold / @opt("O3") */
+static bool g_pending_simd = false;                 /* set by 'simd for' */
+static int g_pending_unroll = 0;                    /* set by 'unroll(N) for' */
+static Variable g_saved_vars[MAX_VARS];             /* variables outside the current function */
+static int g_saved_var_count = 0;
 
-static char g_main_code[262144];
+static char g_main_code[1048576];
 static int g_main_len = 0;
 
-static char g_output[524288];
+static char g_output[4194304];
 static int g_output_len = 0;
 
+static char g_decls[1048576];    /* static data generated at compile time (regex tables, folded constants) */
+static int g_decls_len = 0;
+
 /* ============== Logging System ============== */
 
 static const char* type_to_string(VarType t) {
@@ -113,6 +196,17 @@ static const char* type_to_string(VarType t) {
         case TYPE_LIST: return "list";
         case TYPE_DICT: return "dict";
         case TYPE_TUPLE: return "tuple";
+        case TYPE_SET: return "set";
+        case TYPE_DEQUE: return "deque";
+        case TYPE_HEAP: return "heap";
+        case TYPE_ORDMAP: return "ordmap";
+        case TYPE_LRU: return "lru";
+        case TYPE_BLOOM: return "bloom";
+        case TYPE_CMS: return "cms";
+        case TYPE_HASHER: return "hasher";
+        case TYPE_RNG: return "rng";
+        case TYPE_TDIGEST: return "tdigest";
+        case TYPE_REGEX: return "regex";
         default: return "unknown";
     }
 }
@@ -283,6 +377,22 @@ static void warning(const char* msg) {
     add_error(msg, "warning");
 }
 
+/* Warning about an earlier line, e.g. a loop header found out about when the loop closes */
+static void warning_at(int line_num, const char* msg) {
+    int current = g_current_line;
+    g_current_line = line_num;
+    warning(msg);
+    g_current_line = current;
+}
+
+/* Error about an earlier line */
+static void error_at(int line_num, const char* msg) {
+    int current = g_current_line;
+    g_current_line = line_num;
+    error(msg);
+    g_current_line = current;
+}
+
 static void print_all_errors(void) {
     if (g_error_count == 0) return;
     
@@ -398,6 +508,16 @@ static void append_output(const char* str) {
     }
 }
 
+static void append_decl(const char* str) {
+    int len = strlen(str);
+    if (g_decls_len + len < (int)sizeof(g_decls) - 1) {
+        strcpy(g_decls + g_decls_len, str);
+        g_decls_len += len;
+    } else {
+        error("Too much generated static data");
+    }
+}
+
 static void append_main(const char* str) {
     int len = strlen(str);
     if (g_main_len + len < (int)sizeof(g_main_code) - 1) {
@@ -417,6 +537,19 @@ static void append_func(const char* str) {
     }
 }
 
+/* Keeps the A text of a function body so calls can be evaluated at compile time */
+static void record_func_source(Function* f, const char* line) {
+    size_t len = strlen(line);
+    if (f->source_len + len + 2 > f->source_cap) {
+        f->source_cap = (f->source_len + len + 2) * 2;
+        f->source = (char*)realloc(f->source, f->source_cap);
+    }
+    memcpy(f->source + f->source_len, line, len);
+    f->source_len += len;
+    f->source[f->source_len++] = '\n';
+    f->source[f->source_len] = '\0';
+}
+
 static void emit(const char* str) {
     if (g_in_function) {
         append_func(str);
@@ -445,11 +578,23 @@ static VarType get_var_type(const char* name) {
     return TYPE_UNKNOWN;
 }
 
+static VarType get_var_elem_type(const char* name) {
+    for (int i = 0; i < g_var_count; i++) {
+        if (strcmp(g_vars[i].name, name) == 0) {
+            return g_vars[i].elem_type;
+        }
+    }
+    return TYPE_UNKNOWN;
+}
+
 static void register_var(const char* name, VarType type, bool is_const) {
     for (int i = 0; i < g_var_count; i++) {
         if (strcmp(g_vars[i].name, name) == 0) {
             g_vars[i].type = type;
+            g_vars[i].elem_type = TYPE_UNKNOWN;
             g_vars[i].is_const = is_const;
+            g_vars[i].is_sorted = false;
+            g_vars[i].is_shared = false;
             return;
         }
     }
@@ -457,17 +602,327 @@ static void register_var(const char* name, VarType type, bool is_const) {
     if (g_var_count < MAX_VARS) {
         strncpy(g_vars[g_var_count].name, name, 255);
         g_vars[g_var_count].type = type;
+        g_vars[g_var_count].elem_type = TYPE_UNKNOWN;
         g_vars[g_var_count].is_const = is_const;
+        g_vars[g_var_count].is_sorted = false;
+        g_vars[g_var_count].is_shared = false;
         g_var_count++;
     } else {
         error("Maximum variable limit reached");
     }
 }
 
+/* Element type of a container variable, e.g. the 'string' in set[string] */
+static void set_var_elem_type(const char* name, VarType elem) {
+    for (int i = 0; i < g_var_count; i++) {
+        if (strcmp(g_vars[i].name, name) == 0) {
+            g_vars[i].elem_type = elem;
+            return;
+        }
+    }
+}
+
+static void set_var_sorted(const char* name) {
+    for (int i = 0; i < g_var_count; i++) {
+        if (strcmp(g_vars[i].name, name) == 0) {
+            g_vars[i].is_sorted = true;
+            return;
+        }
+    }
+}
+
+static bool is_var_sorted(const char* name) {
+    for (int i = 0; i < g_var_count; i++) {
+        if (strcmp(g_vars[i].name, name) == 0) {
+            return g_vars[i].is_sorted;
+        }
+    }
+    return false;
+}
+
+/* 'list B = A' copies the List struct, so both names now reach one buffer */
+static void note_list_copy(const char* dst, const char* src) {
+    if (get_var_type(dst) != TYPE_LIST || get_var_type(src) != TYPE_LIST) return;
+    for (int i = 0; i < g_var_count; i++) {
+        if (strcmp(g_vars[i].name, dst) == 0 || strcmp(g_vars[i].name, src) == 0) {
+            g_vars[i].is_shared = true;
+        }
+    }
+}
+
+static bool is_var_shared(const char* name) {
+    for (int i = 0; i < g_var_count; i++) {
+        if (strcmp(g_vars[i].name, name) == 0) {
+            return g_vars[i].is_shared;
+        }
+    }
+    return false;
+}
+
+static bool is_var_const(const char* name) {
+    for (int i = 0; i < g_var_count; i++) {
+        if (strcmp(g_vars[i].name, name) == 0) {
+            return g_vars[i].is_const;
+        }
+    }
+    return false;
+}
+
+static const Function* find_func(const char* name) {
+    for (int i = 0; i < g_func_count; i++) {
+        if (strcmp(g_funcs[i].name, name) == 0) {
+            return &g_funcs[i];
+        }
+    }
+    return NULL;
+}
+
+/* Type names usable in function signatures */
+typedef struct {
+    const char* name;
+    const char* c_type;
+    VarType type;
+    VarType elem;
+} TypeName;
+
+static const TypeName g_type_names[] = {
+    { "int",         "int",       TYPE_INT,     TYPE_UNKNOWN },
+    { "float",       "float",     TYPE_FLOAT,   TYPE_UNKNOWN },
+    { "bool",        "bool",      TYPE_BOOL,    TYPE_UNKNOWN },
+    { "string",      "char*",     TYPE_STRING,  TYPE_UNKNOWN },
+    { "list",        "List",      TYPE_LIST,    TYPE_UNKNOWN },
+    { "list[int]",   "List",      TYPE_LIST,    TYPE_UNKNOWN },
+    { "list[float]", "FList",     TYPE_LIST,    TYPE_FLOAT },
+    { "dict",        "Dict",      TYPE_DICT,    TYPE_UNKNOWN },
+    { "tuple",       "Tuple",     TYPE_TUPLE,   TYPE_UNKNOWN },
+    { "set",         "IntSet",    TYPE_SET,     TYPE_INT },
+    { "set[int]",    "IntSet",    TYPE_SET,     TYPE_INT },
+    { "set[string]", "StrSet",    TYPE_SET,     TYPE_STRING },
+    { "deque",       "Deque",     TYPE_DEQUE,   TYPE_UNKNOWN },
+    { "heap",        "IntHeap",   TYPE_HEAP,    TYPE_INT },
+    { "heap[float]", "FloatHeap", TYPE_HEAP,    TYPE_FLOAT },
+    { "ordmap",      "OrdMap",    TYPE_ORDMAP,  TYPE_UNKNOWN },
+    { "lru",         "Lru",       TYPE_LRU,     TYPE_UNKNOWN },
+    { "bloom",       "Bloom",     TYPE_BLOOM,   TYPE_UNKNOWN },
+    { "cms",         "CountMin",  TYPE_CMS,     TYPE_UNKNOWN },
+    { "hasher",      "Hasher",    TYPE_HASHER,  TYPE_UNKNOWN },
+    { "rng",         "Rng",       TYPE_RNG,     TYPE_UNKNOWN },
+    { "tdigest",     "TDigest",   TYPE_TDIGEST, TYPE_UNKNOWN },
+    { "regex",       "Regex",     TYPE_REGEX,   TYPE_UNKNOWN },
+};
+
+static const TypeName* find_type_name(const char* name) {
+    for (size_t i = 0; i < sizeof(g_type_names) / sizeof(g_type_names[0]); i++) {
+        if (strcmp(g_type_names[i].name, name) == 0) {
+            return &g_type_names[i];
+        }
+    }
+    return NULL;
+}
+
+static bool is_container_type(VarType t) {
+    return t == TYPE_LIST || t == TYPE_DICT || t == TYPE_TUPLE || t == TYPE_SET ||
+           t == TYPE_DEQUE || t == TYPE_HEAP || t == TYPE_ORDMAP ||
+           t == TYPE_LRU || t == TYPE_BLOOM || t == TYPE_CMS || t == TYPE_HASHER ||
+           t == TYPE_RNG || t == TYPE_TDIGEST || t == TYPE_REGEX;
+}
+
+/* ============== Runtime Methods and Builtins ============== */
+
+/* Container methods: 'S.add(x)' is rewritten to 'iset_add(&S, x)' */
+typedef struct {
+    VarType type;
+    VarType elem;       /* TYPE_UNKNOWN matches any element type */
+    const char* method;
+    const char* c_func;
+    VarType ret;
+    int mutates;        /* bit i: the call changes its i-th argument (bit 0 is the container itself) */
+} MethodDef;
+
+static const MethodDef g_methods[] = {
+    { TYPE_SET, TYPE_INT,    "add",       "iset_add",       TYPE_BOOL, 1 },
+    { TYPE_SET, TYPE_INT,    "contains",  "iset_contains",  TYPE_BOOL, 0 },
+    { TYPE_SET, TYPE_INT,    "remove",    "iset_remove",    TYPE_BOOL, 1 },
+    { TYPE_SET, TYPE_INT,    "len",       "iset_len",       TYPE_INT, 0 },
+    { TYPE_SET, TYPE_INT,    "union",     "iset_union",     TYPE_SET, 0 },
+    { TYPE_SET, TYPE_INT,    "intersect", "iset_intersect", TYPE_SET, 0 },
+    { TYPE_SET, TYPE_INT,    "to_list",   "iset_to_list",   TYPE_LIST, 0 },
+    { TYPE_SET, TYPE_INT,    "clear",     "iset_clear",     TYPE_UNKNOWN, 1 },
+    { TYPE_SET, TYPE_STRING, "add",       "sset_add",       TYPE_BOOL, 1 },
+    { TYPE_SET, TYPE_STRING, "contains",  "sset_contains",  TYPE_BOOL, 0 },
+    { TYPE_SET, TYPE_STRING, "remove",    "sset_remove",    TYPE_BOOL, 1 },
+    { TYPE_SET, TYPE_STRING, "len",       "sset_len",       TYPE_INT, 0 },
+    { TYPE_SET, TYPE_STRING, "union",     "sset_union",     TYPE_SET, 0 },
+    { TYPE_SET, TYPE_STRING, "intersect", "sset_intersect", TYPE_SET, 0 },
+    { TYPE_SET, TYPE_STRING, "clear",     "sset_clear",     TYPE_UNKNOWN, 1 },
+    { TYPE_DEQUE, TYPE_UNKNOWN, "push_back",  "deque_push_back",  TYPE_UNKNOWN, 1 },
+    { TYPE_DEQUE, TYPE_UNKNOWN, "push_front", "deque_push_front", TYPE_UNKNOWN, 1 },
+    { TYPE_DEQUE, TYPE_UNKNOWN, "pop_back",   "deque_pop_back",   TYPE_INT, 1 },
+    { TYPE_DEQUE, TYPE_UNKNOWN, "pop_front",  "deque_pop_front",  TYPE_INT, 1 },
+    { TYPE_DEQUE, TYPE_UNKNOWN, "front",      "deque_front",      TYPE_INT, 0 },
+    { TYPE_DEQUE, TYPE_UNKNOWN, "back",       "deque_back",       TYPE_INT, 0 },
+    { TYPE_DEQUE, TYPE_UNKNOWN, "get",        "deque_get",        TYPE_INT, 0 },
+    { TYPE_DEQUE, TYPE_UNKNOWN, "len",        "deque_len",        TYPE_INT, 0 },
+    { TYPE_DEQUE, TYPE_UNKNOWN, "empty",      "deque_empty",      TYPE_BOOL, 0 },
+    { TYPE_DEQUE, TYPE_UNKNOWN, "full",       "deque_full",       TYPE_BOOL, 0 },
+    { TYPE_DEQUE, TYPE_UNKNOWN, "clear",      "deque_clear",      TYPE_UNKNOWN, 1 },
+    { TYPE_DEQUE, TYPE_UNKNOWN, "to_list",    "deque_to_list",    TYPE_LIST, 0 },
+    { TYPE_HEAP, TYPE_INT,   "push",     "iheap_push",     TYPE_UNKNOWN, 1 },
+    { TYPE_HEAP, TYPE_INT,   "pop",      "iheap_pop",      TYPE_INT, 1 },
+    { TYPE_HEAP, TYPE_INT,   "peek",     "iheap_peek",     TYPE_INT, 0 },
+    { TYPE_HEAP, TYPE_INT,   "peek_val", "iheap_peek_val", TYPE_INT, 0 },
+    { TYPE_HEAP, TYPE_INT,   "len",      "iheap_len",      TYPE_INT, 0 },
+    { TYPE_HEAP, TYPE_INT,   "empty",    "iheap_empty",    TYPE_BOOL, 0 },
+    { TYPE_HEAP, TYPE_INT,   "clear",    "iheap_clear",    TYPE_UNKNOWN, 1 },
+    { TYPE_HEAP, TYPE_INT,   "heapify",  "iheap_heapify",  TYPE_UNKNOWN, 1 },
+    { TYPE_HEAP, TYPE_FLOAT, "push",     "fheap_push",     TYPE_UNKNOWN, 1 },
+    { TYPE_HEAP, TYPE_FLOAT, "pop",      "fheap_pop",      TYPE_INT, 1 },
+    { TYPE_HEAP, TYPE_FLOAT, "peek",     "fheap_peek",     TYPE_FLOAT, 0 },
+    { TYPE_HEAP, TYPE_FLOAT, "peek_val", "fheap_peek_val", TYPE_INT, 0 },
+    { TYPE_HEAP, TYPE_FLOAT, "len",      "fheap_len",      TYPE_INT, 0 },
+    { TYPE_HEAP, TYPE_FLOAT, "empty",    "fheap_empty",    TYPE_BOOL, 0 },
+    { TYPE_HEAP, TYPE_FLOAT, "clear",    "fheap_clear",    TYPE_UNKNOWN, 1 },
+    { TYPE_HEAP, TYPE_FLOAT, "heapify",  "fheap_heapify",  TYPE_UNKNOWN, 1 },
+    { TYPE_ORDMAP, TYPE_UNKNOWN, "get",    "ordmap_get",    TYPE_INT, 0 },
+    { TYPE_ORDMAP, TYPE_UNKNOWN, "set",    "ordmap_set",    TYPE_UNKNOWN, 1 },
+    { TYPE_ORDMAP, TYPE_UNKNOWN, "has",    "ordmap_has",    TYPE_BOOL, 0 },
+    { TYPE_ORDMAP, TYPE_UNKNOWN, "remove", "ordmap_remove", TYPE_BOOL, 1 },
+    { TYPE_ORDMAP, TYPE_UNKNOWN, "first",  "ordmap_first",  TYPE_INT, 0 },
+    { TYPE_ORDMAP, TYPE_UNKNOWN, "last",   "ordmap_last",   TYPE_INT, 0 },
+    { TYPE_ORDMAP, TYPE_UNKNOWN, "len",    "ordmap_len",    TYPE_INT, 0 },
+    { TYPE_LRU,   TYPE_UNKNOWN, "get",      "lru_get",        TYPE_INT, 1 },
+    { TYPE_LRU,   TYPE_UNKNOWN, "put",      "lru_put",        TYPE_UNKNOWN, 1 },
+    { TYPE_LRU,   TYPE_UNKNOWN, "has",      "lru_has",        TYPE_BOOL, 0 },
+    { TYPE_LRU,   TYPE_UNKNOWN, "remove",   "lru_remove",     TYPE_BOOL, 1 },
+    { TYPE_LRU,   TYPE_UNKNOWN, "len",      "lru_len",        TYPE_INT, 0 },
+    { TYPE_LRU,   TYPE_UNKNOWN, "clear",    "lru_clear",      TYPE_UNKNOWN, 1 },
+    { TYPE_BLOOM, TYPE_UNKNOWN, "add",      "bloom_add",      TYPE_UNKNOWN, 1 },
+    { TYPE_BLOOM, TYPE_UNKNOWN, "contains", "bloom_contains", TYPE_BOOL, 0 },
+    { TYPE_BLOOM, TYPE_UNKNOWN, "merge",    "bloom_merge",    TYPE_BOOL, 1 },
+    { TYPE_BLOOM, TYPE_UNKNOWN, "clear",    "bloom_clear",    TYPE_UNKNOWN, 1 },
+    { TYPE_BLOOM, TYPE_UNKNOWN, "save",     "bloom_save",     TYPE_BOOL, 0 },
+    { TYPE_BLOOM, TYPE_UNKNOWN, "load",     "bloom_load",     TYPE_BOOL, 1 },
+    { TYPE_CMS,   TYPE_UNKNOWN, "add",      "cms_add",        TYPE_UNKNOWN, 1 },
+    { TYPE_CMS,   TYPE_UNKNOWN, "count",    "cms_count",      TYPE_INT, 0 },
+    { TYPE_CMS,   TYPE_UNKNOWN, "merge",    "cms_merge",      TYPE_BOOL, 1 },
+    { TYPE_CMS,   TYPE_UNKNOWN, "clear",    "cms_clear",      TYPE_UNKNOWN, 1 },
+    { TYPE_CMS,   TYPE_UNKNOWN, "save",     "cms_save",       TYPE_BOOL, 0 },
+    { TYPE_CMS,   TYPE_UNKNOWN, "load",     "cms_load",       TYPE_BOOL, 1 },
+    { TYPE_HASHER, TYPE_UNKNOWN, "update", "hasher_update", TYPE_UNKNOWN, 1 },
+    { TYPE_HASHER, TYPE_UNKNOWN, "digest", "hasher_digest", TYPE_INT, 0 },
+    { TYPE_HASHER, TYPE_UNKNOWN, "reset",  "hasher_reset",  TYPE_UNKNOWN, 1 },
+    { TYPE_RNG, TYPE_UNKNOWN, "next",    "rng_next",    TYPE_INT, 1 },
+    { TYPE_RNG, TYPE_UNKNOWN, "range",   "rng_range",   TYPE_INT, 1 },
+    { TYPE_RNG, TYPE_UNKNOWN, "uniform", "rng_uniform", TYPE_FLOAT, 1 },
+    { TYPE_RNG, TYPE_UNKNOWN, "fill",    "rng_fill",    TYPE_UNKNOWN, 3 },
+    { TYPE_RNG, TYPE_UNKNOWN, "shuffle", "rng_shuffle", TYPE_UNKNOWN, 3 },
+    { TYPE_RNG, TYPE_UNKNOWN, "jump",    "rng_jump",    TYPE_UNKNOWN, 1 },
+    { TYPE_RNG, TYPE_UNKNOWN, "fork",    "rng_fork",    TYPE_RNG, 1 },
+    { TYPE_TDIGEST, TYPE_UNKNOWN, "add",      "tdigest_add",      TYPE_UNKNOWN, 1 },
+    { TYPE_TDIGEST, TYPE_UNKNOWN, "quantile", "tdigest_quantile", TYPE_FLOAT, 1 },
+    { TYPE_TDIGEST, TYPE_UNKNOWN, "merge",    "tdigest_merge",    TYPE_UNKNOWN, 3 },
+    { TYPE_TDIGEST, TYPE_UNKNOWN, "mean",     "tdigest_mean",     TYPE_FLOAT, 0 },
+    { TYPE_TDIGEST, TYPE_UNKNOWN, "var",      "tdigest_var",      TYPE_FLOAT, 0 },
+    { TYPE_TDIGEST, TYPE_UNKNOWN, "len",      "tdigest_len",      TYPE_INT, 0 },
+    { TYPE_TDIGEST, TYPE_UNKNOWN, "clear",    "tdigest_clear",    TYPE_UNKNOWN, 1 },
+    { TYPE_REGEX, TYPE_UNKNOWN, "match",     "regex_match",     TYPE_BOOL, 0 },
+    { TYPE_REGEX, TYPE_UNKNOWN, "search",    "regex_search",    TYPE_BOOL, 0 },
+    { TYPE_REGEX, TYPE_UNKNOWN, "find",      "regex_find",      TYPE_INT, 0 },
+    { TYPE_REGEX, TYPE_UNKNOWN, "match_end", "regex_match_end", TYPE_INT, 0 },
+    { TYPE_REGEX, TYPE_UNKNOWN, "findall",   "regex_findall",   TYPE_LIST, 0 },
+};
+
+/* Runtime functions whose container arguments are passed by address */
+typedef struct {
+    const char* name;
+    const char* c_func;
+    VarType ret;
+    const char* flist_c_func;   /* variant used when the first argument is a list[float] */
+    int mutates;                /* bit i: the call changes its i-th argument */
+} BuiltinDef;
+
+static const BuiltinDef g_builtins[] = {
+    { "dset",       "dset",       TYPE_UNKNOWN, NULL, 1 },
+    { "dget",       "dget",       TYPE_INT, NULL, 0 },
+    { "list_len",   "list_len",   TYPE_INT,     "flist_len", 0 },
+    { "list_free",  "list_free",  TYPE_UNKNOWN, "flist_free", 1 },
+    { "dict_free",  "dict_free",  TYPE_UNKNOWN, NULL, 1 },
+    { "tuple_free", "tuple_free", TYPE_UNKNOWN, NULL, 1 },
+    { "iset_free",  "iset_free",  TYPE_UNKNOWN, NULL, 1 },
+    { "sset_free",  "sset_free",  TYPE_UNKNOWN, NULL, 1 },
+    { "deque_free", "deque_free", TYPE_UNKNOWN, NULL, 1 },
+    { "list_contains",        "list_contains",        TYPE_BOOL, NULL, 0 },
+    { "list_contains_sorted", "list_contains_sorted", TYPE_BOOL, NULL, 0 },
+    { "tuple_contains",       "tuple_contains",       TYPE_BOOL, NULL, 0 },
+    { "dict_has",             "dict_has",             TYPE_BOOL, NULL, 0 },
+    { "str_has_char",         "str_has_char",         TYPE_BOOL, NULL, 0 },
+    { "str_contains",         "str_contains",         TYPE_BOOL, NULL, 0 },
+    { "flist_contains",       "flist_contains",       TYPE_BOOL, NULL, 0 },
+    { "argsort",       "list_argsort",       TYPE_LIST, "flist_argsort", 0 },
+    { "unique",        "list_unique",        TYPE_LIST, "flist_unique", 0 },
+    { "binary_search", "list_binary_search", TYPE_INT,  "flist_binary_search", 0 },
+    { "topk",          "list_topk",          TYPE_LIST, "flist_topk", 0 },
+    { "iheap_free",    "iheap_free",         TYPE_UNKNOWN, NULL, 1 },
+    { "fheap_free",    "fheap_free",         TYPE_UNKNOWN, NULL, 1 },
+    { "ordmap_free",   "ordmap_free",        TYPE_UNKNOWN, NULL, 1 },
+    { "lru_free",      "lru_free",           TYPE_UNKNOWN, NULL, 1 },
+    { "bloom_free",    "bloom_free",         TYPE_UNKNOWN, NULL, 1 },
+    { "cms_free",      "cms_free",           TYPE_UNKNOWN, NULL, 1 },
+    { "hash64",        "hash64",             TYPE_INT, NULL, 0 },
+    { "crc32c",        "crc32c",             TYPE_INT, NULL, 0 },
+    { "fill_random",   "list_fill_random",   TYPE_UNKNOWN, "flist_fill_random", 1 },
+    { "shuffle",       "list_shuffle",       TYPE_UNKNOWN, "flist_shuffle", 1 },
+    { "mean",          "list_mean",          TYPE_FLOAT, "flist_mean", 0 },
+    { "var",           "list_var",           TYPE_FLOAT, "flist_var", 0 },
+    { "stddev",        "list_stddev",        TYPE_FLOAT, "flist_stddev", 0 },
+    { "quantile",      "list_quantile",      TYPE_FLOAT, "flist_quantile", 0 },
+    { "histogram",     "list_histogram",     TYPE_LIST,  "flist_histogram", 0 },
+    { "tdigest_free",  "tdigest_free",       TYPE_UNKNOWN, NULL, 1 },
+    { "utf8_valid",    "utf8_valid",         TYPE_BOOL, NULL, 0 },
+    { "utf8_len",      "utf8_len",           TYPE_INT, NULL, 0 },
+};
+
+static const MethodDef* find_method(VarType type, VarType elem, const char* method) {
+    for (size_t i = 0; i < sizeof(g_methods) / sizeof(g_methods[0]); i++) {
+        const MethodDef* m = &g_methods[i];
+        if (m->type == type && strcmp(m->method, method) == 0 &&
+            (m->elem == TYPE_UNKNOWN || m->elem == elem)) {
+            return m;
+        }
+    }
+    return NULL;
+}
+
+static const BuiltinDef* find_builtin(const char* name) {
+    for (size_t i = 0; i < sizeof(g_builtins) / sizeof(g_builtins[0]); i++) {
+        if (strcmp(g_builtins[i].name, name) == 0) {
+            return &g_builtins[i];
+        }
+    }
+    return NULL;
+}
+
+static const Generic* find_generic(const char* name);
+static const TypeName* generic_call_ret(const Generic* g, const char* call);
+
 static VarType infer_expr_type(const char* expr) {
     char* e = trim((char*)expr);
     
     if (e[0] == '"') return TYPE_STRING;
+    if (starts_with(e, "re\"")) {
+        // Regex literal, possibly with a method call: re"x+".search(s)
+        const char* q = e + 3;
+        while (*q && *q != '"') q += (q[0] == '\\' && q[1]) ? 2 : 1;
+        if (*q == '"' && q[1] == '.') {
+            char method[64];
+            int k = 0;
+            for (q += 2; (isalnum((unsigned char)*q) || *q == '_') && k < 63; q++) method[k++] = *q;
+            method[k] = '\0';
+            const MethodDef* m = find_method(TYPE_REGEX, TYPE_UNKNOWN, method);
+            if (m && m->ret != TYPE_UNKNOWN) return m->ret;
+        }
+        return TYPE_REGEX;
+    }
     if (strcmp(e, "true") == 0 || strcmp(e, "false") == 0) return TYPE_BOOL;
     if (e[0] == '(' && strchr(e, ',')) return TYPE_TUPLE;
     if (e[0] == '[') return TYPE_LIST;
@@ -501,6 +956,43 @@ static VarType infer_expr_type(const char* expr) {
     var_name[j] = '\0';
     
     VarType vt = get_var_type(var_name);
+    
+    // Method call on a container: S.contains(x)
+    if (e[j] == '.' && vt != TYPE_UNKNOWN) {
+        char method[256];
+        int k = 0;
+        for (int i = j + 1; e[i] && (isalnum(e[i]) || e[i] == '_'); i++) {
+            if (k < 255) method[k++] = e[i];
+        }
+        method[k] = '\0';
+        if (e[j + 1 + k] == '(') {
+            const MethodDef* m = find_method(vt, get_var_elem_type(var_name), method);
+            if (m && m->ret != TYPE_UNKNOWN) return m->ret;
+        } else if (is_container_type(vt)) {
+            // Counter field such as C.hits
+            return TYPE_INT;
+        }
+    }
+    
+    // Runtime builtin or user function call: dget(d, k), add(a, b)
+    if (e[j] == '(') {
+        const BuiltinDef* b = find_builtin(var_name);
+        if (b && b->ret != TYPE_UNKNOWN) return b->ret;
+        const Function* f = find_func(var_name);
+        if (f && f->ret != TYPE_UNKNOWN) return f->ret;
+    }
+    const Generic* gen = find_generic(var_name);
+    if (gen && (e[j] == '(' || e[j] == '[')) {
+        const TypeName* tn = generic_call_ret(gen, e + j);
+        if (tn) return tn->type;
+    }
+    
+    // Indexing yields an element, not the container
+    if (e[j] == '[') {
+        if (vt == TYPE_LIST && get_var_elem_type(var_name) == TYPE_FLOAT) return TYPE_FLOAT;
+        if (vt == TYPE_LIST || vt == TYPE_STRING || vt == TYPE_TUPLE) return TYPE_INT;
+    }
+    
     if (vt != TYPE_UNKNOWN) return vt;
     
     if (strchr(e, '[')) {
@@ -514,6 +1006,48 @@ static VarType infer_expr_type(const char* expr) {
     return TYPE_INT;
 }
 
+/* Element type of a container-valued expression: F, topk(F, 3), S.union(T) */
+static VarType infer_expr_elem_type(const char* expr) {
+    char e[MAX_LINE];
+    strncpy(e, expr, MAX_LINE - 1);
+    e[MAX_LINE - 1] = '\0';
+    char* p = trim(e);
+    
+    char name[256];
+    int j = 0;
+    while (p[j] && (isalnum((unsigned char)p[j]) || p[j] == '_') && j < 255) {
+        name[j] = p[j];
+        j++;
+    }
+    name[j] = '\0';
+    
+    if (get_var_type(name) != TYPE_UNKNOWN) {
+        return get_var_elem_type(name);
+    }
+    
+    const Function* f = p[j] == '(' ? find_func(name) : NULL;
+    if (f) return f->ret_elem;
+    const Generic* gen = find_generic(name);
+    if (gen && (p[j] == '(' || p[j] == '[')) {
+        const TypeName* tn = generic_call_ret(gen, p + j);
+        return tn ? tn->elem : TYPE_UNKNOWN;
+    }
+    
+    // Builtin over a list: the element type follows the first argument, but
+    // argsort and histogram return indices and counts whatever the list holds
+    if (p[j] == '(' && (strcmp(name, "argsort") == 0 || strcmp(name, "histogram") == 0)) return TYPE_INT;
+    if (p[j] == '(' && find_builtin(name)) {
+        char arg[256];
+        int k = 0;
+        const char* a = p + j + 1;
+        while (*a && isspace((unsigned char)*a)) a++;
+        while (*a && (isalnum((unsigned char)*a) || *a == '_') && k < 255) arg[k++] = *a++;
+        arg[k] = '\0';
+        return get_var_elem_type(arg);
+    }
+    return TYPE_UNKNOWN;
+}
+
 /* ============== Block Management ============== */
 
 static void push_block(int indent, const char* type, const char* condition, bool uses_braces) {
@@ -523,6 +1057,7 @@ static void push_block(int indent, const char* type, const char* condition, bool
         strncpy(g_blocks[g_block_depth].type, type, 31);
         g_blocks[g_block_depth].closed_by_end = false;
         g_blocks[g_block_depth].uses_braces = uses_braces;
+        g_blocks[g_block_depth].extra_braces = 0;
         g_block_depth++;
         log_block_open(type, condition, uses_braces);
     } else {
@@ -530,15 +1065,44 @@ static void push_block(int indent, const char* type, const char* condition, bool
     }
 }
 
+static void finish_match(bool case_open);
+static void finish_generator(Function* f);
+static void alias_container_params(Function* f);
+static void finish_parallel(void);
+static void emit_reduce(const char* target, VarType type, const char* value, bool declare);
+static int optimise_loop(int depth);
+static bool is_loop_hint(const char* t);
+
 static void close_block(bool by_end, bool by_brace) {
     if (g_block_depth > 0) {
         log_block_close(g_blocks[g_block_depth - 1].type, by_end, 
                         g_blocks[g_block_depth - 1].line_num, by_brace);
-        if (strcmp(g_blocks[g_block_depth - 1].type, "func") == 0) {
+        g_block_depth--;
+        const char* type = g_blocks[g_block_depth].type;
+        if (strcmp(type, "func") == 0) {
+            // generate_output adds the closing brace
+            if (g_func_count > 0) {
+                Function* f = &g_funcs[g_func_count - 1];
+                alias_container_params(f);
+                if (f->is_generator) finish_generator(f);
+                f->source_done = true;
+            }
             g_in_function = false;
+            memcpy(g_vars, g_saved_vars, sizeof(Variable) * g_saved_var_count);
+            g_var_count = g_saved_var_count;
+        } else if (strcmp(type, "match") == 0 || strcmp(type, "case") == 0) {
+            finish_match(strcmp(type, "case") == 0);
+        } else if (strcmp(type, "parallel") == 0) {
+            finish_parallel();
+        } else {
+            if (strcmp(type, "for") == 0 || strcmp(type, "for_in") == 0) {
+                g_blocks[g_block_depth].extra_braces += optimise_loop(g_block_depth);
+            }
+            emit_no_log("}\n");
+        }
+        for (int i = 0; i < g_blocks[g_block_depth].extra_braces; i++) {
+            emit_no_log("}\n");
         }
-        g_block_depth--;
-        emit_no_log("}\n");
     }
 }
 
@@ -598,964 +1162,10165 @@ static void replace_time_funcs(char* line) {
     strcpy(line, buffer);
 }
 
-/* ============== Statement Handlers ============== */
+/* ============== Regular Expressions ============== */
 
-static void handle_variable_decl(char* line, bool is_const) {
-    char type_str[32], name[256], value[MAX_LINE] = {0};
-    char* p = line;
-    
-    if (is_const) {
-        p = trim_left(p + 5);
+/* re"..." literals are compiled here, at compile time: pattern -> AST -> Thompson NFA ->
+   DFA over byte classes (subset construction) -> minimised DFA, emitted as static tables.
+   Four automata per pattern: anchored, unanchored (search), and the same two for the
+   reversed pattern, which find match starts. */
+
+#define RE_MAX_NODES 4096
+#define RE_MAX_NFA 4096
+#define RE_MAX_DFA 2048
+#define RE_MAX_PATTERNS 64
+
+typedef struct {
+    uint64_t bits[4];
+} ReSet;
+
+enum { RE_LIT, RE_CAT, RE_ALT, RE_STAR, RE_PLUS, RE_QUEST, RE_EMPTY };
+
+typedef struct {
+    int kind;
+    ReSet set;      /* RE_LIT */
+    int a, b;       /* children */
+} ReNode;
+
+enum { RE_NFA_CHAR, RE_NFA_SPLIT, RE_NFA_MATCH };
+
+typedef struct {
+    int kind;
+    ReSet set;
+    int out, out2;  /* out2 < 0: plain epsilon */
+} ReNfaState;
+
+typedef struct {
+    int count;
+    uint16_t* trans;        /* count * classes */
+    unsigned char* accept;
+    int start;
+    int accept_from;        /* after minimisation: states >= accept_from accept */
+} ReDfa;
+
+static ReNode g_re_nodes[RE_MAX_NODES];
+static int g_re_node_count;
+static ReNfaState g_re_nfa[RE_MAX_NFA];
+static int g_re_nfa_count;
+static const char* g_re_pos;
+static bool g_re_failed;
+
+static char g_re_patterns[RE_MAX_PATTERNS][MAX_LINE];
+static int g_re_count = 0;
+
+static void re_fail(const char* msg) {
+    if (!g_re_failed) {
+        char buf[512];
+        snprintf(buf, sizeof(buf), "Invalid regex: %s", msg);
+        error(buf);
     }
-    
-    VarType vt = TYPE_UNKNOWN;
-    
-    if (starts_with(p, "int ")) {
-        strcpy(type_str, "int");
-        vt = TYPE_INT;
-        p += 4;
-    } else if (starts_with(p, "float ")) {
-        strcpy(type_str, "float");
-        vt = TYPE_FLOAT;
-        p += 6;
-    } else if (starts_with(p, "bool ")) {
-        strcpy(type_str, "bool");
-        vt = TYPE_BOOL;
-        p += 5;
-    } else if (starts_with(p, "string ")) {
-        strcpy(type_str, "char*");
-        vt = TYPE_STRING;
-        p += 7;
-    } else if (starts_with(p, "list ")) {
-        strcpy(type_str, "List");
-        vt = TYPE_LIST;
-        p += 5;
-    } else if (starts_with(p, "dict ")) {
-        strcpy(type_str, "Dict");
-        vt = TYPE_DICT;
-        p += 5;
-    } else if (starts_with(p, "tuple ")) {
-        strcpy(type_str, "Tuple");
-        vt = TYPE_TUPLE;
-        p += 6;
-    } else {
-        error("Unknown type in variable declaration");
-        return;
+    g_re_failed = true;
+}
+
+static void re_set_add(ReSet* s, int c) { s->bits[c >> 6] |= 1ULL << (c & 63); }
+static bool re_set_has(const ReSet* s, int c) { return (s->bits[c >> 6] >> (c & 63)) & 1; }
+
+static void re_set_range(ReSet* s, int lo, int hi) {
+    for (int c = lo; c <= hi; c++) re_set_add(s, c);
+}
+
+static void re_set_invert(ReSet* s) {
+    for (int i = 0; i < 4; i++) s->bits[i] = ~s->bits[i];
+}
+
+static int re_node(int kind, int a, int b) {
+    if (g_re_node_count >= RE_MAX_NODES) {
+        re_fail("pattern too large");
+        return 0;
+    }
+    ReNode* n = &g_re_nodes[g_re_node_count];
+    memset(n, 0, sizeof(*n));
+    n->kind = kind;
+    n->a = a;
+    n->b = b;
+    return g_re_node_count++;
+}
+
+/* Class shorthands: \d \w \s and their negations; returns false if 'c' is not one */
+static bool re_shorthand(char c, ReSet* s) {
+    ReSet t = {{0, 0, 0, 0}};
+    switch (tolower((unsigned char)c)) {
+        case 'd': re_set_range(&t, '0', '9'); break;
+        case 'w': re_set_range(&t, 'a', 'z'); re_set_range(&t, 'A', 'Z');
+                  re_set_range(&t, '0', '9'); re_set_add(&t, '_'); break;
+        case 's': re_set_add(&t, ' '); re_set_range(&t, '\t', '\r'); break;
+        default: return false;
+    }
+    if (isupper((unsigned char)c)) re_set_invert(&t);
+    for (int i = 0; i < 4; i++) s->bits[i] |= t.bits[i];
+    return true;
+}
+
+/* Byte named by a single-character escape such as \n or \. */
+static int re_escape_byte(void) {
+    char c = *g_re_pos++;
+    switch (c) {
+        case 'n': return '\n';
+        case 't': return '\t';
+        case 'r': return '\r';
+        case 'f': return '\f';
+        case 'v': return '\v';
+        case '0': return 0;
+        case 'x': {
+            int v = 0;
+            for (int i = 0; i < 2; i++) {
+                char h = *g_re_pos;
+                if (!isxdigit((unsigned char)h)) {
+                    re_fail("\\x needs two hex digits");
+                    return 0;
+                }
+                v = v * 16 + (isdigit((unsigned char)h) ? h - '0' : tolower((unsigned char)h) - 'a' + 10);
+                g_re_pos++;
+            }
+            return v;
+        }
+        case '\0':
+            g_re_pos--;
+            re_fail("trailing backslash");
+            return 0;
+        default:
+            return (unsigned char)c;
     }
-    
-    p = trim_left(p);
-    
-    int i = 0;
-    while (*p && (isalnum(*p) || *p == '_')) {
-        name[i++] = *p++;
+}
+
+static int re_parse_alt(void);
+
+static int re_parse_class(void) {
+    ReSet s = {{0, 0, 0, 0}};
+    bool negate = false;
+    if (*g_re_pos == '^') {
+        negate = true;
+        g_re_pos++;
+    }
+    bool first = true;
+    while (*g_re_pos && (*g_re_pos != ']' || first)) {
+        first = false;
+        int lo;
+        if (*g_re_pos == '\\') {
+            g_re_pos++;
+            if (re_shorthand(*g_re_pos, &s)) {
+                g_re_pos++;
+                continue;
+            }
+            lo = re_escape_byte();
+        } else {
+            lo = (unsigned char)*g_re_pos++;
+        }
+        int hi = lo;
+        if (*g_re_pos == '-' && g_re_pos[1] && g_re_pos[1] != ']') {
+            g_re_pos++;
+            if (*g_re_pos == '\\') {
+                g_re_pos++;
+                hi = re_escape_byte();
+            } else {
+                hi = (unsigned char)*g_re_pos++;
+            }
+            if (hi < lo) re_fail("reversed range in character class");
+        }
+        re_set_range(&s, lo, hi);
     }
-    name[i] = '\0';
-    
-    if (strlen(name) == 0) {
-        error("Missing variable name in declaration");
-        return;
+    if (*g_re_pos != ']') {
+        re_fail("missing ']'");
+    } else {
+        g_re_pos++;
     }
-    
-    p = trim_left(p);
-    
-    register_var(name, vt, is_const);
-    
-    char emit_buf[MAX_LINE];
-    
-    if (*p == '=') {
-        p++;
-        p = trim_left(p);
-        if (strlen(p) == 0) {
-            error("Missing value after '=' in variable declaration");
-            strcpy(value, "0");
+    if (negate) re_set_invert(&s);
+    int n = re_node(RE_LIT, -1, -1);
+    g_re_nodes[n].set = s;
+    return n;
+}
+
+static int re_parse_atom(void) {
+    char c = *g_re_pos;
+    if (c == '(') {
+        g_re_pos++;
+        if (g_re_pos[0] == '?' && g_re_pos[1] == ':') g_re_pos += 2;
+        int n = re_parse_alt();
+        if (*g_re_pos != ')') {
+            re_fail("missing ')'");
         } else {
-            strncpy(value, p, MAX_LINE - 1);
-            replace_time_funcs(value);
+            g_re_pos++;
+        }
+        return n;
+    }
+    if (c == '[') {
+        g_re_pos++;
+        return re_parse_class();
+    }
+    if (c == '^' || c == '$') {
+        re_fail("'^' and '$' are only supported at the start and end of the pattern");
+        g_re_pos++;
+        return re_node(RE_EMPTY, -1, -1);
+    }
+    if (c == '*' || c == '+' || c == '?' || c == '{') {
+        re_fail("quantifier without anything to repeat");
+        g_re_pos++;
+        return re_node(RE_EMPTY, -1, -1);
+    }
+    int n = re_node(RE_LIT, -1, -1);
+    ReSet* s = &g_re_nodes[n].set;
+    g_re_pos++;
+    if (c == '.') {
+        re_set_range(s, 0, 255);
+        s->bits['\n' >> 6] &= ~(1ULL << ('\n' & 63));
+    } else if (c == '\\') {
+        if (re_shorthand(*g_re_pos, s)) {
+            g_re_pos++;
+        } else {
+            re_set_add(s, re_escape_byte());
         }
-        
-        snprintf(emit_buf, sizeof(emit_buf), "%s%s %s = %s;\n",
-                 is_const ? "const " : "", type_str, name, value);
     } else {
-        const char* def_val = "";
-        if (vt == TYPE_INT) def_val = "0";
-        else if (vt == TYPE_STRING) def_val = "NULL";
-        else if (vt == TYPE_LIST) def_val = "new_list()";
-        else if (vt == TYPE_DICT) def_val = "new_dict()";
-        else if (vt == TYPE_TUPLE) def_val = "new_tuple()";
-        
-        strcpy(value, def_val);
-        
-        if (strlen(def_val) > 0) {
-            snprintf(emit_buf, sizeof(emit_buf), "%s%s %s = %s;\n",
-                     is_const ? "const " : "", type_str, name, def_val);
+        re_set_add(s, (unsigned char)c);
+    }
+    return n;
+}
+
+/* Copies a subtree, so {m,n} can repeat it */
+static int re_clone(int n) {
+    if (n < 0) return n;
+    int c = re_node(g_re_nodes[n].kind, -1, -1);
+    g_re_nodes[c].set = g_re_nodes[n].set;
+    int a = re_clone(g_re_nodes[n].a);
+    int b = re_clone(g_re_nodes[n].b);
+    g_re_nodes[c].a = a;
+    g_re_nodes[c].b = b;
+    return c;
+}
+
+static int re_parse_repeat(void) {
+    int n = re_parse_atom();
+    for (;;) {
+        char c = *g_re_pos;
+        if (c == '*') { g_re_pos++; n = re_node(RE_STAR, n, -1); }
+        else if (c == '+') { g_re_pos++; n = re_node(RE_PLUS, n, -1); }
+        else if (c == '?') { g_re_pos++; n = re_node(RE_QUEST, n, -1); }
+        else if (c == '{' && isdigit((unsigned char)g_re_pos[1])) {
+            // x{m}, x{m,}, x{m,n}: expanded into copies of x
+            g_re_pos++;
+            int lo = (int)strtol(g_re_pos, (char**)&g_re_pos, 10), hi = lo;
+            if (*g_re_pos == ',') {
+                g_re_pos++;
+                hi = isdigit((unsigned char)*g_re_pos) ? (int)strtol(g_re_pos, (char**)&g_re_pos, 10) : -1;
+            }
+            if (*g_re_pos != '}') {
+                re_fail("malformed {m,n} repetition");
+                return n;
+            }
+            g_re_pos++;
+            if ((hi >= 0 && hi < lo) || lo > 255 || hi > 255) {
+                re_fail("bad repetition bounds (at most 255)");
+                return n;
+            }
+            int result = re_node(RE_EMPTY, -1, -1);
+            for (int i = 0; i < lo; i++) result = re_node(RE_CAT, result, re_clone(n));
+            if (hi < 0) {
+                result = re_node(RE_CAT, result, re_node(RE_STAR, re_clone(n), -1));
+            } else {
+                for (int i = lo; i < hi; i++) {
+                    result = re_node(RE_CAT, result, re_node(RE_QUEST, re_clone(n), -1));
+                }
+            }
+            n = result;
         } else {
-            snprintf(emit_buf, sizeof(emit_buf), "%s%s %s;\n",
-                     is_const ? "const " : "", type_str, name);
+            return n;
         }
     }
-    
-    log_var_decl(name, vt, is_const, value);
-    emit_no_log(emit_buf);
 }
 
-static void handle_print(char* line) {
-    char* start = strchr(line, '(');
-    if (!start) {
-        error("Missing '(' in print statement");
-        return;
-    }
-    start++;
-    
-    char* end = strrchr(line, ')');
-    if (!end) {
-        error("Missing ')' in print statement");
-        return;
+static int re_parse_cat(void) {
+    int n = re_node(RE_EMPTY, -1, -1);
+    while (*g_re_pos && *g_re_pos != '|' && *g_re_pos != ')' && !g_re_failed) {
+        n = re_node(RE_CAT, n, re_parse_repeat());
     }
-    
-    char expr[MAX_LINE];
-    int len = end - start;
-    strncpy(expr, start, len);
-    expr[len] = '\0';
-    trim(expr);
-    
-    if (strlen(expr) == 0) {
-        error("Empty print statement");
-        return;
+    return n;
+}
+
+static int re_parse_alt(void) {
+    int n = re_parse_cat();
+    while (*g_re_pos == '|' && !g_re_failed) {
+        g_re_pos++;
+        n = re_node(RE_ALT, n, re_parse_cat());
     }
-    
-    replace_time_funcs(expr);
-    
-    VarType type = infer_expr_type(expr);
-    log_print(expr, type);
-    
-    char emit_buf[MAX_LINE];
-    
-    switch (type) {
-        case TYPE_STRING:
-            snprintf(emit_buf, sizeof(emit_buf), "printf(\"%%s\\n\", %s);\n", expr);
-            break;
-        case TYPE_BOOL:
-            snprintf(emit_buf, sizeof(emit_buf), 
-                     "printf(\"%%s\\n\", (%s) ? \"true\" : \"false\");\n", expr);
-            break;
-        case TYPE_FLOAT:
-            snprintf(emit_buf, sizeof(emit_buf), "printf(\"%%f\\n\", %s);\n", expr);
-            break;
-        case TYPE_LIST:
-            snprintf(emit_buf, sizeof(emit_buf), "print_list(&%s);\n", expr);
-            break;
-        case TYPE_TUPLE:
-            snprintf(emit_buf, sizeof(emit_buf), "print_tuple(&%s);\n", expr);
-            break;
+    return n;
+}
+
+static int re_nfa_state(int kind, int out, int out2) {
+    if (g_re_nfa_count >= RE_MAX_NFA) {
+        re_fail("pattern too large");
+        return 0;
+    }
+    ReNfaState* s = &g_re_nfa[g_re_nfa_count];
+    memset(s, 0, sizeof(*s));
+    s->kind = kind;
+    s->out = out;
+    s->out2 = out2;
+    return g_re_nfa_count++;
+}
+
+/* Thompson construction in continuation style: returns the entry state of an automaton
+   for node 'n' that continues into 'next'; 'rev' builds it for the reversed language */
+static int re_build(int n, int next, bool rev) {
+    if (g_re_failed) return next;
+    ReNode* node = &g_re_nodes[n];
+    switch (node->kind) {
+        case RE_LIT: {
+            int s = re_nfa_state(RE_NFA_CHAR, next, -1);
+            g_re_nfa[s].set = node->set;
+            return s;
+        }
+        case RE_CAT:
+            if (rev) return re_build(node->b, re_build(node->a, next, rev), rev);
+            return re_build(node->a, re_build(node->b, next, rev), rev);
+        case RE_ALT: {
+            int a = re_build(node->a, next, rev);
+            int b = re_build(node->b, next, rev);
+            return re_nfa_state(RE_NFA_SPLIT, a, b);
+        }
+        case RE_STAR: {
+            int s = re_nfa_state(RE_NFA_SPLIT, -1, next);
+            g_re_nfa[s].out = re_build(node->a, s, rev);
+            return s;
+        }
+        case RE_PLUS: {
+            int s = re_nfa_state(RE_NFA_SPLIT, -1, next);
+            int body = re_build(node->a, s, rev);
+            g_re_nfa[s].out = body;
+            return body;
+        }
+        case RE_QUEST:
+            return re_nfa_state(RE_NFA_SPLIT, re_build(node->a, next, rev), next);
         default:
-            snprintf(emit_buf, sizeof(emit_buf), "printf(\"%%d\\n\", (int)(%s));\n", expr);
-            break;
+            return next;
     }
-    
-    emit_no_log(emit_buf);
 }
 
-static void handle_if(char* line, bool has_brace) {
-    char* p = trim_left(line);
-    p += 2;
-    p = trim_left(p);
-    
-    if (has_brace) {
-        strip_trailing_brace(p);
-    }
-    
-    char* colon = strrchr(p, ':');
-    if (colon) {
-        *colon = '\0';
+/* Adds the epsilon closure of NFA state 's' to the set (marked[] avoids repeats) */
+static void re_closure(int s, int* set, int* n, unsigned char* marked) {
+    if (s < 0 || marked[s]) return;
+    marked[s] = 1;
+    set[(*n)++] = s;
+    if (g_re_nfa[s].kind == RE_NFA_SPLIT) {
+        re_closure(g_re_nfa[s].out, set, n, marked);
+        re_closure(g_re_nfa[s].out2, set, n, marked);
     }
-    
-    p = trim(p);
-    
-    if (strlen(p) == 0) {
-        error("Missing condition in if statement");
-        p = "1";
+}
+
+static int re_int_cmp(const void* a, const void* b) {
+    return *(const int*)a - *(const int*)b;
+}
+
+/* Subset construction over byte classes. State 0 is the empty (dead) set and state 1 the
+   start; an unanchored automaton re-adds the start closure after every byte (.*R). */
+static ReDfa re_subset(int start, int match, const unsigned char* classes, int nclasses,
+                       const unsigned char* class_rep, bool unanchored) {
+    ReDfa d = {0, NULL, NULL, 1, 0};
+    int** sets = (int**)calloc(RE_MAX_DFA, sizeof(int*));
+    int* sizes = (int*)calloc(RE_MAX_DFA, sizeof(int));
+    d.trans = (uint16_t*)calloc((size_t)RE_MAX_DFA * nclasses, sizeof(uint16_t));
+    d.accept = (unsigned char*)calloc(RE_MAX_DFA, 1);
+    unsigned char* marked = (unsigned char*)calloc(g_re_nfa_count, 1);
+    int* work = (int*)malloc(sizeof(int) * g_re_nfa_count);
+    (void)classes;
+    
+    sets[0] = NULL;
+    sizes[0] = 0;
+    int n = 0;
+    re_closure(start, work, &n, marked);
+    sets[1] = (int*)malloc(sizeof(int) * (n ? n : 1));
+    memcpy(sets[1], work, sizeof(int) * n);
+    qsort(sets[1], n, sizeof(int), re_int_cmp);
+    sizes[1] = n;
+    d.count = 2;
+    
+    for (int st = 1; st < d.count && !g_re_failed; st++) {
+        for (int i = 0; i < sizes[st]; i++) {
+            if (sets[st][i] == match) d.accept[st] = 1;
+        }
+        for (int c = 0; c < nclasses; c++) {
+            memset(marked, 0, g_re_nfa_count);
+            n = 0;
+            for (int i = 0; i < sizes[st]; i++) {
+                ReNfaState* ns = &g_re_nfa[sets[st][i]];
+                if (ns->kind == RE_NFA_CHAR && re_set_has(&ns->set, class_rep[c])) {
+                    re_closure(ns->out, work, &n, marked);
+                }
+            }
+            if (unanchored) re_closure(start, work, &n, marked);
+            qsort(work, n, sizeof(int), re_int_cmp);
+            int found = -1;
+            for (int j = 0; j < d.count; j++) {
+                if (sizes[j] == n && (n == 0 || memcmp(sets[j], work, sizeof(int) * n) == 0)) {
+                    found = j;
+                    break;
+                }
+            }
+            if (found < 0) {
+                if (d.count >= RE_MAX_DFA) {
+                    re_fail("pattern needs too many DFA states");
+                    break;
+                }
+                found = d.count++;
+                sets[found] = (int*)malloc(sizeof(int) * (n ? n : 1));
+                memcpy(sets[found], work, sizeof(int) * n);
+                sizes[found] = n;
+            }
+            d.trans[st * nclasses + c] = (uint16_t)found;
+        }
     }
-    
-    char condition[MAX_LINE];
-    strncpy(condition, p, MAX_LINE - 1);
-    replace_time_funcs(p);
-    
-    char emit_buf[MAX_LINE];
-    snprintf(emit_buf, sizeof(emit_buf), "if (%s) {\n", p);
-    emit_no_log(emit_buf);
-    
-    push_block(get_indent(line), "if", condition, has_brace);
+    for (int i = 0; i < RE_MAX_DFA; i++) free(sets[i]);
+    free(sets);
+    free(sizes);
+    free(marked);
+    free(work);
+    return d;
 }
 
-static void handle_elif(char* line, bool has_brace) {
-    if (g_block_depth == 0 || 
-        (strcmp(g_blocks[g_block_depth - 1].type, "if") != 0 &&
-         strcmp(g_blocks[g_block_depth - 1].type, "elif") != 0)) {
-        error("'elif' without matching 'if'");
+/* Moore minimisation: refine blocks by (block, successor blocks) until stable.
+   Renumbers so the dead state is 0 and accepting states come last, which turns the
+   accept test in the scan loops into a single compare. */
+static void re_minimise(ReDfa* d, int nclasses) {
+    int n = d->count;
+    int* block = (int*)malloc(sizeof(int) * n);
+    int* next_block = (int*)malloc(sizeof(int) * n);
+    int* sig = (int*)malloc(sizeof(int) * (size_t)n * (nclasses + 1));
+    for (int s = 0; s < n; s++) block[s] = d->accept[s];
+    int nblocks = 0;
+    for (;;) {
+        for (int s = 0; s < n; s++) {
+            int* g = sig + (size_t)s * (nclasses + 1);
+            g[0] = block[s];
+            for (int c = 0; c < nclasses; c++) g[c + 1] = block[d->trans[s * nclasses + c]];
+        }
+        int count = 0;
+        for (int s = 0; s < n; s++) {
+            next_block[s] = -1;
+            for (int t = 0; t < s; t++) {
+                if (memcmp(sig + (size_t)s * (nclasses + 1), sig + (size_t)t * (nclasses + 1),
+                           sizeof(int) * (nclasses + 1)) == 0) {
+                    next_block[s] = next_block[t];
+                    break;
+                }
+            }
+            if (next_block[s] < 0) next_block[s] = count++;
+        }
+        memcpy(block, next_block, sizeof(int) * n);
+        if (count == nblocks) break;
+        nblocks = count;
+    }
+    /* Order blocks: dead first, then rejecting and accepting ones by first appearance */
+    int* order = (int*)malloc(sizeof(int) * nblocks);
+    for (int b = 0; b < nblocks; b++) order[b] = -1;
+    int next_id = 0;
+    order[block[0]] = next_id++;
+    for (int pass = 0; pass < 2; pass++) {
+        if (pass == 1) d->accept_from = next_id;
+        for (int s = 0; s < n; s++) {
+            if (d->accept[s] == pass && order[block[s]] < 0) order[block[s]] = next_id++;
+        }
     }
-    
-    char* p = trim_left(line);
-    p += 4;
-    p = trim_left(p);
-    
-    if (has_brace) {
-        strip_trailing_brace(p);
+    d->start = order[block[1]];
+    uint16_t* trans = (uint16_t*)calloc((size_t)nblocks * nclasses, sizeof(uint16_t));
+    unsigned char* accept = (unsigned char*)calloc(nblocks, 1);
+    for (int s = 0; s < n; s++) {
+        int id = order[block[s]];
+        accept[id] = d->accept[s];
+        for (int c = 0; c < nclasses; c++) {
+            trans[id * nclasses + c] = (uint16_t)order[block[d->trans[s * nclasses + c]]];
+        }
     }
-    
-    char* colon = strrchr(p, ':');
-    if (colon) {
-        *colon = '\0';
+    free(d->trans);
+    free(d->accept);
+    d->trans = trans;
+    d->accept = accept;
+    d->count = nblocks;
+    free(block);
+    free(next_block);
+    free(sig);
+    free(order);
+}
+
+/* Transitions are stored as row offsets (state * nclasses) so a step is one add and one load */
+static void re_emit_table(int id, const char* name, const ReDfa* d, int nclasses) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "static const uint32_t _re%d_%s[] = {", id, name);
+    append_decl(buf);
+    for (int i = 0; i < d->count * nclasses; i++) {
+        snprintf(buf, sizeof(buf), "%s%d%s", i % 16 == 0 ? "\n    " : "",
+                 d->trans[i] * nclasses, i + 1 < d->count * nclasses ? "," : "");
+        append_decl(buf);
+    }
+    append_decl("\n};\n");
+}
+
+/* Compiles a pattern (deduplicated) and returns the name of its static Regex, or NULL */
+static const char* compile_regex(const char* pattern) {
+    static char name[32];
+    for (int i = 0; i < g_re_count; i++) {
+        if (strcmp(g_re_patterns[i], pattern) == 0) {
+            snprintf(name, sizeof(name), "_re%d", i);
+            return name;
+        }
     }
-    
-    p = trim(p);
-    
-    if (strlen(p) == 0) {
-        error("Missing condition in elif statement");
-        p = "1";
+    if (g_re_count >= RE_MAX_PATTERNS) {
+        error("Too many distinct regex literals");
+        return NULL;
+    }
+    
+    // ^ and $ are only meaningful at the ends; strip them into flags
+    char body[MAX_LINE];
+    snprintf(body, sizeof(body), "%s", pattern);
+    bool anchor_start = false, anchor_end = false;
+    char* text = body;
+    if (*text == '^') {
+        anchor_start = true;
+        text++;
+    }
+    size_t len = strlen(text);
+    if (len > 0 && text[len - 1] == '$') {
+        size_t slashes = 0;
+        while (slashes + 1 < len && text[len - 2 - slashes] == '\\') slashes++;
+        if (slashes % 2 == 0) {
+            anchor_end = true;
+            text[len - 1] = '\0';
+        }
     }
     
-    char condition[MAX_LINE];
-    strncpy(condition, p, MAX_LINE - 1);
-    replace_time_funcs(p);
-    
-    if (g_log_mode == LOG_HUMAN) {
-        fprintf(stderr, "\033[33m[BLOCK CHAIN]\033[0m Line %d: Continuing if-chain with 'elif' condition: %s\n",
-                g_current_line, condition);
-    } else if (g_log_mode == LOG_MACHINE) {
-        fprintf(stderr, "BLOCK_CHAIN:%d:elif:%s\n", g_current_line, condition);
+    g_re_failed = false;
+    g_re_node_count = 0;
+    g_re_nfa_count = 0;
+    g_re_pos = text;
+    int root = re_parse_alt();
+    if (*g_re_pos == ')') re_fail("unbalanced ')'");
+    if (g_re_failed) return NULL;
+    
+    // Byte classes: bytes no character set tells apart share a column in every table
+    int fwd_match = re_nfa_state(RE_NFA_MATCH, -1, -1);
+    int fwd_start = re_build(root, fwd_match, false);
+    int rev_match = re_nfa_state(RE_NFA_MATCH, -1, -1);
+    int rev_start = re_build(root, rev_match, true);
+    if (g_re_failed) return NULL;
+    unsigned char classes[256] = {0};
+    int nclasses = 1;
+    for (int s = 0; s < g_re_nfa_count; s++) {
+        if (g_re_nfa[s].kind != RE_NFA_CHAR) continue;
+        int split[256][2];
+        for (int c = 0; c < 256; c++) split[c][0] = split[c][1] = -1;
+        int count = 0;
+        unsigned char refined[256];
+        for (int b = 0; b < 256; b++) {
+            int in = re_set_has(&g_re_nfa[s].set, b);
+            int* slot = &split[classes[b]][in];
+            if (*slot < 0) *slot = count++;
+            refined[b] = (unsigned char)*slot;
+        }
+        memcpy(classes, refined, sizeof(classes));
+        nclasses = count;
+    }
+    unsigned char class_rep[256];
+    for (int b = 255; b >= 0; b--) class_rep[classes[b]] = (unsigned char)b;
+    
+    ReDfa dfa[4];
+    dfa[0] = re_subset(fwd_start, fwd_match, classes, nclasses, class_rep, false);
+    dfa[1] = re_subset(fwd_start, fwd_match, classes, nclasses, class_rep, true);
+    dfa[2] = re_subset(rev_start, rev_match, classes, nclasses, class_rep, true);
+    dfa[3] = re_subset(rev_start, rev_match, classes, nclasses, class_rep, false);
+    if (g_re_failed) {
+        for (int i = 0; i < 4; i++) { free(dfa[i].trans); free(dfa[i].accept); }
+        return NULL;
+    }
+    for (int i = 0; i < 4; i++) re_minimise(&dfa[i], nclasses);
+    
+    // Literal prefix: bytes every match must start with, followed from the anchored start
+    unsigned char prefix[32];
+    int prefix_len = 0;
+    for (int st = dfa[0].start; prefix_len < 32 && !dfa[0].accept[st]; ) {
+        int only = -1, live = 0;
+        for (int c = 0; c < nclasses; c++) {
+            if (dfa[0].trans[st * nclasses + c]) {
+                live++;
+                only = c;
+            }
+        }
+        if (live != 1) break;
+        int bytes = 0, byte = 0;
+        for (int b = 0; b < 256; b++) {
+            if (classes[b] == only) {
+                bytes++;
+                byte = b;
+            }
+        }
+        if (bytes != 1) break;
+        prefix[prefix_len++] = (unsigned char)byte;
+        st = dfa[0].trans[st * nclasses + only];
+    }
+    
+    int id = g_re_count;
+    snprintf(g_re_patterns[g_re_count++], MAX_LINE, "%s", pattern);
+    
+    char buf[256];
+    append_decl("/* regex ");
+    for (const char* c = pattern; *c; c++) {
+        // Keep the pattern readable without closing the comment
+        char one[2] = { (*c == '/' && c > pattern && c[-1] == '*') ? '|' : *c, '\0' };
+        append_decl(one);
+    }
+    snprintf(buf, sizeof(buf), " */\nstatic const unsigned char _re%d_class[256] = {", id);
+    append_decl(buf);
+    for (int b = 0; b < 256; b++) {
+        snprintf(buf, sizeof(buf), "%s%d%s", b % 32 == 0 ? "\n    " : "", classes[b], b < 255 ? "," : "");
+        append_decl(buf);
+    }
+    append_decl("\n};\n");
+    static const char* table_names[4] = { "fwd", "search", "rsearch", "rev" };
+    for (int i = 0; i < 4; i++) re_emit_table(id, table_names[i], &dfa[i], nclasses);
+    snprintf(buf, sizeof(buf), "static const char _re%d_prefix[] = {", id);
+    append_decl(buf);
+    for (int i = 0; i < prefix_len; i++) {
+        snprintf(buf, sizeof(buf), "%d,", prefix[i]);
+        append_decl(buf);
+    }
+    append_decl("0};\n");
+    snprintf(buf, sizeof(buf), "static const Regex _re%d = { _re%d_class,\n", id, id);
+    append_decl(buf);
+    for (int i = 0; i < 4; i++) {
+        snprintf(buf, sizeof(buf), "    { _re%d_%s, %d, %d },\n", id, table_names[i],
+                 dfa[i].start * nclasses, dfa[i].accept_from * nclasses);
+        append_decl(buf);
+    }
+    snprintf(buf, sizeof(buf), "    _re%d_prefix, %d, %s, %s };\n\n", id, prefix_len,
+             anchor_start ? "true" : "false", anchor_end ? "true" : "false");
+    append_decl(buf);
+    
+    for (int i = 0; i < 4; i++) {
+        free(dfa[i].trans);
+        free(dfa[i].accept);
+    }
+    snprintf(name, sizeof(name), "_re%d", id);
+    return name;
+}
+
+/* ============== Generic Functions ============== */
+
+/*
+ * func maxof[T](list[T] xs) -> T:
+ * The body is kept as text. Each call binds T from the argument types (or
+ * explicitly: maxof[float](xs)) and is rewritten to an instance such as
+ * maxof__float; after the main pass every distinct instance is compiled once by
+ * replaying the template with T substituted.
+ */
+
+static Generic g_generics[MAX_GENERICS];
+static int g_generic_count = 0;
+static int g_capturing = -1;            /* generic whose body is being read */
+static GenericInstance g_instances[MAX_INSTANCES];
+static int g_instance_count = 0;
+
+static void process_line(char* original_line);
+static void out_put(char* out, size_t* o, size_t out_size, const char* str);
+
+static const Generic* find_generic(const char* name) {
+    for (int i = 0; i < g_generic_count; i++) {
+        if (strcmp(g_generics[i].name, name) == 0) return &g_generics[i];
     }
-    
-    char emit_buf[MAX_LINE];
-    snprintf(emit_buf, sizeof(emit_buf), "} else if (%s) {\n", p);
-    emit_no_log(emit_buf);
-    
-    if (g_block_depth > 0) {
-        strcpy(g_blocks[g_block_depth - 1].type, "elif");
-        g_blocks[g_block_depth - 1].uses_braces = has_brace;
+    return NULL;
+}
+
+/* Name of the A type for a value of type vt, e.g. list[float] */
+static const char* type_name_of(VarType vt, VarType elem) {
+    for (size_t i = 0; i < sizeof(g_type_names) / sizeof(g_type_names[0]); i++) {
+        const TypeName* tn = &g_type_names[i];
+        if (tn->type != vt) continue;
+        if (tn->elem == elem || (elem == TYPE_UNKNOWN && tn->elem == TYPE_INT) ||
+            (elem == TYPE_INT && tn->elem == TYPE_UNKNOWN)) {
+            return tn->name;
+        }
     }
+    return NULL;
 }
 
-static void handle_else(char* line, bool has_brace) {
-    (void)line;
-    
-    if (g_block_depth == 0 || 
-        (strcmp(g_blocks[g_block_depth - 1].type, "if") != 0 &&
-         strcmp(g_blocks[g_block_depth - 1].type, "elif") != 0)) {
-        error("'else' without matching 'if' or 'elif'");
+/* C type of a declared type, e.g. "FList" for list[float] */
+static const char* c_type_of(VarType vt, VarType elem) {
+    if (vt == TYPE_STRING) return "char*";
+    const char* fallback = NULL;
+    for (size_t i = 0; i < sizeof(g_type_names) / sizeof(g_type_names[0]); i++) {
+        if (g_type_names[i].type != vt) continue;
+        if (g_type_names[i].elem == elem) return g_type_names[i].c_type;
+        if (!fallback) fallback = g_type_names[i].c_type;
+    }
+    return fallback;
+}
+
+/* Replaces whole-word type parameters in 'in' with their bound types */
+static void substitute_type_params(const Generic* g, char bound[][32], const char* in,
+                                   char* out, size_t out_size) {
+    size_t o = 0;
+    out[0] = '\0';
+    while (*in) {
+        if (*in == '"') {
+            // String literals are copied untouched
+            const char* start = in++;
+            while (*in && *in != '"') in += (*in == '\\' && in[1]) ? 2 : 1;
+            if (*in) in++;
+            char lit[MAX_LINE];
+            snprintf(lit, sizeof(lit), "%.*s", (int)(in - start), start);
+            out_put(out, &o, out_size, lit);
+            continue;
+        }
+        if (isalpha((unsigned char)*in) || *in == '_') {
+            char word[256];
+            int k = 0;
+            while ((isalnum((unsigned char)*in) || *in == '_') && k < 255) word[k++] = *in++;
+            word[k] = '\0';
+            const char* rep = word;
+            for (int t = 0; t < g->type_param_count; t++) {
+                if (strcmp(word, g->type_params[t]) == 0) rep = bound[t];
+            }
+            out_put(out, &o, out_size, rep);
+            continue;
+        }
+        char ch[2] = { *in++, '\0' };
+        out_put(out, &o, out_size, ch);
     }
-    
-    if (g_log_mode == LOG_HUMAN) {
-        fprintf(stderr, "\033[33m[BLOCK CHAIN]\033[0m Line %d: Continuing if-chain with 'else'\n",
-                g_current_line);
-    } else if (g_log_mode == LOG_MACHINE) {
-        fprintf(stderr, "BLOCK_CHAIN:%d:else\n", g_current_line);
+}
+
+/* Splits the call arguments after '(' at p into args; returns the count */
+static int split_call_args(const char* p, char args[][MAX_LINE], int max_args) {
+    int depth = 0, n = 0;
+    size_t k = 0;
+    if (*p != '(') return 0;
+    p++;
+    bool in_str = false;
+    for (; *p; p++) {
+        if (*p == '"' && (k == 0 || p[-1] != '\\')) in_str = !in_str;
+        if (!in_str) {
+            if (*p == '(' || *p == '[' || *p == '{') depth++;
+            else if (*p == ')' || *p == ']' || *p == '}') {
+                if (depth-- == 0) break;
+            } else if (*p == ',' && depth == 0) {
+                if (n < max_args) {
+                    args[n][k] = '\0';
+                    n++;
+                }
+                k = 0;
+                continue;
+            }
+        }
+        if (n < max_args && k < MAX_LINE - 1) args[n][k++] = *p;
     }
-    
-    emit_no_log("} else {\n");
-    
-    if (g_block_depth > 0) {
-        strcpy(g_blocks[g_block_depth - 1].type, "else");
-        g_blocks[g_block_depth - 1].uses_braces = has_brace;
+    if (n < max_args) {
+        args[n][k] = '\0';
+        if (*trim(args[n]) || n > 0) n++;
     }
+    return n;
 }
 
-static void handle_while(char* line, bool has_brace) {
-    char* p = trim_left(line);
-    p += 5;
-    p = trim_left(p);
-    
-    if (has_brace) {
-        strip_trailing_brace(p);
+static bool bind_type_param(const Generic* g, char bound[][32], int fixed, const char* param,
+                            const char* type) {
+    for (int t = 0; t < g->type_param_count; t++) {
+        if (strcmp(param, g->type_params[t]) != 0) continue;
+        if (t < fixed) return true;     /* given explicitly */
+        if (bound[t][0] && strcmp(bound[t], type) != 0) {
+            char msg[512];
+            snprintf(msg, sizeof(msg), "Type parameter %s of '%s' bound to both %s and %s",
+                     param, g->name, bound[t], type);
+            error(msg);
+            return false;
+        }
+        snprintf(bound[t], 32, "%s", type);
+        return true;
     }
-    
-    char* colon = strrchr(p, ':');
-    if (colon) {
-        *colon = '\0';
+    return false;
+}
+
+/*
+ * Binds the type parameters of a call: explicit ones from 'explicit_args'
+ * ("float" in maxof[float](xs)), the rest from the argument types.
+ * Fills the instance name; returns false if some parameter stays unbound.
+ */
+static bool bind_generic_call(const Generic* g, const char* explicit_args, const char* call,
+                              char bound[][32], char* inst_name, size_t inst_size) {
+    for (int t = 0; t < MAX_TYPE_PARAMS; t++) bound[t][0] = '\0';
+    int fixed = 0;
+    if (explicit_args && *explicit_args) {
+        char list[256];
+        snprintf(list, sizeof(list), "%s", explicit_args);
+        for (char* a = strtok(list, ","); a && fixed < g->type_param_count; a = strtok(NULL, ",")) {
+            snprintf(bound[fixed++], 32, "%s", trim(a));
+        }
     }
     
-    p = trim(p);
-    
-    if (strlen(p) == 0) {
-        error("Missing condition in while statement");
-        p = "0";
+    // Heap copy: inferring an argument may bind a nested generic call
+    char (*args)[MAX_LINE] = malloc(sizeof(char[MAX_LINE]) * MAX_PARAMS);
+    int n = split_call_args(call, args, MAX_PARAMS);
+    for (int i = 0; i < n && i < g->arity; i++) {
+        const char* pt = g->param_types[i];
+        char* arg = trim(args[i]);
+        VarType vt = infer_expr_type(arg);
+        VarType elem = is_container_type(vt) ? infer_expr_elem_type(arg) : TYPE_UNKNOWN;
+        char inner[64];
+        const char* open = strchr(pt, '[');
+        if (open && sscanf(open + 1, "%63[^]]", inner) == 1) {
+            // list[T], set[T], heap[T]: T is the element type
+            const char* elem_name = elem == TYPE_FLOAT ? "float" : elem == TYPE_STRING ? "string" : "int";
+            bind_type_param(g, bound, fixed, trim(inner), elem_name);
+        } else {
+            const char* name = type_name_of(vt, elem);
+            if (name) bind_type_param(g, bound, fixed, pt, name);
+        }
     }
+    free(args);
     
-    char condition[MAX_LINE];
-    strncpy(condition, p, MAX_LINE - 1);
-    replace_time_funcs(p);
-    
-    char emit_buf[MAX_LINE];
-    snprintf(emit_buf, sizeof(emit_buf), "while (%s) {\n", p);
-    emit_no_log(emit_buf);
-    
-    push_block(get_indent(line), "while", condition, has_brace);
+    size_t o = 0;
+    inst_name[0] = '\0';
+    out_put(inst_name, &o, inst_size, g->name);
+    for (int t = 0; t < g->type_param_count; t++) {
+        if (bound[t][0] && !find_type_name(bound[t])) {
+            char msg[512];
+            snprintf(msg, sizeof(msg), "Unknown type '%s' for type parameter %s of '%s'",
+                     bound[t], g->type_params[t], g->name);
+            error(msg);
+            return false;
+        }
+        if (!bound[t][0]) {
+            char msg[512];
+            snprintf(msg, sizeof(msg), "Cannot infer type parameter %s of '%s' - give it as %s[type](...)",
+                     g->type_params[t], g->name, g->name);
+            error(msg);
+            return false;
+        }
+        out_put(inst_name, &o, inst_size, "__");
+        for (const char* c = bound[t]; *c; c++) {
+            char ch[2] = { isalnum((unsigned char)*c) ? *c : '_', '\0' };
+            if (*c == ']') continue;
+            out_put(inst_name, &o, inst_size, ch);
+        }
+    }
+    return true;
 }
 
-/* Handle for-in iteration: for var in iterable: */
-static void handle_for_in(char* line, bool has_brace) {
-    char* p = trim_left(line);
-    p += 3;  // skip "for"
-    p = trim_left(p);
-    
-    // Extract variable name
-    char var[64] = {0};
-    int i = 0;
-    while (*p && (isalnum(*p) || *p == '_')) {
-        if (i < 63) var[i++] = *p;
-        p++;
-    }
-    var[i] = '\0';
-    
-    if (strlen(var) == 0) {
-        error("Missing loop variable in for-in statement");
-        strcpy(var, "_item");
-    }
-    
-    // Skip " in "
-    p = trim_left(p);
-    if (strncmp(p, "in", 2) == 0) {
-        p += 2;
-        p = trim_left(p);
-    } else {
-        error("Missing 'in' keyword in for-in statement");
-    }
-    
-    // Get iterable (until : or { or end of string)
-    char iterable[256] = {0};
-    i = 0;
-    while (*p && *p != ':' && *p != '{' && !isspace(*p)) {
-        if (i < 255) iterable[i++] = *p;
-        p++;
-    }
-    iterable[i] = '\0';
-    trim(iterable);
-    
-    if (strlen(iterable) == 0) {
-        error("Missing iterable in for-in statement");
-        strcpy(iterable, "\"\"");
-    }
-    
-    // Determine iterable type
-    VarType iter_type = infer_expr_type(iterable);
-    
-    // For string literals, override type detection
-    if (iterable[0] == '"') {
-        iter_type = TYPE_STRING;
+/* Return type of a generic call ('call' is at its '[' or '('), resolved for its bound types */
+static const TypeName* generic_call_ret(const Generic* g, const char* call) {
+    char bound[MAX_TYPE_PARAMS][32];
+    char inst[256];
+    char explicit_args[256] = "";
+    if (*call == '[') {
+        const char* close = strchr(call, ']');
+        if (!close) return NULL;
+        snprintf(explicit_args, sizeof(explicit_args), "%.*s", (int)(close - call - 1), call + 1);
+        call = close + 1;
+    }
+    int saved = g_error_count;
+    bool ok = bind_generic_call(g, explicit_args, call, bound, inst, sizeof(inst));
+    g_error_count = saved;      /* reported when the call is rewritten */
+    if (!ok || !g->ret[0]) return NULL;
+    char ret[64];
+    substitute_type_params(g, bound, g->ret, ret, sizeof(ret));
+    return find_type_name(ret);
+}
+
+/* Records the instance a call needs (once per distinct set of types) */
+static void request_instance(const Generic* g, char bound[][32], const char* inst_name) {
+    for (int i = 0; i < g_instance_count; i++) {
+        if (strcmp(g_instances[i].name, inst_name) == 0) return;
     }
-    
-    log_for_in(var, iterable, iter_type);
-    
-    char emit_buf[MAX_LINE * 2];
-    char idx_var[80];
-    snprintf(idx_var, sizeof(idx_var), "_%s_idx", var);
-    
-    switch (iter_type) {
-        case TYPE_STRING:
-            // Iterate over characters in string
-            snprintf(emit_buf, sizeof(emit_buf),
-                "{ char* _%s_str = %s;\n"
-                "for (int %s = 0; _%s_str[%s]; %s++) {\n"
-                "    char %s = _%s_str[%s];\n",
-                var, iterable,
-                idx_var, var, idx_var, idx_var,
-                var, var, idx_var);
-            register_var(var, TYPE_INT, false);  // char as int
-            break;
-            
-        case TYPE_LIST:
-            // Iterate over list elements
-            snprintf(emit_buf, sizeof(emit_buf),
-                "for (int %s = 0; %s < %s.size; %s++) {\n"
-                "    int %s = %s.data[%s];\n",
-                idx_var, idx_var, iterable, idx_var,
-                var, iterable, idx_var);
-            register_var(var, TYPE_INT, false);
-            break;
-            
-        case TYPE_DICT:
-            // Iterate over dict keys
-            snprintf(emit_buf, sizeof(emit_buf),
-                "for (int %s = 0; %s < %s.size; %s++) {\n"
-                "    char* %s = %s.keys[%s];\n",
-                idx_var, idx_var, iterable, idx_var,
-                var, iterable, idx_var);
-            register_var(var, TYPE_STRING, false);
-            break;
-            
-        case TYPE_TUPLE:
-            // Iterate over tuple elements
-            snprintf(emit_buf, sizeof(emit_buf),
-                "for (int %s = 0; %s < %s.size; %s++) {\n"
-                "    int %s = %s.data[%s];\n",
-                idx_var, idx_var, iterable, idx_var,
-                var, iterable, idx_var);
-            register_var(var, TYPE_INT, false);
-            break;
-            
-        default:
-            // Assume string-like for unknown types
-            snprintf(emit_buf, sizeof(emit_buf),
-                "{ char* _%s_str = (char*)(%s);\n"
-                "for (int %s = 0; _%s_str && _%s_str[%s]; %s++) {\n"
-                "    char %s = _%s_str[%s];\n",
-                var, iterable,
-                idx_var, var, var, idx_var, idx_var,
-                var, var, idx_var);
-            register_var(var, TYPE_INT, false);
-            break;
+    if (g_instance_count >= MAX_INSTANCES) {
+        error("Too many generic function instances");
+        return;
     }
-    
-    emit_no_log(emit_buf);
-    
-    char condition[MAX_LINE];
-    snprintf(condition, sizeof(condition), "%s in %s", var, iterable);
-    push_block(get_indent(line), "for_in", condition, has_brace);
+    GenericInstance* in = &g_instances[g_instance_count++];
+    in->generic = (int)(g - g_generics);
+    for (int t = 0; t < MAX_TYPE_PARAMS; t++) snprintf(in->type_args[t], 32, "%s", bound[t]);
+    snprintf(in->name, sizeof(in->name), "%s", inst_name);
+    in->compiled = false;
 }
 
-static void handle_for(char* line, bool has_brace) {
-    char* p = trim_left(line);
-    p += 3;
-    p = trim_left(p);
-    
-    // Check if this is a for-in loop
-    char* in_keyword = strstr(p, " in ");
-    if (in_keyword) {
-        handle_for_in(line, has_brace);
+/* Parses 'func name[T, U](params) -> ret:' and starts capturing the body */
+static void begin_generic(const char* name, char* p, int indent, InlineMode inline_mode, const char* attrs) {
+    if (g_generic_count >= MAX_GENERICS) {
+        error("Maximum generic function limit reached");
         return;
     }
-    
-    if (has_brace) {
-        strip_trailing_brace(p);
-    }
-    
-    char* colon = strrchr(p, ':');
-    if (colon) {
-        *colon = '\0';
+    if (find_generic(name) || find_func(name)) {
+        char msg[512];
+        snprintf(msg, sizeof(msg), "Duplicate function definition: '%s'", name);
+        error(msg);
+        return;
     }
-    
-    p = trim(p);
-    
-    char var[64] = {0}, start_val[64] = {0}, end_val[64] = {0}, step[64] = "1";
-    
-    int i = 0;
-    while (*p && (isalnum(*p) || *p == '_')) {
-        if (i < 63) var[i++] = *p;
-        p++;
+    Generic* g = &g_generics[g_generic_count];
+    memset(g, 0, sizeof(*g));
+    snprintf(g->name, sizeof(g->name), "%s", name);
+    g->indent = indent;
+    g->line_num = g_current_line;
+    g->inline_mode = inline_mode;
+    snprintf(g->attrs, sizeof(g->attrs), "%s", attrs);
+    
+    char* close = strchr(p, ']');
+    if (!close) {
+        error("Missing ']' after type parameters");
+        return;
     }
-    var[i] = '\0';
-    
-    if (strlen(var) == 0) {
-        error("Missing loop variable in for statement");
-        strcpy(var, "_i");
+    *close = '\0';
+    for (char* t = strtok(p + 1, ","); t; t = strtok(NULL, ",")) {
+        if (g->type_param_count >= MAX_TYPE_PARAMS) {
+            error("Too many type parameters");
+            return;
+        }
+        snprintf(g->type_params[g->type_param_count++], 32, "%s", trim(t));
     }
-    
-    p = trim_left(p);
-    if (*p == '=') {
-        p++;
-    } else {
-        error("Missing '=' in for loop");
+    p = trim_left(close + 1);
+    if (*p != '(') {
+        error("Expected '(' after type parameters");
+        return;
     }
-    p = trim_left(p);
-    
-    i = 0;
-    while (*p && !isspace(*p) && strncmp(p, "to", 2) != 0) {
-        if (i < 63) start_val[i++] = *p;
-        p++;
+    char* pclose = strchr(p, ')');
+    if (!pclose) {
+        error("Missing ')' in function parameters");
+        return;
     }
-    start_val[i] = '\0';
-    
-    if (strlen(start_val) == 0) {
-        error("Missing start value in for loop");
-        strcpy(start_val, "0");
+    *pclose = '\0';
+    for (char* param = strtok(p + 1, ","); param; param = strtok(NULL, ",")) {
+        param = trim(param);
+        char* space = strrchr(param, ' ');
+        if (!space || g->arity >= MAX_PARAMS) {
+            error("Function parameter needs a type and a name, e.g. 'T x'");
+            return;
+        }
+        *space = '\0';
+        snprintf(g->param_types[g->arity], 64, "%s", trim(param));
+        snprintf(g->param_names[g->arity], 64, "%s", trim(space + 1));
+        g->arity++;
     }
-    
-    p = trim_left(p);
-    
-    if (!starts_with(p, "to")) {
-        error("Missing 'to' keyword in for loop");
-    } else {
-        p += 2;
+    char* rest = trim(pclose + 1);
+    if (starts_with(rest, "->")) {
+        snprintf(g->ret, sizeof(g->ret), "%s", trim(rest + 2));
+    } else if (*rest) {
+        error("Expected '->' and a return type after function parameters");
     }
     
-    if (*p == '(') {
-        p++;
-        i = 0;
-        while (*p && *p != ')') {
-            if (i < 63) step[i++] = *p;
-            p++;
+    log_func_decl(name);
+    g_capturing = g_generic_count++;
+}
+
+/* While a generic body is open, stores its lines; returns true if the line was taken */
+static bool capture_generic_line(const char* line) {
+    if (g_capturing < 0) return false;
+    Generic* g = &g_generics[g_capturing];
+    
+    char copy[MAX_LINE];
+    snprintf(copy, sizeof(copy), "%s", line);
+    char* comment = strchr(copy, '#');
+    if (comment) *comment = '\0';
+    char* t = trim(copy);
+    if (*t && get_indent(line) <= g->indent) {
+        g_capturing = -1;
+        // 'end' or '}' closing the template belongs to it
+        return strcmp(t, "end") == 0 || strcmp(t, "}") == 0;
+    }
+    
+    size_t len = strlen(line);
+    if (g->body_len + len + 2 > g->body_cap) {
+        g->body_cap = (g->body_len + len + 2) * 2;
+        g->body = (char*)realloc(g->body, g->body_cap);
+    }
+    memcpy(g->body + g->body_len, line, len);
+    g->body_len += len;
+    g->body[g->body_len++] = '\n';
+    g->body[g->body_len] = '\0';
+    return true;
+}
+
+/* Compiles every requested instance; instances may request further ones */
+static void instantiate_generics(void) {
+    for (int i = 0; i < g_instance_count; i++) {
+        GenericInstance* in = &g_instances[i];
+        if (in->compiled) continue;
+        in->compiled = true;
+        const Generic* g = &g_generics[in->generic];
+        
+        char line[MAX_LINE];
+        char part[MAX_LINE];
+        size_t o = 0;
+        line[0] = '\0';
+        for (int k = 0; k < g->indent; k++) out_put(line, &o, sizeof(line), " ");
+        out_put(line, &o, sizeof(line), "func ");
+        out_put(line, &o, sizeof(line), in->name);
+        out_put(line, &o, sizeof(line), "(");
+        for (int k = 0; k < g->arity; k++) {
+            substitute_type_params(g, in->type_args, g->param_types[k], part, sizeof(part));
+            if (k) out_put(line, &o, sizeof(line), ", ");
+            out_put(line, &o, sizeof(line), part);
+            out_put(line, &o, sizeof(line), " ");
+            out_put(line, &o, sizeof(line), g->param_names[k]);
         }
-        step[i] = '\0';
-        if (*p == ')') {
-            p++;
-        } else {
-            error("Missing ')' in for loop step");
+        out_put(line, &o, sizeof(line), ")");
+        if (g->ret[0]) {
+            substitute_type_params(g, in->type_args, g->ret, part, sizeof(part));
+            out_put(line, &o, sizeof(line), " -> ");
+            out_put(line, &o, sizeof(line), part);
         }
+        out_put(line, &o, sizeof(line), ":");
         
-        if (strlen(step) == 0) {
-            error("Empty step value in for loop");
-            strcpy(step, "1");
+        int saved_line = g_current_line;
+        int depth = g_block_depth;
+        g_current_line = g->line_num - 1;
+        g_pending_inline = g->inline_mode;
+        snprintf(g_pending_attrs, sizeof(g_pending_attrs), "%s", g->attrs);
+        process_line(line);
+        const char* body = g->body ? g->body : "";
+        while (*body) {
+            const char* nl = strchr(body, '\n');
+            size_t len = nl ? (size_t)(nl - body) : strlen(body);
+            char raw[MAX_LINE];
+            snprintf(raw, sizeof(raw), "%.*s", (int)len, body);
+            substitute_type_params(g, in->type_args, raw, line, sizeof(line));
+            process_line(line);
+            body += len + (nl ? 1 : 0);
         }
+        while (g_block_depth > depth) close_block(false, false);
+        g_current_line = saved_line;
     }
-    
-    p = trim_left(p);
-    strncpy(end_val, trim(p), 63);
-    end_val[63] = '\0';
-    
-    if (strlen(end_val) == 0) {
-        error("Missing end value in for loop");
-        strcpy(end_val, "0");
-    }
-    
-    replace_time_funcs(start_val);
-    replace_time_funcs(end_val);
-    replace_time_funcs(step);
-    
-    char condition[MAX_LINE];
-    snprintf(condition, sizeof(condition), "%s = %s to %s step %s", var, start_val, end_val, step);
-    
-    char emit_buf[MAX_LINE];
-    if (strcmp(step, "1") == 0) {
-        snprintf(emit_buf, sizeof(emit_buf), 
-                 "for (int %s = %s; %s <= %s; %s++) {\n",
-                 var, start_val, var, end_val, var);
-    } else {
-        snprintf(emit_buf, sizeof(emit_buf), 
-                 "for (int %s = %s; %s <= %s; %s += %s) {\n",
-                 var, start_val, var, end_val, var, step);
-    }
-    emit_no_log(emit_buf);
-    
-    register_var(var, TYPE_INT, false);
-    push_block(get_indent(line), "for", condition, has_brace);
 }
 
-static void handle_func(char* line, bool has_brace) {
-    char* p = trim_left(line);
-    p += 4;
-    p = trim_left(p);
-    
-    if (has_brace) {
-        strip_trailing_brace(p);
-    }
-    
-    char* colon = strchr(p, ':');
-    if (colon) {
-        *colon = '\0';
+/* ============== Expression Rewriting ============== */
+
+static void out_put(char* out, size_t* o, size_t out_size, const char* str) {
+    size_t len = strlen(str);
+    if (*o + len < out_size) {
+        memcpy(out + *o, str, len);
+        *o += len;
     }
-    
-    char name[256];
-    int i = 0;
-    while (*p && (isalnum(*p) || *p == '_')) {
-        if (i < 255) name[i++] = *p;
+    out[*o] = '\0';
+}
+
+static char last_non_space(const char* out, size_t o) {
+    while (o > 0 && isspace((unsigned char)out[o - 1])) o--;
+    return o > 0 ? out[o - 1] : '\0';
+}
+
+static bool is_ident_char(char c) {
+    return isalnum((unsigned char)c) || c == '_';
+}
+
+static const char* skip_spaces(const char* p) {
+    while (*p && isspace((unsigned char)*p)) p++;
+    return p;
+}
+
+/* Integer literal or single identifier: nothing to gain from a local */
+static bool is_plain_operand(const char* e) {
+    e = skip_spaces(e);
+    if (!*e) return true;
+    while (is_ident_char(*e)) e++;
+    return *skip_spaces(e) == '\0';
+}
+
+static const char* skip_c_literal(const char* p) {
+    char q = *p++;
+    while (*p && *p != q) {
+        if (*p == '\\' && p[1]) p++;
         p++;
     }
-    name[i] = '\0';
-    
-    if (strlen(name) == 0) {
-        error("Missing function name");
-        return;
-    }
-    
-    if (strcmp(name, "main") == 0) {
-        warning("'func main' is ignored - compiler generates its own main()");
-        g_in_function = false;
-        return;
-    }
-    
-    for (int j = 0; j < g_func_count; j++) {
-        if (strcmp(g_funcs[j].name, name) == 0) {
-            char msg[512];
-            snprintf(msg, sizeof(msg), "Duplicate function definition: '%s'", name);
-            error(msg);
+    return *p ? p + 1 : p;
+}
+
+/*
+ * Copy of C text with every use of the identifier 'name' replaced by 'repl',
+ * skipping literals and member names (after '.' or '->'); the caller frees it
+ */
+static char* replace_ident(const char* text, const char* name, const char* repl) {
+    size_t n = strlen(name), r = strlen(repl), uses = 0;
+    for (const char* p = strstr(text, name); p; p = strstr(p + n, name)) uses++;
+    size_t size = strlen(text) + uses * (r > n ? r - n : 0) + 1;
+    char* out = (char*)malloc(size);
+    size_t o = 0;
+    const char* p = text;
+    while (*p) {
+        if (*p == '"' || *p == '\'') {
+            const char* end = skip_c_literal(p);
+            memcpy(out + o, p, end - p);
+            o += end - p;
+            p = end;
+            continue;
+        }
+        if (!is_ident_char(*p)) {
+            out[o++] = *p++;
+            continue;
+        }
+        const char* word = p;
+        while (is_ident_char(*p)) p++;
+        bool member = word > text && (word[-1] == '.' || (word[-1] == '>' && word - text >= 2 && word[-2] == '-'));
+        if (!member && (size_t)(p - word) == n && strncmp(word, name, n) == 0) {
+            memcpy(out + o, repl, r);
+            o += r;
+        } else {
+            memcpy(out + o, word, p - word);
+            o += p - word;
         }
     }
-    
-    log_func_decl(name);
-    
-    if (g_func_count < MAX_FUNCS) {
-        strcpy(g_funcs[g_func_count].name, name);
-        g_funcs[g_func_count].body[0] = '\0';
-        g_funcs[g_func_count].body_len = 0;
-        g_func_count++;
-    } else {
-        error("Maximum function limit reached");
-    }
-    
-    g_in_function = true;
-    g_func_indent = get_indent(line);
-    
-    push_block(g_func_indent, "func", name, has_brace);
+    out[o] = '\0';
+    return out;
 }
 
-static void handle_append(char* line) {
-    char* p = strchr(line, '(');
-    if (!p) {
-        error("Missing '(' in append statement");
-        return;
-    }
-    p++;
-    
-    char* end = strrchr(line, ')');
-    if (!end) {
-        error("Missing ')' in append statement");
-        return;
-    }
-    
-    char args[MAX_LINE];
-    int len = end - p;
-    strncpy(args, p, len);
-    args[len] = '\0';
-    
-    char* comma = strchr(args, ',');
-    if (!comma) {
-        error("Missing ',' in append - expected: append(list, value)");
-        return;
-    }
-    
-    *comma = '\0';
-    char* list_name = trim(args);
-    char* value = trim(comma + 1);
-    
-    if (strlen(list_name) == 0) {
-        error("Missing list name in append");
-        return;
-    }
-    
-    if (strlen(value) == 0) {
-        error("Missing value in append");
-        return;
-    }
-    
-    VarType lt = get_var_type(list_name);
-    if (lt != TYPE_LIST && lt != TYPE_UNKNOWN) {
-        char msg[512];
-        snprintf(msg, sizeof(msg), "'%s' is not a list", list_name);
-        error(msg);
+/*
+ * 'if likely cond' / 'if unlikely cond': returns 1 or 0 and skips the word,
+ * or -1 when there is no hint ('likely' can also be a variable: 'if likely && x')
+ */
+static int branch_hint(const char** cond) {
+    const char* p = *cond;
+    int hint;
+    if (starts_with(p, "likely ")) {
+        hint = 1;
+        p += 7;
+    } else if (starts_with(p, "unlikely ")) {
+        hint = 0;
+        p += 9;
+    } else {
+        return -1;
     }
-    
-    replace_time_funcs(value);
-    
-    log_statement("append", list_name);
-    
-    char emit_buf[MAX_LINE];
-    snprintf(emit_buf, sizeof(emit_buf), "list_append(&%s, %s);\n", list_name, value);
-    emit_no_log(emit_buf);
+    p = skip_spaces(p);
+    if (!*p || strchr("=!<>+-*/%&|^)?", *p) || starts_with(p, "in ")) return -1;
+    *cond = p;
+    return hint;
 }
 
-static void handle_end(void) {
-    if (g_block_depth > 0) {
-        if (g_blocks[g_block_depth - 1].uses_braces) {
-            warning("Using 'end' to close block opened with '{' - use '}' instead");
+/* Number of top-level arguments in the call whose '(' is at p */
+static int count_call_args(const char* p) {
+    int depth = 0, args = 0;
+    bool any = false;
+    for (; *p; p++) {
+        if (*p == '"' || *p == '\'') {
+            char quote = *p++;
+            while (*p && *p != quote) p += (*p == '\\' && p[1]) ? 2 : 1;
+            if (!*p) break;
+            any = true;
+            continue;
         }
-        close_block(true, false);
-        
-        // Close extra scope for for_in string iteration
-        if (g_block_depth >= 0 && strcmp(g_blocks[g_block_depth].type, "for_in") == 0) {
-            emit_no_log("}\n");
+        if (*p == '(' || *p == '[' || *p == '{') {
+            if (depth++ == 0) continue;
+        } else if (*p == ')' || *p == ']' || *p == '}') {
+            if (--depth == 0) break;
+        } else if (*p == ',' && depth == 1) {
+            args++;
+            continue;
         }
-    } else {
-        error("'end' without matching block");
+        if (!isspace((unsigned char)*p)) any = true;
     }
+    return any ? args + 1 : 0;
 }
 
-static void handle_raw_statement(char* line) {
-    char* p = trim(line);
-    if (!*p) return;
-    
-    replace_time_funcs(p);
-    
-    char first_word[256];
-    int i = 0;
-    const char* pp = p;
-    while (*pp && (isalnum(*pp) || *pp == '_')) {
-        if (i < 255) first_word[i++] = *pp;
-        pp++;
-    }
-    first_word[i] = '\0';
-    
-    bool is_func_call = false;
-    for (int j = 0; j < g_func_count; j++) {
-        if (strcmp(g_funcs[j].name, first_word) == 0) {
-            is_func_call = true;
-            break;
-        }
-    }
-    
-    if (is_func_call) {
-        log_func_call(first_word);
-    } else {
-        log_statement("raw", p);
-    }
-    
-    char buffer[MAX_LINE];
-    char* out = buffer;
-    char* in = p;
+/*
+ * Lowers A expression syntax to C:
+ *   L[i]          -> L.data[i]             (lists; checked mode: L.data[list_check(i, L.size, line)])
+ *   S.add(x)      -> iset_add(&S, x)       (container methods)
+ *   dget(d, k)    -> dget(&d, k)           (containers passed to runtime builtins)
+ *   re"a+b"       -> _re0                  (DFA tables built by compile_regex)
+ * String and character literals are copied untouched.
+ */
+static void rewrite_expr(const char* in, char* out, size_t out_size) {
+    bool addr_args[64];     /* per paren depth: pass container arguments by address */
+    const Function* call_func[64];  /* per paren depth: the user function called, if any */
+    int call_arg[64];       /* its argument being rewritten */
+    bool arg_temp[64];      /* that argument is a container value wrapped in a compound literal */
+    int arg_brackets[64];   /* brackets open at the call, so commas inside [..] are not separators */
+    int depth = 0;
+    bool pending_call = false;
+    const Function* pending_func = NULL;
+    int brackets = 0;
+    char check_close[16][320];  /* ", L.size, line)" closing each open index check */
+    int check_depth[16];
+    int checks = 0;
+    size_t o = 0;
+    out[0] = '\0';
     
     while (*in) {
-        if (isalpha(*in) || *in == '_') {
-            char var[256];
-            i = 0;
-            while (*in && (isalnum(*in) || *in == '_')) {
-                if (i < 255) var[i++] = *in;
-                in++;
+        if (in[0] == 'r' && in[1] == 'e' && in[2] == '"' && (o == 0 || !is_ident_char(out[o - 1]))) {
+            // Regex literal: only \" is an escape here, the rest belongs to the pattern
+            char pattern[MAX_LINE];
+            size_t k = 0;
+            in += 3;
+            while (*in && *in != '"' && k < sizeof(pattern) - 2) {
+                if (in[0] == '\\' && in[1] == '"') in++;
+                else if (in[0] == '\\' && in[1]) pattern[k++] = *in++;
+                pattern[k++] = *in++;
+            }
+            pattern[k] = '\0';
+            if (*in != '"') {
+                error("Unterminated regex literal");
+                return;
             }
-            var[i] = '\0';
+            in++;
+            const char* name = compile_regex(pattern);
+            if (!name) name = "_re_invalid";
             
-            if (*in == '[' && get_var_type(var) == TYPE_LIST) {
-                strcpy(out, var);
-                out += strlen(var);
-                strcpy(out, ".data");
-                out += 5;
+            // Method call straight on the literal: re"x+".search(s)
+            const char* m = in;
+            char method[64];
+            size_t mk = 0;
+            if (*m == '.') {
+                for (m++; is_ident_char(*m) && mk < sizeof(method) - 1; m++) method[mk++] = *m;
+            }
+            method[mk] = '\0';
+            const MethodDef* md = (mk > 0 && *m == '(') ? find_method(TYPE_REGEX, TYPE_UNKNOWN, method) : NULL;
+            if (md) {
+                out_put(out, &o, out_size, md->c_func);
+                out_put(out, &o, out_size, "(&");
+                out_put(out, &o, out_size, name);
+                in = m + 1;
+                if (*skip_spaces(in) != ')') {
+                    out_put(out, &o, out_size, ", ");
+                }
+                if (depth < 64) {
+                    addr_args[depth] = true;
+                    call_func[depth] = NULL;
+                }
+                depth++;
             } else {
-                strcpy(out, var);
-                out += strlen(var);
+                out_put(out, &o, out_size, name);
+            }
+            continue;
+        }
+        
+        if (*in == '"' || *in == '\'') {
+            char quote = *in;
+            char lit[2] = {0};
+            lit[0] = *in++;
+            out_put(out, &o, out_size, lit);
+            while (*in && *in != quote) {
+                if (*in == '\\' && *(in + 1)) {
+                    lit[0] = *in++;
+                    out_put(out, &o, out_size, lit);
+                }
+                lit[0] = *in++;
+                out_put(out, &o, out_size, lit);
+            }
+            if (*in) {
+                lit[0] = *in++;
+                out_put(out, &o, out_size, lit);
+            }
+            continue;
+        }
+        
+        if (isdigit((unsigned char)*in)) {
+            // Numeric literal, including suffixes such as 0x1F or 1e5
+            char ch[2] = {0};
+            while (*in && (isalnum((unsigned char)*in) || *in == '.')) {
+                ch[0] = *in++;
+                out_put(out, &o, out_size, ch);
+            }
+            continue;
+        }
+        
+        if (isalpha((unsigned char)*in) || *in == '_') {
+            char ident[256];
+            int i = 0;
+            while (*in && (isalnum((unsigned char)*in) || *in == '_')) {
+                if (i < 255) ident[i++] = *in;
+                in++;
+            }
+            ident[i] = '\0';
+            
+            char prev = last_non_space(out, o);
+            if (prev == '.' || (o > 1 && out[o - 1] == '>' && out[o - 2] == '-')) {
+                // Struct member, not a variable
+                out_put(out, &o, out_size, ident);
+                continue;
+            }
+            
+            if (strcmp(ident, "reduce") == 0 && *in == '(' && !find_func(ident)) {
+                // Lowered to a block of statements, so it needs a variable to land in
+                error("reduce(...) may only be used as the value of a declaration or assignment");
+                return;
+            }
+            
+            VarType vt = get_var_type(ident);
+            
+            if (*in == '.' && vt != TYPE_UNKNOWN) {
+                char method[256];
+                int k = 0;
+                const char* m = in + 1;
+                while (*m && (isalnum((unsigned char)*m) || *m == '_')) {
+                    if (k < 255) method[k++] = *m;
+                    m++;
+                }
+                method[k] = '\0';
+                
+                const MethodDef* md = (*m == '(') ? find_method(vt, get_var_elem_type(ident), method) : NULL;
+                if (md) {
+                    out_put(out, &o, out_size, md->c_func);
+                    out_put(out, &o, out_size, "(&");
+                    out_put(out, &o, out_size, ident);
+                    in = m + 1;
+                    if (*skip_spaces(in) != ')') {
+                        out_put(out, &o, out_size, ", ");
+                    }
+                    if (depth < 64) {
+                        addr_args[depth] = true;
+                        call_func[depth] = NULL;
+                    }
+                    depth++;
+                    continue;
+                }
+            }
+            
+            if (*in == '[' && vt == TYPE_LIST) {
+                out_put(out, &o, out_size, ident);
+                out_put(out, &o, out_size, ".data");
+                if (g_mode == MODE_CHECKED && checks < 16) {
+                    // Loops drop the checks they can prove (see remove_index_checks)
+                    out_put(out, &o, out_size, "[list_check(");
+                    snprintf(check_close[checks], sizeof(check_close[0]), ", %s.size, %d)", ident,
+                             g_current_line);
+                    check_depth[checks++] = brackets++;
+                    in++;
+                }
+                continue;
+            }
+            
+            const Generic* gen = find_generic(ident);
+            if (gen && (*in == '(' || *in == '[')) {
+                // Generic call: maxof(xs) or maxof[float](xs) -> maxof__float(&xs)
+                char explicit_args[256] = "";
+                if (*in == '[') {
+                    const char* close = strchr(in, ']');
+                    if (!close) {
+                        error("Missing ']' after type arguments");
+                        return;
+                    }
+                    snprintf(explicit_args, sizeof(explicit_args), "%.*s", (int)(close - in - 1), in + 1);
+                    in = close + 1;
+                }
+                char bound[MAX_TYPE_PARAMS][32];
+                char inst[256];
+                if (bind_generic_call(gen, explicit_args, in, bound, inst, sizeof(inst))) {
+                    request_instance(gen, bound, inst);
+                }
+                int args = count_call_args(in);
+                if (args != gen->arity) {
+                    char msg[512];
+                    snprintf(msg, sizeof(msg), "Function '%s' takes %d argument%s, %d given",
+                             ident, gen->arity, gen->arity == 1 ? "" : "s", args);
+                    error(msg);
+                }
+                out_put(out, &o, out_size, inst);
+                pending_call = true;
+                continue;
+            }
+            
+            if (*skip_spaces(in) == '(') {
+                const BuiltinDef* b = find_builtin(ident);
+                if (b) {
+                    const char* c_func = b->c_func;
+                    if (b->flist_c_func) {
+                        char arg[256];
+                        int k = 0;
+                        const char* a = skip_spaces(skip_spaces(in) + 1);
+                        while (is_ident_char(*a) && k < 255) arg[k++] = *a++;
+                        arg[k] = '\0';
+                        if (get_var_type(arg) == TYPE_LIST && get_var_elem_type(arg) == TYPE_FLOAT) {
+                            c_func = b->flist_c_func;
+                        }
+                    }
+                    out_put(out, &o, out_size, c_func);
+                    pending_call = true;
+                    continue;
+                }
+                const Function* f = find_func(ident);
+                if (f) {
+                    int args = count_call_args(skip_spaces(in));
+                    if (args != f->arity) {
+                        char msg[512];
+                        snprintf(msg, sizeof(msg), "Function '%s' takes %d argument%s, %d given",
+                                 ident, f->arity, f->arity == 1 ? "" : "s", args);
+                        error(msg);
+                    }
+                    out_put(out, &o, out_size, ident);
+                    pending_call = true;
+                    pending_func = f;
+                    continue;
+                }
+            }
+            
+            char next = *skip_spaces(in);
+            if (is_container_type(vt) && depth > 0 && depth <= 64 && addr_args[depth - 1] &&
+                (prev == '(' || prev == ',') && (next == ',' || next == ')')) {
+                out_put(out, &o, out_size, "&");
+            }
+            out_put(out, &o, out_size, ident);
+            continue;
+        }
+        
+        if (*in == '(') {
+            if (depth < 64) {
+                addr_args[depth] = pending_call;
+                call_func[depth] = pending_call ? pending_func : NULL;
+                call_arg[depth] = 0;
+                arg_temp[depth] = false;
+                arg_brackets[depth] = brackets;
+            }
+            depth++;
+            pending_call = false;
+            pending_func = NULL;
+        } else if (*in == ')') {
+            if (depth > 0) depth--;
+            if (depth < 64 && call_func[depth] && arg_temp[depth]) out_put(out, &o, out_size, "}");
+        } else if (!isspace((unsigned char)*in)) {
+            pending_call = false;
+            pending_func = NULL;
+        }
+        if (*in == ',' && depth > 0 && depth <= 64 && call_func[depth - 1] && brackets == arg_brackets[depth - 1]) {
+            if (arg_temp[depth - 1]) out_put(out, &o, out_size, "}");
+            arg_temp[depth - 1] = false;
+            call_arg[depth - 1]++;
+        }
+        if (*in == '[') {
+            brackets++;
+        } else if (*in == ']' && brackets > 0 && --brackets == (checks ? check_depth[checks - 1] : -1)) {
+            out_put(out, &o, out_size, check_close[--checks]);
+        }
+        
+        char ch[2] = { *in++, '\0' };
+        out_put(out, &o, out_size, ch);
+        
+        // A container argument that is a value, not a variable - total(make(10)) -
+        // goes to the function in a one-element compound literal array: (List[]){make(10)}
+        if ((ch[0] == '(' || ch[0] == ',') && depth > 0 && depth <= 64 && call_func[depth - 1] &&
+            brackets == arg_brackets[depth - 1]) {
+            const Function* f = call_func[depth - 1];
+            int ai = call_arg[depth - 1];
+            const char* a = skip_spaces(in);
+            const char* e = a;
+            int nest = 0;
+            while (*e && !(nest == 0 && (*e == ',' || *e == ')'))) {
+                if (*e == '"' || *e == '\'') {
+                    e = skip_c_literal(e);
+                    continue;
+                }
+                if (*e == '(' || *e == '[') nest++;
+                else if (*e == ')' || *e == ']') nest--;
+                e++;
+            }
+            while (e > a && isspace((unsigned char)e[-1])) e--;
+            bool plain = true;
+            for (const char* q = a; q < e; q++) {
+                if (!is_ident_char(*q)) plain = false;
+            }
+            if (ai < f->arity && !plain && is_container_type(f->param_types[ai])) {
+                const char* type = c_type_of(f->param_types[ai], f->param_elems[ai]);
+                if (type) {
+                    out_put(out, &o, out_size, "(");
+                    out_put(out, &o, out_size, type);
+                    out_put(out, &o, out_size, "[]){");
+                    arg_temp[depth - 1] = true;
+                }
             }
-        } else {
-            *out++ = *in++;
         }
     }
-    *out = '\0';
-    
-    strcat(buffer, ";\n");
-    emit_no_log(buffer);
 }
 
-/* ============== Main Processing ============== */
-
-static void process_line(char* original_line) {
-    char line[MAX_LINE];
-    strncpy(line, original_line, MAX_LINE - 1);
-    line[MAX_LINE - 1] = '\0';
-    
-    g_current_line++;
-    
-    char* comment = strchr(line, '#');
-    if (comment) *comment = '\0';
-    
-    if (is_empty_or_comment(line)) return;
-    
-    int indent = get_indent(line);
-    char* trimmed = trim_left(line);
-    
-    log_parse_line(trim(trimmed), indent);
-    
-    // Handle closing brace
-    if (is_closing_brace(trimmed)) {
-        close_brace_block();
-        return;
-    }
-    
-    if (strcmp(trim(trimmed), "end") == 0) {
-        handle_end();
-        return;
-    }
-    
-    // Check if line ends with opening brace
-    bool has_brace = ends_with_brace(trimmed);
-    
-    if (!is_raw_mode() && g_block_depth > 0) {
-        if (!starts_with(trimmed, "elif") && !starts_with(trimmed, "else")) {
-            auto_close_blocks_to_indent(indent);
+/* Start of the operand that ends just before 'end': x, L[i], f(a, b), "abc", (a + b) */
+static size_t operand_start(const char* s, size_t end) {
+    size_t p = end;
+    while (p > 0) {
+        char c = s[p - 1];
+        if (c == ')' || c == ']') {
+            char open = (c == ')') ? '(' : '[';
+            int nest = 0;
+            while (p > 0) {
+                p--;
+                if (s[p] == c) nest++;
+                else if (s[p] == open && --nest == 0) break;
+            }
+        } else if (c == '"' || c == '\'') {
+            p--;
+            while (p > 0 && !(s[p - 1] == c && (p < 2 || s[p - 2] != '\\'))) p--;
+            if (p > 0) p--;
+        } else if (is_ident_char(c) || c == '.') {
+            p--;
+        } else {
+            break;
         }
     }
-    
-    char* t = trimmed;
-    
-    if (starts_with(t, "const ")) {
-        handle_variable_decl(t, true);
-    }
-    else if (starts_with(t, "int ") || starts_with(t, "float ") || 
-             starts_with(t, "bool ") || starts_with(t, "string ") ||
-             starts_with(t, "list ") || starts_with(t, "dict ") ||
-             starts_with(t, "tuple ")) {
-        handle_variable_decl(t, false);
-    }
-    else if (starts_with(t, "print(")) {
-        handle_print(t);
-    }
-    else if (starts_with(t, "if ")) {
-        handle_if(original_line, has_brace);
-    }
-    else if (starts_with(t, "elif ")) {
-        handle_elif(t, has_brace);
-    }
-    else if (starts_with(t, "else:") || starts_with(t, "else {") || 
-             starts_with(t, "else:") || strcmp(trim(t), "else") == 0) {
-        handle_else(t, has_brace);
-    }
-    else if (starts_with(t, "while ")) {
-        handle_while(original_line, has_brace);
-    }
-    else if (starts_with(t, "for ")) {
-        handle_for(original_line, has_brace);
-    }
-    else if (starts_with(t, "func ")) {
-        handle_func(original_line, has_brace);
-    }
-    else if (starts_with(t, "append(")) {
-        handle_append(t);
-    }
-    else if (starts_with(t, "dset(") || starts_with(t, "dget(")) {
-        log_statement("dict_op", t);
-        emit_no_log(t);
-        emit_no_log(";\n");
-    }
-    else {
-        handle_raw_statement(t);
-    }
+    return p;
 }
 
-/* ============== Standard Library ============== */
+/*
+ * Lowers 'x in C' and 'x not in C' inside a condition to a search specialised
+ * on the type of C: SIMD scan for lists and tuples (binary search for lists
+ * declared 'sorted'), hash probe for sets and dicts, strchr/strstr for strings.
+ */
+static void lower_membership(char* cond, size_t cond_size) {
+    char quote = 0;
+    for (size_t i = 0; cond[i]; i++) {
+        char c = cond[i];
+        if (quote) {
+            if (c == '\\' && cond[i + 1]) i++;
+            else if (c == quote) quote = 0;
+            continue;
+        }
+        if (c == '"' || c == '\'') {
+            quote = c;
+            continue;
+        }
+        if (!(c == 'i' && cond[i + 1] == 'n' && i > 0 &&
+              isspace((unsigned char)cond[i - 1]) && isspace((unsigned char)cond[i + 2]))) {
+            continue;
+        }
+        
+        size_t lhs_end = i;
+        while (lhs_end > 0 && isspace((unsigned char)cond[lhs_end - 1])) lhs_end--;
+        bool negate = false;
+        if (lhs_end >= 3 && strncmp(cond + lhs_end - 3, "not", 3) == 0 &&
+            (lhs_end == 3 || !is_ident_char(cond[lhs_end - 4]))) {
+            negate = true;
+            lhs_end -= 3;
+            while (lhs_end > 0 && isspace((unsigned char)cond[lhs_end - 1])) lhs_end--;
+        }
+        size_t lhs_start = operand_start(cond, lhs_end);
+        
+        const char* r = skip_spaces(cond + i + 2);
+        size_t rhs_start = r - cond;
+        size_t rhs_end = rhs_start;
+        if (cond[rhs_end] == '"') {
+            rhs_end++;
+            while (cond[rhs_end] && !(cond[rhs_end] == '"' && cond[rhs_end - 1] != '\\')) rhs_end++;
+            if (cond[rhs_end]) rhs_end++;
+        } else {
+            while (is_ident_char(cond[rhs_end])) rhs_end++;
+        }
+        
+        if (lhs_start == lhs_end || rhs_start == rhs_end) {
+            error("'in' needs an operand on both sides");
+            return;
+        }
+        
+        char lhs[MAX_LINE], rhs[256];
+        snprintf(lhs, sizeof(lhs), "%.*s", (int)(lhs_end - lhs_start), cond + lhs_start);
+        snprintf(rhs, sizeof(rhs), "%.*s", (int)(rhs_end - rhs_start), cond + rhs_start);
+        
+        VarType rt = (rhs[0] == '"') ? TYPE_STRING : get_var_type(rhs);
+        char call[MAX_LINE + 320];
+        switch (rt) {
+            case TYPE_LIST:
+                snprintf(call, sizeof(call), "%s(%s, %s)",
+                         get_var_elem_type(rhs) == TYPE_FLOAT ? "flist_contains" :
+                         is_var_sorted(rhs) ? "list_contains_sorted" : "list_contains", rhs, lhs);
+                break;
+            case TYPE_TUPLE:
+                snprintf(call, sizeof(call), "tuple_contains(%s, %s)", rhs, lhs);
+                break;
+            case TYPE_SET:
+                snprintf(call, sizeof(call), "%s.contains(%s)", rhs, lhs);
+                break;
+            case TYPE_ORDMAP:
+                snprintf(call, sizeof(call), "%s.has(%s)", rhs, lhs);
+                break;
+            case TYPE_LRU:
+                snprintf(call, sizeof(call), "%s.has(%s)", rhs, lhs);
+                break;
+            case TYPE_BLOOM:
+                snprintf(call, sizeof(call), "%s.contains(%s)", rhs, lhs);
+                break;
+            case TYPE_DICT:
+                snprintf(call, sizeof(call), "dict_has(%s, %s)", rhs, lhs);
+                break;
+            case TYPE_STRING:
+                snprintf(call, sizeof(call), "%s(%s, %s)",
+                         infer_expr_type(lhs) == TYPE_STRING ? "str_contains" : "str_has_char", rhs, lhs);
+                break;
+            default: {
+                char msg[512];
+                snprintf(msg, sizeof(msg), "'%s' is not a list, tuple, set, dict, ordmap or string - cannot use 'in'", rhs);
+                error(msg);
+                return;
+            }
+        }
+        
+        char lowered[MAX_LINE * 2];
+        int n = snprintf(lowered, sizeof(lowered), "%.*s%s%s%s",
+                         (int)lhs_start, cond, negate ? "!" : "", call, cond + rhs_end);
+        if (n < 0 || (size_t)n >= cond_size) {
+            error("Condition too long after lowering 'in'");
+            return;
+        }
+        strcpy(cond, lowered);
+        i = lhs_start + strlen(call) + (negate ? 1 : 0) - 1;
+    }
+}
 
-static const char* STDLIB = 
-"#include <stdio.h>\n"
-"#include <stdlib.h>\n"
-"#include <string.h>\n"
-"#include <stdbool.h>\n"
-"#include <stdarg.h>\n"
-"#include <math.h>\n"
-"#include <time.h>\n"
-"#include <setjmp.h>\n"
+/* ============== Compile-Time Evaluation ============== */
+
+/*
+ * const declarations are evaluated here when their value depends only on
+ * literals, earlier constants and functions that do plain int/float/bool/list
+ * arithmetic: const list T = squares(256) becomes a static array in the output.
+ * The interpreter walks the function text captured during the main pass and
+ * follows C semantics (32-bit int wraparound, float rounding, truncating
+ * division). Anything it does not model - print, strings, other containers,
+ * non-const globals, a blown step budget - makes the evaluation fail, and the
+ * declaration is compiled as a runtime expression as before.
+ */
+
+#define CT_STEP_BUDGET 2000000
+#define CT_MAX_DEPTH 256
+#define CT_MAX_LIST 65536
+#define CT_MAX_LOCALS 64
+#define CT_MAX_CONSTS 256
+
+typedef enum { CT_INT, CT_BOOL, CT_FLOAT, CT_DOUBLE, CT_LIST } CtKind;
+
+typedef struct {
+    CtKind kind;
+    int i;              /* CT_INT, CT_BOOL; the list handle for CT_LIST */
+    double f;           /* CT_FLOAT (always float-representable), CT_DOUBLE */
+} CtValue;
+
+typedef struct {
+    bool is_float;
+    double* items;
+    int size, cap;
+} CtList;
+
+typedef struct {
+    char name[64];
+    CtKind kind;        /* declared type: assignments convert to it */
+    bool float_elems;   /* list[float] */
+    CtValue v;
+} CtVar;
+
+typedef struct {
+    CtVar vars[CT_MAX_LOCALS];
+    int count;
+} CtFrame;
+
+typedef enum { CT_NEXT, CT_RETURN, CT_BREAK, CT_CONTINUE, CT_FAIL } CtFlow;
+
+static CtList* g_ct_lists = NULL;
+static int g_ct_list_count = 0, g_ct_list_cap = 0;
+static CtVar g_ct_consts[CT_MAX_CONSTS];
+static int g_ct_const_count = 0;
+static long g_ct_steps = 0;
+static int g_ct_depth = 0;
+static int g_ct_dry = 0;            /* > 0: parse only (the skipped side of && and ||) */
+static int g_ct_data_count = 0;
+
+static bool ct_expr(const char** pp, CtFrame* fr, int min_prec, CtValue* out);
+
+static bool ct_step(void) {
+    return ++g_ct_steps <= CT_STEP_BUDGET;
+}
+
+static int ct_new_list(bool is_float) {
+    if (g_ct_list_count == g_ct_list_cap) {
+        g_ct_list_cap = g_ct_list_cap ? g_ct_list_cap * 2 : 64;
+        g_ct_lists = (CtList*)realloc(g_ct_lists, sizeof(CtList) * g_ct_list_cap);
+    }
+    CtList* l = &g_ct_lists[g_ct_list_count];
+    l->is_float = is_float;
+    l->items = NULL;
+    l->size = l->cap = 0;
+    return g_ct_list_count++;
+}
+
+static bool ct_list_push(int h, double v) {
+    CtList* l = &g_ct_lists[h];
+    if (l->size >= CT_MAX_LIST) return false;
+    if (l->size == l->cap) {
+        l->cap = l->cap ? l->cap * 2 : 8;
+        l->items = (double*)realloc(l->items, sizeof(double) * l->cap);
+    }
+    l->items[l->size++] = v;
+    return true;
+}
+
+static CtValue ct_int(long long v) {
+    CtValue r = { CT_INT, (int)(int32_t)(uint32_t)v, 0 };
+    return r;
+}
+
+static bool ct_is_int(CtValue v) {
+    return v.kind == CT_INT || v.kind == CT_BOOL;
+}
+
+static double ct_num(CtValue v) {
+    return ct_is_int(v) ? (double)v.i : v.f;
+}
+
+/* Declared kind of an A type, false for types the interpreter does not model */
+static bool ct_kind_of(VarType vt, VarType elem, CtKind* kind, bool* float_elems) {
+    *float_elems = false;
+    switch (vt) {
+        case TYPE_INT: *kind = CT_INT; return true;
+        case TYPE_BOOL: *kind = CT_BOOL; return true;
+        case TYPE_FLOAT: *kind = CT_FLOAT; return true;
+        case TYPE_LIST:
+            *kind = CT_LIST;
+            *float_elems = elem == TYPE_FLOAT;
+            return true;
+        default: return false;
+    }
+}
+
+/* Implicit conversion on assignment, as C does it */
+static bool ct_convert(CtValue* v, CtKind to, bool float_elems) {
+    if (to == CT_LIST || v->kind == CT_LIST) {
+        return to == v->kind && g_ct_lists[v->i].is_float == float_elems;
+    }
+    switch (to) {
+        case CT_INT:
+            if (!ct_is_int(*v)) {
+                if (!(v->f > -2147483649.0 && v->f < 2147483648.0)) return false;
+                v->i = (int)v->f;
+            }
+            break;
+        case CT_BOOL:
+            v->i = ct_is_int(*v) ? v->i != 0 : v->f != 0;
+            break;
+        case CT_FLOAT:
+            v->f = (float)ct_num(*v);
+            break;
+        default:
+            v->f = ct_num(*v);
+            break;
+    }
+    v->kind = to;
+    return true;
+}
+
+static bool ct_truth(CtValue v, bool* out) {
+    if (v.kind == CT_LIST) return false;
+    *out = ct_is_int(v) ? v.i != 0 : v.f != 0;
+    return true;
+}
+
+static CtVar* ct_local(CtFrame* fr, const char* name) {
+    for (int i = fr->count - 1; i >= 0; i--) {
+        if (strcmp(fr->vars[i].name, name) == 0) return &fr->vars[i];
+    }
+    return NULL;
+}
+
+static const CtVar* ct_const(const char* name) {
+    for (int i = 0; i < g_ct_const_count; i++) {
+        if (strcmp(g_ct_consts[i].name, name) == 0) return &g_ct_consts[i];
+    }
+    return NULL;
+}
+
+static bool ct_declare(CtFrame* fr, const char* name, CtKind kind, bool float_elems, CtValue v) {
+    if (!ct_convert(&v, kind, float_elems)) return false;
+    CtVar* var = ct_local(fr, name);
+    if (!var) {
+        if (fr->count >= CT_MAX_LOCALS) return false;
+        var = &fr->vars[fr->count++];
+        snprintf(var->name, sizeof(var->name), "%s", name);
+    }
+    var->kind = kind;
+    var->float_elems = float_elems;
+    var->v = v;
+    return true;
+}
+
+static bool ct_binary(const char* op, CtValue a, CtValue b, CtValue* r) {
+    if (g_ct_dry) {
+        *r = ct_int(0);
+        return true;
+    }
+    if (a.kind == CT_LIST || b.kind == CT_LIST) return false;
+    bool cmp = strcmp(op, "<") == 0 || strcmp(op, "<=") == 0 || strcmp(op, ">") == 0 ||
+               strcmp(op, ">=") == 0 || strcmp(op, "==") == 0 || strcmp(op, "!=") == 0;
+    if (ct_is_int(a) && ct_is_int(b)) {
+        long long x = a.i, y = b.i, z;
+        switch (op[0]) {
+            case '+': z = x + y; break;
+            case '-': z = x - y; break;
+            case '*': z = x * y; break;
+            case '/':
+            case '%':
+                if (y == 0 || (x == INT_MIN && y == -1)) return false;
+                z = op[0] == '/' ? x / y : x % y;
+                break;
+            case '&': z = x & y; break;
+            case '|': z = x | y; break;
+            case '^': z = x ^ y; break;
+            default:
+                if (strcmp(op, "<<") == 0 || strcmp(op, ">>") == 0) {
+                    if (y < 0 || y > 31) return false;
+                    z = op[0] == '<' ? (long long)((uint32_t)x << y) : x >> y;
+                    break;
+                }
+                z = strcmp(op, "<") == 0 ? x < y : strcmp(op, "<=") == 0 ? x <= y :
+                    strcmp(op, ">") == 0 ? x > y : strcmp(op, ">=") == 0 ? x >= y :
+                    strcmp(op, "==") == 0 ? x == y : x != y;
+                break;
+        }
+        *r = ct_int(z);
+        if (cmp) r->kind = CT_BOOL;
+        return true;
+    }
+    // Floating point: float unless either side is double, like C
+    bool is_double = a.kind == CT_DOUBLE || b.kind == CT_DOUBLE;
+    double x = ct_num(a), y = ct_num(b), z;
+    if (!is_double) {
+        x = (float)x;
+        y = (float)y;
+    }
+    if (cmp) {
+        z = strcmp(op, "<") == 0 ? x < y : strcmp(op, "<=") == 0 ? x <= y :
+            strcmp(op, ">") == 0 ? x > y : strcmp(op, ">=") == 0 ? x >= y :
+            strcmp(op, "==") == 0 ? x == y : x != y;
+        *r = ct_int((int)z);
+        r->kind = CT_BOOL;
+        return true;
+    }
+    switch (op[0]) {
+        case '+': z = x + y; break;
+        case '-': z = x - y; break;
+        case '*': z = x * y; break;
+        case '/': z = x / y; break;
+        default: return false;      // bitwise operators and % need ints
+    }
+    r->kind = is_double ? CT_DOUBLE : CT_FLOAT;
+    r->i = 0;
+    r->f = is_double ? z : (float)z;
+    return true;
+}
+
+static bool ct_invoke(Function* f, CtValue* args, int argc, CtValue* out);
+
+/* list_len and abs; libm calls are left to the runtime */
+static bool ct_builtin(const char* name, CtValue* args, int argc, CtValue* out) {
+    if (strcmp(name, "abs") == 0 && argc == 1 && ct_is_int(args[0]) && args[0].i != INT_MIN) {
+        *out = ct_int(abs(args[0].i));
+        return true;
+    }
+    if (strcmp(name, "list_len") == 0 && argc == 1 && args[0].kind == CT_LIST) {
+        *out = ct_int(g_ct_lists[args[0].i].size);
+        return true;
+    }
+    return false;
+}
+
+static bool ct_call(const char* name, const char** pp, CtFrame* fr, CtValue* out) {
+    CtValue args[MAX_PARAMS];
+    int argc = 0;
+    const char* p = skip_spaces(*pp + 1);
+    if (*p != ')') {
+        for (;;) {
+            if (argc >= MAX_PARAMS || !ct_expr(&p, fr, 0, &args[argc++])) return false;
+            p = skip_spaces(p);
+            if (*p == ')') break;
+            if (*p != ',') return false;
+            p++;
+        }
+    }
+    *pp = p + 1;
+    if (g_ct_dry) {
+        *out = ct_int(0);
+        return true;
+    }
+    if (ct_builtin(name, args, argc, out)) return true;
+    Function* f = (Function*)find_func(name);
+    return f && ct_invoke(f, args, argc, out);
+}
+
+/* [a, b, c]: a float list when any item is floating point */
+static bool ct_list_literal(const char** pp, CtFrame* fr, CtValue* out) {
+    int h = ct_new_list(false);
+    bool is_float = false;
+    const char* p = skip_spaces(*pp + 1);
+    if (*p != ']') {
+        for (;;) {
+            CtValue v;
+            if (!ct_expr(&p, fr, 0, &v) || v.kind == CT_LIST || !ct_list_push(h, ct_num(v))) return false;
+            if (!ct_is_int(v)) is_float = true;
+            p = skip_spaces(p);
+            if (*p == ']') break;
+            if (*p != ',') return false;
+            p = skip_spaces(p + 1);
+        }
+    }
+    *pp = p + 1;
+    CtList* l = &g_ct_lists[h];
+    l->is_float = is_float;
+    if (is_float) {
+        for (int i = 0; i < l->size; i++) l->items[i] = (float)l->items[i];
+    }
+    out->kind = CT_LIST;
+    out->i = h;
+    out->f = 0;
+    return true;
+}
+
+static bool ct_number(const char** pp, CtValue* out) {
+    const char* p = *pp;
+    const char* q = p;
+    bool is_hex = p[0] == '0' && (p[1] == 'x' || p[1] == 'X');
+    bool is_real = false;
+    while (isalnum((unsigned char)*q) || *q == '.' ||
+           ((*q == '+' || *q == '-') && !is_hex && (q[-1] == 'e' || q[-1] == 'E'))) {
+        if (*q == '.' || (!is_hex && (*q == 'e' || *q == 'E'))) is_real = true;
+        q++;
+    }
+    char* end;
+    if (is_real) {
+        double d = strtod(p, &end);
+        out->kind = CT_DOUBLE;
+        if (*end == 'f' || *end == 'F') {
+            out->kind = CT_FLOAT;
+            d = (float)d;
+            end++;
+        }
+        out->f = d;
+    } else {
+        long long v = strtoll(p, &end, 0);
+        if (v > INT_MAX) return false;  // a long in C
+        *out = ct_int(v);
+    }
+    if (end != q) return false;
+    *pp = q;
+    return true;
+}
+
+static bool ct_unary(const char** pp, CtFrame* fr, CtValue* out) {
+    const char* p = skip_spaces(*pp);
+    if ((*p == '-' || *p == '+') && p[1] != p[0]) {
+        *pp = p + 1;
+        if (!ct_unary(pp, fr, out)) return false;
+        if (g_ct_dry || *p == '+') return out->kind != CT_LIST;
+        if (out->kind == CT_LIST || (ct_is_int(*out) && out->i == INT_MIN)) return false;
+        if (ct_is_int(*out)) *out = ct_int(-out->i);
+        else out->f = -out->f;
+        return true;
+    }
+    if ((*p == '!' && p[1] != '=') || *p == '~') {
+        *pp = p + 1;
+        if (!ct_unary(pp, fr, out)) return false;
+        if (g_ct_dry) return true;
+        if (*p == '~') {
+            if (!ct_is_int(*out)) return false;
+            *out = ct_int(~out->i);
+            return true;
+        }
+        bool truth;
+        if (!ct_truth(*out, &truth)) return false;
+        *out = ct_int(!truth);
+        out->kind = CT_BOOL;
+        return true;
+    }
+    if (*p == '(') {
+        // Casts: (int), (float), (double)
+        static const struct { const char* text; CtKind kind; } casts[] = {
+            { "(int)", CT_INT }, { "(float)", CT_FLOAT }, { "(double)", CT_DOUBLE }, { "(bool)", CT_BOOL },
+        };
+        for (size_t i = 0; i < sizeof(casts) / sizeof(casts[0]); i++) {
+            if (starts_with(p, casts[i].text)) {
+                *pp = p + strlen(casts[i].text);
+                if (!ct_unary(pp, fr, out)) return false;
+                return g_ct_dry || ct_convert(out, casts[i].kind, false);
+            }
+        }
+        p++;
+        if (!ct_expr(&p, fr, 0, out)) return false;
+        p = skip_spaces(p);
+        if (*p != ')') return false;
+        *pp = p + 1;
+    } else if (*p == '[') {
+        if (!ct_list_literal(&p, fr, out)) return false;
+        *pp = p;
+    } else if (isdigit((unsigned char)*p) || (*p == '.' && isdigit((unsigned char)p[1]))) {
+        if (!ct_number(&p, out)) return false;
+        *pp = p;
+    } else if (isalpha((unsigned char)*p) || *p == '_') {
+        char name[64];
+        int n = 0;
+        while (is_ident_char(*p)) {
+            if (n >= 63) return false;
+            name[n++] = *p++;
+        }
+        name[n] = '\0';
+        const char* q = skip_spaces(p);
+        if (*q == '(') {
+            if (!ct_call(name, &q, fr, out)) return false;
+            p = q;
+        } else if (strcmp(name, "true") == 0 || strcmp(name, "false") == 0) {
+            *out = ct_int(name[0] == 't');
+            out->kind = CT_BOOL;
+        } else if (g_ct_dry) {
+            *out = ct_int(0);
+        } else {
+            const CtVar* var = ct_local(fr, name);
+            if (!var) var = ct_const(name);
+            if (!var) return false;
+            *out = var->v;
+        }
+        *pp = p;
+    } else {
+        return false;
+    }
+    // Indexing
+    for (;;) {
+        p = skip_spaces(*pp);
+        if (*p != '[') return true;
+        p++;
+        CtValue idx;
+        if (!ct_expr(&p, fr, 0, &idx)) return false;
+        p = skip_spaces(p);
+        if (*p != ']') return false;
+        *pp = p + 1;
+        if (g_ct_dry) continue;
+        if (out->kind != CT_LIST || !ct_is_int(idx)) return false;
+        const CtList* l = &g_ct_lists[out->i];
+        if (idx.i < 0 || idx.i >= l->size) return false;
+        if (l->is_float) {
+            out->kind = CT_FLOAT;
+            out->f = l->items[idx.i];
+        } else {
+            *out = ct_int((long long)l->items[idx.i]);
+        }
+    }
+}
+
+static const struct { const char* op; int prec; } g_ct_ops[] = {
+    { "||", 1 }, { "&&", 2 }, { "==", 6 }, { "!=", 6 }, { "<=", 7 }, { ">=", 7 },
+    { "<<", 8 }, { ">>", 8 }, { "|", 3 }, { "^", 4 }, { "&", 5 }, { "<", 7 }, { ">", 7 },
+    { "+", 9 }, { "-", 9 }, { "*", 10 }, { "/", 10 }, { "%", 10 },
+};
+
+/* Binary operator at p, NULL at the end of the expression or at an op-assign */
+static const char* ct_peek_op(const char* p, int* prec) {
+    if (!*p || !strchr("|&=!<>^+-*/%", *p)) return NULL;
+    for (size_t i = 0; i < sizeof(g_ct_ops) / sizeof(g_ct_ops[0]); i++) {
+        size_t len = strlen(g_ct_ops[i].op);
+        if (strncmp(p, g_ct_ops[i].op, len) != 0) continue;
+        if (p[len] == '=' && g_ct_ops[i].prec != 6 && g_ct_ops[i].prec != 7) return NULL;
+        *prec = g_ct_ops[i].prec;
+        return g_ct_ops[i].op;
+    }
+    return NULL;
+}
+
+/* Precedence climbing over C's binary operators */
+static bool ct_expr(const char** pp, CtFrame* fr, int min_prec, CtValue* out) {
+    if (!ct_unary(pp, fr, out)) return false;
+    for (;;) {
+        const char* p = skip_spaces(*pp);
+        int prec = 0;
+        const char* op = ct_peek_op(p, &prec);
+        if (!op || prec < min_prec) return true;
+        *pp = p + strlen(op);
+        CtValue rhs;
+        if (prec <= 2) {
+            // && and ||: the right side is only parsed when the left decides
+            bool left;
+            if (!g_ct_dry && !ct_truth(*out, &left)) return false;
+            bool skip = !g_ct_dry && (prec == 1 ? left : !left);
+            if (skip) g_ct_dry++;
+            bool ok = ct_expr(pp, fr, prec + 1, &rhs);
+            if (skip) g_ct_dry--;
+            if (!ok) return false;
+            if (g_ct_dry) continue;
+            bool right = false;
+            if (!skip && !ct_truth(rhs, &right)) return false;
+            *out = ct_int(skip ? prec == 1 : right);
+            out->kind = CT_BOOL;
+            continue;
+        }
+        if (!ct_expr(pp, fr, prec + 1, &rhs)) return false;
+        if (!ct_binary(op, *out, rhs, out)) return false;
+    }
+}
+
+/* Evaluates all of 'text' as one expression */
+static bool ct_eval(const char* text, CtFrame* fr, CtValue* out) {
+    const char* p = text;
+    if (!ct_expr(&p, fr, 0, out)) return false;
+    return *skip_spaces(p) == '\0';
+}
+
+static bool ct_cond(const char* text, CtFrame* fr, bool* out) {
+    CtValue v;
+    branch_hint(&text);
+    return ct_eval(text, fr, &v) && ct_truth(v, out);
+}
+
+/* Splits the captured body into statements with their indentation */
+static void ct_split_source(Function* f) {
+    int cap = 16;
+    f->ct_lines = (char**)malloc(sizeof(char*) * cap);
+    f->ct_indents = (int*)malloc(sizeof(int) * cap);
+    f->ct_line_count = 0;
+    char* text = f->source ? strdup(f->source) : strdup("");
+    for (char* line = strtok(text, "\n"); line; line = strtok(NULL, "\n")) {
+        int indent = get_indent(line);
+        char* s = trim(line);
+        strip_trailing_brace(s);
+        s = trim(s);
+        size_t len = strlen(s);
+        if (len > 0 && s[len - 1] == ':') s[--len] = '\0';
+        s = trim(s);
+        if (!*s || strcmp(s, "}") == 0 || strcmp(s, "end") == 0) continue;
+        // Loop annotations do not change what the loop computes
+        if (starts_with(s, "parallel for ")) s = trim_left(s + 8);
+        while (is_loop_hint(s) && !starts_with(s, "for ")) {
+            s = starts_with(s, "simd ") ? trim_left(s + 5) : trim_left(strchr(s, ')') + 1);
+        }
+        if (f->ct_line_count == cap) {
+            cap *= 2;
+            f->ct_lines = (char**)realloc(f->ct_lines, sizeof(char*) * cap);
+            f->ct_indents = (int*)realloc(f->ct_indents, sizeof(int) * cap);
+        }
+        f->ct_lines[f->ct_line_count] = s;
+        f->ct_indents[f->ct_line_count++] = indent;
+    }
+}
+
+static CtFlow ct_exec(Function* f, int start, int end, CtFrame* fr, CtValue* ret);
+
+/* Runs a loop body and folds break/continue into the loop's own control flow */
+static bool ct_loop_body(Function* f, int start, int end, CtFrame* fr, CtValue* ret, CtFlow* flow) {
+    *flow = ct_exec(f, start, end, fr, ret);
+    if (*flow == CT_CONTINUE) *flow = CT_NEXT;
+    if (*flow == CT_BREAK) {
+        *flow = CT_NEXT;
+        return false;
+    }
+    if (*flow == CT_NEXT && !ct_step()) *flow = CT_FAIL;
+    return *flow == CT_NEXT;
+}
+
+/* for i = A to B, for i = A to(C) B and for x in L, with handle_for's parsing */
+static CtFlow ct_for(Function* f, const char* header, int start, int end, CtFrame* fr, CtValue* ret) {
+    char var[64];
+    int n = 0;
+    const char* p = skip_spaces(header);
+    while (is_ident_char(*p) && n < 63) var[n++] = *p++;
+    var[n] = '\0';
+    p = skip_spaces(p);
+    CtFlow flow = CT_NEXT;
+    if (strncmp(p, "in ", 3) == 0) {
+        CtValue list;
+        if (!n || !ct_eval(p + 3, fr, &list) || list.kind != CT_LIST) return CT_FAIL;
+        bool is_float = g_ct_lists[list.i].is_float;
+        for (int k = 0; k < g_ct_lists[list.i].size; k++) {
+            CtValue item = { is_float ? CT_FLOAT : CT_INT, 0, 0 };
+            if (is_float) item.f = g_ct_lists[list.i].items[k];
+            else item.i = (int)g_ct_lists[list.i].items[k];
+            if (!ct_declare(fr, var, item.kind, false, item)) return CT_FAIL;
+            if (!ct_loop_body(f, start, end, fr, ret, &flow)) break;
+        }
+        return flow;
+    }
+    if (!n || *p != '=') return CT_FAIL;
+    p = skip_spaces(p + 1);
+    char start_val[64], step[64] = "1", end_val[MAX_LINE];
+    n = 0;
+    while (*p && !isspace((unsigned char)*p) && strncmp(p, "to", 2) != 0 && n < 63) start_val[n++] = *p++;
+    start_val[n] = '\0';
+    p = skip_spaces(p);
+    if (strncmp(p, "to", 2) != 0) return CT_FAIL;
+    p += 2;
+    if (*p == '(') {
+        const char* close = strchr(p, ')');
+        if (!close || close - p - 1 >= (int)sizeof(step)) return CT_FAIL;
+        snprintf(step, sizeof(step), "%.*s", (int)(close - p - 1), p + 1);
+        p = close + 1;
+    }
+    snprintf(end_val, sizeof(end_val), "%s", p);
+    CtValue v;
+    if (!ct_eval(start_val, fr, &v) || !ct_declare(fr, var, CT_INT, false, v)) return CT_FAIL;
+    for (;;) {
+        CtValue limit, inc;
+        bool go;
+        CtVar* iv = ct_local(fr, var);
+        if (!ct_eval(end_val, fr, &limit) || !ct_binary("<=", iv->v, limit, &v) || !ct_truth(v, &go)) {
+            return CT_FAIL;
+        }
+        if (!go || !ct_loop_body(f, start, end, fr, ret, &flow)) break;
+        iv = ct_local(fr, var);
+        if (!ct_eval(step, fr, &inc) || !ct_binary("+", iv->v, inc, &v) || !ct_convert(&v, CT_INT, false)) {
+            return CT_FAIL;
+        }
+        iv->v = v;
+    }
+    return flow;
+}
+
+/* Declarations, assignments, append and call statements */
+static CtFlow ct_simple(const char* s, CtFrame* fr, CtValue* ret) {
+    if (strcmp(s, "break") == 0) return CT_BREAK;
+    if (strcmp(s, "continue") == 0) return CT_CONTINUE;
+    if (strcmp(s, "return") == 0) {
+        ret->kind = CT_INT;
+        ret->i = 0;
+        return CT_RETURN;
+    }
+    if (starts_with(s, "return ")) return ct_eval(s + 7, fr, ret) ? CT_RETURN : CT_FAIL;
+
+    // Declarations: int x = e, list[float] L, ...
+    const char* p = s;
+    if (starts_with(p, "const ")) p = skip_spaces(p + 6);
+    static const struct { const char* word; CtKind kind; bool float_elems; } decls[] = {
+        { "int ", CT_INT, false }, { "float ", CT_FLOAT, false }, { "bool ", CT_BOOL, false },
+        { "list ", CT_LIST, false }, { "list[int] ", CT_LIST, false }, { "list[float] ", CT_LIST, true },
+    };
+    for (size_t i = 0; i < sizeof(decls) / sizeof(decls[0]); i++) {
+        if (!starts_with(p, decls[i].word)) continue;
+        CtKind kind = decls[i].kind;
+        bool float_elems = decls[i].float_elems;
+        p = skip_spaces(p + strlen(decls[i].word));
+        char name[64];
+        int n = 0;
+        while (is_ident_char(*p) && n < 63) name[n++] = *p++;
+        name[n] = '\0';
+        p = skip_spaces(p);
+        CtValue v = ct_int(0);
+        if (*p == '=') {
+            if (!ct_eval(p + 1, fr, &v)) return CT_FAIL;
+        } else if (*p) {
+            return CT_FAIL;
+        } else if (kind == CT_LIST) {
+            v.kind = CT_LIST;
+            v.i = ct_new_list(float_elems);
+        }
+        return n && ct_declare(fr, name, kind, float_elems, v) ? CT_NEXT : CT_FAIL;
+    }
+    if (starts_with(s, "append(")) {
+        p = s + 7;
+        CtValue list, item;
+        if (!ct_expr(&p, fr, 0, &list) || list.kind != CT_LIST) return CT_FAIL;
+        p = skip_spaces(p);
+        if (*p != ',') return CT_FAIL;
+        p++;
+        if (!ct_expr(&p, fr, 0, &item)) return CT_FAIL;
+        p = skip_spaces(p);
+        if (strcmp(p, ")") != 0) return CT_FAIL;
+        if (!ct_convert(&item, g_ct_lists[list.i].is_float ? CT_FLOAT : CT_INT, false)) return CT_FAIL;
+        return ct_list_push(list.i, ct_num(item)) ? CT_NEXT : CT_FAIL;
+    }
+
+    // Assignment to a local or a list element: x = e, x += e, L[i] = e, x++
+    char name[64];
+    int n = 0;
+    p = s;
+    while (is_ident_char(*p) && n < 63) name[n++] = *p++;
+    name[n] = '\0';
+    CtVar* var = n ? ct_local(fr, name) : NULL;
+    p = skip_spaces(p);
+    if (var && *p != '(') {
+        int index = -1;
+        if (*p == '[') {
+            CtValue idx;
+            p++;
+            if (var->v.kind != CT_LIST || !ct_expr(&p, fr, 0, &idx) || !ct_is_int(idx)) return CT_FAIL;
+            p = skip_spaces(p);
+            if (*p != ']' || idx.i < 0 || idx.i >= g_ct_lists[var->v.i].size) return CT_FAIL;
+            index = idx.i;
+            p = skip_spaces(p + 1);
+        }
+        CtValue cur = var->v;
+        CtKind kind = var->kind;
+        bool float_elems = var->float_elems;
+        if (index >= 0) {
+            bool is_float = g_ct_lists[var->v.i].is_float;
+            kind = is_float ? CT_FLOAT : CT_INT;
+            float_elems = false;
+            cur.kind = kind;
+            cur.f = g_ct_lists[var->v.i].items[index];
+            cur.i = (int)cur.f;
+        }
+        char op[4] = "";
+        CtValue v;
+        if (strcmp(p, "++") == 0 || strcmp(p, "--") == 0) {
+            op[0] = p[0];
+            v = ct_int(1);
+        } else {
+            int len = 0;
+            while (len < 3 && p[len] && strchr("+-*/%&|^<>", p[len])) len++;
+            if (p[len] != '=' || p[len + 1] == '=' || (len == 0 && p[0] != '=')) return CT_FAIL;
+            if (len == 1 && (p[0] == '<' || p[0] == '>')) return CT_FAIL;   // a comparison
+            snprintf(op, sizeof(op), "%.*s", len, p);
+            if (!ct_eval(p + len + 1, fr, &v)) return CT_FAIL;
+        }
+        if (op[0] && !ct_binary(op, cur, v, &v)) return CT_FAIL;
+        if (!ct_convert(&v, kind, float_elems)) return CT_FAIL;
+        if (index >= 0) {
+            g_ct_lists[var->v.i].items[index] = ct_num(v);
+        } else {
+            var->v = v;
+        }
+        return CT_NEXT;
+    }
+
+    // A call for its effect on list arguments
+    CtValue v;
+    return ct_eval(s, fr, &v) ? CT_NEXT : CT_FAIL;
+}
+
+/* Runs statements [start, end) of f; deeper-indented lines belong to the one above */
+static CtFlow ct_exec(Function* f, int start, int end, CtFrame* fr, CtValue* ret) {
+    int i = start;
+    while (i < end) {
+        if (!ct_step()) return CT_FAIL;
+        const char* s = f->ct_lines[i];
+        int indent = f->ct_indents[i];
+        int body_end = i + 1;
+        while (body_end < end && f->ct_indents[body_end] > indent) body_end++;
+        CtFlow flow;
+        if (starts_with(s, "if ")) {
+            // The whole if/elif/else chain
+            bool taken = false;
+            flow = CT_NEXT;
+            for (;;) {
+                const char* h = f->ct_lines[i];
+                if (!taken) {
+                    bool cond = true;
+                    if ((starts_with(h, "if ") && !ct_cond(h + 3, fr, &cond)) ||
+                        (starts_with(h, "elif ") && !ct_cond(h + 5, fr, &cond))) {
+                        return CT_FAIL;
+                    }
+                    if (cond) {
+                        taken = true;
+                        flow = ct_exec(f, i + 1, body_end, fr, ret);
+                    }
+                }
+                i = body_end;
+                if (i >= end || f->ct_indents[i] != indent ||
+                    (!starts_with(f->ct_lines[i], "elif ") && strcmp(f->ct_lines[i], "else") != 0)) {
+                    break;
+                }
+                body_end = i + 1;
+                while (body_end < end && f->ct_indents[body_end] > indent) body_end++;
+            }
+            body_end = i;
+        } else if (starts_with(s, "while ")) {
+            flow = CT_NEXT;
+            for (;;) {
+                bool cond;
+                if (!ct_cond(s + 6, fr, &cond)) return CT_FAIL;
+                if (!cond || !ct_loop_body(f, i + 1, body_end, fr, ret, &flow)) break;
+            }
+        } else if (starts_with(s, "for ")) {
+            flow = ct_for(f, s + 4, i + 1, body_end, fr, ret);
+        } else if (body_end > i + 1) {
+            return CT_FAIL;         // a block the interpreter does not know
+        } else {
+            flow = ct_simple(s, fr, ret);
+        }
+        if (flow != CT_NEXT) return flow;
+        i = body_end;
+    }
+    return CT_NEXT;
+}
+
+static bool ct_invoke(Function* f, CtValue* args, int argc, CtValue* out) {
+    if (!f->source_done || argc != f->arity || g_ct_depth >= CT_MAX_DEPTH) return false;
+    if (!f->ct_lines) ct_split_source(f);
+    CtFrame* fr = (CtFrame*)malloc(sizeof(CtFrame));
+    fr->count = 0;
+    bool ok = true;
+    for (int i = 0; i < argc && ok; i++) {
+        CtKind kind;
+        bool float_elems;
+        ok = ct_kind_of(f->param_types[i], f->param_elems[i], &kind, &float_elems) &&
+             ct_declare(fr, f->param_names[i], kind, float_elems, args[i]);
+    }
+    CtValue ret = ct_int(0);
+    if (ok) {
+        g_ct_depth++;
+        CtFlow flow = ct_exec(f, 0, f->ct_line_count, fr, &ret);
+        g_ct_depth--;
+        ok = flow == CT_NEXT || flow == CT_RETURN;
+        if (ok && f->ret != TYPE_UNKNOWN) {
+            CtKind kind;
+            bool float_elems;
+            ok = flow == CT_RETURN && ct_kind_of(f->ret, f->ret_elem, &kind, &float_elems) &&
+                 ct_convert(&ret, kind, float_elems);
+        }
+    }
+    free(fr);
+    *out = ret;
+    return ok;
+}
+
+/*
+ * Evaluates the initializer of a const of type vt. Lists made along the way
+ * are dropped again; a list result is kept so later constants can use it.
+ */
+static bool ct_eval_const(const char* expr, VarType vt, VarType elem, CtValue* out) {
+    CtKind kind;
+    bool float_elems;
+    if (!ct_kind_of(vt, elem, &kind, &float_elems)) return false;
+    int mark = g_ct_list_count;
+    g_ct_steps = 0;
+    g_ct_depth = 0;
+    g_ct_dry = 0;
+    CtFrame* fr = (CtFrame*)malloc(sizeof(CtFrame));
+    fr->count = 0;
+    bool ok = ct_eval(expr, fr, out);
+    free(fr);
+    if (ok && *skip_spaces(expr) == '[' && out->kind == CT_LIST && g_ct_lists[out->i].is_float != float_elems) {
+        // [1, 2] for a list[float] and the like: retype the literal
+        CtList* l = &g_ct_lists[out->i];
+        l->is_float = float_elems;
+        for (int i = 0; i < l->size; i++) {
+            l->items[i] = float_elems ? (double)(float)l->items[i] : (double)(int)l->items[i];
+        }
+    }
+    ok = ok && ct_convert(out, kind, float_elems);
+    if (g_ct_steps > CT_STEP_BUDGET) {
+        warning("Constant needs too much work to evaluate at compile time - computed at runtime");
+    }
+    int keep = ok && out->kind == CT_LIST && out->i >= mark ? out->i : -1;
+    for (int i = mark; i < g_ct_list_count; i++) {
+        if (i != keep) free(g_ct_lists[i].items);
+    }
+    g_ct_list_count = mark;
+    if (keep >= 0) {
+        g_ct_lists[mark] = g_ct_lists[keep];
+        out->i = mark;
+        g_ct_list_count = mark + 1;
+    }
+    return ok;
+}
+
+/* C literal for an int or float value; floats keep every bit with an f suffix */
+static void ct_format(char* buf, size_t size, double v, bool is_float) {
+    if (!is_float) {
+        snprintf(buf, size, "%d", (int)v);
+        return;
+    }
+    snprintf(buf, size, "%.9g", v);
+    if (!strpbrk(buf, ".e")) strncat(buf, ".0", size - strlen(buf) - 1);
+    strncat(buf, "f", size - strlen(buf) - 1);
+}
+
+/*
+ * const declaration with a value known at compile time: scalars become
+ * literals, lists a static array wrapped in a List. Returns false (nothing
+ * emitted) when the value has to be computed at runtime.
+ */
+static bool fold_const_decl(const char* name, VarType vt, VarType elem, const char* value) {
+    CtValue v;
+    if (!ct_eval_const(value, vt, elem, &v)) return false;
+    char emit_buf[MAX_LINE];
+    char num[64];
+    if (v.kind == CT_LIST && g_ct_lists[v.i].size == 0) {
+        bool is_float = g_ct_lists[v.i].is_float;
+        snprintf(emit_buf, sizeof(emit_buf), "const %s %s = %s;\n",
+                 is_float ? "FList" : "List", name, is_float ? "new_flist()" : "new_list()");
+    } else if (v.kind == CT_LIST) {
+        const CtList* l = &g_ct_lists[v.i];
+        for (int i = 0; i < l->size; i++) {
+            if (l->is_float && !isfinite(l->items[i])) return false;
+        }
+        int id = g_ct_data_count++;
+        char line[4096];
+        size_t o = 0;
+        snprintf(line, sizeof(line), "static %s _const%d_data[%d] __attribute__((aligned(64))) = {",
+                 l->is_float ? "float" : "int", id, l->size);
+        append_decl(line);
+        for (int i = 0; i < l->size; i++) {
+            if (i % 16 == 0) out_put(line, &o, sizeof(line), "\n   ");
+            ct_format(num, sizeof(num), l->items[i], l->is_float);
+            out_put(line, &o, sizeof(line), " ");
+            out_put(line, &o, sizeof(line), num);
+            out_put(line, &o, sizeof(line), i + 1 < l->size ? "," : "");
+            if (i % 16 == 15 || i + 1 == l->size) {
+                append_decl(line);
+                o = 0;
+                line[0] = '\0';
+            }
+        }
+        append_decl("\n};\n");
+        snprintf(emit_buf, sizeof(emit_buf), "const %s %s = { _const%d_data, %d, %d };\n",
+                 l->is_float ? "FList" : "List", name, id, l->size, l->size);
+    } else {
+        if (v.kind == CT_FLOAT && !isfinite(v.f)) return false;
+        if (v.kind == CT_BOOL) snprintf(num, sizeof(num), "%s", v.i ? "true" : "false");
+        else ct_format(num, sizeof(num), ct_num(v), v.kind == CT_FLOAT);
+        snprintf(emit_buf, sizeof(emit_buf), "const %s %s = %s;\n",
+                 vt == TYPE_INT ? "int" : vt == TYPE_FLOAT ? "float" : "bool", name, num);
+    }
+    emit_no_log(emit_buf);
+
+    // Function-local constants stay out of the table other functions see
+    if (!g_in_function && g_ct_const_count < CT_MAX_CONSTS) {
+        CtVar* c = &g_ct_consts[g_ct_const_count++];
+        snprintf(c->name, sizeof(c->name), "%s", name);
+        ct_kind_of(vt, elem, &c->kind, &c->float_elems);
+        c->v = v;
+    }
+    return true;
+}
+
+/* ============== Pipelines ============== */
+
+/*
+ * Comprehensions and chained list stages compile to one fused loop; no
+ * intermediate list is built:
+ *   [x * x for x in L if x > 0]
+ *   L.map(f).filter(p).take(n)
+ *   zip(A, B), enumerate(L), L.zip(M), L.enumerate()
+ * After zip or enumerate each element is a pair, which map and filter
+ * functions take as two arguments.
+ */
+
+#define MAX_STAGES 16
+
+typedef enum {
+    STAGE_MAP,          /* .map(f) */
+    STAGE_FILTER,       /* .filter(p) */
+    STAGE_TAKE,         /* .take(n) */
+    STAGE_ZIP,          /* .zip(M), zip(L, M) */
+    STAGE_ENUMERATE,    /* .enumerate(), enumerate(L) */
+    STAGE_BIND,         /* comprehension variables: x or i, x */
+    STAGE_WHERE,        /* comprehension condition */
+    STAGE_YIELD         /* comprehension expression */
+} StageKind;
+
+typedef struct {
+    StageKind kind;
+    char arg[MAX_LINE];
+} Stage;
+
+typedef struct {
+    char source[256];
+    Stage stages[MAX_STAGES];
+    int stage_count;
+} Pipeline;
+
+static int g_pipe_count = 0;
+
+/* End of the group opened at p ('(' or '['), or NULL */
+static const char* group_end(const char* p) {
+    int depth = 0;
+    for (; *p; p++) {
+        if (*p == '"' || *p == '\'') {
+            p = skip_c_literal(p) - 1;
+            if (!*p) return NULL;
+        } else if (*p == '(' || *p == '[') {
+            depth++;
+        } else if ((*p == ')' || *p == ']') && --depth == 0) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+/* First 'word' in s outside brackets and literals */
+static const char* find_top_level(const char* s, const char* word) {
+    size_t n = strlen(word);
+    int depth = 0;
+    for (const char* p = s; *p; p++) {
+        if (*p == '"' || *p == '\'') {
+            p = skip_c_literal(p) - 1;
+            if (!*p) return NULL;
+        } else if (*p == '(' || *p == '[') {
+            depth++;
+        } else if (*p == ')' || *p == ']') {
+            depth--;
+        } else if (depth == 0 && strncmp(p, word, n) == 0) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+static bool is_stage_method(const char* p) {
+    static const char* methods[] = { "map(", "filter(", "take(", "zip(", "enumerate(" };
+    for (size_t i = 0; i < sizeof(methods) / sizeof(methods[0]); i++) {
+        if (starts_with(p, methods[i])) return true;
+    }
+    return false;
+}
+
+static bool is_pipeline(const char* text) {
+    const char* t = skip_spaces(text);
+    if (*t == '[') {
+        const char* close = group_end(t);
+        if (!close) return false;
+        char inner[MAX_LINE];
+        snprintf(inner, sizeof(inner), "%.*s", (int)(close - t - 1), t + 1);
+        return find_top_level(inner, " for ") != NULL;
+    }
+    if (starts_with(t, "zip(") || starts_with(t, "enumerate(")) return true;
+    char name[256];
+    int n = 0;
+    while (is_ident_char(t[n]) && n < 255) {
+        name[n] = t[n];
+        n++;
+    }
+    name[n] = '\0';
+    return n > 0 && t[n] == '.' && get_var_type(name) == TYPE_LIST && is_stage_method(t + n + 1);
+}
+
+static bool add_stage(Pipeline* pl, StageKind kind, const char* arg, size_t len) {
+    if (pl->stage_count >= MAX_STAGES) {
+        error("Too many pipeline stages");
+        return false;
+    }
+    while (len > 0 && isspace((unsigned char)*arg)) {
+        arg++;
+        len--;
+    }
+    Stage* s = &pl->stages[pl->stage_count++];
+    s->kind = kind;
+    snprintf(s->arg, sizeof(s->arg), "%.*s", (int)len, arg);
+    trim(s->arg);
+    return true;
+}
+
+static bool is_list_name(const char* name) {
+    char msg[512];
+    if (get_var_type(name) == TYPE_LIST) return true;
+    snprintf(msg, sizeof(msg), "'%s' is not a list - pipelines read lists", name);
+    error(msg);
+    return false;
+}
+
+/* Source and method chain: L.map(f).take(3), zip(A, B).filter(p) */
+static bool parse_chain(const char* text, Pipeline* pl) {
+    const char* p = skip_spaces(text);
+    if (starts_with(p, "zip(") || starts_with(p, "enumerate(")) {
+        bool zip = *p == 'z';
+        const char* open = strchr(p, '(');
+        const char* close = group_end(open);
+        if (!close) {
+            error("Missing ')' in pipeline");
+            return false;
+        }
+        char args[MAX_LINE];
+        snprintf(args, sizeof(args), "%.*s", (int)(close - open - 1), open + 1);
+        char* comma = (char*)find_top_level(args, ",");
+        if (zip != (comma != NULL)) {
+            error(zip ? "zip takes two lists: zip(A, B)" : "enumerate takes one list: enumerate(L)");
+            return false;
+        }
+        if (comma) *comma = '\0';
+        snprintf(pl->source, sizeof(pl->source), "%s", trim(args));
+        if (zip && !add_stage(pl, STAGE_ZIP, comma + 1, strlen(comma + 1))) return false;
+        if (!zip && !add_stage(pl, STAGE_ENUMERATE, "", 0)) return false;
+        p = close + 1;
+    } else {
+        size_t n = 0;
+        while (is_ident_char(p[n])) n++;
+        snprintf(pl->source, sizeof(pl->source), "%.*s", (int)n, p);
+        p += n;
+    }
+    if (!is_list_name(pl->source)) return false;
+
+    while (*(p = skip_spaces(p)) == '.') {
+        p++;
+        const char* open = strchr(p, '(');
+        const char* close = open ? group_end(open) : NULL;
+        if (!is_stage_method(p) || !close) {
+            error("Unknown pipeline stage - expected map, filter, take, zip or enumerate");
+            return false;
+        }
+        const char* arg = open + 1;
+        size_t len = close - arg;
+        StageKind kind = starts_with(p, "map(") ? STAGE_MAP : starts_with(p, "filter(") ? STAGE_FILTER :
+                         starts_with(p, "take(") ? STAGE_TAKE : starts_with(p, "zip(") ? STAGE_ZIP :
+                         STAGE_ENUMERATE;
+        if (!add_stage(pl, kind, arg, len)) return false;
+        p = close + 1;
+    }
+    if (*p) {
+        error("Unexpected text after pipeline");
+        return false;
+    }
+    return true;
+}
+
+/* [expr for x in source if cond], or a chain */
+static bool parse_pipeline(const char* text, Pipeline* pl) {
+    pl->stage_count = 0;
+    pl->source[0] = '\0';
+    const char* t = skip_spaces(text);
+    if (*t != '[') return parse_chain(t, pl);
+
+    const char* close = group_end(t);
+    if (*skip_spaces(close + 1)) {
+        error("Unexpected text after comprehension");
+        return false;
+    }
+    char inner[MAX_LINE];
+    snprintf(inner, sizeof(inner), "%.*s", (int)(close - t - 1), t + 1);
+    char* for_kw = (char*)find_top_level(inner, " for ");
+    char* in_kw = for_kw ? (char*)find_top_level(for_kw + 5, " in ") : NULL;
+    if (!in_kw) {
+        error("Malformed comprehension - expected [expr for x in L]");
+        return false;
+    }
+    *for_kw = '\0';
+    *in_kw = '\0';
+    char* source = in_kw + 4;
+    char* cond = (char*)find_top_level(source, " if ");
+    if (cond) {
+        *cond = '\0';
+        cond += 4;
+    }
+    if (!parse_chain(source, pl) || !add_stage(pl, STAGE_BIND, for_kw + 5, strlen(for_kw + 5))) return false;
+    if (cond && !add_stage(pl, STAGE_WHERE, cond, strlen(cond))) return false;
+    return add_stage(pl, STAGE_YIELD, inner, strlen(inner));
+}
+
+static const char* c_scalar_type(VarType t) {
+    return t == TYPE_FLOAT ? "float" : t == TYPE_BOOL ? "bool" : "int";
+}
+
+/*
+ * Emits the fused loop, open, with its stages; the current element is left in
+ * vals (two values after zip or enumerate). 'reserve' names the list the
+ * caller appends to, sized up front when no stage filters.
+ */
+static bool open_pipeline(const Pipeline* pl, VarType yield_type, const char* reserve,
+                          char vals[2][64], VarType types[2], int* arity) {
+    int id = ++g_pipe_count;
+    char code[MAX_LINE * 4], line[MAX_LINE * 2], c_expr[MAX_LINE];
+    size_t o = 0;
+    code[0] = '\0';
+    out_put(code, &o, sizeof(code), "{\n");
+
+    bool filters = false;
+    for (int k = 0; k < pl->stage_count; k++) {
+        const Stage* s = &pl->stages[k];
+        if (s->kind == STAGE_FILTER || s->kind == STAGE_WHERE) filters = true;
+        if (s->kind == STAGE_TAKE) {
+            rewrite_expr(s->arg, c_expr, sizeof(c_expr));
+            snprintf(line, sizeof(line), "const int _p%d_l%d = %s;\nint _p%d_t%d = 0;\n", id, k, c_expr, id, k);
+            out_put(code, &o, sizeof(code), line);
+        } else if (s->kind == STAGE_ZIP) {
+            if (!is_list_name(s->arg)) return false;
+            snprintf(line, sizeof(line), "int _p%d_z%d = 0;\n", id, k);
+            out_put(code, &o, sizeof(code), line);
+        } else if (s->kind == STAGE_ENUMERATE) {
+            snprintf(line, sizeof(line), "int _p%d_e%d = 0;\n", id, k);
+            out_put(code, &o, sizeof(code), line);
+        }
+    }
+    if (reserve && !filters) {
+        // Every element reaches the result: reserve the shortest input or the take limit
+        snprintf(line, sizeof(line), "int _p%d_cap = %s.size;\n", id, pl->source);
+        out_put(code, &o, sizeof(code), line);
+        for (int k = 0; k < pl->stage_count; k++) {
+            const Stage* s = &pl->stages[k];
+            if (s->kind == STAGE_ZIP) {
+                snprintf(line, sizeof(line), "if (%s.size < _p%d_cap) _p%d_cap = %s.size;\n",
+                         s->arg, id, id, s->arg);
+            } else if (s->kind == STAGE_TAKE) {
+                snprintf(line, sizeof(line), "if (_p%d_l%d < _p%d_cap) _p%d_cap = _p%d_l%d;\n",
+                         id, k, id, id, id, k);
+            } else {
+                continue;
+            }
+            out_put(code, &o, sizeof(code), line);
+        }
+        snprintf(line, sizeof(line), "%s(&%s, _p%d_cap);\n",
+                 get_var_elem_type(reserve) == TYPE_FLOAT ? "flist_reserve" : "list_reserve", reserve, id);
+        out_put(code, &o, sizeof(code), line);
+    }
+
+    VarType src_type = get_var_elem_type(pl->source) == TYPE_FLOAT ? TYPE_FLOAT : TYPE_INT;
+    snprintf(line, sizeof(line), "for (int _p%d_i = 0; _p%d_i < %s.size; _p%d_i++) {\n", id, id, pl->source, id);
+    out_put(code, &o, sizeof(code), line);
+    // Stop as soon as a take is satisfied rather than after running the stages once more
+    for (int k = 0; k < pl->stage_count; k++) {
+        if (pl->stages[k].kind != STAGE_TAKE) continue;
+        snprintf(line, sizeof(line), "if (_p%d_t%d >= _p%d_l%d) break;\n", id, k, id, k);
+        out_put(code, &o, sizeof(code), line);
+    }
+    snprintf(line, sizeof(line), "%s _p%d_v0 = %s.data[_p%d_i];\n", c_scalar_type(src_type), id, pl->source, id);
+    out_put(code, &o, sizeof(code), line);
+    snprintf(vals[0], 64, "_p%d_v0", id);
+    types[0] = src_type;
+    *arity = 1;
+    int next = 1;
+
+    for (int k = 0; k < pl->stage_count; k++) {
+        const Stage* s = &pl->stages[k];
+        char value[64];
+        snprintf(value, sizeof(value), "_p%d_v%d", id, next);
+        switch (s->kind) {
+            case STAGE_MAP:
+            case STAGE_FILTER: {
+                const char* what = s->kind == STAGE_MAP ? "map" : "filter";
+                if (!is_plain_operand(s->arg) || !*s->arg || isdigit((unsigned char)s->arg[0]) ||
+                    (!find_func(s->arg) && !find_generic(s->arg) && !find_builtin(s->arg) &&
+                     strcmp(s->arg, "abs") != 0)) {
+                    char msg[512];
+                    snprintf(msg, sizeof(msg), "%s takes the name of a function, got '%s'", what, s->arg);
+                    error(msg);
+                    return false;
+                }
+                // Typed temporaries let generic functions be instantiated for the call
+                char call[MAX_LINE];
+                for (int v = 0; v < *arity; v++) register_var(vals[v], types[v], false);
+                snprintf(call, sizeof(call), "%s(%s%s%s)", s->arg, vals[0], *arity > 1 ? ", " : "",
+                         *arity > 1 ? vals[1] : "");
+                rewrite_expr(call, c_expr, sizeof(c_expr));
+                if (s->kind == STAGE_FILTER) {
+                    snprintf(line, sizeof(line), "if (!(%s)) continue;\n", c_expr);
+                    break;
+                }
+                VarType rt = infer_expr_type(call);
+                if (rt != TYPE_INT && rt != TYPE_FLOAT && rt != TYPE_BOOL) {
+                    char msg[512];
+                    snprintf(msg, sizeof(msg), "map needs a function returning int, float or bool: '%s'", s->arg);
+                    error(msg);
+                    return false;
+                }
+                snprintf(line, sizeof(line), "%s %s = %s;\n", c_scalar_type(rt), value, c_expr);
+                snprintf(vals[0], 64, "%s", value);
+                types[0] = rt;
+                *arity = 1;
+                next++;
+                break;
+            }
+            case STAGE_TAKE:
+                snprintf(line, sizeof(line), "if (_p%d_t%d >= _p%d_l%d) break;\n_p%d_t%d++;\n",
+                         id, k, id, k, id, k);
+                break;
+            case STAGE_ZIP:
+            case STAGE_ENUMERATE:
+                if (*arity != 1) {
+                    error("zip and enumerate apply to single values, not pairs");
+                    return false;
+                }
+                if (s->kind == STAGE_ZIP) {
+                    VarType zt = get_var_elem_type(s->arg) == TYPE_FLOAT ? TYPE_FLOAT : TYPE_INT;
+                    snprintf(line, sizeof(line), "if (_p%d_z%d >= %s.size) break;\n%s %s = %s.data[_p%d_z%d++];\n",
+                             id, k, s->arg, c_scalar_type(zt), value, s->arg, id, k);
+                    snprintf(vals[1], 64, "%s", value);
+                    types[1] = zt;
+                } else {
+                    snprintf(line, sizeof(line), "int %s = _p%d_e%d++;\n", value, id, k);
+                    snprintf(vals[1], 64, "%s", vals[0]);
+                    types[1] = types[0];
+                    snprintf(vals[0], 64, "%s", value);
+                    types[0] = TYPE_INT;
+                }
+                *arity = 2;
+                next++;
+                break;
+            case STAGE_BIND: {
+                char names[2][64];
+                int count = 0;
+                char list[MAX_LINE];
+                snprintf(list, sizeof(list), "%s", s->arg);
+                for (char* n = strtok(list, ","); n; n = strtok(NULL, ",")) {
+                    n = trim(n);
+                    if (count == 2 || !*n || !is_plain_operand(n) || isdigit((unsigned char)n[0])) {
+                        count = 3;
+                        break;
+                    }
+                    snprintf(names[count++], 64, "%s", n);
+                }
+                if (count != *arity) {
+                    error(*arity == 2 ? "The pipeline yields pairs - expected two variables: for a, b in ..."
+                                      : "The pipeline yields single values - expected one variable");
+                    return false;
+                }
+                size_t lo = 0;
+                line[0] = '\0';
+                for (int v = 0; v < count; v++) {
+                    char decl[256];
+                    snprintf(decl, sizeof(decl), "%s %s = %s;\n", c_scalar_type(types[v]), names[v], vals[v]);
+                    out_put(line, &lo, sizeof(line), decl);
+                    register_var(names[v], types[v], false);
+                    snprintf(vals[v], 64, "%s", names[v]);
+                }
+                break;
+            }
+            case STAGE_WHERE: {
+                char cond[MAX_LINE];
+                snprintf(cond, sizeof(cond), "%s", s->arg);
+                lower_membership(cond, sizeof(cond));
+                rewrite_expr(cond, c_expr, sizeof(c_expr));
+                snprintf(line, sizeof(line), "if (!(%s)) continue;\n", c_expr);
+                break;
+            }
+            case STAGE_YIELD: {
+                VarType yt = yield_type != TYPE_UNKNOWN ? yield_type : infer_expr_type(s->arg);
+                if (yt != TYPE_FLOAT && yt != TYPE_BOOL) yt = TYPE_INT;
+                rewrite_expr(s->arg, c_expr, sizeof(c_expr));
+                snprintf(line, sizeof(line), "%s %s = %s;\n", c_scalar_type(yt), value, c_expr);
+                snprintf(vals[0], 64, "%s", value);
+                types[0] = yt;
+                *arity = 1;
+                next++;
+                break;
+            }
+        }
+        out_put(code, &o, sizeof(code), line);
+    }
+    if (o + 1 >= sizeof(code)) {
+        error("Pipeline too long");
+        return false;
+    }
+    emit_no_log(code);
+    return true;
+}
+
+/* list R = <pipeline>: appends each element to R */
+static void emit_pipeline_list(const char* name, VarType elem, const char* value) {
+    Pipeline* pl = (Pipeline*)malloc(sizeof(Pipeline));
+    bool is_float = elem == TYPE_FLOAT;
+    char line[MAX_LINE];
+    snprintf(line, sizeof(line), "%s %s = %s;\n", is_float ? "FList" : "List", name,
+             is_float ? "new_flist()" : "new_list()");
+    emit_no_log(line);
+
+    char vals[2][64];
+    VarType types[2];
+    int arity;
+    if (parse_pipeline(value, pl) && open_pipeline(pl, is_float ? TYPE_FLOAT : TYPE_INT, name, vals, types, &arity)) {
+        if (arity != 1) {
+            error("The pipeline yields pairs - add a map or use a comprehension to make one value");
+        } else if (types[0] == TYPE_FLOAT && !is_float) {
+            char msg[512];
+            snprintf(msg, sizeof(msg), "The pipeline yields floats - declare '%s' as list[float]", name);
+            error(msg);
+        }
+        snprintf(line, sizeof(line), "%s(&%s, %s);\n}\n}\n", is_float ? "flist_append" : "list_append", name,
+                 vals[0]);
+        emit_no_log(line);
+    }
+    free(pl);
+}
+
+/* for x in <pipeline>: / for a, b in zip(A, B): the body runs inside the fused loop */
+static void handle_pipeline_for(const char* line, const char* var, const char* var2, const char* iterable,
+                                bool has_brace) {
+    Pipeline* pl = (Pipeline*)malloc(sizeof(Pipeline));
+    char vars[160];
+    snprintf(vars, sizeof(vars), "%s%s%s", var, var2[0] ? ", " : "", var2);
+    char vals[2][64];
+    VarType types[2];
+    int arity;
+    if (parse_pipeline(iterable, pl) && add_stage(pl, STAGE_BIND, vars, strlen(vars)) &&
+        open_pipeline(pl, TYPE_UNKNOWN, NULL, vals, types, &arity)) {
+        char condition[MAX_LINE];
+        snprintf(condition, sizeof(condition), "%s in %s", vars, iterable);
+        push_block(get_indent(line), "for_in", condition, has_brace);
+        g_blocks[g_block_depth - 1].extra_braces = 1;
+    }
+    free(pl);
+}
+
+/* ============== Generators ============== */
+
+/*
+ * A func whose body yields compiles to a resumable state machine:
+ *   typedef struct { int _state; T _value; <params and locals> } Gen_name;
+ *   Gen_name name(params)             sets up the frame
+ *   bool name__next(Gen_name* _g)     runs to the next yield, false when done
+ * The body sits in 'switch (_g->_state)' with a case after every yield, and
+ * its locals live in the frame, so resuming needs no stack of its own.
+ */
+
+#define MAX_FRAME_FIELDS 128
+
+typedef struct {
+    char names[MAX_FRAME_FIELDS][64];
+    char types[MAX_FRAME_FIELDS][64];
+    int count;
+} Frame;
+
+static void handle_yield(const char* line) {
+    if (!g_in_function || g_func_count == 0) {
+        error("'yield' outside a function");
+        return;
+    }
+    Function* f = &g_funcs[g_func_count - 1];
+    if (f->ret != TYPE_INT && f->ret != TYPE_FLOAT && f->ret != TYPE_BOOL) {
+        error("A generator needs the type it yields: func name(...) -> int");
+        return;
+    }
+    for (int i = 0; i < g_block_depth; i++) {
+        if (strcmp(g_blocks[i].type, "match") == 0 || strcmp(g_blocks[i].type, "case") == 0) {
+            error("'yield' inside match is not supported");
+            return;
+        }
+    }
+    const char* expr = skip_spaces(line + 5);
+    if (!*expr) {
+        error("Missing value after 'yield'");
+        return;
+    }
+    char c_expr[MAX_LINE], emit_buf[MAX_LINE + 128];
+    rewrite_expr(expr, c_expr, sizeof(c_expr));
+    f->is_generator = true;
+    int state = ++f->yields;
+    snprintf(emit_buf, sizeof(emit_buf), "_g->_state = %d;\n_g->_value = %s;\nreturn true;\ncase %d:;\n",
+             state, c_expr, state);
+    emit_no_log(emit_buf);
+}
+
+/* Adds a frame field; a name declared twice must keep its type */
+static bool frame_add(Frame* fr, const char* name, const char* type, const char* func) {
+    for (int i = 0; i < fr->count; i++) {
+        if (strcmp(fr->names[i], name) != 0) continue;
+        if (strcmp(fr->types[i], type) == 0) return true;
+        char msg[512];
+        snprintf(msg, sizeof(msg), "'%s' is declared as both %s and %s in generator '%s'",
+                 name, fr->types[i], type, func);
+        error(msg);
+        return false;
+    }
+    if (fr->count >= MAX_FRAME_FIELDS) {
+        error("Too many locals in generator");
+        return false;
+    }
+    snprintf(fr->names[fr->count], 64, "%s", name);
+    snprintf(fr->types[fr->count++], 64, "%s", type);
+    return true;
+}
+
+/*
+ * Length of the type at the start of a C declaration ("const int ", "List ",
+ * "int* restrict ", "const unsigned char* "), or 0 when p is no declaration.
+ * The frame field type goes to 'type', without restrict or a top-level const.
+ */
+static size_t decl_type(const char* p, char* type, size_t type_size) {
+    static const char* types[] = {
+        "int", "float", "bool", "double", "char", "long", "unsigned", "size_t", "uint32_t", "uint64_t",
+        "int64_t", "List", "FList", "Dict", "Tuple", "IntSet", "StrSet", "Deque", "IntHeap", "FloatHeap",
+        "OrdMap", "OrdIter", "Hasher", "Rng", "TDigest", "Regex", "Lru", "Bloom", "CountMin",
+    };
+    const char* q = p;
+    bool is_const = starts_with(q, "const ");
+    if (is_const) q += 6;
+    const char* t = q;
+    size_t n = 0;
+    while (is_ident_char(t[n])) n++;
+    bool known = n > 4 && strncmp(t, "Gen_", 4) == 0;
+    for (size_t i = 0; i < sizeof(types) / sizeof(types[0]) && !known; i++) {
+        known = strlen(types[i]) == n && strncmp(t, types[i], n) == 0;
+    }
+    if (!known) return 0;
+    q = t + n;
+    if (n == 8 && strncmp(t, "unsigned", 8) == 0) {
+        q = skip_spaces(q);
+        while (is_ident_char(*q)) q++;
+    }
+    const char* base_end = q;
+    int stars = 0;
+    while (*q == ' ' || *q == '*') stars += *q++ == '*';
+    if (starts_with(q, "restrict ")) q += 9;
+    const char* name = q;
+    while (is_ident_char(*q)) q++;
+    if (q == name || isdigit((unsigned char)*name) || stars > 4) return 0;
+    q = skip_spaces(q);
+    if (!*q || !strchr("=;,", *q) || (q[0] == '=' && q[1] == '=')) return 0;
+    snprintf(type, type_size, "%s%.*s%.*s", is_const && stars ? "const " : "", (int)(base_end - t), t,
+             stars, "****");
+    return name - p;
+}
+
+/* Moves the declaration at p into the frame, copying what remains of it as assignments */
+static const char* hoist_decl(const char* p, const char* type, bool in_for, Frame* fr, const Function* f,
+                              char* out, size_t* o, size_t out_size) {
+    bool any = false;
+    for (;;) {
+        p = skip_spaces(p);
+        const char* name = p;
+        while (is_ident_char(*p)) p++;
+        char field[64];
+        snprintf(field, sizeof(field), "%.*s", (int)(p - name), name);
+        frame_add(fr, field, type, f->name);
+        p = skip_spaces(p);
+        if (*p == '=') {
+            // Initialiser up to the next ',' or ';' outside brackets
+            const char* init = skip_spaces(p + 1);
+            const char* e = init;
+            int depth = 0;
+            while (*e && !(depth == 0 && (*e == ',' || *e == ';'))) {
+                if (*e == '"' || *e == '\'') {
+                    e = skip_c_literal(e);
+                    continue;
+                }
+                if (*e == '(' || *e == '[' || *e == '{') depth++;
+                else if (*e == ')' || *e == ']' || *e == '}') depth--;
+                e++;
+            }
+            char assign[MAX_LINE];
+            const char* base = strncmp(type, "const ", 6) == 0 ? type + 6 : type;
+            snprintf(assign, sizeof(assign), "%s%s = %s%.*s", any ? ", " : "", field,
+                     *init == '{' ? "(" : "", (int)(e - init), init);
+            out_put(out, o, out_size, assign);
+            if (*init == '{') {
+                // Struct initialiser: a compound literal once it is an assignment
+                char* brace = strrchr(out, '=') + 2;
+                char lit[MAX_LINE];
+                snprintf(lit, sizeof(lit), "(%s)%s", base, brace + 1);
+                *o = brace - out;
+                out[*o] = '\0';
+                out_put(out, o, out_size, lit);
+            }
+            any = true;
+            p = e;
+        }
+        if (*p != ',') break;
+        p++;
+    }
+    if (*p == ';') {
+        if (any || in_for) out_put(out, o, out_size, ";");
+        p++;
+    }
+    return p;
+}
+
+/* Rewrites the compiled body of a generator into the resumable form */
+static void finish_generator(Function* f) {
+    Frame* fr = (Frame*)calloc(1, sizeof(Frame));
+    if (strcmp(f->params, "void") != 0) {
+        char params[1024];
+        snprintf(params, sizeof(params), "%s", f->params);
+        for (char* prm = strtok(params, ","); prm; prm = strtok(NULL, ",")) {
+            prm = trim(prm);
+            char* name = prm + strlen(prm);
+            while (name > prm && is_ident_char(name[-1])) name--;
+            char type[64];
+            snprintf(type, sizeof(type), "%.*s", (int)(name - prm), prm);
+            frame_add(fr, name, trim(type), f->name);
+        }
+    }
+
+    // Declarations become frame fields
+    size_t size = sizeof(f->body) * 2;
+    char* hoisted = (char*)malloc(size);
+    size_t o = 0;
+    hoisted[0] = '\0';
+    const char* p = f->body;
+    while (*p) {
+        const char* start = p;
+        while (*p == ' ') p++;
+        bool in_for = false;
+        for (;;) {
+            if (starts_with(p, "for (")) {
+                in_for = true;
+                p += 5;
+            } else if (starts_with(p, "{ ")) {
+                p += 2;
+            } else {
+                break;
+            }
+        }
+        char seg[MAX_LINE];
+        snprintf(seg, sizeof(seg), "%.*s", (int)(p - start), start);
+        out_put(hoisted, &o, size, seg);
+        char type[64];
+        size_t n = decl_type(p, type, sizeof(type));
+        if (n) p = hoist_decl(p + n, type, in_for, fr, f, hoisted, &o, size);
+        const char* nl = strchr(p, '\n');
+        size_t len = nl ? (size_t)(nl - p + 1) : strlen(p);
+        char* rest = (char*)malloc(len + 1);
+        memcpy(rest, p, len);
+        rest[len] = '\0';
+        out_put(hoisted, &o, size, rest);
+        free(rest);
+        p += len;
+    }
+
+    // Every use of a field goes through the frame; a bare return ends the generator
+    char* out = (char*)malloc(size);
+    size_t oo = 0;
+    out[0] = '\0';
+    out_put(out, &oo, size, "switch (_g->_state) {\ncase 0:;\n");
+    for (p = hoisted; *p; ) {
+        if (*p == '"' || *p == '\'') {
+            const char* end = skip_c_literal(p);
+            char lit[MAX_LINE];
+            snprintf(lit, sizeof(lit), "%.*s", (int)(end - p), p);
+            out_put(out, &oo, size, lit);
+            p = end;
+            continue;
+        }
+        if (!is_ident_char(*p) || (p > hoisted && (is_ident_char(p[-1]) || p[-1] == '.' || p[-1] == '>'))) {
+            char c[2] = { *p++, '\0' };
+            out_put(out, &oo, size, c);
+            continue;
+        }
+        const char* word = p;
+        while (is_ident_char(*p)) p++;
+        char name[256];
+        snprintf(name, sizeof(name), "%.*s", (int)(p - word), word);
+        if (strcmp(name, "return") == 0) {
+            if (starts_with(p, " true;\ncase ")) {
+                out_put(out, &oo, size, name);
+                continue;
+            }
+            if (*skip_spaces(p) != ';') {
+                char msg[512];
+                snprintf(msg, sizeof(msg), "Generator '%s' cannot return a value - use 'yield'", f->name);
+                error(msg);
+            }
+            out_put(out, &oo, size, "{ _g->_state = -1; return false; }");
+            p = strchr(p, ';') ? strchr(p, ';') + 1 : p;
+            continue;
+        }
+        bool field = false;
+        for (int i = 0; i < fr->count && !field; i++) field = strcmp(fr->names[i], name) == 0;
+        if (field) out_put(out, &oo, size, "_g->");
+        out_put(out, &oo, size, name);
+    }
+    out_put(out, &oo, size, "}\n_g->_state = -1;\nreturn false;\n");
+    if (oo + 1 >= sizeof(f->body)) {
+        error("Generator body too large");
+    } else {
+        memcpy(f->body, out, oo + 1);
+        f->body_len = (int)oo;
+    }
+
+    // The frame struct
+    size_t fo = 0, fsize = (size_t)fr->count * 140 + 1;
+    f->frame = (char*)malloc(fsize);
+    f->frame[0] = '\0';
+    for (int i = 0; i < fr->count; i++) {
+        char line[160];
+        snprintf(line, sizeof(line), "    %s %s;\n", fr->types[i], fr->names[i]);
+        out_put(f->frame, &fo, fsize, line);
+    }
+    free(hoisted);
+    free(out);
+    free(fr);
+}
+
+/* The generator function called by an iterable such as gen(10), or NULL */
+static const Function* generator_call(const char* iterable) {
+    char name[256];
+    int n = 0;
+    while (is_ident_char(iterable[n]) && n < 255) {
+        name[n] = iterable[n];
+        n++;
+    }
+    name[n] = '\0';
+    if (iterable[n] != '(') return NULL;
+    const Function* f = find_func(name);
+    return f && f->is_generator ? f : NULL;
+}
+
+/* for x in gen(args): pulls one value per iteration from a fresh frame */
+static void handle_generator_for(const char* line, const Function* f, const char* var, const char* iterable,
+                                 bool has_brace) {
+    char c_call[MAX_LINE], emit_buf[MAX_LINE * 2];
+    rewrite_expr(iterable, c_call, sizeof(c_call));
+    snprintf(emit_buf, sizeof(emit_buf),
+             "{ Gen_%s _%s_gen = %s;\n"
+             "while (%s__next(&_%s_gen)) {\n"
+             "    %s %s = _%s_gen._value;\n",
+             f->name, var, c_call,
+             f->name, var,
+             f->ret_c, var, var);
+    emit_no_log(emit_buf);
+    register_var(var, f->ret, false);
+    char condition[MAX_LINE];
+    snprintf(condition, sizeof(condition), "%s in %s", var, iterable);
+    push_block(get_indent(line), "for_in", condition, has_brace);
+    g_blocks[g_block_depth - 1].extra_braces = 1;
+}
+
+/* ============== Statement Handlers ============== */
+
+static void handle_variable_decl(char* line, bool is_const) {
+    char type_str[32], name[256], value[MAX_LINE] = {0};
+    char* p = line;
+    
+    if (is_const) {
+        p = trim_left(p + 5);
+    }
+    
+    bool is_sorted = false;
+    if (starts_with(p, "sorted ")) {
+        is_sorted = true;
+        p = trim_left(p + 7);
+    }
+    
+    VarType vt = TYPE_UNKNOWN;
+    VarType elem = TYPE_UNKNOWN;
+    char type_args[128] = {0};
+    bool is_max_heap = false;
+    
+    if (starts_with(p, "int ")) {
+        strcpy(type_str, "int");
+        vt = TYPE_INT;
+        p += 4;
+    } else if (starts_with(p, "float ")) {
+        strcpy(type_str, "float");
+        vt = TYPE_FLOAT;
+        p += 6;
+    } else if (starts_with(p, "bool ")) {
+        strcpy(type_str, "bool");
+        vt = TYPE_BOOL;
+        p += 5;
+    } else if (starts_with(p, "string ")) {
+        strcpy(type_str, "char*");
+        vt = TYPE_STRING;
+        p += 7;
+    } else if (starts_with(p, "list ") || starts_with(p, "list[")) {
+        vt = TYPE_LIST;
+        p += 4;
+        if (starts_with(p, "[int]")) {
+            p += 5;
+        } else if (starts_with(p, "[float]")) {
+            elem = TYPE_FLOAT;
+            p += 7;
+        } else if (*p == '[') {
+            error("Unknown list element type - expected list[int] or list[float]");
+            return;
+        }
+        strcpy(type_str, elem == TYPE_FLOAT ? "FList" : "List");
+    } else if (starts_with(p, "dict ")) {
+        strcpy(type_str, "Dict");
+        vt = TYPE_DICT;
+        p += 5;
+    } else if (starts_with(p, "tuple ")) {
+        strcpy(type_str, "Tuple");
+        vt = TYPE_TUPLE;
+        p += 6;
+    } else if (starts_with(p, "set ") || starts_with(p, "set[")) {
+        vt = TYPE_SET;
+        elem = TYPE_INT;
+        p += 3;
+        if (starts_with(p, "[int]")) {
+            p += 5;
+        } else if (starts_with(p, "[string]")) {
+            elem = TYPE_STRING;
+            p += 8;
+        } else if (*p == '[') {
+            error("Unknown set element type - expected set[int] or set[string]");
+            return;
+        }
+        strcpy(type_str, elem == TYPE_STRING ? "StrSet" : "IntSet");
+    } else if (starts_with(p, "deque ") || starts_with(p, "deque[")) {
+        strcpy(type_str, "Deque");
+        vt = TYPE_DEQUE;
+        p += 5;
+        if (*p == '[') {
+            // Fixed-capacity sliding window: deque[64] W
+            char* close = strchr(p, ']');
+            if (!close || close == p + 1) {
+                error("Malformed deque capacity - expected deque[N]");
+                return;
+            }
+            snprintf(type_args, sizeof(type_args), "%.*s", (int)(close - p - 1), p + 1);
+            p = close + 1;
+        }
+    } else if (starts_with(p, "heap ") || starts_with(p, "heap[")) {
+        // heap, heap[max], heap[float], heap[max, float]
+        vt = TYPE_HEAP;
+        elem = TYPE_INT;
+        p += 4;
+        if (*p == '[') {
+            char* close = strchr(p, ']');
+            if (!close) {
+                error("Missing ']' in heap declaration");
+                return;
+            }
+            char opts[256];
+            snprintf(opts, sizeof(opts), "%.*s", (int)(close - p - 1), p + 1);
+            for (char* opt = strtok(opts, ","); opt; opt = strtok(NULL, ",")) {
+                opt = trim(opt);
+                if (strcmp(opt, "max") == 0) is_max_heap = true;
+                else if (strcmp(opt, "float") == 0) elem = TYPE_FLOAT;
+                else if (strcmp(opt, "min") != 0 && strcmp(opt, "int") != 0) {
+                    error("Unknown heap option - expected min, max, int or float");
+                }
+            }
+            p = close + 1;
+        }
+        strcpy(type_str, elem == TYPE_FLOAT ? "FloatHeap" : "IntHeap");
+    } else if (starts_with(p, "ordmap ")) {
+        strcpy(type_str, "OrdMap");
+        vt = TYPE_ORDMAP;
+        p += 7;
+    } else if (starts_with(p, "hasher ")) {
+        strcpy(type_str, "Hasher");
+        vt = TYPE_HASHER;
+        p += 7;
+    } else if (starts_with(p, "rng ") || starts_with(p, "rng[")) {
+        // rng R (own stream), rng[seed] R (reproducible)
+        strcpy(type_str, "Rng");
+        vt = TYPE_RNG;
+        p += 3;
+        if (*p == '[') {
+            char* close = strchr(p, ']');
+            if (!close || close == p + 1) {
+                error("Malformed rng seed - expected rng[seed]");
+                return;
+            }
+            snprintf(type_args, sizeof(type_args), "%.*s", (int)(close - p - 1), p + 1);
+            p = close + 1;
+        }
+    } else if (starts_with(p, "tdigest ")) {
+        strcpy(type_str, "TDigest");
+        vt = TYPE_TDIGEST;
+        p += 8;
+    } else if (starts_with(p, "regex ")) {
+        strcpy(type_str, "Regex");
+        vt = TYPE_REGEX;
+        p += 6;
+    } else if (starts_with(p, "lru[")) {
+        // Bounded cache: lru[256] C
+        strcpy(type_str, "Lru");
+        vt = TYPE_LRU;
+        p += 3;
+        char* close = strchr(p, ']');
+        if (!close || close == p + 1) {
+            error("Malformed lru capacity - expected lru[N]");
+            return;
+        }
+        snprintf(type_args, sizeof(type_args), "%.*s", (int)(close - p - 1), p + 1);
+        p = close + 1;
+    } else if (starts_with(p, "bloom ") || starts_with(p, "bloom[") ||
+               starts_with(p, "cms ") || starts_with(p, "cms[")) {
+        // bloom[items, fp_rate] B, cms[width, depth] C
+        bool is_bloom = starts_with(p, "bloom");
+        strcpy(type_str, is_bloom ? "Bloom" : "CountMin");
+        vt = is_bloom ? TYPE_BLOOM : TYPE_CMS;
+        p += is_bloom ? 5 : 3;
+        if (*p == '[') {
+            char* close = strchr(p, ']');
+            if (!close || close == p + 1) {
+                error(is_bloom ? "Malformed bloom size - expected bloom[items] or bloom[items, fp_rate]"
+                               : "Malformed cms size - expected cms[width, depth]");
+                return;
+            }
+            snprintf(type_args, sizeof(type_args), "%.*s", (int)(close - p - 1), p + 1);
+            p = close + 1;
+        }
+    } else {
+        error("Unknown type in variable declaration");
+        return;
+    }
+    
+    p = trim_left(p);
+    
+    int i = 0;
+    while (*p && (isalnum(*p) || *p == '_')) {
+        name[i++] = *p++;
+    }
+    name[i] = '\0';
+    
+    if (strlen(name) == 0) {
+        error("Missing variable name in declaration");
+        return;
+    }
+    
+    p = trim_left(p);
+    
+    register_var(name, vt, is_const);
+    if (elem != TYPE_UNKNOWN) {
+        set_var_elem_type(name, elem);
+    }
+    if (is_sorted) {
+        if (vt == TYPE_LIST) {
+            set_var_sorted(name);
+        } else {
+            warning("'sorted' only applies to lists - ignored");
+        }
+    }
+    
+    char emit_buf[MAX_LINE * 2];
+    
+    if (*p == '=') {
+        p++;
+        p = trim_left(p);
+        if (strlen(p) == 0) {
+            error("Missing value after '=' in variable declaration");
+            strcpy(value, "0");
+        } else {
+            strncpy(value, p, MAX_LINE - 1);
+            replace_time_funcs(value);
+        }
+        
+        if (is_const && fold_const_decl(name, vt, elem, value)) {
+            log_var_decl(name, vt, is_const, value);
+            return;
+        }
+        if (vt == TYPE_LIST && is_pipeline(value)) {
+            emit_pipeline_list(name, elem, value);
+            log_var_decl(name, vt, is_const, value);
+            return;
+        }
+        if (starts_with(value, "reduce(")) {
+            emit_reduce(name, vt, value, true);
+            log_var_decl(name, vt, is_const, value);
+            return;
+        }
+        if (vt == TYPE_LIST) note_list_copy(name, trim(value));
+        
+        char c_value[MAX_LINE];
+        if (vt == TYPE_SET && value[0] == '{') {
+            // Set literal: {1, 2, 3} -> iset_of(3, 1, 2, 3)
+            char items[MAX_LINE];
+            strncpy(items, value + 1, MAX_LINE - 1);
+            items[MAX_LINE - 1] = '\0';
+            char* close = strrchr(items, '}');
+            if (close) *close = '\0';
+            char* body = trim(items);
+            int count = 0;
+            if (*body) {
+                count = 1;
+                bool in_str = false;
+                for (char* c = body; *c; c++) {
+                    if (*c == '"' && (c == body || *(c - 1) != '\\')) in_str = !in_str;
+                    else if (*c == ',' && !in_str) count++;
+                }
+            }
+            char rewritten[MAX_LINE];
+            rewrite_expr(body, rewritten, sizeof(rewritten));
+            snprintf(c_value, sizeof(c_value), "%s(%d%s%s)",
+                     elem == TYPE_STRING ? "sset_of" : "iset_of",
+                     count, count > 0 ? ", " : "", rewritten);
+        } else {
+            rewrite_expr(value, c_value, sizeof(c_value));
+        }
+        
+        snprintf(emit_buf, sizeof(emit_buf), "%s%s %s = %s;\n",
+                 is_const ? "const " : "", type_str, name, c_value);
+    } else {
+        const char* def_val = "";
+        if (vt == TYPE_INT) def_val = "0";
+        else if (vt == TYPE_STRING) def_val = "NULL";
+        else if (vt == TYPE_LIST) def_val = elem == TYPE_FLOAT ? "new_flist()" : "new_list()";
+        else if (vt == TYPE_DICT) def_val = "new_dict()";
+        else if (vt == TYPE_TUPLE) def_val = "new_tuple()";
+        else if (vt == TYPE_SET) def_val = elem == TYPE_STRING ? "new_sset()" : "new_iset()";
+        else if (vt == TYPE_DEQUE) def_val = "new_deque()";
+        else if (vt == TYPE_ORDMAP) def_val = "new_ordmap()";
+        else if (vt == TYPE_BLOOM) def_val = "new_bloom(1000000, 0.01)";
+        else if (vt == TYPE_CMS) def_val = "new_cms(4096, 5)";
+        else if (vt == TYPE_HASHER) def_val = "new_hasher()";
+        else if (vt == TYPE_RNG) def_val = "new_rng_stream()";
+        else if (vt == TYPE_TDIGEST) def_val = "new_tdigest()";
+        else if (vt == TYPE_REGEX) {
+            error("regex declaration needs a pattern - expected regex R = re\"...\"");
+            return;
+        }
+        else if (vt == TYPE_HEAP) {
+            if (elem == TYPE_FLOAT) def_val = is_max_heap ? "new_fheap(true)" : "new_fheap(false)";
+            else def_val = is_max_heap ? "new_iheap(true)" : "new_iheap(false)";
+        }
+        
+        char fixed_val[256];
+        if (type_args[0] && vt == TYPE_DEQUE) {
+            snprintf(fixed_val, sizeof(fixed_val), "new_deque_fixed(%s)", type_args);
+            def_val = fixed_val;
+        } else if (type_args[0] && vt == TYPE_RNG) {
+            snprintf(fixed_val, sizeof(fixed_val), "new_rng((uint64_t)(%s))", type_args);
+            def_val = fixed_val;
+        } else if (vt == TYPE_LRU) {
+            snprintf(fixed_val, sizeof(fixed_val), "new_lru(%s)", type_args);
+            def_val = fixed_val;
+        } else if (type_args[0] && vt == TYPE_BLOOM) {
+            snprintf(fixed_val, sizeof(fixed_val), "new_bloom(%s%s)", type_args,
+                     strchr(type_args, ',') ? "" : ", 0.01");
+            def_val = fixed_val;
+        } else if (type_args[0] && vt == TYPE_CMS) {
+            snprintf(fixed_val, sizeof(fixed_val), "new_cms(%s%s)", type_args,
+                     strchr(type_args, ',') ? "" : ", 5");
+            def_val = fixed_val;
+        }
+        
+        strcpy(value, def_val);
+        
+        if (strlen(def_val) > 0) {
+            snprintf(emit_buf, sizeof(emit_buf), "%s%s %s = %s;\n",
+                     is_const ? "const " : "", type_str, name, def_val);
+        } else {
+            snprintf(emit_buf, sizeof(emit_buf), "%s%s %s;\n",
+                     is_const ? "const " : "", type_str, name);
+        }
+    }
+    
+    log_var_decl(name, vt, is_const, value);
+    emit_no_log(emit_buf);
+}
+
+static void handle_print(char* line) {
+    char* start = strchr(line, '(');
+    if (!start) {
+        error("Missing '(' in print statement");
+        return;
+    }
+    start++;
+    
+    char* end = strrchr(line, ')');
+    if (!end) {
+        error("Missing ')' in print statement");
+        return;
+    }
+    
+    char expr[MAX_LINE];
+    int len = end - start;
+    strncpy(expr, start, len);
+    expr[len] = '\0';
+    trim(expr);
+    
+    if (strlen(expr) == 0) {
+        error("Empty print statement");
+        return;
+    }
+    
+    replace_time_funcs(expr);
+    
+    VarType type = infer_expr_type(expr);
+    log_print(expr, type);
+    
+    char a_expr[MAX_LINE];
+    strcpy(a_expr, expr);
+    rewrite_expr(a_expr, expr, sizeof(expr));
+    
+    char emit_buf[MAX_LINE * 2];
+    
+    switch (type) {
+        case TYPE_STRING:
+            snprintf(emit_buf, sizeof(emit_buf), "printf(\"%%s\\n\", %s);\n", expr);
+            break;
+        case TYPE_BOOL:
+            snprintf(emit_buf, sizeof(emit_buf), 
+                     "printf(\"%%s\\n\", (%s) ? \"true\" : \"false\");\n", expr);
+            break;
+        case TYPE_FLOAT:
+            snprintf(emit_buf, sizeof(emit_buf), "printf(\"%%f\\n\", %s);\n", expr);
+            break;
+        case TYPE_LIST:
+        case TYPE_TUPLE:
+        case TYPE_SET:
+        case TYPE_DEQUE:
+        case TYPE_HEAP:
+        case TYPE_ORDMAP:
+        case TYPE_LRU:
+        case TYPE_RNG:
+        case TYPE_TDIGEST:
+        case TYPE_REGEX:
+        case TYPE_BLOOM:
+        case TYPE_CMS: {
+            VarType elem = infer_expr_elem_type(a_expr);
+            const char* print_fn = "print_list";
+            if (type == TYPE_LIST && elem == TYPE_FLOAT) print_fn = "print_flist";
+            else if (type == TYPE_TUPLE) print_fn = "print_tuple";
+            else if (type == TYPE_SET) print_fn = elem == TYPE_STRING ? "print_sset" : "print_iset";
+            else if (type == TYPE_DEQUE) print_fn = "print_deque";
+            else if (type == TYPE_HEAP) print_fn = elem == TYPE_FLOAT ? "print_fheap" : "print_iheap";
+            else if (type == TYPE_ORDMAP) print_fn = "print_ordmap";
+            else if (type == TYPE_LRU) print_fn = "print_lru";
+            else if (type == TYPE_RNG) print_fn = "print_rng";
+            else if (type == TYPE_TDIGEST) print_fn = "print_tdigest";
+            else if (type == TYPE_REGEX) print_fn = "print_regex";
+            else if (type == TYPE_BLOOM) print_fn = "print_bloom";
+            else if (type == TYPE_CMS) print_fn = "print_cms";
+            
+            if (get_var_type(a_expr) != TYPE_UNKNOWN) {
+                snprintf(emit_buf, sizeof(emit_buf), "%s(&%s);\n", print_fn, expr);
+            } else {
+                // Temporary container, e.g. print(topk(L, 5))
+                snprintf(emit_buf, sizeof(emit_buf),
+                         "{ __auto_type _print_tmp = %s; %s(&_print_tmp); }\n", expr, print_fn);
+            }
+            break;
+        }
+        default:
+            snprintf(emit_buf, sizeof(emit_buf), "print_int(%s);\n", expr);
+            break;
+    }
+    
+    emit_no_log(emit_buf);
+}
+
+static void handle_if(char* line, bool has_brace) {
+    char* p = trim_left(line);
+    p += 2;
+    p = trim_left(p);
+    
+    if (has_brace) {
+        strip_trailing_brace(p);
+    }
+    
+    char* colon = strrchr(p, ':');
+    if (colon) {
+        *colon = '\0';
+    }
+    
+    p = trim(p);
+    int hint = branch_hint((const char**)&p);
+    
+    if (strlen(p) == 0) {
+        error("Missing condition in if statement");
+        p = "1";
+    }
+    
+    char condition[MAX_LINE];
+    strncpy(condition, p, MAX_LINE - 1);
+    replace_time_funcs(p);
+    
+    char a_cond[MAX_LINE];
+    strncpy(a_cond, p, MAX_LINE - 1);
+    a_cond[MAX_LINE - 1] = '\0';
+    lower_membership(a_cond, sizeof(a_cond));
+    
+    char c_cond[MAX_LINE];
+    rewrite_expr(a_cond, c_cond, sizeof(c_cond));
+    
+    char emit_buf[MAX_LINE + 48];
+    if (hint >= 0) {
+        snprintf(emit_buf, sizeof(emit_buf), "if (__builtin_expect(!!(%s), %d)) {\n", c_cond, hint);
+    } else {
+        snprintf(emit_buf, sizeof(emit_buf), "if (%s) {\n", c_cond);
+    }
+    emit_no_log(emit_buf);
+    
+    push_block(get_indent(line), "if", condition, has_brace);
+}
+
+static void handle_elif(char* line, bool has_brace) {
+    if (g_block_depth == 0 || 
+        (strcmp(g_blocks[g_block_depth - 1].type, "if") != 0 &&
+         strcmp(g_blocks[g_block_depth - 1].type, "elif") != 0)) {
+        error("'elif' without matching 'if'");
+    }
+    
+    char* p = trim_left(line);
+    p += 4;
+    p = trim_left(p);
+    
+    if (has_brace) {
+        strip_trailing_brace(p);
+    }
+    
+    char* colon = strrchr(p, ':');
+    if (colon) {
+        *colon = '\0';
+    }
+    
+    p = trim(p);
+    int hint = branch_hint((const char**)&p);
+    
+    if (strlen(p) == 0) {
+        error("Missing condition in elif statement");
+        p = "1";
+    }
+    
+    char condition[MAX_LINE];
+    strncpy(condition, p, MAX_LINE - 1);
+    replace_time_funcs(p);
+    
+    if (g_log_mode == LOG_HUMAN) {
+        fprintf(stderr, "\033[33m[BLOCK CHAIN]\033[0m Line %d: Continuing if-chain with 'elif' condition: %s\n",
+                g_current_line, condition);
+    } else if (g_log_mode == LOG_MACHINE) {
+        fprintf(stderr, "BLOCK_CHAIN:%d:elif:%s\n", g_current_line, condition);
+    }
+    
+    char a_cond[MAX_LINE];
+    strncpy(a_cond, p, MAX_LINE - 1);
+    a_cond[MAX_LINE - 1] = '\0';
+    lower_membership(a_cond, sizeof(a_cond));
+    
+    char c_cond[MAX_LINE];
+    rewrite_expr(a_cond, c_cond, sizeof(c_cond));
+    
+    char emit_buf[MAX_LINE + 48];
+    if (hint >= 0) {
+        snprintf(emit_buf, sizeof(emit_buf), "} else if (__builtin_expect(!!(%s), %d)) {\n", c_cond, hint);
+    } else {
+        snprintf(emit_buf, sizeof(emit_buf), "} else if (%s) {\n", c_cond);
+    }
+    emit_no_log(emit_buf);
+    
+    if (g_block_depth > 0) {
+        strcpy(g_blocks[g_block_depth - 1].type, "elif");
+        g_blocks[g_block_depth - 1].uses_braces = has_brace;
+    }
+}
+
+static void handle_else(char* line, bool has_brace) {
+    (void)line;
+    
+    if (g_block_depth == 0 || 
+        (strcmp(g_blocks[g_block_depth - 1].type, "if") != 0 &&
+         strcmp(g_blocks[g_block_depth - 1].type, "elif") != 0)) {
+        error("'else' without matching 'if' or 'elif'");
+    }
+    
+    if (g_log_mode == LOG_HUMAN) {
+        fprintf(stderr, "\033[33m[BLOCK CHAIN]\033[0m Line %d: Continuing if-chain with 'else'\n",
+                g_current_line);
+    } else if (g_log_mode == LOG_MACHINE) {
+        fprintf(stderr, "BLOCK_CHAIN:%d:else\n", g_current_line);
+    }
+    
+    emit_no_log("} else {\n");
+    
+    if (g_block_depth > 0) {
+        strcpy(g_blocks[g_block_depth - 1].type, "else");
+        g_blocks[g_block_depth - 1].uses_braces = has_brace;
+    }
+}
+
+static void handle_while(char* line, bool has_brace) {
+    char* p = trim_left(line);
+    p += 5;
+    p = trim_left(p);
+    
+    if (has_brace) {
+        strip_trailing_brace(p);
+    }
+    
+    char* colon = strrchr(p, ':');
+    if (colon) {
+        *colon = '\0';
+    }
+    
+    p = trim(p);
+    
+    if (strlen(p) == 0) {
+        error("Missing condition in while statement");
+        p = "0";
+    }
+    
+    char condition[MAX_LINE];
+    strncpy(condition, p, MAX_LINE - 1);
+    replace_time_funcs(p);
+    
+    char a_cond[MAX_LINE];
+    strncpy(a_cond, p, MAX_LINE - 1);
+    a_cond[MAX_LINE - 1] = '\0';
+    lower_membership(a_cond, sizeof(a_cond));
+    
+    char c_cond[MAX_LINE];
+    rewrite_expr(a_cond, c_cond, sizeof(c_cond));
+    
+    char emit_buf[MAX_LINE + 16];
+    snprintf(emit_buf, sizeof(emit_buf), "while (%s) {\n", c_cond);
+    emit_no_log(emit_buf);
+    
+    push_block(get_indent(line), "while", condition, has_brace);
+}
+
+/*
+ * match x:            int subjects become a C switch (gcc emits a jump table for
+ *     case 1, 2:      dense labels and a balanced compare tree for sparse ones)
+ *         ...
+ *     case _:         default
+ *
+ * String subjects are dispatched by a trie built here from the case strings:
+ * switch on the length, then on the bytes that tell the remaining strings apart,
+ * then one memcmp. Since all case labels must be known first, the dispatch code
+ * is inserted at the top of the match when it closes.
+ */
+
+#define MAX_MATCH_DEPTH 16
+#define MAX_MATCH_LABELS 256
+
+typedef struct {
+    char text[128];     /* label as written (C literal for strings) */
+    char bytes[128];    /* string labels: decoded bytes */
+    int len;
+    int target;         /* case index the label selects */
+} MatchLabel;
+
+typedef struct {
+    int id;
+    bool is_string;
+    bool has_default;
+    bool uses_break;    /* a 'break' in a case must leave the enclosing loop */
+    int case_count;
+    MatchLabel labels[MAX_MATCH_LABELS];
+    int label_count;
+    int insert_at;      /* offset in the emit buffer for the dispatch prologue */
+} MatchState;
+
+static MatchState g_matches[MAX_MATCH_DEPTH];
+static int g_match_depth = 0;
+static int g_match_id = 0;
+
+/* Buffer emit() currently writes to */
+static char* emit_buffer(int** len, int* cap) {
+    if (g_in_function && g_func_count > 0) {
+        Function* f = &g_funcs[g_func_count - 1];
+        *len = &f->body_len;
+        *cap = (int)sizeof(f->body);
+        return f->body;
+    }
+    *len = &g_main_len;
+    *cap = (int)sizeof(g_main_code);
+    return g_main_code;
+}
+
+static void insert_emitted(int at, const char* str) {
+    int* len;
+    int cap;
+    char* buf = emit_buffer(&len, &cap);
+    int n = strlen(str);
+    if (*len + n >= cap - 1) {
+        error("Generated code too large for match dispatch");
+        return;
+    }
+    memmove(buf + at + n, buf + at, *len - at + 1);
+    memcpy(buf + at, str, n);
+    *len += n;
+}
+
+/* Decodes a C string literal ("..." with escapes) into bytes; returns length or -1 */
+static int decode_string_literal(const char* lit, char* out, int out_size) {
+    const char* p = lit;
+    if (*p++ != '"') return -1;
+    int n = 0;
+    while (*p && *p != '"') {
+        int c = (unsigned char)*p++;
+        if (c == '\\') {
+            char e = *p++;
+            if (e == 'n') c = '\n';
+            else if (e == 't') c = '\t';
+            else if (e == 'r') c = '\r';
+            else if (e == '\\' || e == '"' || e == '\'') c = e;
+            else if (e == 'x' && isxdigit((unsigned char)p[0])) {
+                c = 0;
+                while (isxdigit((unsigned char)*p)) {
+                    c = c * 16 + (isdigit((unsigned char)*p) ? *p - '0' : (tolower((unsigned char)*p) - 'a' + 10));
+                    p++;
+                }
+            } else return -1;
+        }
+        if (c == 0 || n >= out_size) return -1;
+        out[n++] = (char)c;
+    }
+    if (*p != '"' || *skip_spaces(p + 1)) return -1;
+    return n;
+}
+
+/* Emits dispatch for labels idx[0..n) of equal length: switch on the byte
+   position that splits them most, recursing until one candidate is left */
+static void emit_string_trie(const MatchState* m, const int* idx, int n, int len,
+                             bool* used, char* out, size_t out_size) {
+    char buf[512];
+    size_t o = strlen(out);
+    if (n == 1) {
+        const MatchLabel* l = &m->labels[idx[0]];
+        if (len == 0) {
+            snprintf(buf, sizeof(buf), "_match_%d_case = %d;\n", m->id, l->target);
+        } else {
+            snprintf(buf, sizeof(buf), "if (memcmp(_match_%d_s, %s, %d) == 0) _match_%d_case = %d;\n",
+                     m->id, l->text, len, m->id, l->target);
+        }
+        out_put(out, &o, out_size, buf);
+        return;
+    }
+    int best = -1, best_distinct = 0;
+    for (int pos = 0; pos < len; pos++) {
+        if (used[pos]) continue;
+        bool seen[256] = {false};
+        int distinct = 0;
+        for (int i = 0; i < n; i++) {
+            unsigned char c = (unsigned char)m->labels[idx[i]].bytes[pos];
+            if (!seen[c]) {
+                seen[c] = true;
+                distinct++;
+            }
+        }
+        if (distinct > best_distinct) {
+            best_distinct = distinct;
+            best = pos;
+        }
+    }
+    used[best] = true;
+    snprintf(buf, sizeof(buf), "switch ((unsigned char)_match_%d_s[%d]) {\n", m->id, best);
+    out_put(out, &o, out_size, buf);
+    bool done[MAX_MATCH_LABELS] = {false};
+    for (int i = 0; i < n; i++) {
+        if (done[i]) continue;
+        unsigned char c = (unsigned char)m->labels[idx[i]].bytes[best];
+        int sub[MAX_MATCH_LABELS];
+        int k = 0;
+        for (int j = i; j < n; j++) {
+            if (!done[j] && (unsigned char)m->labels[idx[j]].bytes[best] == c) {
+                sub[k++] = idx[j];
+                done[j] = true;
+            }
+        }
+        snprintf(buf, sizeof(buf), "case %d:\n", c);
+        out_put(out, &o, out_size, buf);
+        emit_string_trie(m, sub, k, len, used, out, out_size);
+        o = strlen(out);
+        out_put(out, &o, out_size, "break;\n");
+    }
+    out_put(out, &o, out_size, "}\n");
+    used[best] = false;
+}
+
+/* Lowers 'break': inside a case it sets the match's flag so the loop is left after the switch */
+static void emit_break(void) {
+    for (int i = g_block_depth - 1; i >= 0; i--) {
+        const char* type = g_blocks[i].type;
+        if (strcmp(type, "case") == 0 && g_match_depth > 0) {
+            MatchState* m = &g_matches[g_match_depth - 1];
+            m->uses_break = true;
+            char buf[128];
+            snprintf(buf, sizeof(buf), "{ _match_%d_break = true; break; }\n", m->id);
+            emit_no_log(buf);
+            return;
+        }
+        if (strcmp(type, "parallel") == 0) {
+            error("'break' cannot leave a parallel for");
+            return;
+        }
+        if (strcmp(type, "for") == 0 || strcmp(type, "while") == 0 || strcmp(type, "func") == 0) {
+            break;
+        }
+    }
+    emit_no_log("break;\n");
+}
+
+static void handle_match(char* line, bool has_brace) {
+    char* p = trim_left(line);
+    p += 5;
+    p = trim_left(p);
+    
+    if (has_brace) {
+        strip_trailing_brace(p);
+    }
+    
+    char* colon = strrchr(p, ':');
+    if (colon) {
+        *colon = '\0';
+    }
+    
+    p = trim(p);
+    
+    if (strlen(p) == 0) {
+        error("Missing subject in match statement");
+        p = "0";
+    }
+    if (g_match_depth >= MAX_MATCH_DEPTH) {
+        error("Maximum match nesting depth exceeded");
+        return;
+    }
+    
+    char subject[MAX_LINE];
+    strncpy(subject, p, MAX_LINE - 1);
+    subject[MAX_LINE - 1] = '\0';
+    replace_time_funcs(p);
+    VarType type = infer_expr_type(p);
+    if (type != TYPE_INT && type != TYPE_BOOL && type != TYPE_STRING) {
+        error("match needs an int or string subject");
+    }
+    
+    char c_subject[MAX_LINE];
+    rewrite_expr(p, c_subject, sizeof(c_subject));
+    
+    MatchState* m = &g_matches[g_match_depth++];
+    m->id = g_match_id++;
+    m->has_default = false;
+    m->uses_break = false;
+    m->case_count = 0;
+    m->label_count = 0;
+    m->is_string = type == TYPE_STRING;
+    
+    char emit_buf[MAX_LINE + 128];
+    emit_no_log("{\n");
+    if (m->is_string) {
+        snprintf(emit_buf, sizeof(emit_buf), "const char* _match_%d_s = %s;\nint _match_%d_case = -1;\n",
+                 m->id, c_subject, m->id);
+        emit_no_log(emit_buf);
+    }
+    int* len;
+    int cap;
+    emit_buffer(&len, &cap);
+    m->insert_at = *len;
+    if (m->is_string) {
+        snprintf(emit_buf, sizeof(emit_buf), "switch (_match_%d_case) {\n", m->id);
+    } else {
+        snprintf(emit_buf, sizeof(emit_buf), "switch (%s) {\n", c_subject);
+    }
+    emit_no_log(emit_buf);
+    
+    push_block(get_indent(line), "match", subject, has_brace);
+}
+
+static void handle_case(char* line) {
+    if (g_block_depth == 0 || g_match_depth == 0 ||
+        (strcmp(g_blocks[g_block_depth - 1].type, "match") != 0 &&
+         strcmp(g_blocks[g_block_depth - 1].type, "case") != 0)) {
+        error("'case' outside of 'match'");
+        return;
+    }
+    MatchState* m = &g_matches[g_match_depth - 1];
+    
+    char labels[MAX_LINE];
+    strncpy(labels, trim_left(line) + 4, MAX_LINE - 1);
+    labels[MAX_LINE - 1] = '\0';
+    char* colon = strrchr(labels, ':');
+    if (!colon) {
+        error("Missing ':' after case labels");
+    } else {
+        *colon = '\0';
+    }
+    char* p = trim(labels);
+    if (!*p) {
+        error("Missing value in case");
+        return;
+    }
+    
+    log_statement("case", p);
+    if (strcmp(g_blocks[g_block_depth - 1].type, "case") == 0) {
+        emit_no_log("break;\n}\n");
+    }
+    strcpy(g_blocks[g_block_depth - 1].type, "case");
+    
+    if (strcmp(p, "_") == 0) {
+        if (m->has_default) error("Duplicate 'case _' in match");
+        m->has_default = true;
+        emit_no_log("default: {\n");
+        return;
+    }
+    
+    // Split on top-level commas: case 1, 2, 3 / case "a", "b"
+    char emit_buf[MAX_LINE * 2] = "";
+    size_t o = 0;
+    char* label = p;
+    int depth = 0;
+    bool in_str = false;
+    for (char* c = p; ; c++) {
+        if (*c == '"' && (c == p || c[-1] != '\\')) in_str = !in_str;
+        if (!in_str && (*c == '(' || *c == '[')) depth++;
+        if (!in_str && (*c == ')' || *c == ']')) depth--;
+        if (*c && (in_str || depth > 0 || *c != ',')) continue;
+        
+        bool last = *c == '\0';
+        *c = '\0';
+        label = trim(label);
+        if (m->label_count >= MAX_MATCH_LABELS || strlen(label) >= sizeof(m->labels[0].text)) {
+            error("Too many or too long case labels in match");
+            return;
+        }
+        MatchLabel* l = &m->labels[m->label_count];
+        snprintf(l->text, sizeof(l->text), "%s", label);
+        l->target = m->case_count;
+        if (m->is_string) {
+            l->len = decode_string_literal(label, l->bytes, sizeof(l->bytes));
+            if (l->len < 0) {
+                error("case label for a string match must be a string literal");
+                return;
+            }
+        }
+        for (int i = 0; i < m->label_count; i++) {
+            const MatchLabel* prev = &m->labels[i];
+            bool same = m->is_string ? (prev->len == l->len && memcmp(prev->bytes, l->bytes, l->len) == 0)
+                                     : strcmp(prev->text, l->text) == 0;
+            if (same) {
+                char msg[256];
+                snprintf(msg, sizeof(msg), "Duplicate case label %s", label);
+                error(msg);
+            }
+        }
+        m->label_count++;
+        
+        if (!m->is_string) {
+            char c_label[MAX_LINE];
+            rewrite_expr(label, c_label, sizeof(c_label));
+            out_put(emit_buf, &o, sizeof(emit_buf), "case ");
+            out_put(emit_buf, &o, sizeof(emit_buf), c_label);
+            out_put(emit_buf, &o, sizeof(emit_buf), ": ");
+        }
+        if (last) break;
+        label = c + 1;
+    }
+    
+    if (m->is_string) {
+        snprintf(emit_buf, sizeof(emit_buf), "case %d: ", m->case_count);
+        o = strlen(emit_buf);
+    }
+    m->case_count++;
+    out_put(emit_buf, &o, sizeof(emit_buf), "{\n");
+    emit_no_log(emit_buf);
+}
+
+/* Called from close_block for the match block: ends the switch and fills in the prologue */
+static void finish_match(bool case_open) {
+    if (g_match_depth == 0) return;
+    MatchState* m = &g_matches[--g_match_depth];
+    
+    if (case_open) emit_no_log("break;\n}\n");
+    emit_no_log("}\n");
+    if (m->uses_break) {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "if (_match_%d_break) ", m->id);
+        emit_no_log(buf);
+        emit_break();
+    }
+    emit_no_log("}\n");
+    
+    static char prologue[65536];
+    prologue[0] = '\0';
+    size_t o = 0;
+    char buf[128];
+    if (m->uses_break) {
+        snprintf(buf, sizeof(buf), "bool _match_%d_break = false;\n", m->id);
+        out_put(prologue, &o, sizeof(prologue), buf);
+    }
+    if (m->is_string && m->label_count > 0) {
+        int max_len = 0;
+        for (int i = 0; i < m->label_count; i++) {
+            if (m->labels[i].len > max_len) max_len = m->labels[i].len;
+        }
+        // Subjects longer than every label never match, so their length is not needed
+        snprintf(buf, sizeof(buf), "switch (strnlen(_match_%d_s, %d)) {\n", m->id, max_len + 1);
+        out_put(prologue, &o, sizeof(prologue), buf);
+        for (int len = 0; len <= max_len; len++) {
+            int idx[MAX_MATCH_LABELS];
+            int n = 0;
+            for (int i = 0; i < m->label_count; i++) {
+                if (m->labels[i].len == len) idx[n++] = i;
+            }
+            if (n == 0) continue;
+            snprintf(buf, sizeof(buf), "case %d:\n", len);
+            out_put(prologue, &o, sizeof(prologue), buf);
+            bool used[128] = {false};
+            emit_string_trie(m, idx, n, len, used, prologue, sizeof(prologue));
+            o = strlen(prologue);
+            out_put(prologue, &o, sizeof(prologue), "break;\n");
+        }
+        out_put(prologue, &o, sizeof(prologue), "}\n");
+    }
+    if (o > 0) insert_emitted(m->insert_at, prologue);
+}
+
+/*
+ * Loop optimisation. When a for loop closes its body has been emitted, so the
+ * header can be rewritten with what the body is now known not to change:
+ *
+ *   for i = 0 to list_len(L) - 1:     the bound (and a computed step) is
+ *                                     evaluated once into a local
+ *   for x in L:                       L.size and L.data are read once
+ *   ... L[i], M[j] ...                data pointers of lists the body indexes
+ *                                     are cached in restrict locals
+ *
+ * gcc cannot do this itself once a list's address has escaped (every append
+ * passes one), and the plain counted loops over restrict pointers it gets
+ * instead are ones it vectorises. A value is only hoisted when the body does
+ * not assign it or pass it by address. Common subexpressions, dead stores and
+ * induction-variable strength reduction are left to gcc, which handles them
+ * once the loads are out of the way.
+ */
+
+#define LOOP_EXPR_MAX 512
+
+typedef struct {
+    bool active;
+    int header_at;                  /* offset of the loop header in the emit buffer */
+    int body_at;                    /* offset just past it */
+    char var[64];
+    char start[LOOP_EXPR_MAX];      /* range loops, C text */
+    char end[LOOP_EXPR_MAX];
+    char step[LOOP_EXPR_MAX];       /* empty: ++ */
+    char list[256];                 /* for x in L over a list */
+    bool is_float;
+    bool simd;                      /* simd for: vectorise, report what prevents it */
+    int unroll;                     /* unroll(N) for */
+} LoopInfo;
+
+static LoopInfo g_loops[MAX_BLOCKS];
+
+/* Remembers the header just emitted for the innermost block, a for loop */
+static void track_loop(int header_at, const char* var, const char* start, const char* end,
+                       const char* step, const char* list, bool is_float, bool simd, int unroll) {
+    if (g_block_depth == 0 || strlen(start) >= LOOP_EXPR_MAX || strlen(end) >= LOOP_EXPR_MAX ||
+        strlen(step) >= LOOP_EXPR_MAX) {
+        return;
+    }
+    int* len;
+    int cap;
+    emit_buffer(&len, &cap);
+    LoopInfo* lp = &g_loops[g_block_depth - 1];
+    lp->active = true;
+    lp->header_at = header_at;
+    lp->body_at = *len;
+    snprintf(lp->var, sizeof(lp->var), "%s", var);
+    snprintf(lp->start, sizeof(lp->start), "%s", start);
+    snprintf(lp->end, sizeof(lp->end), "%s", end);
+    snprintf(lp->step, sizeof(lp->step), "%s", step);
+    snprintf(lp->list, sizeof(lp->list), "%s", list);
+    lp->is_float = is_float;
+    lp->simd = simd;
+    lp->unroll = unroll;
+}
+
+/* Pragmas for a loop header; omp simd cannot be stacked with the GCC ones */
+static void loop_pragmas(char* out, size_t size, bool simd, int unroll, const char* reductions) {
+    size_t o = 0;
+    char buf[1024];
+    out[0] = '\0';
+    if (simd && reductions && !unroll) {
+        snprintf(buf, sizeof(buf), "#pragma omp simd%s\n", reductions);
+        out_put(out, &o, size, buf);
+        return;
+    }
+    if (simd) out_put(out, &o, size, "#pragma GCC ivdep\n");
+    if (unroll) {
+        snprintf(buf, sizeof(buf), "#pragma GCC unroll %d\n", unroll);
+        out_put(out, &o, size, buf);
+    }
+}
+
+/* Pending simd/unroll annotations, consumed by the loop being compiled */
+static void take_loop_hints(bool* simd, int* unroll) {
+    *simd = g_pending_simd;
+    *unroll = g_pending_unroll;
+    g_pending_simd = false;
+    g_pending_unroll = 0;
+}
+
+/* '&' at amp is the first argument of a runtime function that only reads it */
+static bool is_read_only_arg(const char* body, const char* amp) {
+    static const char* readers[] = {
+        "list_len", "flist_len", "list_contains", "flist_contains", "list_contains_sorted",
+        "list_binary_search", "flist_binary_search", "print_list", "print_flist",
+    };
+    const char* p = amp;
+    while (p > body && p[-1] == ' ') p--;
+    if (p == body || p[-1] != '(') return false;
+    const char* end = --p;
+    while (p > body && is_ident_char(p[-1])) p--;
+    for (size_t i = 0; i < sizeof(readers) / sizeof(readers[0]); i++) {
+        if ((size_t)(end - p) == strlen(readers[i]) && strncmp(p, readers[i], end - p) == 0) return true;
+    }
+    return false;
+}
+
+/* Whether the body declares a list called name (its storage does not exist before the loop) */
+static bool declares_list(const char* body, const char* name) {
+    char decl[300];
+    snprintf(decl, sizeof(decl), "List %s ", name);
+    if (strstr(body, decl)) return true;
+    snprintf(decl, sizeof(decl), "List %s;", name);
+    return strstr(body, decl) != NULL;
+}
+
+/*
+ * How the body uses 'name': *whole when it is assigned, incremented or has its
+ * address taken (a call may then change anything in it), *elems when only
+ * elements are stored through name.data[...].
+ */
+static void body_writes(const char* body, const char* name, bool* whole, bool* elems) {
+    size_t n = strlen(name);
+    *whole = *elems = false;
+    for (const char* p = body; *p; ) {
+        if (*p == '"' || *p == '\'') {
+            p = skip_c_literal(p);
+            continue;
+        }
+        if (!is_ident_char(*p)) {
+            p++;
+            continue;
+        }
+        const char* word = p;
+        while (is_ident_char(*p)) p++;
+        if ((size_t)(p - word) != n || strncmp(word, name, n) != 0) continue;
+        if (word > body && (word[-1] == '.' || (word[-1] == '>' && word > body + 1 && word[-2] == '-'))) {
+            continue;   // a member of something else
+        }
+        const char* b = word;
+        while (b > body && (b[-1] == ' ' || b[-1] == '(')) b--;
+        if (b > body && b[-1] == '&' && !(b > body + 1 && b[-2] == '&') && !is_read_only_arg(body, b - 1)) {
+            *whole = true;
+            return;
+        }
+        if (b > body + 1 && (strncmp(b - 2, "++", 2) == 0 || strncmp(b - 2, "--", 2) == 0)) {
+            *whole = true;
+            return;
+        }
+        // Member and index chain, then the operator that follows it
+        const char* q = p;
+        bool indexed = false;
+        for (;;) {
+            if (*q == '.' && is_ident_char(q[1])) {
+                q++;
+                while (is_ident_char(*q)) q++;
+            } else if (q[0] == '-' && q[1] == '>') {
+                q += 2;
+                while (is_ident_char(*q)) q++;
+            } else if (*q == '[') {
+                int depth = 0;
+                do {
+                    if (*q == '[') depth++;
+                    else if (*q == ']') depth--;
+                    q++;
+                } while (*q && depth > 0);
+                indexed = true;
+            } else {
+                break;
+            }
+        }
+        q = skip_spaces(q);
+        bool assigns = (q[0] == '=' && q[1] != '=') || strncmp(q, "++", 2) == 0 || strncmp(q, "--", 2) == 0 ||
+                       (strchr("+-*/%&|^", q[0]) && q[0] && q[1] == '=') ||
+                       ((strncmp(q, "<<", 2) == 0 || strncmp(q, ">>", 2) == 0) && q[2] == '=');
+        if (!assigns) continue;
+        if (indexed) {
+            *elems = true;
+        } else {
+            *whole = true;
+            return;
+        }
+    }
+}
+
+/* Container parameter of the function being compiled (becomes *_arg_name) */
+static bool is_container_param(const char* name) {
+    if (!g_in_function || g_func_count == 0) return false;
+    const Function* f = &g_funcs[g_func_count - 1];
+    for (int i = 0; i < f->arity; i++) {
+        if (is_container_type(f->param_types[i]) && strcmp(f->param_names[i], name) == 0) return true;
+    }
+    return false;
+}
+
+/* Two container parameters may be the same object, so one passed by address
+   can change the other */
+static bool body_passes_param(const char* body) {
+    if (!g_in_function || g_func_count == 0) return false;
+    const Function* f = &g_funcs[g_func_count - 1];
+    for (int i = 0; i < f->arity; i++) {
+        bool whole, elems;
+        if (!is_container_type(f->param_types[i])) continue;
+        body_writes(body, f->param_names[i], &whole, &elems);
+        if (whole) return true;
+    }
+    return false;
+}
+
+static bool can_hoist(const char* name, const char* body, bool* elems) {
+    bool whole;
+    body_writes(body, name, &whole, elems);
+    return !whole && !(is_container_param(name) && body_passes_param(body));
+}
+
+/* Whether an expression has the same value on every iteration */
+static bool expr_is_invariant(const char* expr, const char* body, const char* loop_var) {
+    static const char* pure[] = { "list_len", "flist_len", "abs", "strlen", "sizeof" };
+    const char* p = expr;
+    while (*p) {
+        if (*p == '"' || *p == '\'') {
+            p = skip_c_literal(p);
+            continue;
+        }
+        if (!is_ident_char(*p) || isdigit((unsigned char)*p)) {
+            // Skip numbers whole so 1e5 or 0x1f are not read as names
+            if (isdigit((unsigned char)*p)) while (is_ident_char(*p) || *p == '.') p++;
+            else p++;
+            continue;
+        }
+        const char* word = p;
+        while (is_ident_char(*p)) p++;
+        if (word > expr && (word[-1] == '.' || word[-1] == '>')) continue;
+        char name[256];
+        snprintf(name, sizeof(name), "%.*s", (int)(p - word), word);
+        if (*skip_spaces(p) == '(') {
+            bool ok = false;
+            for (size_t i = 0; i < sizeof(pure) / sizeof(pure[0]); i++) {
+                if (strcmp(name, pure[i]) == 0) ok = true;
+            }
+            if (!ok) return false;
+            continue;
+        }
+        bool elems;
+        if (strcmp(name, loop_var) == 0 || !can_hoist(name, body, &elems) || elems) return false;
+    }
+    return true;
+}
+
+/* Appends "_name_data" for every "name.data[" of a hoisted list in the body */
+static void rewrite_indexed(const char* body, char lists[][256], int count, char* out, size_t out_size) {
+    size_t o = 0;
+    out[0] = '\0';
+    const char* p = body;
+    while (*p) {
+        if (*p == '"' || *p == '\'') {
+            const char* end = skip_c_literal(p);
+            char lit[MAX_LINE];
+            snprintf(lit, sizeof(lit), "%.*s", (int)(end - p), p);
+            out_put(out, &o, out_size, lit);
+            p = end;
+            continue;
+        }
+        if (is_ident_char(*p) && (p == body || (!is_ident_char(p[-1]) && p[-1] != '.' && p[-1] != '>'))) {
+            const char* q = p;
+            while (is_ident_char(*q)) q++;
+            bool replaced = false;
+            for (int i = 0; i < count && !replaced; i++) {
+                size_t n = strlen(lists[i]);
+                if ((size_t)(q - p) == n && strncmp(p, lists[i], n) == 0 && strncmp(q, ".data[", 6) == 0) {
+                    char buf[300];
+                    snprintf(buf, sizeof(buf), "_%s_data[", lists[i]);
+                    out_put(out, &o, out_size, buf);
+                    p = q + 6;
+                    replaced = true;
+                }
+            }
+            if (replaced) continue;
+            char word[256];
+            snprintf(word, sizeof(word), "%.*s", (int)(q - p), p);
+            out_put(out, &o, out_size, word);
+            p = q;
+            continue;
+        }
+        char c[2] = { *p++, '\0' };
+        out_put(out, &o, out_size, c);
+    }
+}
+
+/*
+ * '+' or '*' when the assignment at 'q' is name = name + expr or name = name * expr,
+ * with expr not using name and binding tighter than the operator; 0 otherwise.
+ */
+static char self_update_op(const char* name, const char* q) {
+    size_t len = strlen(name);
+    const char* p = skip_spaces(q + 1);
+    if (strncmp(p, name, len) != 0 || is_ident_char(p[len])) return 0;
+    p = skip_spaces(p + len);
+    char op = *p;
+    if ((op != '+' && op != '-' && op != '*') || p[1] == '=' || p[1] == op) return 0;
+    int nest = 0;
+    char prev = op;  /* last non-space character, to tell a binary + or - from a sign */
+    for (p++; *p && !(nest == 0 && *p == ';'); p++) {
+        if (*p == '"' || *p == '\'') {
+            p = skip_c_literal(p) - 1;
+            prev = 'x';
+            continue;
+        }
+        if (is_ident_char(*p) && !is_ident_char(prev)) {
+            if (strncmp(p, name, len) == 0 && !is_ident_char(p[len])) return 0;
+        }
+        if (*p == '(' || *p == '[') nest++;
+        else if (*p == ')' || *p == ']') nest--;
+        else if (nest == 0 && strchr("<>=!&|^?:,", *p)) return 0;
+        else if (nest == 0 && op == '*' && (*p == '/' || *p == '%')) return 0;
+        else if (nest == 0 && op == '*' && (*p == '+' || *p == '-') &&
+                 (is_ident_char(prev) || prev == ')' || prev == ']' || prev == '.')) return 0;
+        if (!isspace((unsigned char)*p)) prev = *p;
+    }
+    return op == '*' ? '*' : '+';
+}
+
+/*
+ * What keeps the body of a simd loop from vectorising, written to 'why'; false
+ * if anything. Outer scalars the body accumulates into (s += x) become
+ * reduction clauses, as do s = s + x and s = s * x.
+ */
+static bool simd_check(const LoopInfo* lp, const char* body, char lists[][256], int list_count,
+                       char* reductions, size_t red_size, char* why, size_t why_size) {
+    static const char* allowed[] = {
+        "if", "switch", "sizeof", "abs", "sqrt", "sqrtf", "fabs", "fabsf", "fmin", "fmax",
+        "fminf", "fmaxf", "floor", "floorf", "ceil", "ceilf", "exp", "expf", "log", "logf",
+        "sin", "sinf", "cos", "cosf", "pow", "powf",
+    };
+    static const char* types[] = { "int", "float", "bool", "double", "char" };
+    char locals[64][64];
+    int local_count = 0;
+    char red_names[16][64];
+    char red_ops[16];
+    int red_count = 0;
+    size_t ro = 0;
+    reductions[0] = '\0';
+    const char* p = body;
+    while (*p) {
+        if (*p == '"' || *p == '\'') {
+            p = skip_c_literal(p);
+            continue;
+        }
+        if (isdigit((unsigned char)*p)) {
+            while (is_ident_char(*p) || *p == '.') p++;
+            continue;
+        }
+        if (!is_ident_char(*p)) {
+            p++;
+            continue;
+        }
+        const char* word = p;
+        while (is_ident_char(*p)) p++;
+        if (word > body && (word[-1] == '.' || word[-1] == '>')) continue;
+        char name[64];
+        snprintf(name, sizeof(name), "%.*s", (int)(p - word), word);
+        const char* q = skip_spaces(p);
+        if (strcmp(name, "break") == 0 || strcmp(name, "return") == 0 || strcmp(name, "goto") == 0) {
+            snprintf(why, why_size, "it can leave the loop early ('%s')", name);
+            return false;
+        }
+        if (*q == '(') {
+            if (strcmp(name, "for") == 0 || strcmp(name, "while") == 0) {
+                snprintf(why, why_size, "it contains another loop");
+                return false;
+            }
+            if (strcmp(name, "list_check") == 0) {
+                snprintf(why, why_size, "it has list index checks that cannot be proven redundant");
+                return false;
+            }
+            bool ok = false;
+            for (size_t i = 0; i < sizeof(allowed) / sizeof(allowed[0]); i++) {
+                if (strcmp(name, allowed[i]) == 0) ok = true;
+            }
+            if (!ok) {
+                snprintf(why, why_size, "it calls '%s'", name);
+                return false;
+            }
+            continue;
+        }
+        if (strncmp(p, ".data[", 6) == 0 && get_var_type(name) == TYPE_LIST) {
+            bool cached = false;
+            for (int i = 0; i < list_count; i++) {
+                if (strcmp(lists[i], name) == 0) cached = true;
+            }
+            if (!cached) {
+                snprintf(why, why_size, "'%s' is resized or passed by address in the loop", name);
+                return false;
+            }
+            continue;
+        }
+        // Declarations of loop-local scalars
+        const char* b = word;
+        while (b > body && (b[-1] == ' ' || b[-1] == '*')) b--;
+        const char* t = b;
+        while (t > body && is_ident_char(t[-1])) t--;
+        bool declared = false;
+        for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+            if ((size_t)(b - t) == strlen(types[i]) && strncmp(t, types[i], b - t) == 0) declared = true;
+        }
+        if (declared) {
+            if (local_count < 64) snprintf(locals[local_count++], 64, "%s", name);
+            continue;
+        }
+        // Writes to scalars from outside the loop
+        char op = 0;
+        if (b > body + 1 && (strncmp(b - 2, "++", 2) == 0 || strncmp(b - 2, "--", 2) == 0)) op = '+';
+        else if (strncmp(q, "++", 2) == 0 || strncmp(q, "--", 2) == 0) op = '+';
+        else if ((q[0] == '+' || q[0] == '-') && q[1] == '=') op = '+';
+        else if (q[0] == '*' && q[1] == '=') op = '*';
+        else if (q[0] == '=' && q[1] != '=') op = '=';
+        else if (q[0] && strchr("/%&|^<>", q[0]) && (q[1] == '=' || (q[1] == q[0] && q[2] == '='))) {
+            if (q[0] != '<' && q[0] != '>') op = '=';
+            else if (q[1] == q[0]) op = '=';
+        }
+        if (op == '=') {
+            char self = self_update_op(name, q);
+            if (self) op = self;
+        }
+        if (!op) continue;
+        bool local = false;
+        for (int i = 0; i < local_count; i++) {
+            if (strcmp(locals[i], name) == 0) local = true;
+        }
+        if (local) continue;
+        if (strcmp(name, lp->var) == 0) {
+            snprintf(why, why_size, "it changes the loop variable '%s'", name);
+            return false;
+        }
+        int r = 0;
+        while (r < red_count && strcmp(red_names[r], name) != 0) r++;
+        if (op == '=' || (r < red_count && red_ops[r] != op)) {
+            snprintf(why, why_size, "'%s' carries a value from one iteration to the next", name);
+            return false;
+        }
+        if (r == red_count && red_count < 16) {
+            snprintf(red_names[red_count], 64, "%s", name);
+            red_ops[red_count++] = op;
+            char clause[128];
+            snprintf(clause, sizeof(clause), " reduction(%c:%s)", op, name);
+            out_put(reductions, &ro, red_size, clause);
+        }
+    }
+    return true;
+}
+
+/* Name of the list L when a loop bound is L's last index or below: L.size - 1, list_len(&L) - 2 */
+static bool bound_list(const char* end, char* list, size_t list_size) {
+    char e[LOOP_EXPR_MAX];
+    size_t n = 0;
+    for (const char* p = end; *p && n < sizeof(e) - 1; p++) {
+        if (!isspace((unsigned char)*p)) e[n++] = *p;
+    }
+    e[n] = '\0';
+    const char* p = e;
+    const char* name;
+    size_t name_len = 0;
+    if (starts_with(p, "list_len(&") || starts_with(p, "flist_len(&")) {
+        name = strchr(p, '&') + 1;
+        while (is_ident_char(name[name_len])) name_len++;
+        if (name[name_len] != ')') return false;
+        p = name + name_len + 1;
+    } else {
+        name = p;
+        while (is_ident_char(name[name_len])) name_len++;
+        if (name_len == 0 || strncmp(name + name_len, ".size", 5) != 0) return false;
+        p = name + name_len + 5;
+    }
+    if (*p++ != '-' || !isdigit((unsigned char)*p)) return false;
+    char* rest;
+    long k = strtol(p, &rest, 10);
+    if (*rest || k < 1 || isdigit((unsigned char)name[0])) return false;
+    snprintf(list, list_size, "%.*s", (int)name_len, name);
+    return true;
+}
+
+/* Replaces list_check(var, list.size, line) by var, in place */
+static void drop_index_checks(char* text, const char* var, const char* list) {
+    char check[600];
+    snprintf(check, sizeof(check), "list_check(%s, %s.size, ", var, list);
+    size_t n = strlen(check);
+    size_t var_len = strlen(var);
+    char* w = text;
+    const char* r = text;
+    while (*r) {
+        // The writer never passes the reader
+        if (strncmp(r, check, n) == 0 && (r == text || !is_ident_char(r[-1]))) {
+            memmove(w, var, var_len);
+            w += var_len;
+            r = strchr(r + n, ')') + 1;
+            continue;
+        }
+        *w++ = *r++;
+    }
+    *w = '\0';
+}
+
+/* Checked mode: the loop variable runs upwards from a non-negative start and the body leaves it alone */
+static bool index_checks_removable(const LoopInfo* lp, const char* body) {
+    if (g_mode != MODE_CHECKED || lp->list[0]) return false;
+    char* rest;
+    long start = strtol(lp->start, &rest, 10);
+    if (rest == lp->start || *skip_spaces(rest) || start < 0) return false;
+    if (lp->step[0]) {
+        long step = strtol(lp->step, &rest, 10);
+        if (rest == lp->step || *skip_spaces(rest) || step < 1) return false;
+    }
+    bool whole, elems;
+    body_writes(body, lp->var, &whole, &elems);
+    return !whole;
+}
+
+/*
+ * In 'for i = 0 to list_len(L) - 1' every L[i] is in range as long as the
+ * body does not change L's size, so those checks go.
+ */
+static void remove_index_checks(const LoopInfo* lp) {
+    int* len;
+    int cap;
+    char* buf = emit_buffer(&len, &cap);
+    char* body = buf + lp->body_at;
+    char list[256];
+    bool elems;
+    if (!index_checks_removable(lp, body) || !bound_list(lp->end, list, sizeof(list)) ||
+        !can_hoist(list, body, &elems)) {
+        return;
+    }
+    drop_index_checks(body, lp->var, list);
+    *len = lp->body_at + (int)strlen(body);
+}
+
+/*
+ * Lists other than the bound's that the body indexes by the loop variable:
+ * their checks become one test before the loop, "end < M.size && ...", which
+ * picks a copy of the loop without them.
+ */
+static bool version_index_checks(const LoopInfo* lp, const char* body, const char* end,
+                                 char* cond, size_t cond_size, char** fast) {
+    if (!index_checks_removable(lp, body) || !expr_is_invariant(lp->end, body, lp->var)) return false;
+    char check[128];
+    snprintf(check, sizeof(check), "list_check(%s, ", lp->var);
+    size_t n = strlen(check);
+    size_t o = 0;
+    cond[0] = '\0';
+    *fast = NULL;
+    for (const char* p = strstr(body, check); p; p = strstr(p + 1, check)) {
+        if (p > body && is_ident_char(p[-1])) continue;
+        const char* name = p + n;
+        size_t k = 0;
+        while (is_ident_char(name[k])) k++;
+        char list[256], term[600];
+        snprintf(list, sizeof(list), "%.*s", (int)k, name);
+        snprintf(term, sizeof(term), "%s < %s.size", end, list);
+        bool elems;
+        if (k == 0 || strstr(cond, term) || o + strlen(term) + 5 >= cond_size || declares_list(body, list) ||
+            !can_hoist(list, body, &elems)) {
+            continue;
+        }
+        if (!*fast) *fast = strdup(body);
+        drop_index_checks(*fast, lp->var, list);
+        if (o) out_put(cond, &o, cond_size, " && ");
+        out_put(cond, &o, cond_size, term);
+    }
+    return *fast != NULL;
+}
+
+/* Rewrites the header of the loop at block depth 'depth'; returns the braces it opened */
+static int optimise_loop(int depth) {
+    LoopInfo* lp = &g_loops[depth];
+    if (!lp->active) return 0;
+    lp->active = false;
+    int* len;
+    int cap;
+    char* buf = emit_buffer(&len, &cap);
+    // The caller may change anything between a generator's yields
+    if (strstr(buf + lp->body_at, "_g->_state = ")) return 0;
+    remove_index_checks(lp);
+    const char* body = buf + lp->body_at;
+
+    char prologue[4096], header[2048], line[1024];
+    size_t o = 0;
+    prologue[0] = '\0';
+    char end[LOOP_EXPR_MAX + 80], step[LOOP_EXPR_MAX + 80], size[300];
+    snprintf(end, sizeof(end), "%s", lp->end);
+    snprintf(step, sizeof(step), "%s", lp->step);
+
+    if (!lp->list[0]) {
+        if (!is_plain_operand(lp->end) && expr_is_invariant(lp->end, body, lp->var)) {
+            snprintf(line, sizeof(line), "const int _%s_end = %s;\n", lp->var, lp->end);
+            out_put(prologue, &o, sizeof(prologue), line);
+            snprintf(end, sizeof(end), "_%s_end", lp->var);
+        }
+        if (lp->step[0] && !is_plain_operand(lp->step) && expr_is_invariant(lp->step, body, lp->var)) {
+            snprintf(line, sizeof(line), "const int _%s_step = %s;\n", lp->var, lp->step);
+            out_put(prologue, &o, sizeof(prologue), line);
+            snprintf(step, sizeof(step), "_%s_step", lp->var);
+        }
+    }
+
+    char versioned[1024];
+    char* fast = NULL;
+    if (!version_index_checks(lp, body, end, versioned, sizeof(versioned), &fast)) versioned[0] = '\0';
+    const char* fast_body = fast ? fast : body;
+
+    // Lists whose data pointer can be cached: the iterated one and those indexed
+    char lists[16][256];
+    int list_count = 0;
+    bool elems, stores = false;
+    bool list_hoisted = lp->list[0] && can_hoist(lp->list, body, &elems);
+    if (list_hoisted) {
+        stores = elems;
+        snprintf(lists[list_count++], 256, "%s", lp->list);
+        snprintf(size, sizeof(size), "_%s_size", lp->list);
+        snprintf(line, sizeof(line), "const int %s = %s.size;\n", size, lp->list);
+        out_put(prologue, &o, sizeof(prologue), line);
+    } else {
+        snprintf(size, sizeof(size), "%s.size", lp->list);
+    }
+    for (const char* p = strstr(body, ".data["); p && list_count < 16; p = strstr(p + 1, ".data[")) {
+        const char* w = p;
+        while (w > body && is_ident_char(w[-1])) w--;
+        if (w == p || (w > body && (w[-1] == '.' || w[-1] == '>'))) continue;
+        char name[256];
+        snprintf(name, sizeof(name), "%.*s", (int)(p - w), w);
+        bool seen = false;
+        for (int i = 0; i < list_count; i++) {
+            if (strcmp(lists[i], name) == 0) seen = true;
+        }
+        char decl[300];
+        snprintf(decl, sizeof(decl), "_%s_data =", name);
+        if (seen || get_var_type(name) != TYPE_LIST || strstr(body, decl) || declares_list(body, name) ||
+            !can_hoist(name, body, &elems)) {
+            continue;
+        }
+        stores = stores || elems;
+        snprintf(lists[list_count++], 256, "%s", name);
+    }
+    // Two parameters, or two lists copied from one another, may be one buffer,
+    // so they are not restrict once either is written
+    int shared = 0;
+    for (int i = 0; i < list_count; i++) {
+        if (is_container_param(lists[i]) || is_var_shared(lists[i])) shared++;
+    }
+    for (int i = 0; i < list_count; i++) {
+        bool restricted =
+            !(stores && shared > 1 && (is_container_param(lists[i]) || is_var_shared(lists[i])));
+        bool is_float = get_var_elem_type(lists[i]) == TYPE_FLOAT;
+        if (lp->simd) {
+            // All list storage is allocated 64-byte aligned (see list_alloc_aligned)
+            snprintf(line, sizeof(line), "%s*%s _%s_data = __builtin_assume_aligned(%s.data, 64);\n",
+                     is_float ? "float" : "int", restricted ? " restrict" : "", lists[i], lists[i]);
+        } else {
+            snprintf(line, sizeof(line), "%s*%s _%s_data = %s.data;\n", is_float ? "float" : "int",
+                     restricted ? " restrict" : "", lists[i], lists[i]);
+        }
+        out_put(prologue, &o, sizeof(prologue), line);
+    }
+
+    char pragmas[1200] = "";
+    if (lp->simd || lp->unroll) {
+        char reductions[1024], why[256];
+        bool vectorises = !lp->simd ||
+                          simd_check(lp, fast_body, lists, list_count, reductions, sizeof(reductions), why,
+                                     sizeof(why));
+        if (!vectorises) {
+            char msg[512];
+            snprintf(msg, sizeof(msg), "simd loop cannot be vectorised: %s", why);
+            warning_at(g_blocks[depth].line_num, msg);
+        }
+        loop_pragmas(pragmas, sizeof(pragmas), lp->simd, lp->unroll, vectorises ? reductions : NULL);
+    }
+    if (o == 0 && !pragmas[0] && !versioned[0]) return 0;
+
+    if (lp->list[0]) {
+        char data[300];
+        snprintf(data, sizeof(data), list_hoisted ? "_%s_data" : "%s.data", lp->list);
+        snprintf(header, sizeof(header),
+                 "for (int _%s_idx = 0; _%s_idx < %s; _%s_idx++) {\n"
+                 "    %s %s = %s[_%s_idx];\n",
+                 lp->var, lp->var, size, lp->var,
+                 lp->is_float ? "float" : "int", lp->var, data, lp->var);
+    } else if (!lp->step[0]) {
+        snprintf(header, sizeof(header), "for (int %s = %s; %s <= %s; %s++) {\n",
+                 lp->var, lp->start, lp->var, end, lp->var);
+    } else {
+        snprintf(header, sizeof(header), "for (int %s = %s; %s <= %s; %s += %s) {\n",
+                 lp->var, lp->start, lp->var, end, lp->var, step);
+    }
+
+    size_t body_len = *len - lp->body_at;
+    size_t out_size = strlen(prologue) + strlen(pragmas) + strlen(versioned) + strlen(header) * 2 +
+                      body_len * 4 + 64;
+    char* out = (char*)malloc(out_size);
+    size_t oo = 0;
+    out[0] = '\0';
+    out_put(out, &oo, out_size, "{\n");
+    out_put(out, &oo, out_size, prologue);
+    if (versioned[0]) {
+        out_put(out, &oo, out_size, "if (");
+        out_put(out, &oo, out_size, versioned);
+        out_put(out, &oo, out_size, ") {\n");
+    }
+    out_put(out, &oo, out_size, pragmas);
+    out_put(out, &oo, out_size, header);
+    char* rewritten = (char*)malloc(out_size);
+    rewrite_indexed(fast_body, lists, list_count, rewritten, out_size);
+    out_put(out, &oo, out_size, rewritten);
+    if (versioned[0]) {
+        // The checked copy runs when some index would be out of range
+        out_put(out, &oo, out_size, "}\n} else {\n");
+        out_put(out, &oo, out_size, header);
+        rewrite_indexed(body, lists, list_count, rewritten, out_size);
+        out_put(out, &oo, out_size, rewritten);
+    }
+    free(rewritten);
+    free(fast);
+
+    int room = cap - 1 - lp->header_at;
+    if ((int)oo >= room) {
+        free(out);
+        return 0;       // no space to rewrite: the loop stays as emitted
+    }
+    memcpy(buf + lp->header_at, out, oo + 1);
+    *len = lp->header_at + (int)oo;
+    free(out);
+    return versioned[0] ? 2 : 1;
+}
+
+/* Handle for-in iteration: for var in iterable: */
+static void handle_for_in(char* line, bool has_brace) {
+    bool simd;
+    int unroll;
+    take_loop_hints(&simd, &unroll);
+    char* p = trim_left(line);
+    p += 3;  // skip "for"
+    p = trim_left(p);
+    
+    // Extract variable name
+    char var[64] = {0};
+    int i = 0;
+    while (*p && (isalnum(*p) || *p == '_')) {
+        if (i < 63) var[i++] = *p;
+        p++;
+    }
+    var[i] = '\0';
+    
+    if (strlen(var) == 0) {
+        error("Missing loop variable in for-in statement");
+        strcpy(var, "_item");
+    }
+    
+    // Optional second variable: for k, v in M
+    char var2[64] = {0};
+    p = trim_left(p);
+    if (*p == ',') {
+        p = trim_left(p + 1);
+        i = 0;
+        while (*p && (isalnum(*p) || *p == '_')) {
+            if (i < 63) var2[i++] = *p;
+            p++;
+        }
+        var2[i] = '\0';
+    }
+    
+    // Skip " in "
+    p = trim_left(p);
+    if (strncmp(p, "in", 2) == 0) {
+        p += 2;
+        p = trim_left(p);
+    } else {
+        error("Missing 'in' keyword in for-in statement");
+    }
+    
+    // Get iterable (until : or { or end of string, outside parentheses and quotes)
+    char iterable[256] = {0};
+    i = 0;
+    int paren = 0;
+    char quote = 0;
+    while (*p && (quote || paren > 0 || (*p != ':' && *p != '{' && !isspace(*p)))) {
+        if (quote) {
+            if (*p == quote) quote = 0;
+        } else if (*p == '"' || *p == '\'') {
+            quote = *p;
+        } else if (*p == '(' || *p == '[') {
+            paren++;
+        } else if (*p == ')' || *p == ']') {
+            paren--;
+        }
+        if (i < 255) iterable[i++] = *p;
+        p++;
+    }
+    iterable[i] = '\0';
+    trim(iterable);
+    
+    if (strlen(iterable) == 0) {
+        error("Missing iterable in for-in statement");
+        strcpy(iterable, "\"\"");
+    }
+    
+    const Function* gen = generator_call(iterable);
+    if (gen) {
+        if (var2[0]) error("A generator yields single values - expected one loop variable");
+        handle_generator_for(line, gen, var, iterable, has_brace);
+        return;
+    }
+    if (is_pipeline(iterable)) {
+        if (simd || unroll) warning("'simd' and 'unroll' only apply to counted loops and loops over lists - ignored");
+        handle_pipeline_for(line, var, var2, iterable, has_brace);
+        return;
+    }
+    
+    // Determine iterable type
+    VarType iter_type = infer_expr_type(iterable);
+    
+    // For string literals, override type detection
+    if (iterable[0] == '"') {
+        iter_type = TYPE_STRING;
+    }
+    
+    log_for_in(var, iterable, iter_type);
+    
+    if (var2[0] && iter_type != TYPE_ORDMAP) {
+        error("A second loop variable is only supported when iterating an ordmap");
+    }
+    if ((simd || unroll) && (iter_type != TYPE_LIST || starts_with(iterable, "codepoints("))) {
+        warning("'simd' and 'unroll' only apply to counted loops and loops over lists - ignored");
+        simd = false;
+        unroll = 0;
+    }
+    
+    char emit_buf[MAX_LINE * 2];
+    char idx_var[80];
+    snprintf(idx_var, sizeof(idx_var), "_%s_idx", var);
+    int extra_braces = 0;
+    char loop_list[256] = "";
+    bool loop_float = false;
+    
+    if (starts_with(iterable, "codepoints(")) {
+        // Decode UTF-8 code points; plain 'for c in s' still walks bytes
+        char arg[256], c_arg[MAX_LINE];
+        snprintf(arg, sizeof(arg), "%s", iterable + 11);
+        char* close = strrchr(arg, ')');
+        if (close) *close = '\0';
+        rewrite_expr(trim(arg), c_arg, sizeof(c_arg));
+        snprintf(emit_buf, sizeof(emit_buf),
+            "{ const unsigned char* _%s_str = (const unsigned char*)(%s);\n"
+            "int _%s_len = (int)strlen((const char*)_%s_str);\n"
+            "for (int %s = 0, %s; (%s = utf8_next(_%s_str, &%s, _%s_len)) >= 0; ) {\n",
+            var, c_arg,
+            var, var,
+            idx_var, var, var, var, idx_var, var);
+        register_var(var, TYPE_INT, false);
+        emit_no_log(emit_buf);
+        push_block(get_indent(line), "for_in", iterable, has_brace);
+        g_blocks[g_block_depth - 1].extra_braces = 1;
+        return;
+    }
+    
+    switch (iter_type) {
+        case TYPE_STRING:
+            // Iterate over characters in string
+            snprintf(emit_buf, sizeof(emit_buf),
+                "{ char* _%s_str = %s;\n"
+                "for (int %s = 0; _%s_str[%s]; %s++) {\n"
+                "    char %s = _%s_str[%s];\n",
+                var, iterable,
+                idx_var, var, idx_var, idx_var,
+                var, var, idx_var);
+            register_var(var, TYPE_INT, false);  // char as int
+            extra_braces = 1;
+            break;
+            
+        case TYPE_LIST: {
+            // Iterate over list elements
+            bool is_float = get_var_elem_type(iterable) == TYPE_FLOAT;
+            if (is_plain_operand(iterable) && !isdigit((unsigned char)iterable[0])) {
+                snprintf(loop_list, sizeof(loop_list), "%s", iterable);
+                loop_float = is_float;
+            }
+            snprintf(emit_buf, sizeof(emit_buf),
+                "for (int %s = 0; %s < %s.size; %s++) {\n"
+                "    %s %s = %s.data[%s];\n",
+                idx_var, idx_var, iterable, idx_var,
+                is_float ? "float" : "int", var, iterable, idx_var);
+            register_var(var, is_float ? TYPE_FLOAT : TYPE_INT, false);
+            break;
+        }
+            
+        case TYPE_DICT:
+            // Iterate over dict keys
+            snprintf(emit_buf, sizeof(emit_buf),
+                "for (int %s = 0; %s < %s.size; %s++) {\n"
+                "    char* %s = %s.keys[%s];\n",
+                idx_var, idx_var, iterable, idx_var,
+                var, iterable, idx_var);
+            register_var(var, TYPE_STRING, false);
+            break;
+            
+        case TYPE_SET:
+            // Iterate over occupied slots; negative control bytes are empty or deleted
+            if (get_var_elem_type(iterable) == TYPE_STRING) {
+                snprintf(emit_buf, sizeof(emit_buf),
+                    "for (int %s = 0; %s < %s.cap; %s++) {\n"
+                    "    if (%s.ctrl[%s] < 0) continue;\n"
+                    "    char* %s = %s.keys[%s];\n",
+                    idx_var, idx_var, iterable, idx_var,
+                    iterable, idx_var,
+                    var, iterable, idx_var);
+                register_var(var, TYPE_STRING, false);
+            } else {
+                snprintf(emit_buf, sizeof(emit_buf),
+                    "for (int %s = 0; %s < %s.cap; %s++) {\n"
+                    "    if (%s.ctrl[%s] < 0) continue;\n"
+                    "    int %s = %s.keys[%s];\n",
+                    idx_var, idx_var, iterable, idx_var,
+                    iterable, idx_var,
+                    var, iterable, idx_var);
+                register_var(var, TYPE_INT, false);
+            }
+            break;
+            
+        case TYPE_ORDMAP: {
+            // Iterate keys in order, optionally restricted to M.range(lo, hi)
+            char map_name[256], lo[256] = "INT_MIN", hi[256] = "INT_MAX";
+            snprintf(map_name, sizeof(map_name), "%s", iterable);
+            char* dot = strchr(map_name, '.');
+            if (dot) {
+                *dot = '\0';
+                char* args = dot + 1;
+                if (!starts_with(args, "range(")) {
+                    error("Only .range(lo, hi) can be iterated on an ordmap");
+                } else {
+                    args += 6;
+                    char* close = strrchr(args, ')');
+                    if (close) *close = '\0';
+                    char* comma = strchr(args, ',');
+                    if (!comma) {
+                        error("Missing ',' in range - expected: M.range(lo, hi)");
+                    } else {
+                        *comma = '\0';
+                        rewrite_expr(trim(args), lo, sizeof(lo));
+                        rewrite_expr(trim(comma + 1), hi, sizeof(hi));
+                    }
+                }
+            }
+            snprintf(emit_buf, sizeof(emit_buf),
+                "for (OrdIter _%s_it = ordmap_iter(&%s, %s, %s); ordmap_next(&_%s_it); ) {\n"
+                "    int %s = _%s_it.key;\n",
+                var, map_name, lo, hi, var,
+                var, var);
+            if (var2[0]) {
+                char val_line[256];
+                snprintf(val_line, sizeof(val_line), "    int %s = _%s_it.val;\n", var2, var);
+                strcat(emit_buf, val_line);
+                register_var(var2, TYPE_INT, false);
+            }
+            register_var(var, TYPE_INT, false);
+            break;
+        }
+            
+        case TYPE_DEQUE:
+            // Iterate front to back; the mask wraps the index around the ring
+            snprintf(emit_buf, sizeof(emit_buf),
+                "for (int %s = 0; %s < %s.size; %s++) {\n"
+                "    int %s = %s.data[(%s.head + %s) & %s.mask];\n",
+                idx_var, idx_var, iterable, idx_var,
+                var, iterable, iterable, idx_var, iterable);
+            register_var(var, TYPE_INT, false);
+            break;
+            
+        case TYPE_TUPLE:
+            // Iterate over tuple elements
+            snprintf(emit_buf, sizeof(emit_buf),
+                "for (int %s = 0; %s < %s.size; %s++) {\n"
+                "    int %s = %s.data[%s];\n",
+                idx_var, idx_var, iterable, idx_var,
+                var, iterable, idx_var);
+            register_var(var, TYPE_INT, false);
+            break;
+            
+        default:
+            // Assume string-like for unknown types
+            snprintf(emit_buf, sizeof(emit_buf),
+                "{ char* _%s_str = (char*)(%s);\n"
+                "for (int %s = 0; _%s_str && _%s_str[%s]; %s++) {\n"
+                "    char %s = _%s_str[%s];\n",
+                var, iterable,
+                idx_var, var, var, idx_var, idx_var,
+                var, var, idx_var);
+            register_var(var, TYPE_INT, false);
+            extra_braces = 1;
+            break;
+    }
+    
+    int* len;
+    int cap;
+    emit_buffer(&len, &cap);
+    int header_at = *len;
+    char pragmas[128];
+    loop_pragmas(pragmas, sizeof(pragmas), simd, unroll, NULL);
+    emit_no_log(pragmas);
+    emit_no_log(emit_buf);
+    
+    char condition[MAX_LINE];
+    snprintf(condition, sizeof(condition), "%s in %s", var, iterable);
+    int depth = g_block_depth;
+    push_block(get_indent(line), "for_in", condition, has_brace);
+    g_blocks[g_block_depth - 1].extra_braces = extra_braces;
+    if (loop_list[0] && g_block_depth > depth) track_loop(header_at, var, "", "", "", loop_list, loop_float, simd, unroll);
+}
+
+static void handle_for(char* line, bool has_brace) {
+    char* p = trim_left(line);
+    p += 3;
+    p = trim_left(p);
+    
+    // Check if this is a for-in loop
+    char* in_keyword = strstr(p, " in ");
+    if (in_keyword) {
+        handle_for_in(line, has_brace);
+        return;
+    }
+    bool simd;
+    int unroll;
+    take_loop_hints(&simd, &unroll);
+    
+    if (has_brace) {
+        strip_trailing_brace(p);
+    }
+    
+    char* colon = strrchr(p, ':');
+    if (colon) {
+        *colon = '\0';
+    }
+    
+    p = trim(p);
+    
+    char var[64] = {0}, start_val[64] = {0}, end_val[MAX_LINE] = {0}, step[64] = "1";
+    
+    int i = 0;
+    while (*p && (isalnum(*p) || *p == '_')) {
+        if (i < 63) var[i++] = *p;
+        p++;
+    }
+    var[i] = '\0';
+    
+    if (strlen(var) == 0) {
+        error("Missing loop variable in for statement");
+        strcpy(var, "_i");
+    }
+    
+    p = trim_left(p);
+    if (*p == '=') {
+        p++;
+    } else {
+        error("Missing '=' in for loop");
+    }
+    p = trim_left(p);
+    
+    i = 0;
+    while (*p && !isspace(*p) && strncmp(p, "to", 2) != 0) {
+        if (i < 63) start_val[i++] = *p;
+        p++;
+    }
+    start_val[i] = '\0';
+    
+    if (strlen(start_val) == 0) {
+        error("Missing start value in for loop");
+        strcpy(start_val, "0");
+    }
+    
+    p = trim_left(p);
+    
+    if (!starts_with(p, "to")) {
+        error("Missing 'to' keyword in for loop");
+    } else {
+        p += 2;
+    }
+    
+    if (*p == '(') {
+        p++;
+        i = 0;
+        while (*p && *p != ')') {
+            if (i < 63) step[i++] = *p;
+            p++;
+        }
+        step[i] = '\0';
+        if (*p == ')') {
+            p++;
+        } else {
+            error("Missing ')' in for loop step");
+        }
+        
+        if (strlen(step) == 0) {
+            error("Empty step value in for loop");
+            strcpy(step, "1");
+        }
+    }
+    
+    p = trim_left(p);
+    strncpy(end_val, trim(p), sizeof(end_val) - 1);
+    end_val[sizeof(end_val) - 1] = '\0';
+    
+    if (strlen(end_val) == 0) {
+        error("Missing end value in for loop");
+        strcpy(end_val, "0");
+    }
+    
+    replace_time_funcs(start_val);
+    replace_time_funcs(end_val);
+    replace_time_funcs(step);
+    
+    char condition[MAX_LINE];
+    snprintf(condition, sizeof(condition), "%s = %s to %s step %s", var, start_val, end_val, step);
+    
+    char c_start[MAX_LINE], c_end[MAX_LINE], c_step[MAX_LINE];
+    rewrite_expr(start_val, c_start, sizeof(c_start));
+    rewrite_expr(end_val, c_end, sizeof(c_end));
+    rewrite_expr(step, c_step, sizeof(c_step));
+    
+    char emit_buf[MAX_LINE * 4];
+    if (strcmp(step, "1") == 0) {
+        c_step[0] = '\0';
+        snprintf(emit_buf, sizeof(emit_buf), 
+                 "for (int %s = %s; %s <= %s; %s++) {\n",
+                 var, c_start, var, c_end, var);
+    } else {
+        snprintf(emit_buf, sizeof(emit_buf), 
+                 "for (int %s = %s; %s <= %s; %s += %s) {\n",
+                 var, c_start, var, c_end, var, c_step);
+    }
+    int* len;
+    int cap;
+    emit_buffer(&len, &cap);
+    int header_at = *len;
+    char pragmas[128];
+    loop_pragmas(pragmas, sizeof(pragmas), simd, unroll, NULL);
+    emit_no_log(pragmas);
+    emit_no_log(emit_buf);
+    
+    register_var(var, TYPE_INT, false);
+    int depth = g_block_depth;
+    push_block(get_indent(line), "for", condition, has_brace);
+    if (g_block_depth > depth) track_loop(header_at, var, c_start, c_end, c_step, "", false, simd, unroll);
+}
+
+static bool has_func_attr(const char* attrs, const char* name) {
+    size_t n = strlen(name);
+    for (const char* p = attrs; (p = strstr(p, name)) != NULL; p += n) {
+        if ((p == attrs || p[-1] == ' ') && (p[n] == '\0' || p[n] == ',')) return true;
+    }
+    return false;
+}
+
+/*
+ * @hot          __attribute__((hot)): optimised harder, grouped with other hot code
+ * @cold         __attribute__((cold)): kept out of the hot path, calls predicted not taken
+ * @opt("O3")    __attribute__((optimize("O3")))
+ * Collected for the next func, like @inline.
+ */
+static void handle_func_attr(const char* t) {
+    char attr[96];
+    if (strcmp(t, "@hot") == 0 || strcmp(t, "@cold") == 0) {
+        snprintf(attr, sizeof(attr), "%s", t + 1);
+        if (has_func_attr(g_pending_attrs, strcmp(attr, "hot") == 0 ? "cold" : "hot")) {
+            error("A function cannot be both @hot and @cold");
+            return;
+        }
+    } else {
+        const char* level = t + 5;
+        size_t len = 0;
+        if (*level == '"') {
+            level++;
+            while (isalnum((unsigned char)level[len]) || level[len] == '-' || level[len] == '_' ||
+                   level[len] == '=') {
+                len++;
+            }
+        }
+        if (len == 0 || len > 32 || strcmp(level + len, "\")") != 0) {
+            error("Expected an optimisation level, e.g. @opt(\"O3\")");
+            return;
+        }
+        snprintf(attr, sizeof(attr), "optimize(\"%.*s\")", (int)len, level);
+    }
+    if (has_func_attr(g_pending_attrs, attr)) return;
+    size_t o = strlen(g_pending_attrs);
+    if (o + strlen(attr) + 3 > sizeof(g_pending_attrs)) {
+        error("Too many function annotations");
+        return;
+    }
+    snprintf(g_pending_attrs + o, sizeof(g_pending_attrs) - o, "%s%s", o ? ", " : "", attr);
+}
+
+/*
+ * simd for i = 0 to n:        vectorise; warns when the body prevents it
+ * unroll(4) for x in L:       unroll by a constant factor
+ * The prefixes may be combined and are consumed by the for loop they precede.
+ */
+static bool is_loop_hint(const char* t) {
+    for (;;) {
+        if (starts_with(t, "simd ")) {
+            t = skip_spaces(t + 5);
+        } else if (starts_with(t, "unroll(")) {
+            const char* close = strchr(t, ')');
+            if (!close) return false;
+            t = skip_spaces(close + 1);
+        } else {
+            return starts_with(t, "for ");
+        }
+    }
+}
+
+static void handle_loop_hints(char* line, bool has_brace) {
+    char* start = trim_left(line);
+    char* p = start;
+    for (;;) {
+        if (starts_with(p, "simd ")) {
+            g_pending_simd = true;
+            p = trim_left(p + 5);
+        } else if (starts_with(p, "unroll(")) {
+            char* end;
+            long n = strtol(p + 7, &end, 10);
+            if (end == p + 7 || *end != ')' || n < 1 || n > 65535) {
+                error("unroll needs a constant count, e.g. unroll(4)");
+                end = strchr(p, ')');
+                if (!end) return;
+                n = 0;
+            }
+            g_pending_unroll = (int)n;
+            p = trim_left(end + 1);
+        } else {
+            break;
+        }
+    }
+    if (!starts_with(p, "for ")) {
+        error("Expected 'for' after loop annotation");
+        g_pending_simd = false;
+        g_pending_unroll = 0;
+        return;
+    }
+    memmove(start, p, strlen(p) + 1);
+    handle_for(line, has_brace);
+}
+
+/*
+ * func name:                          void name(void)
+ * func add(int a, int b) -> int:      static int add(int a, int b)
+ * Container parameters are passed by pointer so the caller sees changes; the
+ * body uses the parameter name like a local, and when the function closes each
+ * use becomes (*_arg_name).
+ */
+static void handle_func(char* line, bool has_brace) {
+    char* p = trim_left(line);
+    p += 4;
+    p = trim_left(p);
+    
+    if (has_brace) {
+        strip_trailing_brace(p);
+    }
+    
+    char* colon = strrchr(p, ':');
+    if (colon) {
+        *colon = '\0';
+    }
+    
+    char name[256];
+    int i = 0;
+    while (*p && (isalnum(*p) || *p == '_')) {
+        if (i < 255) name[i++] = *p;
+        p++;
+    }
+    name[i] = '\0';
+    
+    InlineMode inline_mode = g_pending_inline;
+    g_pending_inline = INLINE_AUTO;
+    char attrs[128];
+    snprintf(attrs, sizeof(attrs), "%s", g_pending_attrs);
+    g_pending_attrs[0] = '\0';
+    
+    if (strlen(name) == 0) {
+        error("Missing function name");
+        return;
+    }
+    
+    // Calls to these are lowered before user functions are looked up
+    static const char* statements[] = { "print", "append", "sort", "reduce" };
+    bool reserved = find_builtin(name) != NULL || (*p != '[' && find_generic(name) != NULL);
+    for (size_t j = 0; j < sizeof(statements) / sizeof(statements[0]); j++) {
+        if (strcmp(name, statements[j]) == 0) reserved = true;
+    }
+    if (reserved) {
+        char msg[512];
+        snprintf(msg, sizeof(msg), "'%s' is already a builtin or generic function - choose another name", name);
+        error(msg);
+        return;
+    }
+    
+    if (*p == '[') {
+        begin_generic(name, p, get_indent(line), inline_mode, attrs);
+        return;
+    }
+    
+    if (strcmp(name, "main") == 0) {
+        warning("'func main' is ignored - compiler generates its own main()");
+        g_in_function = false;
+        return;
+    }
+    
+    for (int j = 0; j < g_func_count; j++) {
+        if (strcmp(g_funcs[j].name, name) == 0) {
+            char msg[512];
+            snprintf(msg, sizeof(msg), "Duplicate function definition: '%s'", name);
+            error(msg);
+        }
+    }
+    
+    log_func_decl(name);
+    
+    if (g_func_count >= MAX_FUNCS) {
+        error("Maximum function limit reached");
+        return;
+    }
+    Function* f = &g_funcs[g_func_count];
+    strcpy(f->name, name);
+    f->body[0] = '\0';
+    f->body_len = 0;
+    strcpy(f->params, "void");
+    strcpy(f->ret_c, "void");
+    f->ret = TYPE_UNKNOWN;
+    f->ret_elem = TYPE_UNKNOWN;
+    f->arity = 0;
+    f->inline_mode = inline_mode;
+    snprintf(f->attrs, sizeof(f->attrs), "%s", attrs);
+    f->is_generator = false;
+    f->yields = 0;
+    f->frame = NULL;
+    f->source_len = 0;
+    if (f->source) f->source[0] = '\0';
+    f->source_done = false;
+    f->ct_lines = NULL;
+    f->ct_indents = NULL;
+    f->ct_line_count = 0;
+    
+    // Parameters and locals are scoped to the function
+    memcpy(g_saved_vars, g_vars, sizeof(Variable) * g_var_count);
+    g_saved_var_count = g_var_count;
+    
+    p = trim_left(p);
+    if (*p == '(') {
+        char* close = strchr(p, ')');
+        if (!close) {
+            error("Missing ')' in function parameters");
+            return;
+        }
+        *close = '\0';
+        char* rest = close + 1;
+        size_t po = 0;
+        f->params[0] = '\0';
+        for (char* param = strtok(p + 1, ","); param; param = strtok(NULL, ",")) {
+            param = trim(param);
+            char* space = strrchr(param, ' ');
+            if (!space) {
+                error("Function parameter needs a type and a name, e.g. 'int n'");
+                continue;
+            }
+            *space = '\0';
+            char* pname = trim(space + 1);
+            const TypeName* tn = find_type_name(trim(param));
+            if (!tn) {
+                char msg[512];
+                snprintf(msg, sizeof(msg), "Unknown parameter type '%s'", trim(param));
+                error(msg);
+                continue;
+            }
+            if (f->arity >= MAX_PARAMS) {
+                error("Too many function parameters");
+                break;
+            }
+            char buf[600];
+            if (is_container_type(tn->type)) {
+                snprintf(buf, sizeof(buf), "%s%s* _arg_%s", f->arity ? ", " : "", tn->c_type, pname);
+                out_put(f->params, &po, sizeof(f->params), buf);
+            } else {
+                snprintf(buf, sizeof(buf), "%s%s %s", f->arity ? ", " : "", tn->c_type, pname);
+                out_put(f->params, &po, sizeof(f->params), buf);
+            }
+            register_var(pname, tn->type, false);
+            if (tn->elem != TYPE_UNKNOWN) set_var_elem_type(pname, tn->elem);
+            snprintf(f->param_names[f->arity], sizeof(f->param_names[0]), "%s", pname);
+            f->param_elems[f->arity] = tn->elem;
+            f->param_types[f->arity++] = tn->type;
+        }
+        if (f->arity == 0) strcpy(f->params, "void");
+        
+        rest = trim(rest);
+        if (starts_with(rest, "->")) {
+            const TypeName* tn = find_type_name(trim(rest + 2));
+            if (!tn) {
+                char msg[512];
+                snprintf(msg, sizeof(msg), "Unknown return type '%s'", trim(rest + 2));
+                error(msg);
+            } else {
+                strcpy(f->ret_c, tn->c_type);
+                f->ret = tn->type;
+                f->ret_elem = tn->elem;
+            }
+        } else if (*rest) {
+            error("Expected '->' and a return type after function parameters");
+        }
+    } else if (*p) {
+        error("Unexpected text after function name - expected '(' or ':'");
+    }
+    g_func_count++;
+    
+    g_in_function = true;
+    g_func_indent = get_indent(line);
+    
+    push_block(g_func_indent, "func", name, has_brace);
+}
+
+/* Uses of a container parameter in the finished body go through its pointer */
+static void alias_container_params(Function* f) {
+    for (int i = 0; i < f->arity; i++) {
+        if (!is_container_type(f->param_types[i])) continue;
+        char repl[128];
+        snprintf(repl, sizeof(repl), "(*_arg_%s)", f->param_names[i]);
+        char* body = replace_ident(f->body, f->param_names[i], repl);
+        size_t n = strlen(body);
+        if (n + 1 > sizeof(f->body)) {
+            error("Function body too large");
+        } else {
+            memcpy(f->body, body, n + 1);
+            f->body_len = (int)n;
+        }
+        free(body);
+    }
+}
+
+static void handle_append(char* line) {
+    char* p = strchr(line, '(');
+    if (!p) {
+        error("Missing '(' in append statement");
+        return;
+    }
+    p++;
+    
+    char* end = strrchr(line, ')');
+    if (!end) {
+        error("Missing ')' in append statement");
+        return;
+    }
+    
+    char args[MAX_LINE];
+    int len = end - p;
+    strncpy(args, p, len);
+    args[len] = '\0';
+    
+    char* comma = strchr(args, ',');
+    if (!comma) {
+        error("Missing ',' in append - expected: append(list, value)");
+        return;
+    }
+    
+    *comma = '\0';
+    char* list_name = trim(args);
+    char* value = trim(comma + 1);
+    
+    if (strlen(list_name) == 0) {
+        error("Missing list name in append");
+        return;
+    }
+    
+    if (strlen(value) == 0) {
+        error("Missing value in append");
+        return;
+    }
+    
+    VarType lt = get_var_type(list_name);
+    if (lt != TYPE_LIST && lt != TYPE_UNKNOWN) {
+        char msg[512];
+        snprintf(msg, sizeof(msg), "'%s' is not a list", list_name);
+        error(msg);
+    } else if (lt == TYPE_LIST && is_var_const(list_name)) {
+        char msg[512];
+        snprintf(msg, sizeof(msg), "Cannot append to constant list '%s'", list_name);
+        error(msg);
+    }
+    
+    replace_time_funcs(value);
+    
+    char c_value[MAX_LINE];
+    rewrite_expr(value, c_value, sizeof(c_value));
+    
+    log_statement("append", list_name);
+    
+    char emit_buf[MAX_LINE * 2];
+    snprintf(emit_buf, sizeof(emit_buf), "%s(&%s, %s);\n",
+             get_var_elem_type(list_name) == TYPE_FLOAT ? "flist_append" : "list_append",
+             list_name, c_value);
+    emit_no_log(emit_buf);
+}
+
+static void handle_sort(char* line) {
+    char* p = strchr(line, '(');
+    char* end = strrchr(line, ')');
+    if (!p || !end || end < p) {
+        error("Malformed sort - expected: sort(list) or sort(list, desc)");
+        return;
+    }
+    
+    char args[MAX_LINE];
+    int len = end - p - 1;
+    strncpy(args, p + 1, len);
+    args[len] = '\0';
+    
+    bool desc = false;
+    char* comma = strchr(args, ',');
+    if (comma) {
+        *comma = '\0';
+        char* order = trim(comma + 1);
+        if (strcmp(order, "desc") == 0) {
+            desc = true;
+        } else if (strcmp(order, "asc") != 0) {
+            error("Unknown sort order - expected 'asc' or 'desc'");
+        }
+    }
+    
+    char* list_name = trim(args);
+    if (get_var_type(list_name) != TYPE_LIST) {
+        char msg[512];
+        snprintf(msg, sizeof(msg), "'%s' is not a list - cannot sort", list_name);
+        error(msg);
+        return;
+    }
+    
+    log_statement("sort", list_name);
+    
+    char emit_buf[MAX_LINE];
+    snprintf(emit_buf, sizeof(emit_buf), "%s(&%s, %d);\n",
+             get_var_elem_type(list_name) == TYPE_FLOAT ? "flist_sort" : "list_sort",
+             list_name, desc ? 1 : 0);
+    emit_no_log(emit_buf);
+}
+
+static void handle_end(void) {
+    if (g_block_depth > 0) {
+        if (g_blocks[g_block_depth - 1].uses_braces) {
+            warning("Using 'end' to close block opened with '{' - use '}' instead");
+        }
+        close_block(true, false);
+    } else {
+        error("'end' without matching block");
+    }
+}
+
+static void handle_raw_statement(char* line) {
+    char* p = trim(line);
+    if (!*p) return;
+    
+    replace_time_funcs(p);
+    
+    char first_word[256];
+    int i = 0;
+    const char* pp = p;
+    while (*pp && (isalnum(*pp) || *pp == '_')) {
+        if (i < 255) first_word[i++] = *pp;
+        pp++;
+    }
+    first_word[i] = '\0';
+    
+    bool is_func_call = false;
+    for (int j = 0; j < g_func_count; j++) {
+        if (strcmp(g_funcs[j].name, first_word) == 0) {
+            is_func_call = true;
+            break;
+        }
+    }
+    
+    if (is_func_call) {
+        log_func_call(first_word);
+    } else {
+        log_statement("raw", p);
+    }
+    
+    if (strcmp(p, "break") == 0) {
+        emit_break();
+        return;
+    }
+    
+    const char* eq = skip_spaces(pp);
+    if (first_word[0] && eq[0] == '=' && eq[1] != '=' && starts_with(skip_spaces(eq + 1), "reduce(")) {
+        emit_reduce(first_word, get_var_type(first_word), skip_spaces(eq + 1), false);
+        return;
+    }
+    if (first_word[0] && eq[0] == '=' && eq[1] != '=') {
+        char src[256];
+        snprintf(src, sizeof(src), "%s", skip_spaces(eq + 1));
+        note_list_copy(first_word, trim(src));
+    }
+    
+    char buffer[MAX_LINE];
+    rewrite_expr(p, buffer, sizeof(buffer) - 2);
+    
+    strcat(buffer, ";\n");
+    emit_no_log(buffer);
+}
+
+/* ============== Parallel Loops ============== */
+
+/*
+ * parallel for i = A to B:
+ * The body is outlined into _parN_body(ctx, lo, hi), which runs iterations
+ * [lo, hi) and is handed to a_parallel_for on the runtime's thread pool.
+ * Variables from outside the loop are captured in a _parN_ctx struct:
+ * scalars by value, containers by pointer (each use becomes (*_c->name), as
+ * for container parameters). Writes that would race between threads are
+ * errors. reduce expressions are outlined the same way (see emit_reduce).
+ */
+
+#define MAX_PARALLEL_DEPTH 8
+
+typedef struct {
+    char var[64];
+    char start[MAX_LINE];
+    char end[MAX_LINE];
+    int body_at;
+    int var_count;      /* variables declared before the loop: the capture candidates */
+    int line_num;
+} ParallelLoop;
+
+static ParallelLoop g_parallel[MAX_PARALLEL_DEPTH];
+static int g_parallel_depth = 0;
+static int g_parallel_count = 0;
+static char* g_parallel_code = NULL;    /* outlined bodies, emitted before the function definitions */
+static size_t g_parallel_len = 0, g_parallel_cap = 0;
+
+static void append_parallel_code(const char* s) {
+    size_t n = strlen(s);
+    if (g_parallel_len + n + 1 > g_parallel_cap) {
+        g_parallel_cap = (g_parallel_len + n + 1) * 2;
+        g_parallel_code = (char*)realloc(g_parallel_code, g_parallel_cap);
+    }
+    memcpy(g_parallel_code + g_parallel_len, s, n + 1);
+    g_parallel_len += n;
+}
+
+static void handle_parallel_for(char* line, bool has_brace) {
+    char* p = trim_left(trim_left(line) + 8) + 3;
+    p = trim_left(p);
+    if (has_brace) strip_trailing_brace(p);
+    p = trim(p);
+    size_t len = strlen(p);
+    if (len > 0 && p[len - 1] == ':') p[--len] = '\0';
+
+    char var[64], start[MAX_LINE], end[MAX_LINE];
+    char* eq = strchr(p, '=');
+    char* to = strstr(p, " to ");
+    if (!eq || !to || to < eq || starts_with(skip_spaces(to + 4), "(")) {
+        error("parallel for needs a range: parallel for i = A to B");
+        return;
+    }
+    snprintf(var, sizeof(var), "%.*s", (int)(eq - p), p);
+    snprintf(start, sizeof(start), "%.*s", (int)(to - eq - 1), eq + 1);
+    snprintf(end, sizeof(end), "%s", to + 4);
+    char* v = trim(var);
+    if (!*v || !is_ident_char(*v) || isdigit((unsigned char)*v)) {
+        error("parallel for needs a loop variable: parallel for i = A to B");
+        return;
+    }
+    if (g_parallel_depth >= MAX_PARALLEL_DEPTH) {
+        error("parallel for nested too deeply");
+        return;
+    }
+
+    ParallelLoop* pl = &g_parallel[g_parallel_depth++];
+    snprintf(pl->var, sizeof(pl->var), "%s", v);
+    rewrite_expr(trim(start), pl->start, sizeof(pl->start));
+    rewrite_expr(trim(end), pl->end, sizeof(pl->end));
+    int* buf_len;
+    int cap;
+    emit_buffer(&buf_len, &cap);
+    pl->body_at = *buf_len;
+    pl->var_count = g_var_count;
+    pl->line_num = g_current_line;
+    register_var(pl->var, TYPE_INT, false);
+    push_block(get_indent(line), "parallel", pl->var, has_brace);
+}
+
+/* C type of a variable, or NULL when it has none that can be captured */
+static const char* var_c_type(const Variable* v) {
+    return c_type_of(v->type, v->elem_type);
+}
+
+/* Whether the body declares 'name' itself (a statement or for header starting with its type) */
+static bool body_declares(const char* body, const char* name) {
+    for (const char* p = body; *p; ) {
+        while (*p == ' ') p++;
+        for (;;) {
+            if (starts_with(p, "for (")) p += 5;
+            else if (starts_with(p, "{ ")) p += 2;
+            else break;
+        }
+        char type[64];
+        size_t n = decl_type(p, type, sizeof(type));
+        if (n) {
+            const char* d = p + n;
+            size_t len = strlen(name);
+            if (strncmp(d, name, len) == 0 && !is_ident_char(d[len])) return true;
+        }
+        const char* nl = strchr(p, '\n');
+        if (!nl) break;
+        p = nl + 1;
+    }
+    return false;
+}
+
+static bool parallel_writes(const char* body, const char* name, bool container, char* fn, size_t fn_size);
+
+/* Whether user function f leaves its arg-th parameter, a container, unchanged */
+static bool func_reads_param(const Function* f, int arg) {
+    static int depth = 0;
+    if (arg >= f->arity || !is_container_type(f->param_types[arg])) return false;
+    // Unfinished (recursive) and generator bodies are not checked
+    if (!f->source_done || f->is_generator || depth >= 8) return false;
+    // The body uses the parameter as (*_arg_name); check it as a plain name
+    char param[80], use[90];
+    snprintf(param, sizeof(param), "_arg_%s", f->param_names[arg]);
+    snprintf(use, sizeof(use), "(*%s)", param);
+    char* body = strdup(f->body);
+    for (char* u = strstr(body, use); u; u = strstr(u, use)) {
+        size_t n = strlen(param);
+        memmove(u, u + 2, n);
+        memmove(u + n, u + n + 3, strlen(u + n + 3) + 1);
+    }
+    char fn[256];
+    depth++;
+    bool writes = parallel_writes(body, param, true, fn, sizeof(fn));
+    depth--;
+    free(body);
+    return !writes;
+}
+
+/*
+ * Whether function fn leaves its arg-th argument (passed by address)
+ * unchanged: for runtime functions by the mutates bits of the method and
+ * builtin tables, for user functions by their body. Anything else is taken
+ * to write.
+ */
+static bool call_reads_arg(const char* fn, int arg) {
+    if (!fn[0]) return false;
+    const Function* f = find_func(fn);
+    if (f) return func_reads_param(f, arg);
+    for (size_t i = 0; i < sizeof(g_methods) / sizeof(g_methods[0]); i++) {
+        if (strcmp(g_methods[i].c_func, fn) == 0) return !(g_methods[i].mutates >> arg & 1);
+    }
+    for (size_t i = 0; i < sizeof(g_builtins) / sizeof(g_builtins[0]); i++) {
+        const BuiltinDef* b = &g_builtins[i];
+        if (strcmp(b->c_func, fn) == 0 || (b->flist_c_func && strcmp(b->flist_c_func, fn) == 0)) {
+            return !(b->mutates >> arg & 1);
+        }
+    }
+    // print(X) on a container
+    return starts_with(fn, "print_");
+}
+
+/*
+ * How the body writes 'name': assignment, ++/--, or taking its address. A
+ * container's address may go to calls that only read it (call_reads_arg);
+ * 'fn' gets the function it is passed to where that call writes. Copying a
+ * container (B = name) counts as a write, since the copy shares its storage.
+ */
+static bool parallel_writes(const char* body, const char* name, bool container, char* fn, size_t fn_size) {
+    size_t len = strlen(name);
+    fn[0] = '\0';
+    for (const char* p = body; *p; ) {
+        if (*p == '"' || *p == '\'') {
+            p = skip_c_literal(p);
+            continue;
+        }
+        if (!is_ident_char(*p)) {
+            p++;
+            continue;
+        }
+        const char* word = p;
+        while (is_ident_char(*p)) p++;
+        if ((size_t)(p - word) != len || strncmp(word, name, len) != 0) continue;
+        if (word > body && (word[-1] == '.' || word[-1] == '>')) continue;
+        const char* q = skip_spaces(p);
+        if ((q[0] == '=' && q[1] != '=') || starts_with(q, "++") || starts_with(q, "--") ||
+            (strchr("+-*/%&|^", q[0]) && q[0] && q[1] == '=') ||
+            ((starts_with(q, "<<") || starts_with(q, ">>")) && q[2] == '=')) {
+            return true;
+        }
+        const char* b = word;
+        while (b > body && b[-1] == ' ') b--;
+        if (container && b > body && b[-1] == '=' && !(b - body >= 2 && strchr("=!<>", b[-2])) &&
+            (*q == ';' || *q == ',')) {
+            return true;
+        }
+        if (b - body >= 2 && (strncmp(b - 2, "++", 2) == 0 || strncmp(b - 2, "--", 2) == 0)) return true;
+        if (b > body && b[-1] == '&' && !(b - body >= 2 && b[-2] == '&')) {
+            // Address taken: unary unless an operand comes before the '&'
+            const char* a = b - 1;
+            while (a > body && a[-1] == ' ') a--;
+            if (a == body || strchr("(,=!", a[-1])) {
+                // Name the called function, found before the '(' that opens the
+                // argument list, and count the arguments before this one
+                int depth = 0, arg = 0;
+                const char* c = a;
+                while (c > body) {
+                    c--;
+                    if (*c == ')') depth++;
+                    else if (*c == '(' && depth-- == 0) break;
+                    else if (*c == ',' && depth == 0) arg++;
+                    else if (*c == '\n' || *c == ';') break;
+                }
+                const char* e = c;
+                while (c > body && is_ident_char(c[-1])) c--;
+                fn[0] = '\0';
+                if (*e == '(' && e > c) snprintf(fn, fn_size, "%.*s", (int)(e - c), c);
+                if (container && call_reads_arg(fn, arg)) continue;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/* What an outlined body captures: context fields, their values at the call site, and loads in the body */
+typedef struct {
+    char fields[MAX_LINE * 4];
+    char inits[MAX_LINE * 2];
+    char loads[MAX_LINE * 4];
+    char containers[32][64];    /* captured by pointer: each use becomes (*_c->name) */
+    int container_count;
+    size_t fo, io, lo;
+} Captures;
+
+/*
+ * Captures the variables among the first var_count that body uses and does not
+ * declare. 'construct' names the parallel for or reduce in diagnostics.
+ */
+static void capture_vars(const char* body, int var_count, const char* loop_var, const char* construct,
+                         int line_num, Captures* cp) {
+    char line[MAX_LINE], msg[512];
+    cp->fo = cp->io = cp->lo = 0;
+    cp->container_count = 0;
+    cp->fields[0] = cp->inits[0] = cp->loads[0] = '\0';
+
+    for (const char* p = body; *p; ) {
+        if (*p == '"' || *p == '\'') {
+            p = skip_c_literal(p);
+            continue;
+        }
+        if (!is_ident_char(*p) || isdigit((unsigned char)*p)) {
+            if (isdigit((unsigned char)*p)) while (is_ident_char(*p) || *p == '.') p++;
+            else p++;
+            continue;
+        }
+        const char* word = p;
+        while (is_ident_char(*p)) p++;
+        if (word > body && (word[-1] == '.' || word[-1] == '>')) continue;
+        char name[256];
+        snprintf(name, sizeof(name), "%.*s", (int)(p - word), word);
+        if (strcmp(name, "return") == 0) {
+            snprintf(msg, sizeof(msg), "'return' cannot leave a %s", construct);
+            error_at(line_num, msg);
+            continue;
+        }
+        int vi = -1;
+        for (int i = 0; i < var_count; i++) {
+            if (strcmp(g_vars[i].name, name) == 0) vi = i;
+        }
+        if (vi < 0 || strcmp(name, loop_var) == 0 || body_declares(body, name)) continue;
+        // Capture each variable once
+        char key[300];
+        snprintf(key, sizeof(key), " %s;\n", name);
+        if (strstr(cp->fields, key)) continue;
+
+        const Variable* v = &g_vars[vi];
+        const char* type = var_c_type(v);
+        if (!type) {
+            snprintf(msg, sizeof(msg), "%s cannot capture '%s'", construct, name);
+            error_at(line_num, msg);
+            continue;
+        }
+        char fn[256];
+        bool written = parallel_writes(body, name, is_container_type(v->type), fn, sizeof(fn));
+        const char* cq = v->is_const ? "const " : "";
+        if (is_container_type(v->type)) {
+            if (written) {
+                snprintf(msg, sizeof(msg), "Iterations of %s race on '%s'%s%s%s", construct, name,
+                         fn[0] ? " (" : "", fn, fn[0] ? " changes it)" : "");
+                error_at(line_num, msg);
+            }
+            snprintf(line, sizeof(line), "    %s%s* %s;\n", cq, type, name);
+            out_put(cp->fields, &cp->fo, sizeof(cp->fields), line);
+            snprintf(line, sizeof(line), "%s&%s", cp->io ? ", " : "", name);
+            out_put(cp->inits, &cp->io, sizeof(cp->inits), line);
+            if (cp->container_count == 32) {
+                snprintf(msg, sizeof(msg), "%s captures too many containers", construct);
+                error_at(line_num, msg);
+                continue;
+            }
+            snprintf(cp->containers[cp->container_count++], 64, "%s", name);
+        } else {
+            if (written && strcmp(construct, "parallel for") == 0) {
+                snprintf(msg, sizeof(msg), "Iterations of parallel for race on '%s' - accumulate with reduce, "
+                         "or write to a list indexed by '%s'", name, loop_var);
+                error_at(line_num, msg);
+            } else if (written) {
+                snprintf(msg, sizeof(msg), "Iterations of %s race on '%s'", construct, name);
+                error_at(line_num, msg);
+            }
+            snprintf(line, sizeof(line), "    %s %s;\n", type, name);
+            out_put(cp->fields, &cp->fo, sizeof(cp->fields), line);
+            snprintf(line, sizeof(line), "%s%s", cp->io ? ", " : "", name);
+            out_put(cp->inits, &cp->io, sizeof(cp->inits), line);
+            snprintf(line, sizeof(line), "    %s%s %s = _c->%s;\n", cq, type, name, name);
+            out_put(cp->loads, &cp->lo, sizeof(cp->loads), line);
+        }
+    }
+}
+
+/* Copy of an outlined body with captured containers reached through the context */
+static char* alias_captures(const Captures* cp, const char* body) {
+    char* out = strdup(body);
+    for (int i = 0; i < cp->container_count; i++) {
+        char repl[128];
+        snprintf(repl, sizeof(repl), "(*_c->%s)", cp->containers[i]);
+        char* next = replace_ident(out, cp->containers[i], repl);
+        free(out);
+        out = next;
+    }
+    return out;
+}
+
+/* Closes a parallel for: moves its body into an outlined function and emits the call */
+static void finish_parallel(void) {
+    if (g_parallel_depth == 0) return;
+    ParallelLoop* pl = &g_parallel[--g_parallel_depth];
+    int id = ++g_parallel_count;
+    int* len;
+    int cap;
+    char* buf = emit_buffer(&len, &cap);
+    char* body = strdup(buf + pl->body_at);
+    *len = pl->body_at;
+    buf[*len] = '\0';
+
+    static Captures cp;
+    capture_vars(body, pl->var_count, pl->var, "parallel for", pl->line_num, &cp);
+    if (!cp.fo) {
+        out_put(cp.fields, &cp.fo, sizeof(cp.fields), "    char _unused;\n");
+        out_put(cp.inits, &cp.io, sizeof(cp.inits), "0");
+    }
+    char* aliased = alias_captures(&cp, body);
+    free(body);
+    body = aliased;
+
+    char line[MAX_LINE];
+    size_t size = strlen(body) + sizeof(cp.fields) + sizeof(cp.loads) + 1024;
+    char* code = (char*)malloc(size);
+    size_t o = 0;
+    code[0] = '\0';
+    snprintf(line, sizeof(line), "/* parallel for at line %d */\ntypedef struct {\n", pl->line_num);
+    out_put(code, &o, size, line);
+    out_put(code, &o, size, cp.fields);
+    snprintf(line, sizeof(line),
+             "} _par%d_ctx;\n\n"
+             "static void _par%d_body(void* _ctx, long _lo, long _hi) {\n"
+             "    _par%d_ctx* _c = (_par%d_ctx*)_ctx;\n",
+             id, id, id, id);
+    out_put(code, &o, size, line);
+    out_put(code, &o, size, cp.loads);
+    snprintf(line, sizeof(line), "    for (int %s = (int)_lo; %s < (int)_hi; %s++) {\n", pl->var, pl->var, pl->var);
+    out_put(code, &o, size, line);
+    out_put(code, &o, size, body);
+    out_put(code, &o, size, "    }\n");
+    out_put(code, &o, size, "}\n\n");
+    append_parallel_code(code);
+
+    char call[MAX_LINE * 5];
+    snprintf(call, sizeof(call),
+             "{\n"
+             "    _par%d_ctx _par%d = { %s };\n"
+             "    a_parallel_for((long)(%s), (long)(%s) + 1, _par%d_body, &_par%d);\n"
+             "}\n",
+             id, id, cp.inits, pl->start, pl->end, id, id);
+    emit_no_log(call);
+    free(body);
+    free(code);
+}
+
+/*
+ * int s = reduce(sum) over x in L: x * x
+ * float m = reduce(max) over i = 0 to n - 1: f(i)
+ * Ops: sum, min, max, count (iterations where the expression is true) or a
+ * function of two arguments with its identity, reduce(gcd, 0). Each chunk
+ * accumulates in a local with an 'omp simd' reduction; chunk results go into
+ * one partial per thread, combined pairwise at the end. reduce(sum, pairwise)
+ * instead gives every block of A_REDUCE_BLOCK elements its own partial, so a
+ * float sum comes out the same whatever the thread count.
+ */
+static void emit_reduce(const char* target, VarType type, const char* value, bool declare) {
+    const char* p = skip_spaces(value) + 6;
+    const char* close = group_end(p);
+    if (!close) {
+        error("Missing ')' in reduce");
+        return;
+    }
+    if (type != TYPE_INT && type != TYPE_FLOAT) {
+        error("reduce produces an int or a float");
+        return;
+    }
+    char op[256], arg[MAX_LINE];
+    snprintf(op, sizeof(op), "%.*s", (int)(close - p - 1), p + 1);
+    arg[0] = '\0';
+    char* comma = (char*)find_top_level(op, ",");
+    if (comma) {
+        *comma = '\0';
+        snprintf(arg, sizeof(arg), "%s", comma + 1);
+    }
+    char* o = trim(op);
+    char* a = trim(arg);
+    bool pairwise = strcmp(a, "pairwise") == 0;
+    bool builtin = strcmp(o, "sum") == 0 || strcmp(o, "min") == 0 || strcmp(o, "max") == 0 ||
+                   strcmp(o, "count") == 0;
+    if (builtin && *a && !(pairwise && strcmp(o, "sum") == 0)) {
+        error("Only reduce(sum, pairwise) takes a second argument");
+        return;
+    }
+    if (!builtin) {
+        const Function* f = find_func(o);
+        if (!f || f->arity != 2) {
+            char msg[512];
+            snprintf(msg, sizeof(msg), "'%s' is not sum, min, max, count or a function of two arguments", o);
+            error(msg);
+            return;
+        }
+        if (!*a) {
+            error("A custom reduce needs the identity of its function: reduce(f, 0)");
+            return;
+        }
+    }
+
+    const char* over = skip_spaces(close + 1);
+    const char* colon = starts_with(over, "over ") ? find_top_level(over, ":") : NULL;
+    if (!colon || !*skip_spaces(colon + 1)) {
+        error("Expected 'over x in L: expr' or 'over i = A to B: expr' after reduce(...)");
+        return;
+    }
+    char binding[MAX_LINE], var[64], list[256], first[MAX_LINE], end[MAX_LINE];
+    snprintf(binding, sizeof(binding), "%.*s", (int)(colon - over - 5), over + 5);
+    const char* in = find_top_level(binding, " in ");
+    bool is_float_list = false;
+    list[0] = '\0';
+    if (in) {
+        snprintf(var, sizeof(var), "%.*s", (int)(in - binding), binding);
+        snprintf(list, sizeof(list), "%s", skip_spaces(in + 4));
+        trim(list);
+        if (get_var_type(list) != TYPE_LIST) {
+            char msg[512];
+            snprintf(msg, sizeof(msg), "'%s' is not a list - reduce reads a list or a range", list);
+            error(msg);
+            return;
+        }
+        is_float_list = get_var_elem_type(list) == TYPE_FLOAT;
+        snprintf(first, sizeof(first), "0");
+        snprintf(end, sizeof(end), "%s.size", list);
+    } else {
+        char* eq = strchr(binding, '=');
+        char* to = strstr(binding, " to ");
+        if (!eq || !to || to < eq) {
+            error("Expected 'over x in L: expr' or 'over i = A to B: expr' after reduce(...)");
+            return;
+        }
+        *to = '\0';
+        snprintf(var, sizeof(var), "%.*s", (int)(eq - binding), binding);
+        char c_expr[MAX_LINE];
+        rewrite_expr(trim(eq + 1), c_expr, sizeof(c_expr));
+        snprintf(first, sizeof(first), "(long)(%s)", c_expr);
+        rewrite_expr(trim(to + 4), c_expr, sizeof(c_expr));
+        snprintf(end, sizeof(end), "(long)(%s) + 1", c_expr);
+    }
+    char* v = trim(var);
+    int var_count = g_var_count;
+    register_var(v, is_float_list ? TYPE_FLOAT : TYPE_INT, false);
+
+    const char* acc = type == TYPE_FLOAT ? "float" : "int";
+    char identity[MAX_LINE], expr[MAX_LINE], elem[MAX_LINE + 32];
+    rewrite_expr(skip_spaces(colon + 1), expr, sizeof(expr));
+    snprintf(elem, sizeof(elem), strcmp(o, "count") == 0 ? "((%s) ? 1 : 0)" : "(%s)", expr);
+    if (!builtin) {
+        rewrite_expr(a, identity, sizeof(identity));
+    } else if (strcmp(o, "min") == 0) {
+        snprintf(identity, sizeof(identity), "%s", type == TYPE_FLOAT ? "INFINITY" : "INT_MAX");
+    } else if (strcmp(o, "max") == 0) {
+        snprintf(identity, sizeof(identity), "%s", type == TYPE_FLOAT ? "-INFINITY" : "INT_MIN");
+    } else {
+        snprintf(identity, sizeof(identity), "0");
+    }
+    // The combining step as a format taking the two operands
+    char combine[300];
+    if (!builtin) snprintf(combine, sizeof(combine), "%s(%%s, %%s)", o);
+    else if (strcmp(o, "min") == 0) snprintf(combine, sizeof(combine), "(%%2$s < %%1$s ? %%2$s : %%1$s)");
+    else if (strcmp(o, "max") == 0) snprintf(combine, sizeof(combine), "(%%2$s > %%1$s ? %%2$s : %%1$s)");
+    else snprintf(combine, sizeof(combine), "%%s + %%s");
+    const char* clause = !builtin ? NULL : strcmp(o, "min") == 0 ? "min" : strcmp(o, "max") == 0 ? "max" : "+";
+
+    // The loop over one chunk, [_from, _to)
+    int id = ++g_parallel_count;
+    size_t size = strlen(expr) * 2 + strlen(identity) + MAX_LINE * 2;
+    char* inner = (char*)malloc(size);
+    char step[MAX_LINE * 3], line[MAX_LINE * 3];
+    size_t io = 0;
+    inner[0] = '\0';
+    if (list[0]) {
+        snprintf(line, sizeof(line), "    const %s* _xs = %s.data;\n", is_float_list ? "float" : "int", list);
+        out_put(inner, &io, size, line);
+    }
+    snprintf(line, sizeof(line), "%s    %s _acc = %s;\n", pairwise ? "    " : "", acc, identity);
+    if (pairwise) {
+        out_put(inner, &io, size,
+                "    for (long _b = _lo; _b < _hi; _b++) {\n"
+                "        long _from = _c->_first + _b * A_REDUCE_BLOCK;\n"
+                "        long _to = _from + A_REDUCE_BLOCK < _c->_end ? _from + A_REDUCE_BLOCK : _c->_end;\n");
+    }
+    out_put(inner, &io, size, line);
+    if (clause) {
+        snprintf(line, sizeof(line), "#pragma omp simd reduction(%s:_acc)\n", clause);
+        out_put(inner, &io, size, line);
+    }
+    const char* ix = list[0] ? "_i" : v;
+    const char* from = pairwise ? "_from" : "_lo";
+    const char* to = pairwise ? "_to" : "_hi";
+    snprintf(line, sizeof(line), "    for (int %s = (int)%s; %s < (int)%s; %s++) {\n", ix, from, ix, to, ix);
+    out_put(inner, &io, size, line);
+    if (list[0]) {
+        snprintf(line, sizeof(line), "        %s %s = _xs[_i];\n", is_float_list ? "float" : "int", v);
+        out_put(inner, &io, size, line);
+    }
+    snprintf(step, sizeof(step), combine, "_acc", "_v");
+    snprintf(line, sizeof(line), "        %s _v = %s;\n        _acc = %s;\n    }\n", acc, elem, step);
+    out_put(inner, &io, size, line);
+    if (pairwise) {
+        out_put(inner, &io, size, "        _c->_parts[_b] = _acc;\n    }\n");
+    } else {
+        snprintf(step, sizeof(step), combine, "*_p", "_acc");
+        snprintf(line, sizeof(line), "    %s* _p = &_c->_parts[a_thread_index * 16];\n    *_p = %s;\n", acc, step);
+        out_put(inner, &io, size, line);
+    }
+
+    static Captures cp;
+    capture_vars(inner, var_count, v, "reduce", g_current_line, &cp);
+    char* aliased = alias_captures(&cp, inner);
+    free(inner);
+    inner = aliased;
+    size_t csize = strlen(inner) + sizeof(cp.fields) + sizeof(cp.loads) + 1024;
+    char* code = (char*)malloc(csize);
+    size_t co = 0;
+    code[0] = '\0';
+    snprintf(line, sizeof(line), "/* reduce at line %d */\ntypedef struct {\n", g_current_line);
+    out_put(code, &co, csize, line);
+    out_put(code, &co, csize, cp.fields);
+    snprintf(line, sizeof(line),
+             "    %s* _parts;\n"
+             "    long _first;\n"
+             "    long _end;\n"
+             "} _par%d_ctx;\n\n"
+             "static void _par%d_body(void* _ctx, long _lo, long _hi) {\n"
+             "    _par%d_ctx* _c = (_par%d_ctx*)_ctx;\n",
+             acc, id, id, id, id);
+    out_put(code, &co, csize, line);
+    out_put(code, &co, csize, cp.loads);
+    out_put(code, &co, csize, inner);
+    out_put(code, &co, csize, "}\n\n");
+    append_parallel_code(code);
+
+    // Call site: one partial per thread (or block), then a pairwise combine in index order
+    int stride = pairwise ? 1 : 16;
+    char* call = (char*)malloc(csize);
+    co = 0;
+    call[0] = '\0';
+    if (declare) {
+        snprintf(line, sizeof(line), "%s %s;\n", acc, target);
+        out_put(call, &co, csize, line);
+    }
+    snprintf(line, sizeof(line), "{\n    _par%d_ctx _par%d = { %s%sNULL, %s, %s };\n", id, id, cp.inits,
+             cp.io ? ", " : "", first, end);
+    out_put(call, &co, csize, line);
+    if (pairwise) {
+        snprintf(line, sizeof(line),
+                 "    long _par%d_n = _par%d._end > _par%d._first ? "
+                 "(_par%d._end - _par%d._first + A_REDUCE_BLOCK - 1) / A_REDUCE_BLOCK : 0;\n",
+                 id, id, id, id, id);
+    } else {
+        snprintf(line, sizeof(line), "    long _par%d_n = a_thread_count();\n", id);
+    }
+    out_put(call, &co, csize, line);
+    snprintf(line, sizeof(line),
+             "    %s* _par%d_parts = (%s*)malloc(sizeof(%s) * (_par%d_n * %d + 1));\n"
+             "    _par%d_parts[0] = %s;\n"
+             "    for (long _k = 0; _k < _par%d_n; _k++) _par%d_parts[_k * %d] = %s;\n"
+             "    _par%d._parts = _par%d_parts;\n",
+             acc, id, acc, acc, id, stride, id, identity, id, id, stride, identity, id, id);
+    out_put(call, &co, csize, line);
+    if (pairwise) {
+        snprintf(line, sizeof(line), "    a_parallel_for(0, _par%d_n, _par%d_body, &_par%d);\n", id, id, id);
+    } else {
+        snprintf(line, sizeof(line), "    a_parallel_for(_par%d._first, _par%d._end, _par%d_body, &_par%d);\n",
+                 id, id, id, id);
+    }
+    out_put(call, &co, csize, line);
+    char left[64], right[64];
+    snprintf(left, sizeof(left), "_par%d_parts[_k * %d]", id, stride);
+    snprintf(right, sizeof(right), "_par%d_parts[(_k + _w) * %d]", id, stride);
+    snprintf(step, sizeof(step), combine, left, right);
+    snprintf(line, sizeof(line),
+             "    for (long _w = 1; _w < _par%d_n; _w *= 2) {\n"
+             "        for (long _k = 0; _k + _w < _par%d_n; _k += 2 * _w) {\n"
+             "            %s = %s;\n"
+             "        }\n"
+             "    }\n"
+             "    %s = _par%d_parts[0];\n"
+             "    free(_par%d_parts);\n"
+             "}\n",
+             id, id, left, step, target, id, id);
+    out_put(call, &co, csize, line);
+    emit_no_log(call);
+    free(inner);
+    free(code);
+    free(call);
+}
+
+/* ============== Main Processing ============== */
+
+static void process_line(char* original_line) {
+    char line[MAX_LINE];
+    strncpy(line, original_line, MAX_LINE - 1);
+    line[MAX_LINE - 1] = '\0';
+    
+    g_current_line++;
+    
+    if (capture_generic_line(original_line)) return;
+    
+    char* comment = strchr(line, '#');
+    if (comment) *comment = '\0';
+    
+    if (is_empty_or_comment(line)) return;
+    
+    int indent = get_indent(line);
+    char* trimmed = trim_left(line);
+    
+    log_parse_line(trim(trimmed), indent);
+    
+    // Handle closing brace
+    if (is_closing_brace(trimmed)) {
+        close_brace_block();
+        return;
+    }
+    
+    if (strcmp(trim(trimmed), "end") == 0) {
+        handle_end();
+        return;
+    }
+    
+    // Check if line ends with opening brace
+    bool has_brace = ends_with_brace(trimmed);
+    
+    if (!is_raw_mode() && g_block_depth > 0) {
+        if (!starts_with(trimmed, "elif") && !starts_with(trimmed, "else")) {
+            auto_close_blocks_to_indent(indent);
+        } else {
+            // Close nested blocks but keep the if-chain this line continues
+            auto_close_blocks_to_indent(indent + 1);
+        }
+    }
+    
+    if (g_in_function && g_func_count > 0) {
+        record_func_source(&g_funcs[g_func_count - 1], line);
+    }
+    
+    char* t = trimmed;
+    
+    if (g_block_depth > 0 && strcmp(g_blocks[g_block_depth - 1].type, "match") == 0 &&
+        !starts_with(t, "case ")) {
+        error("Expected 'case' after 'match'");
+        return;
+    }
+    
+    if (strcmp(trim(t), "@inline") == 0 || strcmp(trim(t), "@noinline") == 0) {
+        g_pending_inline = strcmp(t, "@inline") == 0 ? INLINE_ALWAYS : INLINE_NEVER;
+        return;
+    }
+    
+    if (strcmp(t, "@hot") == 0 || strcmp(t, "@cold") == 0 || starts_with(t, "@opt(")) {
+        handle_func_attr(t);
+        return;
+    }
+    
+    if (starts_with(t, "const ")) {
+        handle_variable_decl(t, true);
+    }
+    else if (starts_with(t, "int ") || starts_with(t, "float ") || 
+             starts_with(t, "bool ") || starts_with(t, "string ") ||
+             starts_with(t, "list ") || starts_with(t, "list[") ||
+             starts_with(t, "dict ") ||
+             starts_with(t, "tuple ") || starts_with(t, "set ") ||
+             starts_with(t, "set[") || starts_with(t, "sorted ") ||
+             starts_with(t, "deque ") || starts_with(t, "deque[") ||
+             starts_with(t, "heap ") || starts_with(t, "heap[") ||
+             starts_with(t, "ordmap ") ||
+             starts_with(t, "lru[") || starts_with(t, "hasher ") ||
+             starts_with(t, "rng ") || starts_with(t, "rng[") ||
+             starts_with(t, "tdigest ") || starts_with(t, "regex ") ||
+             starts_with(t, "bloom ") || starts_with(t, "bloom[") ||
+             starts_with(t, "cms ") || starts_with(t, "cms[")) {
+        handle_variable_decl(t, false);
+    }
+    else if (starts_with(t, "print(")) {
+        handle_print(t);
+    }
+    else if (starts_with(t, "if ")) {
+        handle_if(original_line, has_brace);
+    }
+    else if (starts_with(t, "elif ")) {
+        handle_elif(t, has_brace);
+    }
+    else if (starts_with(t, "else:") || starts_with(t, "else {") || 
+             starts_with(t, "else:") || strcmp(trim(t), "else") == 0) {
+        handle_else(t, has_brace);
+    }
+    else if (starts_with(t, "while ")) {
+        handle_while(original_line, has_brace);
+    }
+    else if (starts_with(t, "match ") && (has_brace || trim(t)[strlen(trim(t)) - 1] == ':')) {
+        handle_match(original_line, has_brace);
+    }
+    else if (starts_with(t, "case ")) {
+        handle_case(t);
+    }
+    else if (starts_with(t, "for ")) {
+        handle_for(original_line, has_brace);
+    }
+    else if (is_loop_hint(t)) {
+        handle_loop_hints(original_line, has_brace);
+    }
+    else if (starts_with(t, "parallel for ")) {
+        handle_parallel_for(original_line, has_brace);
+    }
+    else if (starts_with(t, "func ")) {
+        handle_func(original_line, has_brace);
+    }
+    else if (starts_with(t, "yield ") || strcmp(trim(t), "yield") == 0) {
+        handle_yield(t);
+    }
+    else if (starts_with(t, "append(")) {
+        handle_append(t);
+    }
+    else if (starts_with(t, "sort(")) {
+        handle_sort(t);
+    }
+    else {
+        handle_raw_statement(t);
+    }
+}
+
+/* ============== Standard Library ============== */
+
+static const char* STDLIB = 
+"#include <stdio.h>\n"
+"#include <stdlib.h>\n"
+"#include <string.h>\n"
+"#include <stdbool.h>\n"
+"#include <stdarg.h>\n"
+"#include <math.h>\n"
+"#include <time.h>\n"
+"#include <setjmp.h>\n"
+"#include <stdint.h>\n"
+"#include <limits.h>\n"
+"#include <pthread.h>\n"
+"#include <unistd.h>\n"
+"#if defined(__AVX2__)\n"
+"#include <immintrin.h>\n"
+"#elif defined(__SSE4_2__)\n"
+"#include <nmmintrin.h>\n"
+"#elif defined(__SSE2__)\n"
+"#include <emmintrin.h>\n"
+"#endif\n"
+"\n"
+"/* print() of an integer; hash64 and digest() results are unsigned 64-bit */\n"
+"#define print_int(x) _Generic((x), \\\n"
+"    uint64_t: printf(\"%llu\\n\", (unsigned long long)(x)), \\\n"
+"    default: printf(\"%lld\\n\", (long long)(x)))\n"
+"\n"
+"/* List implementation */\n"
+"typedef struct {\n"
+"    int* data;\n"
+"    int size;\n"
+"    int cap;\n"
+"} List;\n"
+"\n"
+"/* List storage is 64-byte aligned from creation and stays aligned as it grows,\n"
+"   so simd loops can assume the alignment without touching the list */\n"
+"static void* list_alloc_aligned(size_t bytes) {\n"
+"    void* p = NULL;\n"
+"    if (posix_memalign(&p, 64, bytes ? bytes : 64) != 0) {\n"
+"        fprintf(stderr, \"Out of memory\\n\");\n"
+"        exit(1);\n"
+"    }\n"
+"    return p;\n"
+"}\n"
+"\n"
+"static void* list_realloc_data(void* data, size_t used, size_t bytes) {\n"
+"    void* p = list_alloc_aligned(bytes);\n"
+"    if (data) memcpy(p, data, used);\n"
+"    free(data);\n"
+"    return p;\n"
+"}\n"
+"\n"
+"static List new_list(void) {\n"
+"    List l;\n"
+"    l.cap = 8;\n"
+"    l.size = 0;\n"
+"    l.data = (int*)list_alloc_aligned(sizeof(int) * l.cap);\n"
+"    return l;\n"
+"}\n"
+"\n"
+"static void list_append(List* l, int val) {\n"
+"    if (l->size >= l->cap) {\n"
+"        l->cap *= 2;\n"
+"        l->data = (int*)list_realloc_data(l->data, sizeof(int) * l->size, sizeof(int) * l->cap);\n"
+"    }\n"
+"    l->data[l->size++] = val;\n"
+"}\n"
+"\n"
+
+"static void list_reserve(List* l, int n) {\n"
+"    if (n <= l->cap) return;\n"
+"    l->cap = n;\n"
+"    l->data = (int*)list_realloc_data(l->data, sizeof(int) * l->size, sizeof(int) * l->cap);\n"
+"}\n"
+"\n"
+"/* Index checks emitted in checked mode (works for FList too) */\n"
+"static void __attribute__((cold, noreturn)) list_index_fail(int i, int size, int line) {\n"
+"    fprintf(stderr, \"Line %d: list index %d out of range (size %d)\\n\", line, i, size);\n"
+"    exit(1);\n"
+"}\n"
+"\n"
+"static inline int list_check(int i, int size, int line) {\n"
+"    if (__builtin_expect((unsigned)i >= (unsigned)size, 0)) list_index_fail(i, size, line);\n"
+"    return i;\n"
+"}\n"
+"\n"
+"static void list_free(List* l) {\n"
+"    free(l->data);\n"
+"    l->data = NULL;\n"
+"    l->size = 0;\n"
+"    l->cap = 0;\n"
+"}\n"
+"\n"
+"static int list_len(const List* l) {\n"
+"    return l->size;\n"
+"}\n"
+"\n"
+"static void print_list(const List* l) {\n"
+"    printf(\"[\");\n"
+"    for (int i = 0; i < l->size; i++) {\n"
+"        printf(\"%d\", l->data[i]);\n"
+"        if (i < l->size - 1) printf(\", \");\n"
+"    }\n"
+"    printf(\"]\\n\");\n"
+"}\n"
+"\n"
+"/* Float list: same layout as List, used for list[float] */\n"
+"typedef struct {\n"
+"    float* data;\n"
+"    int size;\n"
+"    int cap;\n"
+"} FList;\n"
+"\n"
+"static FList new_flist(void) {\n"
+"    FList l;\n"
+"    l.cap = 8;\n"
+"    l.size = 0;\n"
+"    l.data = (float*)list_alloc_aligned(sizeof(float) * l.cap);\n"
+"    return l;\n"
+"}\n"
+"\n"
+"static void flist_append(FList* l, float val) {\n"
+"    if (l->size >= l->cap) {\n"
+"        l->cap *= 2;\n"
+"        l->data = (float*)list_realloc_data(l->data, sizeof(float) * l->size, sizeof(float) * l->cap);\n"
+"    }\n"
+"    l->data[l->size++] = val;\n"
+"}\n"
+"\n"
+
+"static void flist_reserve(FList* l, int n) {\n"
+"    if (n <= l->cap) return;\n"
+"    l->cap = n;\n"
+"    l->data = (float*)list_realloc_data(l->data, sizeof(float) * l->size, sizeof(float) * l->cap);\n"
+"}\n"
+"\n"
+"static void flist_free(FList* l) {\n"
+"    free(l->data);\n"
+"    l->data = NULL;\n"
+"    l->size = 0;\n"
+"    l->cap = 0;\n"
+"}\n"
+"\n"
+"static int flist_len(const FList* l) {\n"
+"    return l->size;\n"
+"}\n"
+"\n"
+"static void print_flist(const FList* l) {\n"
+"    printf(\"[\");\n"
+"    for (int i = 0; i < l->size; i++) {\n"
+"        printf(\"%f\", l->data[i]);\n"
+"        if (i < l->size - 1) printf(\", \");\n"
+"    }\n"
+"    printf(\"]\\n\");\n"
+"}\n"
+"\n"
+"static int* slice_arr(int* arr, int start, int end, int* out_len) {\n"
+"    *out_len = end - start;\n"
+"    int* result = (int*)malloc(sizeof(int) * (*out_len));\n"
+"    for (int i = 0; i < *out_len; i++) {\n"
+"        result[i] = arr[start + i];\n"
+"    }\n"
+"    return result;\n"
+"}\n"
+"\n"
+"/* Membership search used by the 'in' operator */\n"
+"static bool int_array_contains(const int* data, int n, int x) {\n"
+"    int i = 0;\n"
+"#if defined(__AVX2__)\n"
+"    __m256i needle = _mm256_set1_epi32(x);\n"
+"    for (; i + 32 <= n; i += 32) {\n"
+"        __m256i a = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(data + i)), needle);\n"
+"        __m256i b = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(data + i + 8)), needle);\n"
+"        __m256i c = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(data + i + 16)), needle);\n"
+"        __m256i d = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(data + i + 24)), needle);\n"
+"        __m256i any = _mm256_or_si256(_mm256_or_si256(a, b), _mm256_or_si256(c, d));\n"
+"        if (_mm256_movemask_epi8(any)) return true;\n"
+"    }\n"
+"    for (; i + 8 <= n; i += 8) {\n"
+"        __m256i eq = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(data + i)), needle);\n"
+"        if (_mm256_movemask_epi8(eq)) return true;\n"
+"    }\n"
+"#elif defined(__SSE2__)\n"
+"    __m128i needle = _mm_set1_epi32(x);\n"
+"    for (; i + 4 <= n; i += 4) {\n"
+"        __m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(data + i)), needle);\n"
+"        if (_mm_movemask_epi8(eq)) return true;\n"
+"    }\n"
+"#endif\n"
+"    for (; i < n; i++) {\n"
+"        if (data[i] == x) return true;\n"
+"    }\n"
+"    return false;\n"
+"}\n"
+"\n"
+"/* Same scan for floats; ordered compares, so NaN matches nothing and -0.0 matches 0.0 as with == */\n"
+"static bool float_array_contains(const float* data, int n, float x) {\n"
+"    int i = 0;\n"
+"#if defined(__AVX2__)\n"
+"    __m256 needle = _mm256_set1_ps(x);\n"
+"    for (; i + 32 <= n; i += 32) {\n"
+"        __m256 a = _mm256_cmp_ps(_mm256_loadu_ps(data + i), needle, _CMP_EQ_OQ);\n"
+"        __m256 b = _mm256_cmp_ps(_mm256_loadu_ps(data + i + 8), needle, _CMP_EQ_OQ);\n"
+"        __m256 c = _mm256_cmp_ps(_mm256_loadu_ps(data + i + 16), needle, _CMP_EQ_OQ);\n"
+"        __m256 d = _mm256_cmp_ps(_mm256_loadu_ps(data + i + 24), needle, _CMP_EQ_OQ);\n"
+"        __m256 any = _mm256_or_ps(_mm256_or_ps(a, b), _mm256_or_ps(c, d));\n"
+"        if (_mm256_movemask_ps(any)) return true;\n"
+"    }\n"
+"    for (; i + 8 <= n; i += 8) {\n"
+"        __m256 eq = _mm256_cmp_ps(_mm256_loadu_ps(data + i), needle, _CMP_EQ_OQ);\n"
+"        if (_mm256_movemask_ps(eq)) return true;\n"
+"    }\n"
+"#elif defined(__SSE2__)\n"
+"    __m128 needle = _mm_set1_ps(x);\n"
+"    for (; i + 4 <= n; i += 4) {\n"
+"        __m128 eq = _mm_cmpeq_ps(_mm_loadu_ps(data + i), needle);\n"
+"        if (_mm_movemask_ps(eq)) return true;\n"
+"    }\n"
+"#endif\n"
+"    for (; i < n; i++) {\n"
+"        if (data[i] == x) return true;\n"
+"    }\n"
+"    return false;\n"
+"}\n"
+"\n"
+"/* Index of the first element >= x in an ascending array */\n"
+"static int int_array_lower_bound(const int* data, int n, int x) {\n"
+"    if (n <= 0) return 0;\n"
+"    const int* base = data;\n"
+"    while (n > 1) {\n"
+"        int half = n / 2;\n"
+"        base = (base[half] < x) ? base + half : base;\n"
+"        n -= half;\n"
+"    }\n"
+"    return (int)(base - data) + (*base < x);\n"
+"}\n"
+"\n"
+"static bool list_contains(const List* l, int x) {\n"
+"    return int_array_contains(l->data, l->size, x);\n"
+"}\n"
+"\n"
+"static bool list_contains_sorted(const List* l, int x) {\n"
+"    int i = int_array_lower_bound(l->data, l->size, x);\n"
+"    return i < l->size && l->data[i] == x;\n"
+"}\n"
+"\n"
+"static bool str_has_char(const char* s, int c) {\n"
+"    return s && c != 0 && strchr(s, c) != NULL;\n"
+"}\n"
+"\n"
+"static bool str_contains(const char* s, const char* sub) {\n"
+"    return s && sub && strstr(s, sub) != NULL;\n"
+"}\n"
+"\n"
+"static bool flist_contains(const FList* l, float x) {\n"
+"    return float_array_contains(l->data, l->size, x);\n"
+"}\n"
+"\n"
+"/* UTF-8: validation (AVX2 lookup tables, ASCII fast path) and code point decoding */\n"
+"static bool utf8_valid_scalar(const unsigned char* s, size_t len) {\n"
+"    size_t i = 0;\n"
+"    while (i < len) {\n"
+"        /* ASCII fast path: 8 bytes per step */\n"
+"        if (i + 8 <= len) {\n"
+"            uint64_t w;\n"
+"            memcpy(&w, s + i, 8);\n"
+"            if ((w & 0x8080808080808080ULL) == 0) {\n"
+"                i += 8;\n"
+"                continue;\n"
+"            }\n"
+"        }\n"
+"        unsigned char c = s[i];\n"
+"        if (c < 0x80) {\n"
+"            i++;\n"
+"            continue;\n"
+"        }\n"
+"        int need;\n"
+"        uint32_t cp;\n"
+"        if (c >= 0xC2 && c <= 0xDF) { need = 1; cp = c & 0x1F; }\n"
+"        else if (c >= 0xE0 && c <= 0xEF) { need = 2; cp = c & 0x0F; }\n"
+"        else if (c >= 0xF0 && c <= 0xF4) { need = 3; cp = c & 0x07; }\n"
+"        else return false;\n"
+"        if (i + need >= len) return false;\n"
+"        for (int k = 1; k <= need; k++) {\n"
+"            if ((s[i + k] & 0xC0) != 0x80) return false;\n"
+"            cp = (cp << 6) | (s[i + k] & 0x3F);\n"
+"        }\n"
+"        if ((need == 2 && cp < 0x800) || (need == 3 && (cp < 0x10000 || cp > 0x10FFFF)) ||\n"
+"            (cp >= 0xD800 && cp <= 0xDFFF)) {\n"
+"            return false;\n"
+"        }\n"
+"        i += need + 1;\n"
+"    }\n"
+"    return true;\n"
+"}\n"
+"\n"
+"#if defined(__AVX2__)\n"
+"/* Keiser-Lemire: each byte is classified from the high nibble of the previous byte, the low\n"
+"   nibble of the previous byte and the high nibble of itself; any error bit surviving the AND\n"
+"   of the three lookups (or a missing 3rd/4th continuation) marks the input invalid */\n"
+"#define U8_TOO_SHORT  (1 << 0)\n"
+"#define U8_TOO_LONG   (1 << 1)\n"
+"#define U8_OVERLONG_3 (1 << 2)\n"
+"#define U8_TOO_LARGE  (1 << 3)\n"
+"#define U8_SURROGATE  (1 << 4)\n"
+"#define U8_OVERLONG_2 (1 << 5)\n"
+"#define U8_TOO_LARGE_1000 (1 << 6)\n"
+"#define U8_OVERLONG_4 (1 << 6)\n"
+"#define U8_TWO_CONTS  (1 << 7)\n"
+"#define U8_CARRY (U8_TOO_SHORT | U8_TOO_LONG | U8_TWO_CONTS)\n"
+"\n"
+"static inline __m256i utf8_lookup(__m256i nibbles, const int8_t* table) {\n"
+"    __m128i t = _mm_loadu_si128((const __m128i*)table);\n"
+"    return _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(t), nibbles);\n"
+"}\n"
+"\n"
+"/* The block shifted right by n bytes, with the tail of 'prev' shifted in */\n"
+"#define UTF8_PREV(input, prev, n) \\\n"
+"    _mm256_alignr_epi8((input), _mm256_permute2x128_si256((prev), (input), 0x21), 16 - (n))\n"
+"\n"
+"static inline __m256i utf8_block_errors(__m256i input, __m256i prev) {\n"
+"    static const int8_t byte1_high[16] = {\n"
+"        U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG,\n"
+"        U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG,\n"
+"        U8_TWO_CONTS, U8_TWO_CONTS, U8_TWO_CONTS, U8_TWO_CONTS,\n"
+"        U8_TOO_SHORT | U8_OVERLONG_2,\n"
+"        U8_TOO_SHORT,\n"
+"        U8_TOO_SHORT | U8_OVERLONG_3 | U8_SURROGATE,\n"
+"        U8_TOO_SHORT | U8_TOO_LARGE | U8_TOO_LARGE_1000 | U8_OVERLONG_4\n"
+"    };\n"
+"    static const int8_t byte1_low[16] = {\n"
+"        U8_CARRY | U8_OVERLONG_3 | U8_OVERLONG_2 | U8_OVERLONG_4,\n"
+"        U8_CARRY | U8_OVERLONG_2,\n"
+"        U8_CARRY,\n"
+"        U8_CARRY,\n"
+"        U8_CARRY | U8_TOO_LARGE,\n"
+"        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,\n"
+"        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,\n"
+"        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,\n"
+"        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,\n"
+"        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,\n"
+"        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,\n"
+"        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,\n"
+"        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,\n"
+"        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000 | U8_SURROGATE,\n"
+"        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,\n"
+"        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000\n"
+"    };\n"
+"    static const int8_t byte2_high[16] = {\n"
+"        U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT,\n"
+"        U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT,\n"
+"        U8_TOO_LONG | U8_OVERLONG_2 | U8_TWO_CONTS | U8_OVERLONG_3 | U8_TOO_LARGE_1000 | U8_OVERLONG_4,\n"
+"        U8_TOO_LONG | U8_OVERLONG_2 | U8_TWO_CONTS | U8_OVERLONG_3 | U8_TOO_LARGE,\n"
+"        U8_TOO_LONG | U8_OVERLONG_2 | U8_TWO_CONTS | U8_SURROGATE | U8_TOO_LARGE,\n"
+"        U8_TOO_LONG | U8_OVERLONG_2 | U8_TWO_CONTS | U8_SURROGATE | U8_TOO_LARGE,\n"
+"        U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT\n"
+"    };\n"
+"    const __m256i low4 = _mm256_set1_epi8(0x0F);\n"
+"    __m256i prev1 = UTF8_PREV(input, prev, 1);\n"
+"    __m256i sc = _mm256_and_si256(\n"
+"        _mm256_and_si256(\n"
+"            utf8_lookup(_mm256_and_si256(_mm256_srli_epi16(prev1, 4), low4), byte1_high),\n"
+"            utf8_lookup(_mm256_and_si256(prev1, low4), byte1_low)),\n"
+"        utf8_lookup(_mm256_and_si256(_mm256_srli_epi16(input, 4), low4), byte2_high));\n"
+"    /* Bytes two or three after a 3- or 4-byte lead must be continuations */\n"
+"    __m256i third = _mm256_subs_epu8(UTF8_PREV(input, prev, 2), _mm256_set1_epi8((char)(0xE0 - 0x80)));\n"
+"    __m256i fourth = _mm256_subs_epu8(UTF8_PREV(input, prev, 3), _mm256_set1_epi8((char)(0xF0 - 0x80)));\n"
+"    __m256i must23 = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8((char)0x80));\n"
+"    return _mm256_xor_si256(must23, sc);\n"
+"}\n"
+"\n"
+"/* Non-zero where the block ends inside a multi-byte sequence */\n"
+"static inline __m256i utf8_block_incomplete(__m256i input) {\n"
+"    const __m256i max = _mm256_setr_epi8(\n"
+"        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,\n"
+"        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,\n"
+"        (char)(0xF0 - 1), (char)(0xE0 - 1), (char)(0xC0 - 1));\n"
+"    return _mm256_subs_epu8(input, max);\n"
+"}\n"
+"\n"
+"static bool utf8_valid_bytes(const unsigned char* s, size_t len) {\n"
+"    __m256i error = _mm256_setzero_si256();\n"
+"    __m256i prev = _mm256_setzero_si256();\n"
+"    __m256i prev_incomplete = _mm256_setzero_si256();\n"
+"    size_t i = 0;\n"
+"    for (;;) {\n"
+"        __m256i input;\n"
+"        bool last = i + 32 > len;\n"
+"        if (!last) {\n"
+"            input = _mm256_loadu_si256((const __m256i*)(s + i));\n"
+"        } else {\n"
+"            /* Zero padding is ASCII, so a sequence cut off by the end shows up as too short */\n"
+"            unsigned char tail[32] = {0};\n"
+"            memcpy(tail, s + i, len - i);\n"
+"            input = _mm256_loadu_si256((const __m256i*)tail);\n"
+"        }\n"
+"        if (_mm256_movemask_epi8(input) == 0) {\n"
+"            error = _mm256_or_si256(error, prev_incomplete);\n"
+"        } else {\n"
+"            error = _mm256_or_si256(error, utf8_block_errors(input, prev));\n"
+"            prev_incomplete = utf8_block_incomplete(input);\n"
+"        }\n"
+"        prev = input;\n"
+"        if (last) break;\n"
+"        i += 32;\n"
+"    }\n"
+"    return _mm256_testz_si256(error, error);\n"
+"}\n"
+"#else\n"
+"static bool utf8_valid_bytes(const unsigned char* s, size_t len) {\n"
+"    return utf8_valid_scalar(s, len);\n"
+"}\n"
+"#endif\n"
+"\n"
+"static bool utf8_valid(const char* s) {\n"
+"    return utf8_valid_bytes((const unsigned char*)s, strlen(s));\n"
+"}\n"
+"\n"
+"/* Number of code points: every byte that is not a continuation starts one */\n"
+"static int utf8_len(const char* s) {\n"
+"    const unsigned char* p = (const unsigned char*)s;\n"
+"    size_t len = strlen(s);\n"
+"    int count = 0;\n"
+"    for (size_t i = 0; i < len; i++) count += (p[i] & 0xC0) != 0x80;\n"
+"    return count;\n"
+"}\n"
+"\n"
+"/* Decodes the code point at s[*i] and advances *i; returns -1 at the end.\n"
+"   Malformed bytes decode to U+FFFD one byte at a time. */\n"
+"static inline int utf8_next(const unsigned char* s, int* i, int len) {\n"
+"    if (*i >= len) return -1;\n"
+"    unsigned char c = s[*i];\n"
+"    if (c < 0x80) {\n"
+"        (*i)++;\n"
+"        return c;\n"
+"    }\n"
+"    int need;\n"
+"    uint32_t cp, min;\n"
+"    if (c >= 0xC2 && c <= 0xDF) { need = 1; cp = c & 0x1F; min = 0x80; }\n"
+"    else if (c >= 0xE0 && c <= 0xEF) { need = 2; cp = c & 0x0F; min = 0x800; }\n"
+"    else if (c >= 0xF0 && c <= 0xF4) { need = 3; cp = c & 0x07; min = 0x10000; }\n"
+"    else { (*i)++; return 0xFFFD; }\n"
+"    if (*i + need >= len) { (*i)++; return 0xFFFD; }\n"
+"    for (int k = 1; k <= need; k++) {\n"
+"        unsigned char cc = s[*i + k];\n"
+"        if ((cc & 0xC0) != 0x80) { (*i)++; return 0xFFFD; }\n"
+"        cp = (cp << 6) | (cc & 0x3F);\n"
+"    }\n"
+"    if (cp < min || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) { (*i)++; return 0xFFFD; }\n"
+"    *i += need + 1;\n"
+"    return (int)cp;\n"
+"}\n"
+"\n"
+"/* Regex: the compiler builds the DFA tables for every re\"...\" literal; nothing is\n"
+"   compiled at run time and every scan is a single pass of table lookups */\n"
+"typedef struct {\n"
+"    const uint32_t* trans;  /* row offsets: next = trans[state + classes[byte]] */\n"
+"    uint32_t start;\n"
+"    uint32_t accept_from;   /* states at or past this offset accept; 0 is dead */\n"
+"} ReTable;\n"
+"\n"
+"typedef struct {\n"
+"    const unsigned char* classes;   /* byte -> column */\n"
+"    ReTable fwd;                    /* anchored, forward */\n"
+"    ReTable search;                 /* unanchored, forward */\n"
+"    ReTable rsearch;                /* unanchored, reversed pattern */\n"
+"    ReTable rev;                    /* anchored, reversed pattern */\n"
+"    const char* prefix;             /* bytes every match starts with */\n"
+"    int prefix_len;\n"
+"    bool anchor_start, anchor_end;\n"
+"} Regex;\n"
+"\n"
+"#define RE_STEP(t, r, st, c) ((t)->trans[(st) + (r)->classes[(unsigned char)(c)]])\n"
+"\n"
+"/* Next position >= i where the literal prefix occurs, or -1 */\n"
+"static int regex_skip(const Regex* r, const char* s, int i, int len) {\n"
+"    if (r->prefix_len == 0) return i;\n"
+"    while (i + r->prefix_len <= len) {\n"
+"        const char* hit = (const char*)memchr(s + i, r->prefix[0], len - i - r->prefix_len + 1);\n"
+"        if (!hit) return -1;\n"
+"        i = (int)(hit - s);\n"
+"        if (memcmp(hit + 1, r->prefix + 1, r->prefix_len - 1) == 0) return i;\n"
+"        i++;\n"
+"    }\n"
+"    return -1;\n"
+"}\n"
+"\n"
+"/* End of the longest match starting at 'from', or -1 */\n"
+"static int regex_longest(const Regex* r, const char* s, int from, int len) {\n"
+"    const ReTable* t = &r->fwd;\n"
+"    uint32_t st = t->start;\n"
+"    int end = st >= t->accept_from ? from : -1;\n"
+"    for (int i = from; i < len; i++) {\n"
+"        st = RE_STEP(t, r, st, s[i]);\n"
+"        if (st == 0) break;\n"
+"        if (st >= t->accept_from) end = i + 1;\n"
+"    }\n"
+"    return end;\n"
+"}\n"
+"\n"
+"/* Leftmost start of a match ending exactly at 'len', or -1 */\n"
+"static int regex_start_at_end(const Regex* r, const char* s, int len) {\n"
+"    const ReTable* t = &r->rev;\n"
+"    uint32_t st = t->start;\n"
+"    int start = st >= t->accept_from ? len : -1;\n"
+"    for (int i = len - 1; i >= 0; i--) {\n"
+"        st = RE_STEP(t, r, st, s[i]);\n"
+"        if (st == 0) break;\n"
+"        if (st >= t->accept_from) start = i;\n"
+"    }\n"
+"    return start;\n"
+"}\n"
+"\n"
+"/* Whole string matches the pattern */\n"
+"static bool regex_match(const Regex* r, const char* s) {\n"
+"    const ReTable* t = &r->fwd;\n"
+"    uint32_t st = t->start;\n"
+"    for (const unsigned char* p = (const unsigned char*)s; *p && st; p++) {\n"
+"        st = RE_STEP(t, r, st, *p);\n"
+"    }\n"
+"    return st >= t->accept_from;\n"
+"}\n"
+"\n"
+"/* Some substring matches: stops at the first accepting state */\n"
+"static bool regex_search(const Regex* r, const char* s) {\n"
+"    int len = (int)strlen(s);\n"
+"    if (r->anchor_start && r->anchor_end) return regex_match(r, s);\n"
+"    if (r->anchor_end) return regex_start_at_end(r, s, len) >= 0;\n"
+"    if (r->anchor_start) return regex_longest(r, s, 0, len) >= 0;\n"
+"    const ReTable* t = &r->search;\n"
+"    uint32_t st = t->start;\n"
+"    if (st >= t->accept_from) return true;\n"
+"    for (int i = 0; i < len; i++) {\n"
+"        if (st == t->start) {\n"
+"            // Nothing in flight: the next match can only start at the literal prefix\n"
+"            i = regex_skip(r, s, i, len);\n"
+"            if (i < 0) return false;\n"
+"        }\n"
+"        st = RE_STEP(t, r, st, s[i]);\n"
+"        if (st >= t->accept_from) return true;\n"
+"    }\n"
+"    return false;\n"
+"}\n"
+"\n"
+"/* Start of the leftmost match, or -1 */\n"
+"static int regex_find(const Regex* r, const char* s) {\n"
+"    int len = (int)strlen(s);\n"
+"    if (r->anchor_end) {\n"
+"        int start = regex_start_at_end(r, s, len);\n"
+"        if (r->anchor_start) return start == 0 ? 0 : -1;\n"
+"        return start;\n"
+"    }\n"
+"    if (r->anchor_start) return regex_longest(r, s, 0, len) >= 0 ? 0 : -1;\n"
+"    if (!regex_search(r, s)) return -1;\n"
+"    // Reverse scan: every accepting position starts some match, the last one seen is leftmost\n"
+"    const ReTable* t = &r->rsearch;\n"
+"    uint32_t st = t->start;\n"
+"    int start = st >= t->accept_from ? len : -1;\n"
+"    for (int i = len - 1; i >= 0; i--) {\n"
+"        st = RE_STEP(t, r, st, s[i]);\n"
+"        if (st >= t->accept_from) start = i;\n"
+"    }\n"
+"    return start;\n"
+"}\n"
+"\n"
+"/* End of the longest match starting at 'start', or -1 */\n"
+"static int regex_match_end(const Regex* r, const char* s, int start) {\n"
+"    int len = (int)strlen(s);\n"
+"    if (start < 0 || start > len) return -1;\n"
+"    if (r->anchor_start && start != 0) return -1;\n"
+"    if (r->anchor_end) {\n"
+"        const ReTable* t = &r->fwd;\n"
+"        uint32_t st = t->start;\n"
+"        for (int i = start; i < len && st; i++) st = RE_STEP(t, r, st, s[i]);\n"
+"        return st >= t->accept_from ? len : -1;\n"
+"    }\n"
+"    return regex_longest(r, s, start, len);\n"
+"}\n"
+"\n"
+"/* Starts of all non-overlapping leftmost-longest matches */\n"
+"static List regex_findall(const Regex* r, const char* s) {\n"
+"    List out = new_list();\n"
+"    int len = (int)strlen(s);\n"
+"    if (r->anchor_start || r->anchor_end) {\n"
+"        int start = regex_find(r, s);\n"
+"        if (start >= 0) list_append(&out, start);\n"
+"        return out;\n"
+"    }\n"
+"    if (!regex_search(r, s)) return out;\n"
+"    \n"
+"    // One reverse pass marks every position where some match starts\n"
+"    unsigned char* starts = (unsigned char*)malloc(len + 1);\n"
+"    const ReTable* t = &r->rsearch;\n"
+"    uint32_t st = t->start;\n"
+"    starts[len] = st >= t->accept_from;\n"
+"    for (int i = len - 1; i >= 0; i--) {\n"
+"        st = RE_STEP(t, r, st, s[i]);\n"
+"        starts[i] = st >= t->accept_from;\n"
+"    }\n"
+"    int p = 0;\n"
+"    while (p <= len) {\n"
+"        const unsigned char* hit = (const unsigned char*)memchr(starts + p, 1, len + 1 - p);\n"
+"        if (!hit) break;\n"
+"        int i = (int)(hit - starts);\n"
+"        int end = regex_longest(r, s, i, len);\n"
+"        list_append(&out, i);\n"
+"        p = end > i ? end : i + 1;\n"
+"    }\n"
+"    free(starts);\n"
+"    return out;\n"
+"}\n"
+"\n"
+"static void print_regex(const Regex* r) {\n"
+"    printf(\"<regex prefix \\\"%.*s\\\">\\n\", r->prefix_len, r->prefix);\n"
+"}\n"
+"\n"
+"/* Worker threads: A_THREADS if set, else one per online CPU (at most 256) */\n"
+"static int a_thread_count(void) {\n"
+"    static int count = 0;\n"
+"    if (count == 0) {\n"
+"        const char* env = getenv(\"A_THREADS\");\n"
+"        long n = env ? strtol(env, NULL, 10) : 0;\n"
+"        if (n <= 0) n = sysconf(_SC_NPROCESSORS_ONLN);\n"
+"        count = n > 256 ? 256 : n > 0 ? (int)n : 1;\n"
+"    }\n"
+"    return count;\n"
+"}\n"
+"\n"
+"typedef struct {\n"
+"    void (*fn)(void* ctx, int part, int parts);\n"
+"    void* ctx;\n"
+"    int part;\n"
+"    int parts;\n"
+"} ThreadPart;\n"
+"\n"
+"static void* a_thread_part_main(void* arg) {\n"
+"    ThreadPart* tp = (ThreadPart*)arg;\n"
+"    tp->fn(tp->ctx, tp->part, tp->parts);\n"
+"    return NULL;\n"
+"}\n"
+"\n"
+"/* The caller runs part 0, parts 1..n-1 get their own thread. A part whose\n"
+"   thread cannot be created runs on the caller instead. */\n"
+"static void a_run_parts(int parts, void (*fn)(void* ctx, int part, int parts), void* ctx) {\n"
+"    pthread_t threads[256];\n"
+"    ThreadPart args[256];\n"
+"    bool started[256];\n"
+"    if (parts > 256) parts = 256;\n"
+"    for (int i = 1; i < parts; i++) {\n"
+"        args[i].fn = fn;\n"
+"        args[i].ctx = ctx;\n"
+"        args[i].part = i;\n"
+"        args[i].parts = parts;\n"
+"        started[i] = pthread_create(&threads[i], NULL, a_thread_part_main, &args[i]) == 0;\n"
+"    }\n"
+"    fn(ctx, 0, parts);\n"
+"    for (int i = 1; i < parts; i++) {\n"
+"        if (started[i]) pthread_join(threads[i], NULL);\n"
+"        else fn(ctx, i, parts);\n"
+"    }\n"
+"}\n"
+"\n"
+"/* parallel for: a persistent pool of worker threads. Each thread owns a slice\n"
+"   of the range and runs chunks from its front, a quarter of what is left each\n"
+"   time, so chunks shrink as the slice runs down; a thread whose slice is empty\n"
+"   steals the back half of another's. */\n"
+"typedef void (*ParBody)(void* ctx, long lo, long hi);\n"
+"\n"
+"typedef struct {\n"
+"    pthread_mutex_t lock;\n"
+"    long next;\n"
+"    long end;\n"
+"    char pad[64];\n"
+"} ParSlice;\n"
+"\n"
+"static struct {\n"
+"    pthread_mutex_t lock;\n"
+"    pthread_cond_t wake;\n"
+"    pthread_cond_t idle;\n"
+"    pthread_t threads[256];\n"
+"    ParSlice slices[256];\n"
+"    bool ready;\n"
+"    int started;\n"
+"    int parts;\n"
+"    int busy;\n"
+"    unsigned long round;\n"
+"    ParBody body;\n"
+"    void* ctx;\n"
+"    long grain;\n"
+"} a_pool = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER };\n"
+"\n"
+"/* Set on pool threads: a parallel for inside a parallel body runs serially */\n"
+"static __thread bool a_in_parallel = false;\n"
+"\n"
+"/* Which pool thread this is (0 for the caller), for per-thread reduce partials */\n"
+"static __thread int a_thread_index = 0;\n"
+"\n"
+"/* reduce(sum, pairwise): elements per partial, fixed so results do not depend on the thread count */\n"
+"#define A_REDUCE_BLOCK 4096\n"
+"\n"
+"static bool par_take(ParSlice* s, long grain, long* lo, long* hi) {\n"
+"    pthread_mutex_lock(&s->lock);\n"
+"    long left = s->end - s->next;\n"
+"    if (left <= 0) {\n"
+"        pthread_mutex_unlock(&s->lock);\n"
+"        return false;\n"
+"    }\n"
+"    long n = left / 4 > grain ? left / 4 : grain;\n"
+"    if (n > left) n = left;\n"
+"    *lo = s->next;\n"
+"    s->next += n;\n"
+"    *hi = s->next;\n"
+"    pthread_mutex_unlock(&s->lock);\n"
+"    return true;\n"
+"}\n"
+"\n"
+"static bool par_steal(int self) {\n"
+"    for (int k = 1; k < a_pool.parts; k++) {\n"
+"        ParSlice* v = &a_pool.slices[(self + k) % a_pool.parts];\n"
+"        pthread_mutex_lock(&v->lock);\n"
+"        long left = v->end - v->next;\n"
+"        if (left > a_pool.grain) {\n"
+"            long end = v->end;\n"
+"            v->end -= left / 2;\n"
+"            pthread_mutex_unlock(&v->lock);\n"
+"            ParSlice* s = &a_pool.slices[self];\n"
+"            pthread_mutex_lock(&s->lock);\n"
+"            s->next = end - left / 2;\n"
+"            s->end = end;\n"
+"            pthread_mutex_unlock(&s->lock);\n"
+"            return true;\n"
+"        }\n"
+"        pthread_mutex_unlock(&v->lock);\n"
+"    }\n"
+"    return false;\n"
+"}\n"
+"\n"
+"static void par_run(int self) {\n"
+"    long lo, hi;\n"
+"    do {\n"
+"        while (par_take(&a_pool.slices[self], a_pool.grain, &lo, &hi)) a_pool.body(a_pool.ctx, lo, hi);\n"
+"    } while (par_steal(self));\n"
+"}\n"
+"\n"
+"static void* par_worker(void* arg) {\n"
+"    int self = (int)(intptr_t)arg;\n"
+"    unsigned long seen = 0;\n"
+"    a_in_parallel = true;\n"
+"    a_thread_index = self;\n"
+"    for (;;) {\n"
+"        pthread_mutex_lock(&a_pool.lock);\n"
+"        while (a_pool.round == seen) pthread_cond_wait(&a_pool.wake, &a_pool.lock);\n"
+"        seen = a_pool.round;\n"
+"        pthread_mutex_unlock(&a_pool.lock);\n"
+"        if (self < a_pool.parts) par_run(self);\n"
+"        pthread_mutex_lock(&a_pool.lock);\n"
+"        if (--a_pool.busy == 0) pthread_cond_signal(&a_pool.idle);\n"
+"        pthread_mutex_unlock(&a_pool.lock);\n"
+"    }\n"
+"    return NULL;\n"
+"}\n"
+"\n"
+"/* Runs body over [lo, hi) on the pool; the calling thread works on slice 0 */\n"
+"static void a_parallel_for(long lo, long hi, ParBody body, void* ctx) {\n"
+"    long n = hi - lo;\n"
+"    if (n <= 0) return;\n"
+"    int parts = a_thread_count();\n"
+"    if (parts > n) parts = (int)n;\n"
+"    if (parts <= 1 || a_in_parallel) {\n"
+"        body(ctx, lo, hi);\n"
+"        return;\n"
+"    }\n"
+"    pthread_mutex_lock(&a_pool.lock);\n"
+"    if (!a_pool.ready) {\n"
+"        int count = a_thread_count();\n"
+"        for (int i = 0; i < count; i++) pthread_mutex_init(&a_pool.slices[i].lock, NULL);\n"
+"        /* Workers are numbered without gaps, so stop at the first that cannot start */\n"
+"        for (int i = 1; i < count; i++) {\n"
+"            if (pthread_create(&a_pool.threads[i], NULL, par_worker, (void*)(intptr_t)i) != 0) break;\n"
+"            a_pool.started = i;\n"
+"        }\n"
+"        a_pool.ready = true;\n"
+"    }\n"
+"    if (parts > a_pool.started + 1) parts = a_pool.started + 1;\n"
+"    if (parts <= 1) {\n"
+"        pthread_mutex_unlock(&a_pool.lock);\n"
+"        body(ctx, lo, hi);\n"
+"        return;\n"
+"    }\n"
+"    a_pool.body = body;\n"
+"    a_pool.ctx = ctx;\n"
+"    a_pool.parts = parts;\n"
+"    a_pool.grain = n / ((long)parts * 64) > 1 ? n / ((long)parts * 64) : 1;\n"
+"    for (int i = 0; i < parts; i++) {\n"
+"        a_pool.slices[i].next = lo + n * i / parts;\n"
+"        a_pool.slices[i].end = lo + n * (i + 1) / parts;\n"
+"    }\n"
+"    a_pool.busy = a_pool.started;\n"
+"    a_pool.round++;\n"
+"    pthread_cond_broadcast(&a_pool.wake);\n"
+"    pthread_mutex_unlock(&a_pool.lock);\n"
+"    a_in_parallel = true;\n"
+"    par_run(0);\n"
+"    a_in_parallel = false;\n"
+"    pthread_mutex_lock(&a_pool.lock);\n"
+"    while (a_pool.busy > 0) pthread_cond_wait(&a_pool.idle, &a_pool.lock);\n"
+"    pthread_mutex_unlock(&a_pool.lock);\n"
+"}\n"
+"\n"
+"/* Sorting: LSD radix on order-preserving 32-bit keys, parallel for large inputs */\n"
+"#define SORT_SMALL 48\n"
+"#define SORT_PARALLEL_MIN (1 << 21)\n"
+"\n"
+"/* Keys alias int and float list storage in place */\n"
+"typedef uint32_t __attribute__((may_alias)) sort_u32;\n"
+"\n"
+"/* Map an int or float bit pattern to an unsigned key with the same ordering */\n"
+"static inline uint32_t sort_key_int(uint32_t bits, int desc) {\n"
+"    uint32_t k = bits ^ 0x80000000u;\n"
+"    return desc ? ~k : k;\n"
+"}\n"
+"\n"
+"static inline uint32_t sort_key_float(uint32_t bits, int desc) {\n"
+"    uint32_t k = bits ^ ((uint32_t)((int32_t)bits >> 31) | 0x80000000u);\n"
+"    return desc ? ~k : k;\n"
+"}\n"
+"\n"
+"static inline uint32_t sort_unkey_float(uint32_t k) {\n"
+"    return k ^ (((k >> 31) - 1) | 0x80000000u);\n"
+"}\n"
+"\n"
+"/* Sorts keys (and optional payload) by 8-bit digits; result ends in keys/vals */\n"
+"static void radix_sort_u32(sort_u32* keys, int* vals, int n) {\n"
+"    sort_u32* ktmp = (sort_u32*)malloc(sizeof(uint32_t) * (size_t)n);\n"
+"    int* vtmp = vals ? (int*)malloc(sizeof(int) * (size_t)n) : NULL;\n"
+"    size_t counts[4][256];\n"
+"    memset(counts, 0, sizeof(counts));\n"
+"    for (int i = 0; i < n; i++) {\n"
+"        uint32_t k = keys[i];\n"
+"        counts[0][k & 0xFF]++;\n"
+"        counts[1][(k >> 8) & 0xFF]++;\n"
+"        counts[2][(k >> 16) & 0xFF]++;\n"
+"        counts[3][k >> 24]++;\n"
+"    }\n"
+"    sort_u32* src = keys;\n"
+"    sort_u32* dst = ktmp;\n"
+"    int* vsrc = vals;\n"
+"    int* vdst = vtmp;\n"
+"    for (int pass = 0; pass < 4; pass++) {\n"
+"        int shift = pass * 8;\n"
+"        size_t* c = counts[pass];\n"
+"        if (c[(src[0] >> shift) & 0xFF] == (size_t)n) continue;  /* every key shares this digit */\n"
+"        size_t sum = 0;\n"
+"        for (int d = 0; d < 256; d++) {\n"
+"            size_t t = c[d];\n"
+"            c[d] = sum;\n"
+"            sum += t;\n"
+"        }\n"
+"        for (int i = 0; i < n; i++) {\n"
+"            size_t pos = c[(src[i] >> shift) & 0xFF]++;\n"
+"            dst[pos] = src[i];\n"
+"            if (vals) vdst[pos] = vsrc[i];\n"
+"        }\n"
+"        sort_u32* t = src; src = dst; dst = t;\n"
+"        int* vt = vsrc; vsrc = vdst; vdst = vt;\n"
+"    }\n"
+"    if (src != keys) {\n"
+"        memcpy(keys, src, sizeof(uint32_t) * (size_t)n);\n"
+"        if (vals) memcpy(vals, vsrc, sizeof(int) * (size_t)n);\n"
+"    }\n"
+"    free(ktmp);\n"
+"    free(vtmp);\n"
+"}\n"
+"\n"
+"typedef struct {\n"
+"    sort_u32* src;\n"
+"    sort_u32* dst;\n"
+"    int n;\n"
+"    int shift;\n"
+"    size_t (*counts)[256];\n"
+"} RadixPass;\n"
+"\n"
+"static void radix_pass_count(void* ctx, int part, int parts) {\n"
+"    RadixPass* rp = (RadixPass*)ctx;\n"
+"    int lo = (int)((long long)rp->n * part / parts);\n"
+"    int hi = (int)((long long)rp->n * (part + 1) / parts);\n"
+"    size_t* c = rp->counts[part];\n"
+"    memset(c, 0, sizeof(size_t) * 256);\n"
+"    for (int i = lo; i < hi; i++) c[(rp->src[i] >> rp->shift) & 0xFF]++;\n"
+"}\n"
+"\n"
+"static void radix_pass_scatter(void* ctx, int part, int parts) {\n"
+"    RadixPass* rp = (RadixPass*)ctx;\n"
+"    int lo = (int)((long long)rp->n * part / parts);\n"
+"    int hi = (int)((long long)rp->n * (part + 1) / parts);\n"
+"    size_t* c = rp->counts[part];\n"
+"    for (int i = lo; i < hi; i++) {\n"
+"        uint32_t k = rp->src[i];\n"
+"        rp->dst[c[(k >> rp->shift) & 0xFF]++] = k;\n"
+"    }\n"
+"}\n"
+"\n"
+"/* Multithreaded LSD radix: per-thread digit histograms, then a parallel stable scatter */\n"
+"static void radix_sort_u32_parallel(sort_u32* keys, int n) {\n"
+"    int parts = a_thread_count();\n"
+"    if (parts > 64) parts = 64;\n"
+"    sort_u32* tmp = (sort_u32*)malloc(sizeof(uint32_t) * (size_t)n);\n"
+"    size_t (*counts)[256] = malloc(sizeof(size_t) * 256 * (size_t)parts);\n"
+"    RadixPass rp = { keys, tmp, n, 0, counts };\n"
+"    for (int pass = 0; pass < 4; pass++) {\n"
+"        rp.shift = pass * 8;\n"
+"        a_run_parts(parts, radix_pass_count, &rp);\n"
+"        size_t sum = 0;\n"
+"        for (int d = 0; d < 256; d++) {\n"
+"            for (int p = 0; p < parts; p++) {\n"
+"                size_t t = counts[p][d];\n"
+"                counts[p][d] = sum;\n"
+"                sum += t;\n"
+"            }\n"
+"        }\n"
+"        a_run_parts(parts, radix_pass_scatter, &rp);\n"
+"        sort_u32* t = rp.src; rp.src = rp.dst; rp.dst = t;\n"
+"    }\n"
+"    /* Four passes leave the result back in 'keys' */\n"
+"    free(tmp);\n"
+"    free(counts);\n"
+"}\n"
+"\n"
+"static void insertion_sort_int(int* a, int n, int desc) {\n"
+"    for (int i = 1; i < n; i++) {\n"
+"        int x = a[i];\n"
+"        int* p = a + i;\n"
+"        while (p > a && (desc ? p[-1] < x : p[-1] > x)) {\n"
+"            *p = p[-1];\n"
+"            p--;\n"
+"        }\n"
+"        *p = x;\n"
+"    }\n"
+"}\n"
+"\n"
+"static void list_sort(List* l, int desc) {\n"
+"    int n = l->size;\n"
+"    if (n <= SORT_SMALL) {\n"
+"        insertion_sort_int(l->data, n, desc);\n"
+"        return;\n"
+"    }\n"
+"    sort_u32* keys = (sort_u32*)l->data;\n"
+"    for (int i = 0; i < n; i++) keys[i] = sort_key_int(keys[i], desc);\n"
+"    if (n >= SORT_PARALLEL_MIN && a_thread_count() > 1) {\n"
+"        radix_sort_u32_parallel(keys, n);\n"
+"    } else {\n"
+"        radix_sort_u32(keys, NULL, n);\n"
+"    }\n"
+"    for (int i = 0; i < n; i++) keys[i] = sort_key_int(desc ? ~keys[i] : keys[i], 0);\n"
+"}\n"
+"\n"
+"/* Branchless compare-exchange; gcc lowers these networks to minss/maxss */\n"
+"#define SORT_CSWAP(a, i, j) do { \\\n"
+"    float lo_ = (a)[i] < (a)[j] ? (a)[i] : (a)[j]; \\\n"
+"    float hi_ = (a)[i] < (a)[j] ? (a)[j] : (a)[i]; \\\n"
+"    (a)[i] = lo_; (a)[j] = hi_; \\\n"
+"} while (0)\n"
+"\n"
+"#if defined(__AVX2__)\n"
+"/* One layer of the network in a register: each lane meets the lane named in the\n"
+" * permutation, and the lanes set in 'hi' keep the larger value of their pair */\n"
+"#define SORT_LAYER8(v, p0, p1, p2, p3, p4, p5, p6, p7, hi) do { \\\n"
+"    __m256 w_ = _mm256_permutevar8x32_ps(v, _mm256_setr_epi32(p0, p1, p2, p3, p4, p5, p6, p7)); \\\n"
+"    v = _mm256_blend_ps(_mm256_min_ps(v, w_), _mm256_max_ps(v, w_), hi); \\\n"
+"} while (0)\n"
+"#endif\n"
+"\n"
+"static void sort_network8_float(float* a) {\n"
+"#if defined(__AVX2__)\n"
+"    __m256 v = _mm256_loadu_ps(a);\n"
+"    SORT_LAYER8(v, 2, 3, 0, 1, 6, 7, 4, 5, 0xCC);  /* 0-2 1-3 4-6 5-7 */\n"
+"    SORT_LAYER8(v, 4, 5, 6, 7, 0, 1, 2, 3, 0xF0);  /* 0-4 1-5 2-6 3-7 */\n"
+"    SORT_LAYER8(v, 1, 0, 3, 2, 5, 4, 7, 6, 0xAA);  /* 0-1 2-3 4-5 6-7 */\n"
+"    SORT_LAYER8(v, 0, 1, 4, 5, 2, 3, 6, 7, 0x30);  /* 2-4 3-5 */\n"
+"    SORT_LAYER8(v, 0, 4, 2, 6, 1, 5, 3, 7, 0x50);  /* 1-4 3-6 */\n"
+"    SORT_LAYER8(v, 0, 2, 1, 4, 3, 6, 5, 7, 0x54);  /* 1-2 3-4 5-6 */\n"
+"    _mm256_storeu_ps(a, v);\n"
+"#else\n"
+"    SORT_CSWAP(a, 0, 2); SORT_CSWAP(a, 1, 3); SORT_CSWAP(a, 4, 6); SORT_CSWAP(a, 5, 7);\n"
+"    SORT_CSWAP(a, 0, 4); SORT_CSWAP(a, 1, 5); SORT_CSWAP(a, 2, 6); SORT_CSWAP(a, 3, 7);\n"
+"    SORT_CSWAP(a, 0, 1); SORT_CSWAP(a, 2, 3); SORT_CSWAP(a, 4, 5); SORT_CSWAP(a, 6, 7);\n"
+"    SORT_CSWAP(a, 2, 4); SORT_CSWAP(a, 3, 5);\n"
+"    SORT_CSWAP(a, 1, 4); SORT_CSWAP(a, 3, 6);\n"
+"    SORT_CSWAP(a, 1, 2); SORT_CSWAP(a, 3, 4); SORT_CSWAP(a, 5, 6);\n"
+"#endif\n"
+"}\n"
+"\n"
+"static void insertion_sort_float(float* a, int n) {\n"
+"    for (int i = 1; i < n; i++) {\n"
+"        float x = a[i];\n"
+"        float* p = a + i;\n"
+"        while (p > a && p[-1] > x) {\n"
+"            *p = p[-1];\n"
+"            p--;\n"
+"        }\n"
+"        *p = x;\n"
+"    }\n"
+"}\n"
+"\n"
+"/* Insertion sort that gives up once it has moved 8 elements; whether it finished */\n"
+"static bool partial_insertion_sort_float(float* a, int n) {\n"
+"    int moved = 0;\n"
+"    for (int i = 1; i < n; i++) {\n"
+"        float x = a[i];\n"
+"        float* p = a + i;\n"
+"        while (p > a && p[-1] > x) {\n"
+"            *p = p[-1];\n"
+"            p--;\n"
+"        }\n"
+"        *p = x;\n"
+"        moved += (int)(a + i - p);\n"
+"        if (moved > 8) return false;\n"
+"    }\n"
+"    return true;\n"
+"}\n"
+"\n"
+"static void heap_sift_float(float* a, int n, int i) {\n"
+"    for (;;) {\n"
+"        int c = 2 * i + 1;\n"
+"        if (c >= n) return;\n"
+"        if (c + 1 < n && a[c + 1] > a[c]) c++;\n"
+"        if (a[i] >= a[c]) return;\n"
+"        float t = a[i]; a[i] = a[c]; a[c] = t;\n"
+"        i = c;\n"
+"    }\n"
+"}\n"
+"\n"
+"static void heapsort_float(float* a, int n) {\n"
+"    for (int i = n / 2 - 1; i >= 0; i--) heap_sift_float(a, n, i);\n"
+"    for (int i = n - 1; i > 0; i--) {\n"
+"        float t = a[0]; a[0] = a[i]; a[i] = t;\n"
+"        heap_sift_float(a, i, 0);\n"
+"    }\n"
+"}\n"
+"\n"
+"/*\n"
+" * Pattern-defeating quicksort: quicksort on a median-of-3 (ninther when large)\n"
+" * that shuffles a few elements after a lopsided split and falls back to heapsort\n"
+" * after too many. A split that moved nothing tries a bounded insertion sort of\n"
+" * both sides, so sorted runs finish in one pass.\n"
+" */\n"
+"static void introsort_float(float* a, int n, int bad_allowed) {\n"
+"    while (n > 24) {\n"
+"        int mid = n / 2;\n"
+"        if (n > 128) {\n"
+"            SORT_CSWAP(a, 0, mid); SORT_CSWAP(a, mid, n - 1); SORT_CSWAP(a, 0, mid);\n"
+"            SORT_CSWAP(a, 1, mid - 1); SORT_CSWAP(a, mid - 1, n - 2); SORT_CSWAP(a, 1, mid - 1);\n"
+"            SORT_CSWAP(a, 2, mid + 1); SORT_CSWAP(a, mid + 1, n - 3); SORT_CSWAP(a, 2, mid + 1);\n"
+"            SORT_CSWAP(a, mid - 1, mid); SORT_CSWAP(a, mid, mid + 1); SORT_CSWAP(a, mid - 1, mid);\n"
+"        } else {\n"
+"            SORT_CSWAP(a, 0, mid); SORT_CSWAP(a, mid, n - 1); SORT_CSWAP(a, 0, mid);\n"
+"        }\n"
+"        float pivot = a[mid];\n"
+"        int i = 0, j = n - 1;\n"
+"        int swaps = 0;\n"
+"        for (;;) {\n"
+"            while (a[i] < pivot) i++;\n"
+"            while (a[j] > pivot) j--;\n"
+"            if (i >= j) break;\n"
+"            float t = a[i]; a[i] = a[j]; a[j] = t;\n"
+"            swaps++;\n"
+"            i++;\n"
+"            j--;\n"
+"        }\n"
+"        int left = j + 1;\n"
+"        int right = n - left;\n"
+"        if (left < n / 8 || right < n / 8) {\n"
+"            if (--bad_allowed <= 0) {\n"
+"                heapsort_float(a, n);\n"
+"                return;\n"
+"            }\n"
+"            /* Break up the pattern that produced the split */\n"
+"            if (left >= 24) {\n"
+"                float t = a[0]; a[0] = a[left / 4]; a[left / 4] = t;\n"
+"                t = a[left - 1]; a[left - 1] = a[left - left / 4]; a[left - left / 4] = t;\n"
+"            }\n"
+"            if (right >= 24) {\n"
+"                float* r = a + left;\n"
+"                float t = r[0]; r[0] = r[right / 4]; r[right / 4] = t;\n"
+"                t = r[right - 1]; r[right - 1] = r[right - right / 4]; r[right - right / 4] = t;\n"
+"            }\n"
+"        } else if (swaps == 0 && partial_insertion_sort_float(a, left) &&\n"
+"                   partial_insertion_sort_float(a + left, right)) {\n"
+"            return;\n"
+"        }\n"
+"        /* Recurse into the smaller side, loop on the larger */\n"
+"        if (left < right) {\n"
+"            introsort_float(a, left, bad_allowed);\n"
+"            a += left;\n"
+"            n = right;\n"
+"        } else {\n"
+"            introsort_float(a + left, right, bad_allowed);\n"
+"            n = left;\n"
+"        }\n"
+"    }\n"
+"    /* Presort 8-element blocks with the network so insertion sort only merges them */\n"
+"    for (int b = 0; b + 8 <= n; b += 8) sort_network8_float(a + b);\n"
+"    insertion_sort_float(a, n);\n"
+"}\n"
+"\n"
+"static void flist_sort(FList* l, int desc) {\n"
+"    int n = l->size;\n"
+"    if (n >= SORT_PARALLEL_MIN && a_thread_count() > 1) {\n"
+"        sort_u32* keys = (sort_u32*)l->data;\n"
+"        for (int i = 0; i < n; i++) keys[i] = sort_key_float(keys[i], desc);\n"
+"        radix_sort_u32_parallel(keys, n);\n"
+"        for (int i = 0; i < n; i++) keys[i] = sort_unkey_float(desc ? ~keys[i] : keys[i]);\n"
+"        return;\n"
+"    }\n"
+"    int bad_allowed = 1;\n"
+"    for (int m = n; m > 1; m >>= 1) bad_allowed++;\n"
+"    introsort_float(l->data, n, bad_allowed);\n"
+"    if (desc) {\n"
+"        for (int i = 0, j = n - 1; i < j; i++, j--) {\n"
+"            float t = l->data[i]; l->data[i] = l->data[j]; l->data[j] = t;\n"
+"        }\n"
+"    }\n"
+"}\n"
+"\n"
+"/* Stable: equal elements keep their original relative order */\n"
+"static List list_argsort(const List* l) {\n"
+"    int n = l->size;\n"
+"    List idx = new_list();\n"
+"    free(idx.data);\n"
+"    idx.data = (int*)list_alloc_aligned(sizeof(int) * (size_t)(n > 0 ? n : 1));\n"
+"    idx.size = n;\n"
+"    idx.cap = n > 0 ? n : 1;\n"
+"    sort_u32* keys = (sort_u32*)malloc(sizeof(uint32_t) * (size_t)(n > 0 ? n : 1));\n"
+"    for (int i = 0; i < n; i++) {\n"
+"        keys[i] = sort_key_int((uint32_t)l->data[i], 0);\n"
+"        idx.data[i] = i;\n"
+"    }\n"
+"    if (n > 1) radix_sort_u32(keys, idx.data, n);\n"
+"    free(keys);\n"
+"    return idx;\n"
+"}\n"
+"\n"
+"static List flist_argsort(const FList* l) {\n"
+"    int n = l->size;\n"
+"    List idx = new_list();\n"
+"    free(idx.data);\n"
+"    idx.data = (int*)list_alloc_aligned(sizeof(int) * (size_t)(n > 0 ? n : 1));\n"
+"    idx.size = n;\n"
+"    idx.cap = n > 0 ? n : 1;\n"
+"    sort_u32* keys = (sort_u32*)malloc(sizeof(uint32_t) * (size_t)(n > 0 ? n : 1));\n"
+"    for (int i = 0; i < n; i++) {\n"
+"        uint32_t bits;\n"
+"        memcpy(&bits, &l->data[i], sizeof(bits));\n"
+"        keys[i] = sort_key_float(bits, 0);\n"
+"        idx.data[i] = i;\n"
+"    }\n"
+"    if (n > 1) radix_sort_u32(keys, idx.data, n);\n"
+"    free(keys);\n"
+"    return idx;\n"
+"}\n"
+"\n"
+"/* Drops repeated neighbours, so a sorted list becomes its distinct values */\n"
+"static List list_unique(const List* l) {\n"
+"    List u = new_list();\n"
+"    for (int i = 0; i < l->size; i++) {\n"
+"        if (i == 0 || l->data[i] != l->data[i - 1]) list_append(&u, l->data[i]);\n"
+"    }\n"
+"    return u;\n"
+"}\n"
+"\n"
+"static FList flist_unique(const FList* l) {\n"
+"    FList u = new_flist();\n"
+"    for (int i = 0; i < l->size; i++) {\n"
+"        if (i == 0 || l->data[i] != l->data[i - 1]) flist_append(&u, l->data[i]);\n"
+"    }\n"
+"    return u;\n"
+"}\n"
+"\n"
+"/* Index of x in an ascending list, or -1 */\n"
+"static int list_binary_search(const List* l, int x) {\n"
+"    int i = int_array_lower_bound(l->data, l->size, x);\n"
+"    return (i < l->size && l->data[i] == x) ? i : -1;\n"
+"}\n"
+"\n"
+"static int flist_binary_search(const FList* l, float x) {\n"
+"    int lo = 0, hi = l->size;\n"
+"    while (lo < hi) {\n"
+"        int mid = lo + (hi - lo) / 2;\n"
+"        if (l->data[mid] < x) lo = mid + 1;\n"
+"        else hi = mid;\n"
+"    }\n"
+"    return (lo < l->size && l->data[lo] == x) ? lo : -1;\n"
+"}\n"
+"\n"
+"/* Statistics: blocked Welford mean/variance, selection-based quantiles, histograms */\n"
+"#define STATS_BLOCK 1024\n"
+"\n"
+"/* Widens one block of an int or float array into 'out' */\n"
+"static inline void stats_load(const void* data, bool is_float, int start, int len, double* out) {\n"
+"    if (is_float) {\n"
+"        const float* p = (const float*)data + start;\n"
+"        for (int i = 0; i < len; i++) out[i] = p[i];\n"
+"    } else {\n"
+"        const int* p = (const int*)data + start;\n"
+"        for (int i = 0; i < len; i++) out[i] = p[i];\n"
+"    }\n"
+"}\n"
+"\n"
+"/* Mean and population variance in one pass over memory: each cache-resident block\n"
+"   gets an exact two-pass mean/M2 (vectorisable), blocks are combined with Chan's update */\n"
+"static void stats_moments(const void* data, bool is_float, int n, double* mean_out, double* var_out) {\n"
+"    double block[STATS_BLOCK];\n"
+"    double mean = 0.0, m2 = 0.0;\n"
+"    long long count = 0;\n"
+"    for (int start = 0; start < n; start += STATS_BLOCK) {\n"
+"        int len = n - start < STATS_BLOCK ? n - start : STATS_BLOCK;\n"
+"        stats_load(data, is_float, start, len, block);\n"
+"        double sum = 0.0;\n"
+"        for (int i = 0; i < len; i++) sum += block[i];\n"
+"        double bmean = sum / len, bm2 = 0.0;\n"
+"        for (int i = 0; i < len; i++) bm2 += (block[i] - bmean) * (block[i] - bmean);\n"
+"        double delta = bmean - mean;\n"
+"        long long total = count + len;\n"
+"        mean += delta * len / total;\n"
+"        m2 += bm2 + delta * delta * (double)count * len / total;\n"
+"        count = total;\n"
+"    }\n"
+"    *mean_out = mean;\n"
+"    *var_out = count > 0 ? m2 / count : 0.0;\n"
+"}\n"
+"\n"
+"static double list_mean(const List* l) { double m, v; stats_moments(l->data, false, l->size, &m, &v); return m; }\n"
+"static double list_var(const List* l) { double m, v; stats_moments(l->data, false, l->size, &m, &v); return v; }\n"
+"static double list_stddev(const List* l) { return sqrt(list_var(l)); }\n"
+"static double flist_mean(const FList* l) { double m, v; stats_moments(l->data, true, l->size, &m, &v); return m; }\n"
+"static double flist_var(const FList* l) { double m, v; stats_moments(l->data, true, l->size, &m, &v); return v; }\n"
+"static double flist_stddev(const FList* l) { return sqrt(flist_var(l)); }\n"
+"\n"
+"static int stats_cmp(const void* a, const void* b) {\n"
+"    double x = *(const double*)a, y = *(const double*)b;\n"
+"    return (x > y) - (x < y);\n"
+"}\n"
+"\n"
+"/* Introselect: places the k-th smallest at a[k] with everything after it >= a[k].\n"
+"   Quickselect on median-of-3 pivots; a range that stops shrinking gets sorted instead. */\n"
+"static void stats_select(double* a, int n, int k) {\n"
+"    int lo = 0, hi = n - 1, budget = 2 * (32 - __builtin_clz((unsigned)n | 1));\n"
+"    while (hi - lo > 16) {\n"
+"        if (budget-- == 0) {\n"
+"            qsort(a + lo, hi - lo + 1, sizeof(double), stats_cmp);\n"
+"            return;\n"
+"        }\n"
+"        int mid = lo + (hi - lo) / 2;\n"
+"        if (a[mid] < a[lo]) { double t = a[mid]; a[mid] = a[lo]; a[lo] = t; }\n"
+"        if (a[hi] < a[lo]) { double t = a[hi]; a[hi] = a[lo]; a[lo] = t; }\n"
+"        if (a[hi] < a[mid]) { double t = a[hi]; a[hi] = a[mid]; a[mid] = t; }\n"
+"        double pivot = a[mid];\n"
+"        int i = lo, j = hi;\n"
+"        while (i <= j) {\n"
+"            while (a[i] < pivot) i++;\n"
+"            while (pivot < a[j]) j--;\n"
+"            if (i <= j) {\n"
+"                double t = a[i]; a[i] = a[j]; a[j] = t;\n"
+"                i++;\n"
+"                j--;\n"
+"            }\n"
+"        }\n"
+"        if (k <= j) hi = j;\n"
+"        else if (k >= i) lo = i;\n"
+"        else return;\n"
+"    }\n"
+"    for (int i = lo + 1; i <= hi; i++) {\n"
+"        double x = a[i];\n"
+"        int j = i - 1;\n"
+"        while (j >= lo && a[j] > x) { a[j + 1] = a[j]; j--; }\n"
+"        a[j + 1] = x;\n"
+"    }\n"
+"}\n"
+"\n"
+"/* p-quantile (0 <= p <= 1), interpolating between the closest ranks; works on a copy */\n"
+"static double stats_quantile(const void* data, bool is_float, int n, double p) {\n"
+"    if (n == 0) return 0.0;\n"
+"    if (p < 0.0) p = 0.0;\n"
+"    if (p > 1.0) p = 1.0;\n"
+"    double* a = (double*)malloc(sizeof(double) * n);\n"
+"    for (int start = 0; start < n; start += STATS_BLOCK) {\n"
+"        stats_load(data, is_float, start, n - start < STATS_BLOCK ? n - start : STATS_BLOCK, a + start);\n"
+"    }\n"
+"    double pos = p * (n - 1);\n"
+"    int k = (int)pos;\n"
+"    stats_select(a, n, k);\n"
+"    double q = a[k];\n"
+"    if (k + 1 < n && pos > k) {\n"
+"        /* Everything right of k is >= a[k]; the next rank is their minimum */\n"
+"        double next = a[k + 1];\n"
+"        for (int i = k + 2; i < n; i++) next = a[i] < next ? a[i] : next;\n"
+"        q += (pos - k) * (next - q);\n"
+"    }\n"
+"    free(a);\n"
+"    return q;\n"
+"}\n"
+"\n"
+"static double list_quantile(const List* l, double p) { return stats_quantile(l->data, false, l->size, p); }\n"
+"static double flist_quantile(const FList* l, double p) { return stats_quantile(l->data, true, l->size, p); }\n"
+"\n"
+"/* Counts over 'bins' equal-width buckets spanning [min, max] */\n"
+"static List stats_histogram(const void* data, bool is_float, int n, int bins) {\n"
+"    List out = new_list();\n"
+"    if (bins < 1) bins = 1;\n"
+"    for (int b = 0; b < bins; b++) list_append(&out, 0);\n"
+"    if (n == 0) return out;\n"
+"    double block[STATS_BLOCK];\n"
+"    double lo = is_float ? ((const float*)data)[0] : ((const int*)data)[0], hi = lo;\n"
+"    for (int start = 0; start < n; start += STATS_BLOCK) {\n"
+"        int len = n - start < STATS_BLOCK ? n - start : STATS_BLOCK;\n"
+"        stats_load(data, is_float, start, len, block);\n"
+"        for (int i = 0; i < len; i++) {\n"
+"            lo = block[i] < lo ? block[i] : lo;\n"
+"            hi = block[i] > hi ? block[i] : hi;\n"
+"        }\n"
+"    }\n"
+"    double scale = hi > lo ? bins / (hi - lo) : 0.0;\n"
+"    /* Bucket indices are computed a block at a time (vectorisable), then counted into\n"
+"       four sub-histograms so runs of one bucket do not serialise on a single counter */\n"
+"    int* counts = (int*)calloc((size_t)bins * 4, sizeof(int));\n"
+"    int idx[STATS_BLOCK];\n"
+"    for (int start = 0; start < n; start += STATS_BLOCK) {\n"
+"        int len = n - start < STATS_BLOCK ? n - start : STATS_BLOCK;\n"
+"        stats_load(data, is_float, start, len, block);\n"
+"        for (int i = 0; i < len; i++) {\n"
+"            int b = (int)((block[i] - lo) * scale);\n"
+"            idx[i] = b < bins - 1 ? b : bins - 1;\n"
+"        }\n"
+"        for (int i = 0; i < len; i++) counts[(i & 3) * bins + idx[i]]++;\n"
+"    }\n"
+"    for (int b = 0; b < bins; b++) {\n"
+"        out.data[b] = counts[b] + counts[bins + b] + counts[2 * bins + b] + counts[3 * bins + b];\n"
+"    }\n"
+"    free(counts);\n"
+"    return out;\n"
+"}\n"
+"\n"
+"static List list_histogram(const List* l, int bins) { return stats_histogram(l->data, false, l->size, bins); }\n"
+"static List flist_histogram(const FList* l, int bins) { return stats_histogram(l->data, true, l->size, bins); }\n"
+"\n"
+"/* t-digest: streaming quantile sketch of weighted centroids, densest at the tails.\n"
+"   Incoming values are buffered as floats, radix sorted, and merged into the centroids in batches. */\n"
+"#define TDIGEST_COMPRESSION 200.0\n"
+"#define TDIGEST_BUFFER 2048\n"
+"#define TDIGEST_MAX_CENTROIDS ((int)TDIGEST_COMPRESSION + 16)\n"
+"\n"
+"typedef struct {\n"
+"    double mean;\n"
+"    double weight;\n"
+"} TDCentroid;\n"
+"\n"
+"typedef struct {\n"
+"    TDCentroid* c;      /* sorted by mean */\n"
+"    int n;\n"
+"    float* buf;         /* unmerged values */\n"
+"    int nbuf;\n"
+"    TDCentroid* tmp;    /* merge space */\n"
+"    double total;       /* weight held by the centroids */\n"
+"    double min, max;\n"
+"    double run_mean, run_m2;    /* Welford over every value added */\n"
+"} TDigest;\n"
+"\n"
+"static TDigest new_tdigest(void) {\n"
+"    TDigest t;\n"
+"    t.c = (TDCentroid*)malloc(sizeof(TDCentroid) * TDIGEST_MAX_CENTROIDS);\n"
+"    t.buf = (float*)malloc(sizeof(float) * TDIGEST_BUFFER);\n"
+"    t.tmp = (TDCentroid*)malloc(sizeof(TDCentroid) * (2 * TDIGEST_MAX_CENTROIDS + TDIGEST_BUFFER));\n"
+"    t.n = t.nbuf = 0;\n"
+"    t.total = 0.0;\n"
+"    t.min = t.max = 0.0;\n"
+"    t.run_mean = t.run_m2 = 0.0;\n"
+"    return t;\n"
+"}\n"
+"\n"
+"/* Scale function k1: the centroid size limit shrinks towards q = 0 and q = 1 */\n"
+"static inline double td_k(double q) {\n"
+"    q = q < 0.0 ? 0.0 : (q > 1.0 ? 1.0 : q);\n"
+"    return TDIGEST_COMPRESSION / (2.0 * M_PI) * asin(2.0 * q - 1.0);\n"
+"}\n"
+"\n"
+"static inline double td_q(double k) {\n"
+"    return (sin(k * 2.0 * M_PI / TDIGEST_COMPRESSION) + 1.0) / 2.0;\n"
+"}\n"
+"\n"
+"/* Greedily merges the m sorted entries of tmp into the centroid array */\n"
+"static void td_compress(TDigest* t, int m, double total) {\n"
+"    int out = 0;\n"
+"    double so_far = 0.0;\n"
+"    double limit = total * td_q(td_k(0.0) + 1.0);\n"
+"    TDCentroid cur = t->tmp[0];\n"
+"    for (int i = 1; i < m; i++) {\n"
+"        TDCentroid next = t->tmp[i];\n"
+"        if (so_far + cur.weight + next.weight <= limit || out == TDIGEST_MAX_CENTROIDS - 1) {\n"
+"            cur.weight += next.weight;\n"
+"            cur.mean += (next.mean - cur.mean) * next.weight / cur.weight;\n"
+"        } else {\n"
+"            so_far += cur.weight;\n"
+"            t->c[out++] = cur;\n"
+"            limit = total * td_q(td_k(so_far / total) + 1.0);\n"
+"            cur = next;\n"
+"        }\n"
+"    }\n"
+"    t->c[out++] = cur;\n"
+"    t->n = out;\n"
+"    t->total = total;\n"
+"}\n"
+"\n"
+"static void tdigest_flush(TDigest* t) {\n"
+"    if (t->nbuf == 0) return;\n"
+"    sort_u32* keys = (sort_u32*)t->buf;\n"
+"    for (int i = 0; i < t->nbuf; i++) keys[i] = sort_key_float(keys[i], 0);\n"
+"    radix_sort_u32(keys, NULL, t->nbuf);\n"
+"    for (int i = 0; i < t->nbuf; i++) keys[i] = sort_unkey_float(keys[i]);\n"
+"    int m = 0, i = 0, j = 0;\n"
+"    while (i < t->nbuf || j < t->n) {\n"
+"        if (j == t->n || (i < t->nbuf && t->buf[i] < t->c[j].mean)) {\n"
+"            t->tmp[m].mean = t->buf[i++];\n"
+"            t->tmp[m].weight = 1.0;\n"
+"        } else {\n"
+"            t->tmp[m] = t->c[j++];\n"
+"        }\n"
+"        m++;\n"
+"    }\n"
+"    td_compress(t, m, t->total + t->nbuf);\n"
+"    t->nbuf = 0;\n"
+"}\n"
+"\n"
+"static void tdigest_add(TDigest* t, double x) {\n"
+"    double count = t->total + t->nbuf + 1;\n"
+"    if (count == 1) t->min = t->max = x;\n"
+"    t->min = x < t->min ? x : t->min;\n"
+"    t->max = x > t->max ? x : t->max;\n"
+"    double delta = x - t->run_mean;\n"
+"    t->run_mean += delta / count;\n"
+"    t->run_m2 += delta * (x - t->run_mean);\n"
+"    if (t->nbuf == TDIGEST_BUFFER) tdigest_flush(t);\n"
+"    t->buf[t->nbuf++] = (float)x;\n"
+"}\n"
+"\n"
+"static double tdigest_quantile(TDigest* t, double p) {\n"
+"    tdigest_flush(t);\n"
+"    if (t->n == 0) return 0.0;\n"
+"    if (p <= 0.0) return t->min;\n"
+"    if (p >= 1.0) return t->max;\n"
+"    double target = p * t->total;\n"
+"    TDCentroid* c = t->c;\n"
+"    if (target < c[0].weight / 2.0) {\n"
+"        return t->min + (c[0].mean - t->min) * target / (c[0].weight / 2.0);\n"
+"    }\n"
+"    double at = c[0].weight / 2.0;   /* cumulative weight at the centre of centroid i */\n"
+"    for (int i = 0; i + 1 < t->n; i++) {\n"
+"        double gap = (c[i].weight + c[i + 1].weight) / 2.0;\n"
+"        if (target < at + gap) {\n"
+"            return c[i].mean + (c[i + 1].mean - c[i].mean) * (target - at) / gap;\n"
+"        }\n"
+"        at += gap;\n"
+"    }\n"
+"    double last = c[t->n - 1].weight / 2.0;\n"
+"    return c[t->n - 1].mean + (t->max - c[t->n - 1].mean) * (target - at) / last;\n"
+"}\n"
+"\n"
+"/* Adds everything 'other' has seen; 'other' is left unchanged apart from being flushed */\n"
+"static void tdigest_merge(TDigest* t, TDigest* other) {\n"
+"    tdigest_flush(t);\n"
+"    tdigest_flush(other);\n"
+"    if (other->n == 0) return;\n"
+"    double n1 = t->total, n2 = other->total;\n"
+"    int m = 0, i = 0, j = 0;\n"
+"    while (i < t->n || j < other->n) {\n"
+"        if (j == other->n || (i < t->n && t->c[i].mean < other->c[j].mean)) t->tmp[m++] = t->c[i++];\n"
+"        else t->tmp[m++] = other->c[j++];\n"
+"    }\n"
+"    td_compress(t, m, n1 + n2);\n"
+"    double delta = other->run_mean - t->run_mean;\n"
+"    t->run_m2 += other->run_m2 + delta * delta * n1 * n2 / (n1 + n2);\n"
+"    t->run_mean += delta * n2 / (n1 + n2);\n"
+"    t->min = n1 == 0 || other->min < t->min ? other->min : t->min;\n"
+"    t->max = n1 == 0 || other->max > t->max ? other->max : t->max;\n"
+"}\n"
+"\n"
+"static int tdigest_len(const TDigest* t) { return (int)(t->total + t->nbuf); }\n"
+"static double tdigest_mean(const TDigest* t) { return t->run_mean; }\n"
+"static double tdigest_var(const TDigest* t) {\n"
+"    double n = t->total + t->nbuf;\n"
+"    return n > 0 ? t->run_m2 / n : 0.0;\n"
+"}\n"
+"\n"
+"static void tdigest_clear(TDigest* t) {\n"
+"    t->n = t->nbuf = 0;\n"
+"    t->total = 0.0;\n"
+"    t->min = t->max = 0.0;\n"
+"    t->run_mean = t->run_m2 = 0.0;\n"
+"}\n"
+"\n"
+"static void print_tdigest(TDigest* t) {\n"
+"    printf(\"tdigest(n=%d, p50=%g)\\n\", tdigest_len(t), tdigest_quantile(t, 0.5));\n"
+"}\n"
+"\n"
+"static void tdigest_free(TDigest* t) {\n"
+"    free(t->c);\n"
+"    free(t->buf);\n"
+"    free(t->tmp);\n"
+"    t->c = t->tmp = NULL;\n"
+"    t->buf = NULL;\n"
+"    t->n = t->nbuf = 0;\n"
+"}\n"
+"\n"
+"/* Tuple implementation */\n"
+"typedef struct {\n"
+"    int* data;\n"
+"    int size;\n"
+"} Tuple;\n"
+"\n"
+"static Tuple new_tuple(void) {\n"
+"    Tuple t;\n"
+"    t.size = 0;\n"
+"    t.data = NULL;\n"
+"    return t;\n"
+"}\n"
+"\n"
+"static Tuple make_tuple(int count, ...) {\n"
+"    Tuple t;\n"
+"    t.size = count;\n"
+"    t.data = (int*)malloc(sizeof(int) * count);\n"
+"    va_list args;\n"
+"    va_start(args, count);\n"
+"    for (int i = 0; i < count; i++) {\n"
+"        t.data[i] = va_arg(args, int);\n"
+"    }\n"
+"    va_end(args);\n"
+"    return t;\n"
+"}\n"
+"\n"
+"static void print_tuple(Tuple* t) {\n"
+"    printf(\"(\");\n"
+"    for (int i = 0; i < t->size; i++) {\n"
+"        printf(\"%d\", t->data[i]);\n"
+"        if (i < t->size - 1) printf(\", \");\n"
+"    }\n"
+"    printf(\")\\n\");\n"
+"}\n"
+"\n"
+"static void tuple_free(Tuple* t) {\n"
+"    free(t->data);\n"
+"    t->data = NULL;\n"
+"    t->size = 0;\n"
+"}\n"
+"\n"
+"static bool tuple_contains(const Tuple* t, int x) {\n"
+"    return int_array_contains(t->data, t->size, x);\n"
+"}\n"
+"\n"
+"/* Hashing: wyhash-style multiply-fold mixing, shared by dicts, sets, bloom filters and hash64 */\n"
+"static const uint64_t wy_p[4] = {\n"
+"    0x2d358dccaa6c78a5ULL, 0x8bb84b93962eacc9ULL, 0x4b33a62ed433d4a3ULL, 0x4d5a2da51de1aa47ULL\n"
+"};\n"
+"\n"
+"/* 64x64 -> 128 multiply, folded back to 64 bits */\n"
+"static inline uint64_t wy_mum(uint64_t a, uint64_t b) {\n"
+"    __uint128_t r = (__uint128_t)a * b;\n"
+"    return (uint64_t)r ^ (uint64_t)(r >> 64);\n"
+"}\n"
+"\n"
+"static inline void wy_mum2(uint64_t* a, uint64_t* b) {\n"
+"    __uint128_t r = (__uint128_t)*a * *b;\n"
+"    *a = (uint64_t)r;\n"
+"    *b = (uint64_t)(r >> 64);\n"
+"}\n"
+"\n"
+"static inline uint64_t wy_r8(const uint8_t* p) { uint64_t v; memcpy(&v, p, 8); return v; }\n"
+"static inline uint64_t wy_r4(const uint8_t* p) { uint32_t v; memcpy(&v, p, 4); return v; }\n"
+"static inline uint64_t wy_r3(const uint8_t* p, size_t k) {\n"
+"    return ((uint64_t)p[0] << 16) | ((uint64_t)p[k >> 1] << 8) | p[k - 1];\n"
+"}\n"
+"\n"
+"/* Inputs of up to 16 bytes read as two overlapping words */\n"
+"static inline void wy_short(const uint8_t* p, size_t len, uint64_t* a, uint64_t* b) {\n"
+"    if (len >= 4) {\n"
+"        *a = (wy_r4(p) << 32) | wy_r4(p + ((len >> 3) << 2));\n"
+"        *b = (wy_r4(p + len - 4) << 32) | wy_r4(p + len - 4 - ((len >> 3) << 2));\n"
+"    } else if (len > 0) {\n"
+"        *a = wy_r3(p, len);\n"
+"        *b = 0;\n"
+"    } else {\n"
+"        *a = *b = 0;\n"
+"    }\n"
+"}\n"
+"\n"
+"/* Three independent multiply chains per 48-byte block */\n"
+"static inline void wy_block(uint64_t* seed, uint64_t* see1, uint64_t* see2, const uint8_t* p) {\n"
+"    *seed = wy_mum(wy_r8(p) ^ wy_p[1], wy_r8(p + 8) ^ *seed);\n"
+"    *see1 = wy_mum(wy_r8(p + 16) ^ wy_p[2], wy_r8(p + 24) ^ *see1);\n"
+"    *see2 = wy_mum(wy_r8(p + 32) ^ wy_p[3], wy_r8(p + 40) ^ *see2);\n"
+"}\n"
+"\n"
+"static inline uint64_t wy_final(uint64_t a, uint64_t b, uint64_t seed, size_t len) {\n"
+"    a ^= wy_p[1];\n"
+"    b ^= seed;\n"
+"    wy_mum2(&a, &b);\n"
+"    return wy_mum(a ^ wy_p[0] ^ len, b ^ wy_p[1]);\n"
+"}\n"
+"\n"
+"static uint64_t hash_bytes(const void* key, size_t len, uint64_t seed) {\n"
+"    const uint8_t* p = (const uint8_t*)key;\n"
+"    uint64_t a, b;\n"
+"    seed ^= wy_mum(seed ^ wy_p[0], wy_p[1]);\n"
+"    if (len <= 16) {\n"
+"        wy_short(p, len, &a, &b);\n"
+"    } else {\n"
+"        size_t i = len;\n"
+"        if (i > 48) {\n"
+"            uint64_t see1 = seed, see2 = seed;\n"
+"            do {\n"
+"                wy_block(&seed, &see1, &see2, p);\n"
+"                p += 48;\n"
+"                i -= 48;\n"
+"            } while (i > 48);\n"
+"            seed ^= see1 ^ see2;\n"
+"        }\n"
+"        while (i > 16) {\n"
+"            seed = wy_mum(wy_r8(p) ^ wy_p[1], wy_r8(p + 8) ^ seed);\n"
+"            p += 16;\n"
+"            i -= 16;\n"
+"        }\n"
+"        a = wy_r8(p + i - 16);\n"
+"        b = wy_r8(p + i - 8);\n"
+"    }\n"
+"    return wy_final(a, b, seed, len);\n"
+"}\n"
+"\n"
+"static inline uint64_t hash_int(int64_t x) {\n"
+"    uint64_t a = (uint64_t)x ^ wy_p[0], b = (uint64_t)x ^ wy_p[1];\n"
+"    wy_mum2(&a, &b);\n"
+"    return wy_mum(a ^ wy_p[2], b ^ wy_p[3]);\n"
+"}\n"
+"\n"
+"static inline uint64_t hash_float(double x) {\n"
+"    if (x == 0.0) x = 0.0;   /* -0.0 and 0.0 compare equal */\n"
+"    int64_t bits;\n"
+"    memcpy(&bits, &x, sizeof(bits));\n"
+"    return hash_int(bits);\n"
+"}\n"
+"\n"
+"static inline uint64_t hash_str(const char* s) {\n"
+"    return hash_bytes(s, strlen(s), 0);\n"
+"}\n"
+"\n"
+"static uint64_t hash_list(const List* l) {\n"
+"    return hash_bytes(l->data, sizeof(int) * l->size, 0);\n"
+"}\n"
+"\n"
+"static uint64_t hash_flist(const FList* l) {\n"
+"    return hash_bytes(l->data, sizeof(float) * l->size, 0);\n"
+"}\n"
+"\n"
+"#define hash64(x) _Generic((x), \\\n"
+"    char*: hash_str, const char*: hash_str, \\\n"
+"    List*: hash_list, const List*: hash_list, FList*: hash_flist, const FList*: hash_flist, \\\n"
+"    float: hash_float, double: hash_float, \\\n"
+"    default: hash_int)(x)\n"
+"\n"
+"/* Streaming hasher: update() in pieces, digest() equals hash_bytes of the concatenation */\n"
+"typedef struct {\n"
+"    uint64_t seed, see1, see2;\n"
+"    uint8_t buf[64];    /* last 16 bytes already consumed, then up to 48 pending */\n"
+"    size_t pending;\n"
+"    size_t total;\n"
+"} Hasher;\n"
+"\n"
+"static Hasher new_hasher(void) {\n"
+"    Hasher h;\n"
+"    memset(&h, 0, sizeof(h));\n"
+"    h.seed = wy_mum(wy_p[0], wy_p[1]);\n"
+"    h.see1 = h.see2 = h.seed;\n"
+"    return h;\n"
+"}\n"
+"\n"
+"static void hasher_bytes(Hasher* h, const void* data, size_t len) {\n"
+"    const uint8_t* p = (const uint8_t*)data;\n"
+"    h->total += len;\n"
+"    /* A block is only consumed once more input follows it, as in hash_bytes */\n"
+"    if (h->pending == 0 && len > 48) {\n"
+"        do {\n"
+"            wy_block(&h->seed, &h->see1, &h->see2, p);\n"
+"            p += 48;\n"
+"            len -= 48;\n"
+"        } while (len > 48);\n"
+"        memcpy(h->buf, p - 16, 16);\n"
+"    }\n"
+"    while (len > 0) {\n"
+"        if (h->pending == 48) {\n"
+"            wy_block(&h->seed, &h->see1, &h->see2, h->buf + 16);\n"
+"            memcpy(h->buf, h->buf + 48, 16);\n"
+"            h->pending = 0;\n"
+"        }\n"
+"        size_t n = 48 - h->pending < len ? 48 - h->pending : len;\n"
+"        memcpy(h->buf + 16 + h->pending, p, n);\n"
+"        h->pending += n;\n"
+"        p += n;\n"
+"        len -= n;\n"
+"    }\n"
+"}\n"
+"\n"
+"static void hasher_update_int(Hasher* h, int x) { hasher_bytes(h, &x, sizeof(x)); }\n"
+"static void hasher_update_float(Hasher* h, double x) { float f = (float)x; hasher_bytes(h, &f, sizeof(f)); }\n"
+"static void hasher_update_str(Hasher* h, const char* s) { hasher_bytes(h, s, strlen(s)); }\n"
+"static void hasher_update_list(Hasher* h, const List* l) { hasher_bytes(h, l->data, sizeof(int) * l->size); }\n"
+"static void hasher_update_flist(Hasher* h, const FList* l) { hasher_bytes(h, l->data, sizeof(float) * l->size); }\n"
+"\n"
+"#define hasher_update(h, x) _Generic((x), \\\n"
+"    char*: hasher_update_str, const char*: hasher_update_str, \\\n"
+"    List*: hasher_update_list, const List*: hasher_update_list, \\\n"
+"    FList*: hasher_update_flist, const FList*: hasher_update_flist, \\\n"
+"    float: hasher_update_float, double: hasher_update_float, \\\n"
+"    default: hasher_update_int)(h, x)\n"
+"\n"
+"static uint64_t hasher_digest(const Hasher* h) {\n"
+"    const uint8_t* p = h->buf + 16;\n"
+"    size_t i = h->pending;\n"
+"    uint64_t seed = h->seed, a, b;\n"
+"    if (h->total <= 16) {\n"
+"        wy_short(p, h->total, &a, &b);\n"
+"    } else {\n"
+"        if (h->total > 48) seed ^= h->see1 ^ h->see2;\n"
+"        while (i > 16) {\n"
+"            seed = wy_mum(wy_r8(p) ^ wy_p[1], wy_r8(p + 8) ^ seed);\n"
+"            p += 16;\n"
+"            i -= 16;\n"
+"        }\n"
+"        a = wy_r8(p + i - 16);\n"
+"        b = wy_r8(p + i - 8);\n"
+"    }\n"
+"    return wy_final(a, b, seed, h->total);\n"
+"}\n"
+"\n"
+"static void hasher_reset(Hasher* h) {\n"
+"    *h = new_hasher();\n"
+"}\n"
+"\n"
+"/* CRC-32C (Castagnoli): SSE4.2 crc32 instruction, 8 bytes per step */\n"
+"static uint32_t crc32c_bytes(uint32_t crc, const void* data, size_t len) {\n"
+"    const uint8_t* p = (const uint8_t*)data;\n"
+"    crc = ~crc;\n"
+"#if defined(__SSE4_2__)\n"
+"    uint64_t c = crc;\n"
+"    for (; len >= 8; p += 8, len -= 8) c = _mm_crc32_u64(c, wy_r8(p));\n"
+"    crc = (uint32_t)c;\n"
+"    for (; len > 0; p++, len--) crc = _mm_crc32_u8(crc, *p);\n"
+"#else\n"
+"    static uint32_t table[256];\n"
+"    static bool ready = false;\n"
+"    if (!ready) {\n"
+"        for (uint32_t i = 0; i < 256; i++) {\n"
+"            uint32_t v = i;\n"
+"            for (int k = 0; k < 8; k++) v = (v >> 1) ^ (0x82F63B78u & (0u - (v & 1)));\n"
+"            table[i] = v;\n"
+"        }\n"
+"        ready = true;\n"
+"    }\n"
+"    for (; len > 0; p++, len--) crc = table[(crc ^ *p) & 0xFF] ^ (crc >> 8);\n"
+"#endif\n"
+"    return ~crc;\n"
+"}\n"
+"\n"
+"static uint32_t crc32c_str(const char* s) { return crc32c_bytes(0, s, strlen(s)); }\n"
+"static uint32_t crc32c_list(const List* l) { return crc32c_bytes(0, l->data, sizeof(int) * l->size); }\n"
+"static uint32_t crc32c_flist(const FList* l) { return crc32c_bytes(0, l->data, sizeof(float) * l->size); }\n"
+"\n"
+"#define crc32c(x) _Generic((x), \\\n"
+"    char*: crc32c_str, const char*: crc32c_str, \\\n"
+"    List*: crc32c_list, const List*: crc32c_list, FList*: crc32c_flist, const FList*: crc32c_flist)(x)\n"
+"\n"
+"/* Random numbers: xoshiro256++ generators, one independent stream per thread */\n"
+"typedef struct {\n"
+"    uint64_t s[4];\n"
+"} Rng;\n"
+"\n"
+"static inline uint64_t rng_rotl(uint64_t x, int k) {\n"
+"    return (x << k) | (x >> (64 - k));\n"
+"}\n"
+"\n"
+"static inline uint64_t splitmix64(uint64_t* x) {\n"
+"    uint64_t z = (*x += 0x9E3779B97F4A7C15ULL);\n"
+"    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;\n"
+"    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;\n"
+"    return z ^ (z >> 31);\n"
+"}\n"
+"\n"
+"static Rng new_rng(uint64_t seed) {\n"
+"    Rng r;\n"
+"    for (int i = 0; i < 4; i++) r.s[i] = splitmix64(&seed);\n"
+"    return r;\n"
+"}\n"
+"\n"
+"static inline uint64_t rng_next64(Rng* r) {\n"
+"    uint64_t* s = r->s;\n"
+"    uint64_t out = rng_rotl(s[0] + s[3], 23) + s[0];\n"
+"    uint64_t t = s[1] << 17;\n"
+"    s[2] ^= s[0];\n"
+"    s[3] ^= s[1];\n"
+"    s[1] ^= s[2];\n"
+"    s[0] ^= s[3];\n"
+"    s[2] ^= t;\n"
+"    s[3] = rng_rotl(s[3], 45);\n"
+"    return out;\n"
+"}\n"
+"\n"
+"/* Advances by 2^128 steps: streams split off with jump() never overlap */\n"
+"static void rng_jump(Rng* r) {\n"
+"    static const uint64_t jump[4] = {\n"
+"        0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL, 0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL\n"
+"    };\n"
+"    uint64_t s[4] = {0, 0, 0, 0};\n"
+"    for (int i = 0; i < 4; i++) {\n"
+"        for (int b = 0; b < 64; b++) {\n"
+"            if (jump[i] & (1ULL << b)) {\n"
+"                for (int k = 0; k < 4; k++) s[k] ^= r->s[k];\n"
+"            }\n"
+"            rng_next64(r);\n"
+"        }\n"
+"    }\n"
+"    memcpy(r->s, s, sizeof(s));\n"
+"}\n"
+"\n"
+"/* Copy of the current stream; this generator jumps ahead so the two never overlap */\n"
+"static Rng rng_fork(Rng* r) {\n"
+"    Rng child = *r;\n"
+"    rng_jump(r);\n"
+"    return child;\n"
+"}\n"
+"\n"
+"/* Seed from A_SEED when set, so runs can be reproduced */\n"
+"static uint64_t a_rng_seed(void) {\n"
+"    static uint64_t seed;\n"
+"    static bool ready = false;\n"
+"    if (!ready) {\n"
+"        const char* env = getenv(\"A_SEED\");\n"
+"        seed = env ? strtoull(env, NULL, 10) : ((uint64_t)time(NULL) << 20) ^ (uint64_t)getpid();\n"
+"        ready = true;\n"
+"    }\n"
+"    return seed;\n"
+"}\n"
+"\n"
+"/* Stream n of the program: the base generator jumped n times. The last\n"
+"   stream handed out is kept, so each new one costs a single jump. */\n"
+"static Rng new_rng_stream(void) {\n"
+"    static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;\n"
+"    static Rng last;\n"
+"    static bool started = false;\n"
+"    pthread_mutex_lock(&lock);\n"
+"    if (started) {\n"
+"        rng_jump(&last);\n"
+"    } else {\n"
+"        last = new_rng(a_rng_seed());\n"
+"        started = true;\n"
+"    }\n"
+"    Rng r = last;\n"
+"    pthread_mutex_unlock(&lock);\n"
+"    return r;\n"
+"}\n"
+"\n"
+"/* Unbiased integer in [lo, hi] (Lemire's multiply-shift with rejection) */\n"
+"static inline int rng_bounded(Rng* r, uint32_t x, int lo, uint64_t span) {\n"
+"    if (span > UINT32_MAX) return (int)((int64_t)lo + x);\n"
+"    uint64_t m = (uint64_t)x * span;\n"
+"    uint32_t low = (uint32_t)m;\n"
+"    if (low < span) {\n"
+"        uint32_t threshold = (uint32_t)(-(uint32_t)span) % (uint32_t)span;\n"
+"        while (low < threshold) {\n"
+"            m = (uint64_t)(uint32_t)(rng_next64(r) >> 32) * span;\n"
+"            low = (uint32_t)m;\n"
+"        }\n"
+"    }\n"
+"    return (int)((int64_t)lo + (int64_t)(m >> 32));\n"
+"}\n"
+"\n"
+"static int rng_range(Rng* r, int lo, int hi) {\n"
+"    if (hi < lo) return lo;\n"
+"    return rng_bounded(r, (uint32_t)(rng_next64(r) >> 32), lo, (uint64_t)((int64_t)hi - lo) + 1);\n"
+"}\n"
+"\n"
+"/* Uniform in [0, 1) */\n"
+"static float rng_uniform(Rng* r) {\n"
+"    return (float)(rng_next64(r) >> 40) * (1.0f / 16777216.0f);\n"
+"}\n"
+"\n"
+"static int rng_next(Rng* r) {\n"
+"    return (int)(rng_next64(r) >> 33);\n"
+"}\n"
+"\n"
+"/* Four interleaved generators; the lane loop compiles to 256-bit integer ops */\n"
+"#define RNG_LANES 4\n"
+"#define RNG_BATCH 256\n"
+"\n"
+"typedef struct {\n"
+"    uint64_t s0[RNG_LANES], s1[RNG_LANES], s2[RNG_LANES], s3[RNG_LANES];\n"
+"} RngLanes;\n"
+"\n"
+"/* Lanes are seeded from the parent stream; jumping each would cost more than small fills */\n"
+"static RngLanes rng_lanes_from(Rng* r) {\n"
+"    RngLanes g;\n"
+"    for (int l = 0; l < RNG_LANES; l++) {\n"
+"        Rng lane = new_rng(rng_next64(r));\n"
+"        g.s0[l] = lane.s[0];\n"
+"        g.s1[l] = lane.s[1];\n"
+"        g.s2[l] = lane.s[2];\n"
+"        g.s3[l] = lane.s[3];\n"
+"    }\n"
+"    return g;\n"
+"}\n"
+"\n"
+"/* Writes n (a multiple of RNG_LANES) random 64-bit words */\n"
+"static void rng_lanes_fill(RngLanes* g, uint64_t* out, size_t n) {\n"
+"    uint64_t s0[RNG_LANES], s1[RNG_LANES], s2[RNG_LANES], s3[RNG_LANES];\n"
+"    memcpy(s0, g->s0, sizeof(s0));\n"
+"    memcpy(s1, g->s1, sizeof(s1));\n"
+"    memcpy(s2, g->s2, sizeof(s2));\n"
+"    memcpy(s3, g->s3, sizeof(s3));\n"
+"    for (size_t i = 0; i < n; i += RNG_LANES) {\n"
+"        for (int l = 0; l < RNG_LANES; l++) {\n"
+"            out[i + l] = rng_rotl(s0[l] + s3[l], 23) + s0[l];\n"
+"            uint64_t t = s1[l] << 17;\n"
+"            s2[l] ^= s0[l];\n"
+"            s3[l] ^= s1[l];\n"
+"            s1[l] ^= s2[l];\n"
+"            s0[l] ^= s3[l];\n"
+"            s2[l] ^= t;\n"
+"            s3[l] = rng_rotl(s3[l], 45);\n"
+"        }\n"
+"    }\n"
+"    memcpy(g->s0, s0, sizeof(s0));\n"
+"    memcpy(g->s1, s1, sizeof(s1));\n"
+"    memcpy(g->s2, s2, sizeof(s2));\n"
+"    memcpy(g->s3, s3, sizeof(s3));\n"
+"}\n"
+"\n"
+"/* Overwrites every element with a value in [lo, hi] */\n"
+"static void rng_fill_list(Rng* r, List* l, int lo, int hi) {\n"
+"    if (hi < lo) hi = lo;\n"
+"    uint64_t span = (uint64_t)((int64_t)hi - lo) + 1;\n"
+"    RngLanes g = rng_lanes_from(r);\n"
+"    uint64_t buf[RNG_BATCH];\n"
+"    for (int i = 0; i < l->size; i += 2 * RNG_BATCH) {\n"
+"        rng_lanes_fill(&g, buf, RNG_BATCH);\n"
+"        int n = l->size - i < 2 * RNG_BATCH ? l->size - i : 2 * RNG_BATCH;\n"
+"        for (int j = 0; j < n; j++) {\n"
+"            uint32_t x = (uint32_t)(buf[j >> 1] >> (32 * (j & 1)));\n"
+"            l->data[i + j] = rng_bounded(r, x, lo, span);\n"
+"        }\n"
+"    }\n"
+"}\n"
+"\n"
+"/* Overwrites every element with a value in [lo, hi) */\n"
+"static void rng_fill_flist(Rng* r, FList* l, double lo, double hi) {\n"
+"    float scale = (float)(hi - lo) * (1.0f / 16777216.0f);\n"
+"    RngLanes g = rng_lanes_from(r);\n"
+"    uint64_t buf[RNG_BATCH];\n"
+"    for (int i = 0; i < l->size; i += 2 * RNG_BATCH) {\n"
+"        rng_lanes_fill(&g, buf, RNG_BATCH);\n"
+"        int n = l->size - i < 2 * RNG_BATCH ? l->size - i : 2 * RNG_BATCH;\n"
+"        for (int j = 0; j < n; j++) {\n"
+"            uint32_t x = (uint32_t)(buf[j >> 1] >> (32 * (j & 1))) >> 8;\n"
+"            l->data[i + j] = (float)lo + (float)x * scale;\n"
+"        }\n"
+"    }\n"
+"}\n"
+"\n"
+"#define rng_fill(r, l, lo, hi) _Generic((l), List*: rng_fill_list, FList*: rng_fill_flist)(r, l, lo, hi)\n"
+"\n"
+"/* Fisher-Yates swap targets for positions i, i-1, ... (one batch); returns how many */\n"
+"static int rng_shuffle_batch(Rng* r, RngLanes* g, int i, int* out) {\n"
+"    uint64_t buf[RNG_BATCH];\n"
+"    rng_lanes_fill(g, buf, RNG_BATCH);\n"
+"    int n = i < 2 * RNG_BATCH ? i : 2 * RNG_BATCH;\n"
+"    for (int k = 0; k < n; k++) {\n"
+"        uint32_t x = (uint32_t)(buf[k >> 1] >> (32 * (k & 1)));\n"
+"        out[k] = rng_bounded(r, x, 0, (uint64_t)(i - k) + 1);\n"
+"    }\n"
+"    return n;\n"
+"}\n"
+"\n"
+"static void rng_shuffle_list(Rng* r, List* l) {\n"
+"    RngLanes g = rng_lanes_from(r);\n"
+"    int swap[2 * RNG_BATCH];\n"
+"    for (int i = l->size - 1; i > 0; ) {\n"
+"        int n = rng_shuffle_batch(r, &g, i, swap);\n"
+"        for (int k = 0; k < n; k++, i--) {\n"
+"            int t = l->data[i];\n"
+"            l->data[i] = l->data[swap[k]];\n"
+"            l->data[swap[k]] = t;\n"
+"        }\n"
+"    }\n"
+"}\n"
+"\n"
+"static void rng_shuffle_flist(Rng* r, FList* l) {\n"
+"    RngLanes g = rng_lanes_from(r);\n"
+"    int swap[2 * RNG_BATCH];\n"
+"    for (int i = l->size - 1; i > 0; ) {\n"
+"        int n = rng_shuffle_batch(r, &g, i, swap);\n"
+"        for (int k = 0; k < n; k++, i--) {\n"
+"            float t = l->data[i];\n"
+"            l->data[i] = l->data[swap[k]];\n"
+"            l->data[swap[k]] = t;\n"
+"        }\n"
+"    }\n"
+"}\n"
+"\n"
+"#define rng_shuffle(r, l) _Generic((l), List*: rng_shuffle_list, FList*: rng_shuffle_flist)(r, l)\n"
+"\n"
+"/* The calling thread's own stream, created on first use */\n"
+"static Rng* a_thread_rng(void) {\n"
+"    static __thread Rng rng;\n"
+"    static __thread bool ready = false;\n"
+"    if (!ready) {\n"
+"        rng = new_rng_stream();\n"
+"        ready = true;\n"
+"    }\n"
+"    return &rng;\n"
+"}\n"
+"\n"
+"static void list_fill_random(List* l, int lo, int hi) { rng_fill_list(a_thread_rng(), l, lo, hi); }\n"
+"static void flist_fill_random(FList* l, double lo, double hi) { rng_fill_flist(a_thread_rng(), l, lo, hi); }\n"
+"static void list_shuffle(List* l) { rng_shuffle_list(a_thread_rng(), l); }\n"
+"static void flist_shuffle(FList* l) { rng_shuffle_flist(a_thread_rng(), l); }\n"
+"\n"
+"static void print_rng(const Rng* r) {\n"
+"    printf(\"rng(%016llx)\\n\", (unsigned long long)r->s[0]);\n"
+"}\n"
+"\n"
+"/* Dictionary implementation: insertion-ordered entries plus a hash index */\n"
+"#define DICT_MAX 256\n"
+"#define DICT_INDEX (DICT_MAX * 2)\n"
+"\n"
+"typedef struct {\n"
+"    char* keys[DICT_MAX];\n"
+"    int vals[DICT_MAX];\n"
+"    short index[DICT_INDEX];    /* entry + 1, 0 = empty */\n"
+"    int size;\n"
+"} Dict;\n"
+"\n"
+"static Dict new_dict(void) {\n"
+"    Dict d;\n"
+"    d.size = 0;\n"
+"    for (int i = 0; i < DICT_MAX; i++) {\n"
+"        d.keys[i] = NULL;\n"
+"    }\n"
+"    memset(d.index, 0, sizeof(d.index));\n"
+"    return d;\n"
+"}\n"
+"\n"
+"/* Index slot holding 'key', or the empty slot where it would go */\n"
+"static int dict_slot(const Dict* d, const char* key) {\n"
+"    int slot = (int)(hash_str(key) & (DICT_INDEX - 1));\n"
+"    while (d->index[slot] && strcmp(d->keys[d->index[slot] - 1], key) != 0) {\n"
+"        slot = (slot + 1) & (DICT_INDEX - 1);\n"
+"    }\n"
+"    return slot;\n"
+"}\n"
+"\n"
+"static void dset(Dict* d, const char* key, int val) {\n"
+"    int slot = dict_slot(d, key);\n"
+"    if (d->index[slot]) {\n"
+"        d->vals[d->index[slot] - 1] = val;\n"
+"        return;\n"
+"    }\n"
+"    if (d->size < DICT_MAX) {\n"
+"        d->keys[d->size] = strdup(key);\n"
+"        d->vals[d->size] = val;\n"
+"        d->size++;\n"
+"        d->index[slot] = (short)d->size;\n"
+"    }\n"
+"}\n"
+"\n"
+"static int dget(Dict* d, const char* key) {\n"
+"    int slot = dict_slot(d, key);\n"
+"    return d->index[slot] ? d->vals[d->index[slot] - 1] : 0;\n"
+"}\n"
+"\n"
+"static bool dict_has(const Dict* d, const char* key) {\n"
+"    return d->index[dict_slot(d, key)] != 0;\n"
+"}\n"
+"\n"
+"static void dict_free(Dict* d) {\n"
+"    for (int i = 0; i < d->size; i++) {\n"
+"        free(d->keys[i]);\n"
+"    }\n"
+"    d->size = 0;\n"
+"    memset(d->index, 0, sizeof(d->index));\n"
+"}\n"
+"\n"
+"/* Deque implementation: power-of-two ring buffer */\n"
+"typedef struct {\n"
+"    int* data;\n"
+"    int head;       /* slot of the front element */\n"
+"    int size;\n"
+"    int mask;       /* capacity - 1 */\n"
+"    int limit;      /* fixed capacity, 0 = unbounded; a full window evicts from the opposite end */\n"
+"} Deque;\n"
+"\n"
+"static Deque new_deque_cap(int cap, int limit) {\n"
+"    Deque q;\n"
+"    int c = 8;\n"
+"    while (c < cap) c *= 2;\n"
+"    q.data = (int*)malloc(sizeof(int) * c);\n"
+"    q.head = 0;\n"
+"    q.size = 0;\n"
+"    q.mask = c - 1;\n"
+"    q.limit = limit;\n"
+"    return q;\n"
+"}\n"
+"\n"
+"static Deque new_deque(void) {\n"
+"    return new_deque_cap(8, 0);\n"
+"}\n"
+"\n"
+"/* Sliding window of at most 'cap' elements */\n"
+"static Deque new_deque_fixed(int cap) {\n"
+"    return new_deque_cap(cap, cap > 0 ? cap : 1);\n"
+"}\n"
+"\n"
+"/* The elements as at most two contiguous runs: [a, a+na) then [b, b+nb) */\n"
+"static void deque_segments(const Deque* q, int** a, int* na, int** b, int* nb) {\n"
+"    int cap = q->mask + 1;\n"
+"    int first = cap - q->head;\n"
+"    if (first > q->size) first = q->size;\n"
+"    *a = q->data + q->head;\n"
+"    *na = first;\n"
+"    *b = q->data;\n"
+"    *nb = q->size - first;\n"
+"}\n"
+"\n"
+"static void deque_grow(Deque* q) {\n"
+"    int cap = q->mask + 1;\n"
+"    int* data = (int*)malloc(sizeof(int) * cap * 2);\n"
+"    int *a, *b, na, nb;\n"
+"    deque_segments(q, &a, &na, &b, &nb);\n"
+"    memcpy(data, a, sizeof(int) * na);\n"
+"    memcpy(data + na, b, sizeof(int) * nb);\n"
+"    free(q->data);\n"
+"    q->data = data;\n"
+"    q->head = 0;\n"
+"    q->mask = cap * 2 - 1;\n"
+"}\n"
+"\n"
+"static void deque_push_back(Deque* q, int val) {\n"
+"    if (q->limit && q->size == q->limit) {\n"
+"        q->head = (q->head + 1) & q->mask;\n"
+"        q->size--;\n"
+"    } else if (q->size > q->mask) {\n"
+"        deque_grow(q);\n"
+"    }\n"
+"    q->data[(q->head + q->size) & q->mask] = val;\n"
+"    q->size++;\n"
+"}\n"
+"\n"
+"static void deque_push_front(Deque* q, int val) {\n"
+"    if (q->limit && q->size == q->limit) {\n"
+"        q->size--;\n"
+"    } else if (q->size > q->mask) {\n"
+"        deque_grow(q);\n"
+"    }\n"
+"    q->head = (q->head - 1) & q->mask;\n"
+"    q->data[q->head] = val;\n"
+"    q->size++;\n"
+"}\n"
+"\n"
+"static int deque_pop_front(Deque* q) {\n"
+"    if (q->size == 0) return 0;\n"
+"    int val = q->data[q->head];\n"
+"    q->head = (q->head + 1) & q->mask;\n"
+"    q->size--;\n"
+"    return val;\n"
+"}\n"
+"\n"
+"static int deque_pop_back(Deque* q) {\n"
+"    if (q->size == 0) return 0;\n"
+"    q->size--;\n"
+"    return q->data[(q->head + q->size) & q->mask];\n"
+"}\n"
+"\n"
+"static int deque_front(const Deque* q) {\n"
+"    return q->size ? q->data[q->head] : 0;\n"
+"}\n"
+"\n"
+"static int deque_back(const Deque* q) {\n"
+"    return q->size ? q->data[(q->head + q->size - 1) & q->mask] : 0;\n"
+"}\n"
+"\n"
+"static int deque_get(const Deque* q, int i) {\n"
+"    return q->data[(q->head + i) & q->mask];\n"
+"}\n"
+"\n"
+"static int deque_len(const Deque* q) {\n"
+"    return q->size;\n"
+"}\n"
+"\n"
+"static bool deque_empty(const Deque* q) {\n"
+"    return q->size == 0;\n"
+"}\n"
+"\n"
+"static bool deque_full(const Deque* q) {\n"
+"    return q->limit && q->size == q->limit;\n"
+"}\n"
+"\n"
+"static void deque_clear(Deque* q) {\n"
+"    q->head = 0;\n"
+"    q->size = 0;\n"
+"}\n"
+"\n"
+"static List deque_to_list(const Deque* q) {\n"
+"    List l = new_list();\n"
+"    int *a, *b, na, nb;\n"
+"    deque_segments(q, &a, &na, &b, &nb);\n"
+"    for (int i = 0; i < na; i++) list_append(&l, a[i]);\n"
+"    for (int i = 0; i < nb; i++) list_append(&l, b[i]);\n"
+"    return l;\n"
+"}\n"
+"\n"
+"static void print_deque(const Deque* q) {\n"
+"    int *a, *b, na, nb;\n"
+"    deque_segments(q, &a, &na, &b, &nb);\n"
+"    printf(\"[\");\n"
+"    for (int i = 0; i < na; i++) printf(i ? \", %d\" : \"%d\", a[i]);\n"
+"    for (int i = 0; i < nb; i++) printf(na + i ? \", %d\" : \"%d\", b[i]);\n"
+"    printf(\"]\\n\");\n"
+"}\n"
+"\n"
+"static void deque_free(Deque* q) {\n"
+"    free(q->data);\n"
+"    q->data = NULL;\n"
+"    q->head = 0;\n"
+"    q->size = 0;\n"
+"    q->mask = 0;\n"
+"}\n"
+"\n"
+"/* Priority queue: 4-ary heap of keys with an int payload */\n"
+"#define HEAP_ARITY 4\n"
+"#define HEAP_PAD 3      /* element i lives at slot i + 3, so each group of 4 siblings is 16-byte aligned */\n"
+"\n"
+"typedef struct {\n"
+"    int* keys;\n"
+"    int* vals;\n"
+"    int size;\n"
+"    int cap;\n"
+"    bool max;\n"
+"} IntHeap;\n"
+"\n"
+"static void* heap_alloc(int cap, size_t elem_size) {\n"
+"    size_t bytes = ((size_t)(cap + HEAP_PAD) * elem_size + 63) & ~(size_t)63;\n"
+"    return (char*)aligned_alloc(64, bytes) + HEAP_PAD * elem_size;\n"
+"}\n"
+"\n"
+"static void heap_release(void* base, size_t elem_size) {\n"
+"    if (base) free((char*)base - HEAP_PAD * elem_size);\n"
+"}\n"
+"\n"
+"static IntHeap new_iheap(bool max) {\n"
+"    IntHeap h;\n"
+"    h.cap = 16;\n"
+"    h.size = 0;\n"
+"    h.max = max;\n"
+"    h.keys = (int*)heap_alloc(h.cap, sizeof(int));\n"
+"    h.vals = (int*)heap_alloc(h.cap, sizeof(int));\n"
+"    return h;\n"
+"}\n"
+"\n"
+"static inline bool iheap_before(const IntHeap* h, int a, int b) {\n"
+"    return h->max ? a > b : a < b;\n"
+"}\n"
+"\n"
+"static void iheap_sift_down(IntHeap* h, int i) {\n"
+"    int key = h->keys[i];\n"
+"    int val = h->vals[i];\n"
+"    for (;;) {\n"
+"        int first = HEAP_ARITY * i + 1;\n"
+"        if (first >= h->size) break;\n"
+"        int last = first + HEAP_ARITY < h->size ? first + HEAP_ARITY : h->size;\n"
+"        int best = first;\n"
+"        for (int c = first + 1; c < last; c++) {\n"
+"            if (iheap_before(h, h->keys[c], h->keys[best])) best = c;\n"
+"        }\n"
+"        if (!iheap_before(h, h->keys[best], key)) break;\n"
+"        h->keys[i] = h->keys[best];\n"
+"        h->vals[i] = h->vals[best];\n"
+"        i = best;\n"
+"    }\n"
+"    h->keys[i] = key;\n"
+"    h->vals[i] = val;\n"
+"}\n"
+"\n"
+"static void iheap_push(IntHeap* h, int key, int val) {\n"
+"    if (h->size >= h->cap) {\n"
+"        int cap = h->cap * 2;\n"
+"        int* keys = (int*)heap_alloc(cap, sizeof(int));\n"
+"        int* vals = (int*)heap_alloc(cap, sizeof(int));\n"
+"        memcpy(keys, h->keys, sizeof(int) * h->size);\n"
+"        memcpy(vals, h->vals, sizeof(int) * h->size);\n"
+"        heap_release(h->keys, sizeof(int));\n"
+"        heap_release(h->vals, sizeof(int));\n"
+"        h->keys = keys;\n"
+"        h->vals = vals;\n"
+"        h->cap = cap;\n"
+"    }\n"
+"    int i = h->size++;\n"
+"    while (i > 0) {\n"
+"        int parent = (i - 1) / HEAP_ARITY;\n"
+"        if (!iheap_before(h, key, h->keys[parent])) break;\n"
+"        h->keys[i] = h->keys[parent];\n"
+"        h->vals[i] = h->vals[parent];\n"
+"        i = parent;\n"
+"    }\n"
+"    h->keys[i] = key;\n"
+"    h->vals[i] = val;\n"
+"}\n"
+"\n"
+"/* Removes the top entry and returns its payload (0 when empty) */\n"
+"static int iheap_pop(IntHeap* h) {\n"
+"    if (h->size == 0) return 0;\n"
+"    int val = h->vals[0];\n"
+"    h->size--;\n"
+"    if (h->size > 0) {\n"
+"        h->keys[0] = h->keys[h->size];\n"
+"        h->vals[0] = h->vals[h->size];\n"
+"        iheap_sift_down(h, 0);\n"
+"    }\n"
+"    return val;\n"
+"}\n"
+"\n"
+"static int iheap_peek(const IntHeap* h) {\n"
+"    return h->size ? h->keys[0] : 0;\n"
+"}\n"
+"\n"
+"static int iheap_peek_val(const IntHeap* h) {\n"
+"    return h->size ? h->vals[0] : 0;\n"
+"}\n"
+"\n"
+"static int iheap_len(const IntHeap* h) {\n"
+"    return h->size;\n"
+"}\n"
+"\n"
+"static bool iheap_empty(const IntHeap* h) {\n"
+"    return h->size == 0;\n"
+"}\n"
+"\n"
+"static void iheap_clear(IntHeap* h) {\n"
+"    h->size = 0;\n"
+"}\n"
+"\n"
+"/* Replaces the contents with the list's values (payload = index), built bottom-up in O(n) */\n"
+"static void iheap_heapify(IntHeap* h, const List* l) {\n"
+"    heap_release(h->keys, sizeof(int));\n"
+"    heap_release(h->vals, sizeof(int));\n"
+"    h->cap = l->size > 16 ? l->size : 16;\n"
+"    h->keys = (int*)heap_alloc(h->cap, sizeof(int));\n"
+"    h->vals = (int*)heap_alloc(h->cap, sizeof(int));\n"
+"    memcpy(h->keys, l->data, sizeof(int) * l->size);\n"
+"    for (int i = 0; i < l->size; i++) h->vals[i] = i;\n"
+"    h->size = l->size;\n"
+"    for (int i = (h->size - 2) / HEAP_ARITY; i >= 0; i--) iheap_sift_down(h, i);\n"
+"}\n"
+"\n"
+"static void print_iheap(const IntHeap* h) {\n"
+"    printf(\"[\");\n"
+"    for (int i = 0; i < h->size; i++) printf(i ? \", %d\" : \"%d\", h->keys[i]);\n"
+"    printf(\"]\\n\");\n"
+"}\n"
+"\n"
+"static void iheap_free(IntHeap* h) {\n"
+"    heap_release(h->keys, sizeof(int));\n"
+"    heap_release(h->vals, sizeof(int));\n"
+"    h->keys = NULL;\n"
+"    h->vals = NULL;\n"
+"    h->size = 0;\n"
+"    h->cap = 0;\n"
+"}\n"
+"\n"
+"typedef struct {\n"
+"    float* keys;\n"
+"    int* vals;\n"
+"    int size;\n"
+"    int cap;\n"
+"    bool max;\n"
+"} FloatHeap;\n"
+"\n"
+"static FloatHeap new_fheap(bool max) {\n"
+"    FloatHeap h;\n"
+"    h.cap = 16;\n"
+"    h.size = 0;\n"
+"    h.max = max;\n"
+"    h.keys = (float*)heap_alloc(h.cap, sizeof(float));\n"
+"    h.vals = (int*)heap_alloc(h.cap, sizeof(int));\n"
+"    return h;\n"
+"}\n"
+"\n"
+"static inline bool fheap_before(const FloatHeap* h, float a, float b) {\n"
+"    return h->max ? a > b : a < b;\n"
+"}\n"
+"\n"
+"static void fheap_sift_down(FloatHeap* h, int i) {\n"
+"    float key = h->keys[i];\n"
+"    int val = h->vals[i];\n"
+"    for (;;) {\n"
+"        int first = HEAP_ARITY * i + 1;\n"
+"        if (first >= h->size) break;\n"
+"        int last = first + HEAP_ARITY < h->size ? first + HEAP_ARITY : h->size;\n"
+"        int best = first;\n"
+"        for (int c = first + 1; c < last; c++) {\n"
+"            if (fheap_before(h, h->keys[c], h->keys[best])) best = c;\n"
+"        }\n"
+"        if (!fheap_before(h, h->keys[best], key)) break;\n"
+"        h->keys[i] = h->keys[best];\n"
+"        h->vals[i] = h->vals[best];\n"
+"        i = best;\n"
+"    }\n"
+"    h->keys[i] = key;\n"
+"    h->vals[i] = val;\n"
+"}\n"
+"\n"
+"static void fheap_push(FloatHeap* h, float key, int val) {\n"
+"    if (h->size >= h->cap) {\n"
+"        int cap = h->cap * 2;\n"
+"        float* keys = (float*)heap_alloc(cap, sizeof(float));\n"
+"        int* vals = (int*)heap_alloc(cap, sizeof(int));\n"
+"        memcpy(keys, h->keys, sizeof(float) * h->size);\n"
+"        memcpy(vals, h->vals, sizeof(int) * h->size);\n"
+"        heap_release(h->keys, sizeof(float));\n"
+"        heap_release(h->vals, sizeof(int));\n"
+"        h->keys = keys;\n"
+"        h->vals = vals;\n"
+"        h->cap = cap;\n"
+"    }\n"
+"    int i = h->size++;\n"
+"    while (i > 0) {\n"
+"        int parent = (i - 1) / HEAP_ARITY;\n"
+"        if (!fheap_before(h, key, h->keys[parent])) break;\n"
+"        h->keys[i] = h->keys[parent];\n"
+"        h->vals[i] = h->vals[parent];\n"
+"        i = parent;\n"
+"    }\n"
+"    h->keys[i] = key;\n"
+"    h->vals[i] = val;\n"
+"}\n"
+"\n"
+"static int fheap_pop(FloatHeap* h) {\n"
+"    if (h->size == 0) return 0;\n"
+"    int val = h->vals[0];\n"
+"    h->size--;\n"
+"    if (h->size > 0) {\n"
+"        h->keys[0] = h->keys[h->size];\n"
+"        h->vals[0] = h->vals[h->size];\n"
+"        fheap_sift_down(h, 0);\n"
+"    }\n"
+"    return val;\n"
+"}\n"
+"\n"
+"static float fheap_peek(const FloatHeap* h) {\n"
+"    return h->size ? h->keys[0] : 0.0f;\n"
+"}\n"
+"\n"
+"static int fheap_peek_val(const FloatHeap* h) {\n"
+"    return h->size ? h->vals[0] : 0;\n"
+"}\n"
+"\n"
+"static int fheap_len(const FloatHeap* h) {\n"
+"    return h->size;\n"
+"}\n"
+"\n"
+"static bool fheap_empty(const FloatHeap* h) {\n"
+"    return h->size == 0;\n"
+"}\n"
+"\n"
+"static void fheap_clear(FloatHeap* h) {\n"
+"    h->size = 0;\n"
+"}\n"
+"\n"
+"static void fheap_heapify(FloatHeap* h, const FList* l) {\n"
+"    heap_release(h->keys, sizeof(float));\n"
+"    heap_release(h->vals, sizeof(int));\n"
+"    h->cap = l->size > 16 ? l->size : 16;\n"
+"    h->keys = (float*)heap_alloc(h->cap, sizeof(float));\n"
+"    h->vals = (int*)heap_alloc(h->cap, sizeof(int));\n"
+"    memcpy(h->keys, l->data, sizeof(float) * l->size);\n"
+"    for (int i = 0; i < l->size; i++) h->vals[i] = i;\n"
+"    h->size = l->size;\n"
+"    for (int i = (h->size - 2) / HEAP_ARITY; i >= 0; i--) fheap_sift_down(h, i);\n"
+"}\n"
+"\n"
+"static void print_fheap(const FloatHeap* h) {\n"
+"    printf(\"[\");\n"
+"    for (int i = 0; i < h->size; i++) printf(i ? \", %f\" : \"%f\", h->keys[i]);\n"
+"    printf(\"]\\n\");\n"
+"}\n"
+"\n"
+"static void fheap_free(FloatHeap* h) {\n"
+"    heap_release(h->keys, sizeof(float));\n"
+"    heap_release(h->vals, sizeof(int));\n"
+"    h->keys = NULL;\n"
+"    h->vals = NULL;\n"
+"    h->size = 0;\n"
+"    h->cap = 0;\n"
+"}\n"
+"\n"
+"/* The k largest values, largest first: a size-k min-heap over one pass, O(n log k) */\n"
+"static List list_topk(const List* l, int k) {\n"
+"    if (k > l->size) k = l->size;\n"
+"    if (k < 0) k = 0;\n"
+"    IntHeap h = new_iheap(false);\n"
+"    for (int i = 0; i < l->size; i++) {\n"
+"        int x = l->data[i];\n"
+"        if (h.size < k) {\n"
+"            iheap_push(&h, x, i);\n"
+"        } else if (k > 0 && x > h.keys[0]) {\n"
+"            h.keys[0] = x;\n"
+"            h.vals[0] = i;\n"
+"            iheap_sift_down(&h, 0);\n"
+"        }\n"
+"    }\n"
+"    List out = new_list();\n"
+"    for (int i = 0; i < k; i++) list_append(&out, 0);\n"
+"    for (int i = k - 1; i >= 0; i--) {\n"
+"        out.data[i] = h.keys[0];\n"
+"        iheap_pop(&h);\n"
+"    }\n"
+"    iheap_free(&h);\n"
+"    return out;\n"
+"}\n"
+"\n"
+"static FList flist_topk(const FList* l, int k) {\n"
+"    if (k > l->size) k = l->size;\n"
+"    if (k < 0) k = 0;\n"
+"    FloatHeap h = new_fheap(false);\n"
+"    for (int i = 0; i < l->size; i++) {\n"
+"        float x = l->data[i];\n"
+"        if (h.size < k) {\n"
+"            fheap_push(&h, x, i);\n"
+"        } else if (k > 0 && x > h.keys[0]) {\n"
+"            h.keys[0] = x;\n"
+"            h.vals[0] = i;\n"
+"            fheap_sift_down(&h, 0);\n"
+"        }\n"
+"    }\n"
+"    FList out = new_flist();\n"
+"    for (int i = 0; i < k; i++) flist_append(&out, 0.0f);\n"
+"    for (int i = k - 1; i >= 0; i--) {\n"
+"        out.data[i] = h.keys[0];\n"
+"        fheap_pop(&h);\n"
+"    }\n"
+"    fheap_free(&h);\n"
+"    return out;\n"
+"}\n"
+"\n"
+"/* Ordered map: B+ tree of int keys, leaves linked for in-order scans */\n"
+"#define BT_KEYS 32      /* 128 bytes of keys per node, scanned with SIMD compares */\n"
+"\n"
+"typedef struct BTNode {\n"
+"    int keys[BT_KEYS];  /* unused slots hold INT_MAX */\n"
+"    int n;\n"
+"    bool leaf;\n"
+"    struct BTNode* next;\n"
+"    union {\n"
+"        int vals[BT_KEYS];\n"
+"        struct BTNode* child[BT_KEYS + 1];\n"
+"    } u;\n"
+"} BTNode;\n"
+"\n"
+"typedef struct {\n"
+"    BTNode* root;\n"
+"    int size;\n"
+"} OrdMap;\n"
+"\n"
+"static BTNode* bt_new_node(bool leaf) {\n"
+"    BTNode* node = (BTNode*)aligned_alloc(64, (sizeof(BTNode) + 63) & ~(size_t)63);\n"
+"    for (int i = 0; i < BT_KEYS; i++) node->keys[i] = INT_MAX;\n"
+"    node->n = 0;\n"
+"    node->leaf = leaf;\n"
+"    node->next = NULL;\n"
+"    return node;\n"
+"}\n"
+"\n"
+"static OrdMap new_ordmap(void) {\n"
+"    OrdMap m;\n"
+"    m.root = bt_new_node(true);\n"
+"    m.size = 0;\n"
+"    return m;\n"
+"}\n"
+"\n"
+"/* Number of keys in the node that are < x (lower bound) */\n"
+"static inline int bt_rank(const BTNode* node, int x) {\n"
+"#if defined(__AVX2__)\n"
+"    __m256i needle = _mm256_set1_epi32(x);\n"
+"    int count = 0;\n"
+"    for (int i = 0; i < BT_KEYS; i += 8) {\n"
+"        __m256i k = _mm256_load_si256((const __m256i*)(node->keys + i));\n"
+"        count += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(needle, k))));\n"
+"    }\n"
+"    return count;\n"
+"#else\n"
+"    int count = 0;\n"
+"    for (int i = 0; i < BT_KEYS; i++) count += node->keys[i] < x;\n"
+"    return count;\n"
+"#endif\n"
+"}\n"
+"\n"
+"/* Child to descend into: keys >= separator i live right of it */\n"
+"static inline int bt_child_index(const BTNode* node, int x) {\n"
+"    int r = bt_rank(node, x);\n"
+"    return (r < node->n && node->keys[r] == x) ? r + 1 : r;\n"
+"}\n"
+"\n"
+"static BTNode* bt_find_leaf(const OrdMap* m, int key) {\n"
+"    BTNode* node = m->root;\n"
+"    while (!node->leaf) node = node->u.child[bt_child_index(node, key)];\n"
+"    return node;\n"
+"}\n"
+"\n"
+"static bool ordmap_has(const OrdMap* m, int key) {\n"
+"    BTNode* leaf = bt_find_leaf(m, key);\n"
+"    int r = bt_rank(leaf, key);\n"
+"    return r < leaf->n && leaf->keys[r] == key;\n"
+"}\n"
+"\n"
+"static int ordmap_get(const OrdMap* m, int key) {\n"
+"    BTNode* leaf = bt_find_leaf(m, key);\n"
+"    int r = bt_rank(leaf, key);\n"
+"    return (r < leaf->n && leaf->keys[r] == key) ? leaf->u.vals[r] : 0;\n"
+"}\n"
+"\n"
+"/* Inserts below 'node'; if it splits, returns the new right sibling and its separator */\n"
+"static BTNode* bt_insert(BTNode* node, int key, int val, int* sep, bool* added) {\n"
+"    if (node->leaf) {\n"
+"        int r = bt_rank(node, key);\n"
+"        if (r < node->n && node->keys[r] == key) {\n"
+"            node->u.vals[r] = val;\n"
+"            return NULL;\n"
+"        }\n"
+"        *added = true;\n"
+"        BTNode* target = node;\n"
+"        BTNode* right = NULL;\n"
+"        if (node->n == BT_KEYS) {\n"
+"            right = bt_new_node(true);\n"
+"            int half = BT_KEYS / 2;\n"
+"            right->n = BT_KEYS - half;\n"
+"            memcpy(right->keys, node->keys + half, sizeof(int) * right->n);\n"
+"            memcpy(right->u.vals, node->u.vals + half, sizeof(int) * right->n);\n"
+"            for (int i = half; i < BT_KEYS; i++) node->keys[i] = INT_MAX;\n"
+"            node->n = half;\n"
+"            right->next = node->next;\n"
+"            node->next = right;\n"
+"            if (r > half) {\n"
+"                target = right;\n"
+"                r -= half;\n"
+"            }\n"
+"        }\n"
+"        memmove(target->keys + r + 1, target->keys + r, sizeof(int) * (target->n - r));\n"
+"        memmove(target->u.vals + r + 1, target->u.vals + r, sizeof(int) * (target->n - r));\n"
+"        target->keys[r] = key;\n"
+"        target->u.vals[r] = val;\n"
+"        target->n++;\n"
+"        if (right) *sep = right->keys[0];\n"
+"        return right;\n"
+"    }\n"
+"    \n"
+"    int ci = bt_child_index(node, key);\n"
+"    int child_sep;\n"
+"    BTNode* split = bt_insert(node->u.child[ci], key, val, &child_sep, added);\n"
+"    if (!split) return NULL;\n"
+"    \n"
+"    if (node->n < BT_KEYS) {\n"
+"        memmove(node->keys + ci + 1, node->keys + ci, sizeof(int) * (node->n - ci));\n"
+"        memmove(node->u.child + ci + 2, node->u.child + ci + 1, sizeof(BTNode*) * (node->n - ci));\n"
+"        node->keys[ci] = child_sep;\n"
+"        node->u.child[ci + 1] = split;\n"
+"        node->n++;\n"
+"        return NULL;\n"
+"    }\n"
+"    \n"
+"    /* Full internal node: split around the middle separator, which moves up */\n"
+"    int keys[BT_KEYS + 1];\n"
+"    BTNode* child[BT_KEYS + 2];\n"
+"    memcpy(keys, node->keys, sizeof(int) * ci);\n"
+"    keys[ci] = child_sep;\n"
+"    memcpy(keys + ci + 1, node->keys + ci, sizeof(int) * (BT_KEYS - ci));\n"
+"    memcpy(child, node->u.child, sizeof(BTNode*) * (ci + 1));\n"
+"    child[ci + 1] = split;\n"
+"    memcpy(child + ci + 2, node->u.child + ci + 1, sizeof(BTNode*) * (BT_KEYS - ci));\n"
+"    \n"
+"    int mid = (BT_KEYS + 1) / 2;\n"
+"    BTNode* right = bt_new_node(false);\n"
+"    for (int i = 0; i < BT_KEYS; i++) node->keys[i] = INT_MAX;\n"
+"    memcpy(node->keys, keys, sizeof(int) * mid);\n"
+"    memcpy(node->u.child, child, sizeof(BTNode*) * (mid + 1));\n"
+"    node->n = mid;\n"
+"    right->n = BT_KEYS - mid;\n"
+"    memcpy(right->keys, keys + mid + 1, sizeof(int) * right->n);\n"
+"    memcpy(right->u.child, child + mid + 1, sizeof(BTNode*) * (right->n + 1));\n"
+"    *sep = keys[mid];\n"
+"    return right;\n"
+"}\n"
+"\n"
+"static void ordmap_set(OrdMap* m, int key, int val) {\n"
+"    int sep;\n"
+"    bool added = false;\n"
+"    BTNode* right = bt_insert(m->root, key, val, &sep, &added);\n"
+"    if (right) {\n"
+"        BTNode* root = bt_new_node(false);\n"
+"        root->keys[0] = sep;\n"
+"        root->u.child[0] = m->root;\n"
+"        root->u.child[1] = right;\n"
+"        root->n = 1;\n"
+"        m->root = root;\n"
+"    }\n"
+"    if (added) m->size++;\n"
+"}\n"
+"\n"
+"/* Leaves may underflow after removal; separators stay valid bounds, so lookups are unaffected */\n"
+"static bool ordmap_remove(OrdMap* m, int key) {\n"
+"    BTNode* leaf = bt_find_leaf(m, key);\n"
+"    int r = bt_rank(leaf, key);\n"
+"    if (r >= leaf->n || leaf->keys[r] != key) return false;\n"
+"    memmove(leaf->keys + r, leaf->keys + r + 1, sizeof(int) * (leaf->n - r - 1));\n"
+"    memmove(leaf->u.vals + r, leaf->u.vals + r + 1, sizeof(int) * (leaf->n - r - 1));\n"
+"    leaf->n--;\n"
+"    leaf->keys[leaf->n] = INT_MAX;\n"
+"    m->size--;\n"
+"    return true;\n"
+"}\n"
+"\n"
+"static int ordmap_len(const OrdMap* m) {\n"
+"    return m->size;\n"
+"}\n"
+"\n"
+"static bool bt_first(const BTNode* node, int* key) {\n"
+"    if (node->leaf) {\n"
+"        if (node->n == 0) return false;\n"
+"        *key = node->keys[0];\n"
+"        return true;\n"
+"    }\n"
+"    for (int i = 0; i <= node->n; i++) {\n"
+"        if (bt_first(node->u.child[i], key)) return true;\n"
+"    }\n"
+"    return false;\n"
+"}\n"
+"\n"
+"static bool bt_last(const BTNode* node, int* key) {\n"
+"    if (node->leaf) {\n"
+"        if (node->n == 0) return false;\n"
+"        *key = node->keys[node->n - 1];\n"
+"        return true;\n"
+"    }\n"
+"    for (int i = node->n; i >= 0; i--) {\n"
+"        if (bt_last(node->u.child[i], key)) return true;\n"
+"    }\n"
+"    return false;\n"
+"}\n"
+"\n"
+"/* Smallest and largest keys (0 when empty) */\n"
+"static int ordmap_first(const OrdMap* m) {\n"
+"    int key = 0;\n"
+"    bt_first(m->root, &key);\n"
+"    return key;\n"
+"}\n"
+"\n"
+"static int ordmap_last(const OrdMap* m) {\n"
+"    int key = 0;\n"
+"    bt_last(m->root, &key);\n"
+"    return key;\n"
+"}\n"
+"\n"
+"/* In-order cursor over keys in [lo, hi] */\n"
+"typedef struct {\n"
+"    const BTNode* leaf;\n"
+"    int pos;\n"
+"    int hi;\n"
+"    int key;\n"
+"    int val;\n"
+"} OrdIter;\n"
+"\n"
+"static OrdIter ordmap_iter(const OrdMap* m, int lo, int hi) {\n"
+"    OrdIter it;\n"
+"    it.leaf = bt_find_leaf(m, lo);\n"
+"    it.pos = bt_rank(it.leaf, lo);\n"
+"    it.hi = hi;\n"
+"    it.key = 0;\n"
+"    it.val = 0;\n"
+"    return it;\n"
+"}\n"
+"\n"
+"static bool ordmap_next(OrdIter* it) {\n"
+"    while (it->leaf && it->pos >= it->leaf->n) {\n"
+"        it->leaf = it->leaf->next;\n"
+"        it->pos = 0;\n"
+"    }\n"
+"    if (!it->leaf || it->leaf->keys[it->pos] > it->hi) return false;\n"
+"    it->key = it->leaf->keys[it->pos];\n"
+"    it->val = it->leaf->u.vals[it->pos];\n"
+"    it->pos++;\n"
+"    return true;\n"
+"}\n"
+"\n"
+"static void print_ordmap(const OrdMap* m) {\n"
+"    OrdIter it = ordmap_iter(m, INT_MIN, INT_MAX);\n"
+"    printf(\"{\");\n"
+"    for (int n = 0; ordmap_next(&it); n++) {\n"
+"        printf(n ? \", %d: %d\" : \"%d: %d\", it.key, it.val);\n"
+"    }\n"
+"    printf(\"}\\n\");\n"
+"}\n"
+"\n"
+"static void bt_free(BTNode* node) {\n"
+"    if (!node->leaf) {\n"
+"        for (int i = 0; i <= node->n; i++) bt_free(node->u.child[i]);\n"
+"    }\n"
+"    free(node);\n"
+"}\n"
 "\n"
-"/* List implementation */\n"
+"static void ordmap_free(OrdMap* m) {\n"
+"    if (m->root) bt_free(m->root);\n"
+"    m->root = NULL;\n"
+"    m->size = 0;\n"
+"}\n"
+"\n"
+"/* LRU cache: fixed slab of entries on a recency list, indexed by a chained hash table */\n"
 "typedef struct {\n"
-"    int* data;\n"
-"    int size;\n"
+"    int key;\n"
+"    int val;\n"
+"    int prev, next;     /* recency list, most recent at head */\n"
+"    int chain;          /* next entry in the same hash bucket */\n"
+"} LruEntry;\n"
+"\n"
+"typedef struct {\n"
+"    LruEntry* slab;\n"
+"    int* buckets;\n"
+"    int bucket_mask;\n"
 "    int cap;\n"
-"} List;\n"
+"    int size;\n"
+"    int head, tail;\n"
+"    int free_list;\n"
+"    long long hits;\n"
+"    long long misses;\n"
+"} Lru;\n"
 "\n"
-"static List new_list(void) {\n"
-"    List l;\n"
-"    l.cap = 8;\n"
-"    l.size = 0;\n"
-"    l.data = (int*)malloc(sizeof(int) * l.cap);\n"
-"    return l;\n"
+"static Lru new_lru(int cap) {\n"
+"    Lru c;\n"
+"    if (cap < 1) cap = 1;\n"
+"    c.cap = cap;\n"
+"    c.size = 0;\n"
+"    c.head = c.tail = -1;\n"
+"    c.free_list = -1;\n"
+"    c.hits = c.misses = 0;\n"
+"    int nb = 16;\n"
+"    while (nb < cap * 2) nb *= 2;\n"
+"    c.bucket_mask = nb - 1;\n"
+"    c.slab = (LruEntry*)malloc(sizeof(LruEntry) * cap);\n"
+"    c.buckets = (int*)malloc(sizeof(int) * nb);\n"
+"    memset(c.buckets, 0xff, sizeof(int) * nb);\n"
+"    return c;\n"
 "}\n"
 "\n"
-"static void list_append(List* l, int val) {\n"
-"    if (l->size >= l->cap) {\n"
-"        l->cap *= 2;\n"
-"        l->data = (int*)realloc(l->data, sizeof(int) * l->cap);\n"
+"static inline int* lru_bucket(Lru* c, int key) {\n"
+"    return &c->buckets[hash_int(key) & c->bucket_mask];\n"
+"}\n"
+"\n"
+"static int lru_find(Lru* c, int key) {\n"
+"    for (int i = *lru_bucket(c, key); i >= 0; i = c->slab[i].chain) {\n"
+"        if (c->slab[i].key == key) return i;\n"
 "    }\n"
-"    l->data[l->size++] = val;\n"
+"    return -1;\n"
 "}\n"
 "\n"
-"static void list_free(List* l) {\n"
-"    free(l->data);\n"
-"    l->data = NULL;\n"
-"    l->size = 0;\n"
-"    l->cap = 0;\n"
+"static inline void lru_unlink(Lru* c, int i) {\n"
+"    LruEntry* e = &c->slab[i];\n"
+"    if (e->prev >= 0) c->slab[e->prev].next = e->next; else c->head = e->next;\n"
+"    if (e->next >= 0) c->slab[e->next].prev = e->prev; else c->tail = e->prev;\n"
 "}\n"
 "\n"
-"static int list_len(List* l) {\n"
-"    return l->size;\n"
+"static inline void lru_push_front(Lru* c, int i) {\n"
+"    c->slab[i].prev = -1;\n"
+"    c->slab[i].next = c->head;\n"
+"    if (c->head >= 0) c->slab[c->head].prev = i; else c->tail = i;\n"
+"    c->head = i;\n"
 "}\n"
 "\n"
-"static void print_list(List* l) {\n"
-"    printf(\"[\");\n"
-"    for (int i = 0; i < l->size; i++) {\n"
-"        printf(\"%d\", l->data[i]);\n"
-"        if (i < l->size - 1) printf(\", \");\n"
+"static void lru_unchain(Lru* c, int i) {\n"
+"    int* link = lru_bucket(c, c->slab[i].key);\n"
+"    while (*link != i) link = &c->slab[*link].chain;\n"
+"    *link = c->slab[i].chain;\n"
+"}\n"
+"\n"
+"static bool lru_has(Lru* c, int key) {\n"
+"    return lru_find(c, key) >= 0;\n"
+"}\n"
+"\n"
+"/* Value for key (0 when missing); a hit makes the entry most recent */\n"
+"static int lru_get(Lru* c, int key) {\n"
+"    int i = lru_find(c, key);\n"
+"    if (i < 0) {\n"
+"        c->misses++;\n"
+"        return 0;\n"
 "    }\n"
-"    printf(\"]\\n\");\n"
+"    c->hits++;\n"
+"    if (i != c->head) {\n"
+"        lru_unlink(c, i);\n"
+"        lru_push_front(c, i);\n"
+"    }\n"
+"    return c->slab[i].val;\n"
 "}\n"
 "\n"
-"static int* slice_arr(int* arr, int start, int end, int* out_len) {\n"
-"    *out_len = end - start;\n"
-"    int* result = (int*)malloc(sizeof(int) * (*out_len));\n"
-"    for (int i = 0; i < *out_len; i++) {\n"
-"        result[i] = arr[start + i];\n"
+"/* Inserts or updates; when full the least recently used entry is evicted */\n"
+"static void lru_put(Lru* c, int key, int val) {\n"
+"    int i = lru_find(c, key);\n"
+"    if (i >= 0) {\n"
+"        c->slab[i].val = val;\n"
+"        if (i != c->head) {\n"
+"            lru_unlink(c, i);\n"
+"            lru_push_front(c, i);\n"
+"        }\n"
+"        return;\n"
 "    }\n"
-"    return result;\n"
+"    if (c->free_list >= 0) {\n"
+"        i = c->free_list;\n"
+"        c->free_list = c->slab[i].next;\n"
+"        c->size++;\n"
+"    } else if (c->size < c->cap) {\n"
+"        i = c->size++;\n"
+"    } else {\n"
+"        i = c->tail;\n"
+"        lru_unlink(c, i);\n"
+"        lru_unchain(c, i);\n"
+"    }\n"
+"    int* bucket = lru_bucket(c, key);\n"
+"    c->slab[i].key = key;\n"
+"    c->slab[i].val = val;\n"
+"    c->slab[i].chain = *bucket;\n"
+"    *bucket = i;\n"
+"    lru_push_front(c, i);\n"
 "}\n"
 "\n"
-"/* Tuple implementation */\n"
+"static bool lru_remove(Lru* c, int key) {\n"
+"    int i = lru_find(c, key);\n"
+"    if (i < 0) return false;\n"
+"    lru_unlink(c, i);\n"
+"    lru_unchain(c, i);\n"
+"    c->slab[i].next = c->free_list;\n"
+"    c->free_list = i;\n"
+"    c->size--;\n"
+"    return true;\n"
+"}\n"
+"\n"
+"static int lru_len(Lru* c) {\n"
+"    return c->size;\n"
+"}\n"
+"\n"
+"static void lru_clear(Lru* c) {\n"
+"    memset(c->buckets, 0xff, sizeof(int) * (c->bucket_mask + 1));\n"
+"    c->size = 0;\n"
+"    c->head = c->tail = -1;\n"
+"    c->free_list = -1;\n"
+"    c->hits = c->misses = 0;\n"
+"}\n"
+"\n"
+"/* Entries from most to least recently used */\n"
+"static void print_lru(Lru* c) {\n"
+"    printf(\"{\");\n"
+"    for (int i = c->head; i >= 0; i = c->slab[i].next) {\n"
+"        printf(\"%d: %d\", c->slab[i].key, c->slab[i].val);\n"
+"        if (c->slab[i].next >= 0) printf(\", \");\n"
+"    }\n"
+"    printf(\"}\\n\");\n"
+"}\n"
+"\n"
+"static void lru_free(Lru* c) {\n"
+"    free(c->slab);\n"
+"    free(c->buckets);\n"
+"    c->slab = NULL;\n"
+"    c->buckets = NULL;\n"
+"    c->size = c->cap = 0;\n"
+"}\n"
+"\n"
+"/* Blocked Bloom filter: every key sets k bits inside one 64-byte block */\n"
+"#define BLOOM_BLOCK_BITS 512\n"
+"\n"
 "typedef struct {\n"
-"    int* data;\n"
+"    uint64_t* bits;\n"
+"    uint32_t blocks;\n"
+"    int k;\n"
+"} Bloom;\n"
+"\n"
+"static Bloom new_bloom(long long items, double fp_rate) {\n"
+"    Bloom b;\n"
+"    if (items < 1) items = 1;\n"
+"    if (fp_rate <= 0.0 || fp_rate >= 1.0) fp_rate = 0.01;\n"
+"    /* Blocking costs a little accuracy, so size ~10% above the classic optimum */\n"
+"    double bits = -(double)items * log(fp_rate) / (M_LN2 * M_LN2) * 1.1;\n"
+"    b.blocks = (uint32_t)(bits / BLOOM_BLOCK_BITS) + 1;\n"
+"    b.k = (int)(bits / (double)items * M_LN2 + 0.5);\n"
+"    if (b.k < 1) b.k = 1;\n"
+"    if (b.k > 16) b.k = 16;\n"
+"    b.bits = (uint64_t*)aligned_alloc(64, (size_t)b.blocks * 64);\n"
+"    memset(b.bits, 0, (size_t)b.blocks * 64);\n"
+"    return b;\n"
+"}\n"
+"\n"
+"static inline void bloom_add_hash(Bloom* b, uint64_t h) {\n"
+"    uint64_t* block = b->bits + (size_t)(((h >> 32) * b->blocks) >> 32) * 8;\n"
+"    uint32_t h1 = (uint32_t)h, h2 = (uint32_t)(h >> 41) | 1;\n"
+"    for (int i = 0; i < b->k; i++) {\n"
+"        uint32_t bit = (h1 + (uint32_t)i * h2) & (BLOOM_BLOCK_BITS - 1);\n"
+"        block[bit >> 6] |= 1ULL << (bit & 63);\n"
+"    }\n"
+"}\n"
+"\n"
+"static inline bool bloom_has_hash(const Bloom* b, uint64_t h) {\n"
+"    const uint64_t* block = b->bits + (size_t)(((h >> 32) * b->blocks) >> 32) * 8;\n"
+"    uint32_t h1 = (uint32_t)h, h2 = (uint32_t)(h >> 41) | 1;\n"
+"    bool hit = true;\n"
+"    for (int i = 0; i < b->k; i++) {\n"
+"        uint32_t bit = (h1 + (uint32_t)i * h2) & (BLOOM_BLOCK_BITS - 1);\n"
+"        hit &= (block[bit >> 6] >> (bit & 63)) & 1;\n"
+"    }\n"
+"    return hit;\n"
+"}\n"
+"\n"
+"static void bloom_add_int(Bloom* b, int key) { bloom_add_hash(b, hash_int(key)); }\n"
+"static void bloom_add_str(Bloom* b, const char* key) { bloom_add_hash(b, hash_str(key)); }\n"
+"static bool bloom_contains_int(const Bloom* b, int key) { return bloom_has_hash(b, hash_int(key)); }\n"
+"static bool bloom_contains_str(const Bloom* b, const char* key) { return bloom_has_hash(b, hash_str(key)); }\n"
+"\n"
+"#define bloom_add(b, key) _Generic((key), char*: bloom_add_str, const char*: bloom_add_str, default: bloom_add_int)(b, key)\n"
+"#define bloom_contains(b, key) _Generic((key), char*: bloom_contains_str, const char*: bloom_contains_str, default: bloom_contains_int)(b, key)\n"
+"\n"
+"/* Union of two filters built with the same parameters */\n"
+"static bool bloom_merge(Bloom* b, const Bloom* other) {\n"
+"    if (b->blocks != other->blocks || b->k != other->k) return false;\n"
+"    size_t words = (size_t)b->blocks * 8;\n"
+"    for (size_t i = 0; i < words; i++) b->bits[i] |= other->bits[i];\n"
+"    return true;\n"
+"}\n"
+"\n"
+"static void bloom_clear(Bloom* b) {\n"
+"    memset(b->bits, 0, (size_t)b->blocks * 64);\n"
+"}\n"
+"\n"
+"/* Binary snapshot: magic, k, block count, raw blocks */\n"
+"static bool bloom_save(const Bloom* b, const char* path) {\n"
+"    FILE* fp = fopen(path, \"wb\");\n"
+"    if (!fp) return false;\n"
+"    uint32_t header[3] = { 0x4D4C4241u /* \"ABLM\" */, (uint32_t)b->k, b->blocks };\n"
+"    bool ok = fwrite(header, sizeof(header), 1, fp) == 1 &&\n"
+"              fwrite(b->bits, 64, b->blocks, fp) == b->blocks;\n"
+"    return fclose(fp) == 0 && ok;\n"
+"}\n"
+"\n"
+"static bool bloom_load(Bloom* b, const char* path) {\n"
+"    FILE* fp = fopen(path, \"rb\");\n"
+"    if (!fp) return false;\n"
+"    uint32_t header[3];\n"
+"    bool ok = fread(header, sizeof(header), 1, fp) == 1 && header[0] == 0x4D4C4241u && header[2] > 0;\n"
+"    if (ok) {\n"
+"        uint64_t* bits = (uint64_t*)aligned_alloc(64, (size_t)header[2] * 64);\n"
+"        ok = fread(bits, 64, header[2], fp) == header[2];\n"
+"        if (ok) {\n"
+"            free(b->bits);\n"
+"            b->bits = bits;\n"
+"            b->k = (int)header[1];\n"
+"            b->blocks = header[2];\n"
+"        } else {\n"
+"            free(bits);\n"
+"        }\n"
+"    }\n"
+"    fclose(fp);\n"
+"    return ok;\n"
+"}\n"
+"\n"
+"static void print_bloom(const Bloom* b) {\n"
+"    printf(\"bloom(%u bits, k=%d)\\n\", b->blocks * BLOOM_BLOCK_BITS, b->k);\n"
+"}\n"
+"\n"
+"static void bloom_free(Bloom* b) {\n"
+"    free(b->bits);\n"
+"    b->bits = NULL;\n"
+"    b->blocks = 0;\n"
+"}\n"
+"\n"
+"/* Count-min sketch: 'depth' rows of 'width' counters, estimates never undercount */\n"
+"typedef struct {\n"
+"    uint32_t* counts;\n"
+"    uint32_t width;     /* power of two */\n"
+"    int depth;\n"
+"} CountMin;\n"
+"\n"
+"static CountMin new_cms(int width, int depth) {\n"
+"    CountMin c;\n"
+"    c.width = 16;\n"
+"    while ((int)c.width < width) c.width *= 2;\n"
+"    c.depth = depth < 1 ? 1 : (depth > 16 ? 16 : depth);\n"
+"    c.counts = (uint32_t*)calloc((size_t)c.width * c.depth, sizeof(uint32_t));\n"
+"    return c;\n"
+"}\n"
+"\n"
+"static inline void cms_add_hash(CountMin* c, uint64_t h, uint32_t n) {\n"
+"    uint32_t h1 = (uint32_t)h, h2 = (uint32_t)(h >> 32) | 1;\n"
+"    for (int r = 0; r < c->depth; r++) {\n"
+"        c->counts[(size_t)r * c->width + ((h1 + (uint32_t)r * h2) & (c->width - 1))] += n;\n"
+"    }\n"
+"}\n"
+"\n"
+"static inline int cms_count_hash(const CountMin* c, uint64_t h) {\n"
+"    uint32_t h1 = (uint32_t)h, h2 = (uint32_t)(h >> 32) | 1;\n"
+"    uint32_t best = UINT32_MAX;\n"
+"    for (int r = 0; r < c->depth; r++) {\n"
+"        uint32_t v = c->counts[(size_t)r * c->width + ((h1 + (uint32_t)r * h2) & (c->width - 1))];\n"
+"        if (v < best) best = v;\n"
+"    }\n"
+"    return (int)best;\n"
+"}\n"
+"\n"
+"static void cms_add_int(CountMin* c, int key) { cms_add_hash(c, hash_int(key), 1); }\n"
+"static void cms_add_str(CountMin* c, const char* key) { cms_add_hash(c, hash_str(key), 1); }\n"
+"static int cms_count_int(const CountMin* c, int key) { return cms_count_hash(c, hash_int(key)); }\n"
+"static int cms_count_str(const CountMin* c, const char* key) { return cms_count_hash(c, hash_str(key)); }\n"
+"\n"
+"#define cms_add(c, key) _Generic((key), char*: cms_add_str, const char*: cms_add_str, default: cms_add_int)(c, key)\n"
+"#define cms_count(c, key) _Generic((key), char*: cms_count_str, const char*: cms_count_str, default: cms_count_int)(c, key)\n"
+"\n"
+"static bool cms_merge(CountMin* c, const CountMin* other) {\n"
+"    if (c->width != other->width || c->depth != other->depth) return false;\n"
+"    size_t n = (size_t)c->width * c->depth;\n"
+"    for (size_t i = 0; i < n; i++) c->counts[i] += other->counts[i];\n"
+"    return true;\n"
+"}\n"
+"\n"
+"static void cms_clear(CountMin* c) {\n"
+"    memset(c->counts, 0, sizeof(uint32_t) * (size_t)c->width * c->depth);\n"
+"}\n"
+"\n"
+"static bool cms_save(const CountMin* c, const char* path) {\n"
+"    FILE* fp = fopen(path, \"wb\");\n"
+"    if (!fp) return false;\n"
+"    size_t n = (size_t)c->width * c->depth;\n"
+"    uint32_t header[3] = { 0x534D4341u /* \"ACMS\" */, c->width, (uint32_t)c->depth };\n"
+"    bool ok = fwrite(header, sizeof(header), 1, fp) == 1 &&\n"
+"              fwrite(c->counts, sizeof(uint32_t), n, fp) == n;\n"
+"    return fclose(fp) == 0 && ok;\n"
+"}\n"
+"\n"
+"static bool cms_load(CountMin* c, const char* path) {\n"
+"    FILE* fp = fopen(path, \"rb\");\n"
+"    if (!fp) return false;\n"
+"    uint32_t header[3];\n"
+"    bool ok = fread(header, sizeof(header), 1, fp) == 1 && header[0] == 0x534D4341u &&\n"
+"              header[1] > 0 && header[2] > 0 && header[2] <= 16;\n"
+"    if (ok) {\n"
+"        size_t n = (size_t)header[1] * header[2];\n"
+"        uint32_t* counts = (uint32_t*)malloc(sizeof(uint32_t) * n);\n"
+"        ok = fread(counts, sizeof(uint32_t), n, fp) == n;\n"
+"        if (ok) {\n"
+"            free(c->counts);\n"
+"            c->counts = counts;\n"
+"            c->width = header[1];\n"
+"            c->depth = (int)header[2];\n"
+"        } else {\n"
+"            free(counts);\n"
+"        }\n"
+"    }\n"
+"    fclose(fp);\n"
+"    return ok;\n"
+"}\n"
+"\n"
+"static void print_cms(const CountMin* c) {\n"
+"    printf(\"cms(width=%u, depth=%d)\\n\", c->width, c->depth);\n"
+"}\n"
+"\n"
+"static void cms_free(CountMin* c) {\n"
+"    free(c->counts);\n"
+"    c->counts = NULL;\n"
+"}\n"
+"\n"
+"/* Hash set implementation: open addressing with 16-byte control groups */\n"
+"#define SET_GROUP 16\n"
+"#define SET_EMPTY ((signed char)-128)\n"
+"#define SET_DELETED ((signed char)-2)\n"
+"\n"
+"/* Bitmask of the slots in a group whose control byte equals 'tag' */\n"
+"static inline unsigned set_group_match(const signed char* group, signed char tag) {\n"
+"#if defined(__SSE2__)\n"
+"    __m128i ctrl = _mm_load_si128((const __m128i*)group);\n"
+"    return (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(tag)));\n"
+"#else\n"
+"    unsigned mask = 0;\n"
+"    for (int i = 0; i < SET_GROUP; i++) mask |= (unsigned)(group[i] == tag) << i;\n"
+"    return mask;\n"
+"#endif\n"
+"}\n"
+"\n"
+"/* Bitmask of the empty or deleted slots in a group */\n"
+"static inline unsigned set_group_free(const signed char* group) {\n"
+"#if defined(__SSE2__)\n"
+"    return (unsigned)_mm_movemask_epi8(_mm_load_si128((const __m128i*)group));\n"
+"#else\n"
+"    unsigned mask = 0;\n"
+"    for (int i = 0; i < SET_GROUP; i++) mask |= (unsigned)(group[i] < 0) << i;\n"
+"    return mask;\n"
+"#endif\n"
+"}\n"
+"\n"
+"/* Control bytes and keys share one 64-byte aligned block */\n"
+"static void* set_alloc(int cap, size_t key_size, signed char** ctrl) {\n"
+"    size_t bytes = (size_t)cap + (size_t)cap * key_size;\n"
+"    bytes = (bytes + 63) & ~(size_t)63;\n"
+"    char* block = (char*)aligned_alloc(64, bytes);\n"
+"    memset(block, SET_EMPTY, (size_t)cap);\n"
+"    *ctrl = (signed char*)block;\n"
+"    return block + cap;\n"
+"}\n"
+"\n"
+"typedef struct {\n"
+"    signed char* ctrl;\n"
+"    int* keys;\n"
 "    int size;\n"
-"} Tuple;\n"
+"    int used;\n"
+"    int cap;\n"
+"} IntSet;\n"
 "\n"
-"static Tuple new_tuple(void) {\n"
-"    Tuple t;\n"
-"    t.size = 0;\n"
-"    t.data = NULL;\n"
-"    return t;\n"
+"static IntSet new_iset_cap(int cap) {\n"
+"    IntSet s;\n"
+"    s.cap = SET_GROUP;\n"
+"    while (s.cap * 7 < cap * 8) s.cap *= 2;\n"
+"    s.size = 0;\n"
+"    s.used = 0;\n"
+"    s.keys = (int*)set_alloc(s.cap, sizeof(int), &s.ctrl);\n"
+"    return s;\n"
 "}\n"
 "\n"
-"static Tuple make_tuple(int count, ...) {\n"
-"    Tuple t;\n"
-"    t.size = count;\n"
-"    t.data = (int*)malloc(sizeof(int) * count);\n"
+"static IntSet new_iset(void) {\n"
+"    return new_iset_cap(SET_GROUP);\n"
+"}\n"
+"\n"
+"static int iset_find(const IntSet* s, int key) {\n"
+"    uint64_t h = hash_int(key);\n"
+"    signed char tag = (signed char)(h & 0x7F);\n"
+"    size_t mask = (size_t)s->cap / SET_GROUP - 1;\n"
+"    size_t g = (h >> 7) & mask;\n"
+"    for (size_t step = 1;; step++) {\n"
+"        const signed char* group = s->ctrl + g * SET_GROUP;\n"
+"        unsigned m = set_group_match(group, tag);\n"
+"        while (m) {\n"
+"            int slot = (int)(g * SET_GROUP) + __builtin_ctz(m);\n"
+"            if (s->keys[slot] == key) return slot;\n"
+"            m &= m - 1;\n"
+"        }\n"
+"        if (set_group_match(group, SET_EMPTY)) return -1;\n"
+"        g = (g + step) & mask;\n"
+"    }\n"
+"}\n"
+"\n"
+"static bool iset_contains(const IntSet* s, int key) {\n"
+"    return iset_find(s, key) >= 0;\n"
+"}\n"
+"\n"
+"static void iset_insert_new(IntSet* s, int key, uint64_t h) {\n"
+"    size_t mask = (size_t)s->cap / SET_GROUP - 1;\n"
+"    size_t g = (h >> 7) & mask;\n"
+"    for (size_t step = 1;; step++) {\n"
+"        unsigned m = set_group_free(s->ctrl + g * SET_GROUP);\n"
+"        if (m) {\n"
+"            int slot = (int)(g * SET_GROUP) + __builtin_ctz(m);\n"
+"            if (s->ctrl[slot] == SET_EMPTY) s->used++;\n"
+"            s->ctrl[slot] = (signed char)(h & 0x7F);\n"
+"            s->keys[slot] = key;\n"
+"            s->size++;\n"
+"            return;\n"
+"        }\n"
+"        g = (g + step) & mask;\n"
+"    }\n"
+"}\n"
+"\n"
+"static void iset_rehash(IntSet* s, int min_size) {\n"
+"    IntSet n = new_iset_cap(min_size);\n"
+"    for (int i = 0; i < s->cap; i++) {\n"
+"        if (s->ctrl[i] >= 0) iset_insert_new(&n, s->keys[i], hash_int(s->keys[i]));\n"
+"    }\n"
+"    free(s->ctrl);\n"
+"    *s = n;\n"
+"}\n"
+"\n"
+"static bool iset_add(IntSet* s, int key) {\n"
+"    if (iset_find(s, key) >= 0) return false;\n"
+"    if ((s->used + 1) * 8 > s->cap * 7) {\n"
+"        iset_rehash(s, s->size * 2 + 1);\n"
+"    }\n"
+"    iset_insert_new(s, key, hash_int(key));\n"
+"    return true;\n"
+"}\n"
+"\n"
+"static bool iset_remove(IntSet* s, int key) {\n"
+"    int slot = iset_find(s, key);\n"
+"    if (slot < 0) return false;\n"
+"    /* A group that still has an empty slot never made a probe move past it */\n"
+"    const signed char* group = s->ctrl + (slot & ~(SET_GROUP - 1));\n"
+"    if (set_group_match(group, SET_EMPTY)) {\n"
+"        s->ctrl[slot] = SET_EMPTY;\n"
+"        s->used--;\n"
+"    } else {\n"
+"        s->ctrl[slot] = SET_DELETED;\n"
+"    }\n"
+"    s->size--;\n"
+"    return true;\n"
+"}\n"
+"\n"
+"static int iset_len(const IntSet* s) {\n"
+"    return s->size;\n"
+"}\n"
+"\n"
+"static void iset_clear(IntSet* s) {\n"
+"    memset(s->ctrl, SET_EMPTY, (size_t)s->cap);\n"
+"    s->size = 0;\n"
+"    s->used = 0;\n"
+"}\n"
+"\n"
+"static IntSet iset_of(int count, ...) {\n"
+"    IntSet s = new_iset_cap(count);\n"
 "    va_list args;\n"
 "    va_start(args, count);\n"
 "    for (int i = 0; i < count; i++) {\n"
-"        t.data[i] = va_arg(args, int);\n"
+"        iset_add(&s, va_arg(args, int));\n"
 "    }\n"
 "    va_end(args);\n"
-"    return t;\n"
+"    return s;\n"
 "}\n"
 "\n"
-"static void print_tuple(Tuple* t) {\n"
-"    printf(\"(\");\n"
-"    for (int i = 0; i < t->size; i++) {\n"
-"        printf(\"%d\", t->data[i]);\n"
-"        if (i < t->size - 1) printf(\", \");\n"
+"static IntSet iset_union(const IntSet* a, const IntSet* b) {\n"
+"    if (a->size < b->size) {\n"
+"        const IntSet* t = a; a = b; b = t;\n"
 "    }\n"
-"    printf(\")\\n\");\n"
+"    IntSet s = new_iset_cap(a->size + b->size);\n"
+"    for (int i = 0; i < a->cap; i++) {\n"
+"        if (a->ctrl[i] >= 0) iset_insert_new(&s, a->keys[i], hash_int(a->keys[i]));\n"
+"    }\n"
+"    for (int i = 0; i < b->cap; i++) {\n"
+"        if (b->ctrl[i] >= 0 && iset_find(&s, b->keys[i]) < 0) {\n"
+"            iset_insert_new(&s, b->keys[i], hash_int(b->keys[i]));\n"
+"        }\n"
+"    }\n"
+"    return s;\n"
 "}\n"
 "\n"
-"static void tuple_free(Tuple* t) {\n"
-"    free(t->data);\n"
-"    t->data = NULL;\n"
-"    t->size = 0;\n"
+"static IntSet iset_intersect(const IntSet* a, const IntSet* b) {\n"
+"    if (a->size > b->size) {\n"
+"        const IntSet* t = a; a = b; b = t;\n"
+"    }\n"
+"    IntSet s = new_iset_cap(a->size);\n"
+"    for (int i = 0; i < a->cap; i++) {\n"
+"        if (a->ctrl[i] >= 0 && iset_find(b, a->keys[i]) >= 0) {\n"
+"            iset_insert_new(&s, a->keys[i], hash_int(a->keys[i]));\n"
+"        }\n"
+"    }\n"
+"    return s;\n"
 "}\n"
 "\n"
-"/* Dictionary implementation */\n"
-"#define DICT_MAX 256\n"
+"static List iset_to_list(const IntSet* s) {\n"
+"    List l = new_list();\n"
+"    for (int i = 0; i < s->cap; i++) {\n"
+"        if (s->ctrl[i] >= 0) list_append(&l, s->keys[i]);\n"
+"    }\n"
+"    return l;\n"
+"}\n"
+"\n"
+"static void print_iset(const IntSet* s) {\n"
+"    printf(\"{\");\n"
+"    int n = 0;\n"
+"    for (int i = 0; i < s->cap; i++) {\n"
+"        if (s->ctrl[i] < 0) continue;\n"
+"        printf(n++ ? \", %d\" : \"%d\", s->keys[i]);\n"
+"    }\n"
+"    printf(\"}\\n\");\n"
+"}\n"
+"\n"
+"static void iset_free(IntSet* s) {\n"
+"    free(s->ctrl);\n"
+"    s->ctrl = NULL;\n"
+"    s->keys = NULL;\n"
+"    s->size = 0;\n"
+"    s->used = 0;\n"
+"    s->cap = 0;\n"
+"}\n"
 "\n"
 "typedef struct {\n"
-"    char* keys[DICT_MAX];\n"
-"    int vals[DICT_MAX];\n"
+"    signed char* ctrl;\n"
+"    char** keys;\n"
 "    int size;\n"
-"} Dict;\n"
+"    int used;\n"
+"    int cap;\n"
+"} StrSet;\n"
 "\n"
-"static Dict new_dict(void) {\n"
-"    Dict d;\n"
-"    d.size = 0;\n"
-"    for (int i = 0; i < DICT_MAX; i++) {\n"
-"        d.keys[i] = NULL;\n"
+"static StrSet new_sset_cap(int cap) {\n"
+"    StrSet s;\n"
+"    s.cap = SET_GROUP;\n"
+"    while (s.cap * 7 < cap * 8) s.cap *= 2;\n"
+"    s.size = 0;\n"
+"    s.used = 0;\n"
+"    s.keys = (char**)set_alloc(s.cap, sizeof(char*), &s.ctrl);\n"
+"    return s;\n"
+"}\n"
+"\n"
+"static StrSet new_sset(void) {\n"
+"    return new_sset_cap(SET_GROUP);\n"
+"}\n"
+"\n"
+"static int sset_find(const StrSet* s, const char* key) {\n"
+"    uint64_t h = hash_str(key);\n"
+"    signed char tag = (signed char)(h & 0x7F);\n"
+"    size_t mask = (size_t)s->cap / SET_GROUP - 1;\n"
+"    size_t g = (h >> 7) & mask;\n"
+"    for (size_t step = 1;; step++) {\n"
+"        const signed char* group = s->ctrl + g * SET_GROUP;\n"
+"        unsigned m = set_group_match(group, tag);\n"
+"        while (m) {\n"
+"            int slot = (int)(g * SET_GROUP) + __builtin_ctz(m);\n"
+"            if (strcmp(s->keys[slot], key) == 0) return slot;\n"
+"            m &= m - 1;\n"
+"        }\n"
+"        if (set_group_match(group, SET_EMPTY)) return -1;\n"
+"        g = (g + step) & mask;\n"
 "    }\n"
-"    return d;\n"
 "}\n"
 "\n"
-"static void dset(Dict* d, const char* key, int val) {\n"
-"    for (int i = 0; i < d->size; i++) {\n"
-"        if (d->keys[i] && strcmp(d->keys[i], key) == 0) {\n"
-"            d->vals[i] = val;\n"
+"static bool sset_contains(const StrSet* s, const char* key) {\n"
+"    return sset_find(s, key) >= 0;\n"
+"}\n"
+"\n"
+"/* Takes ownership of 'key' */\n"
+"static void sset_insert_new(StrSet* s, char* key, uint64_t h) {\n"
+"    size_t mask = (size_t)s->cap / SET_GROUP - 1;\n"
+"    size_t g = (h >> 7) & mask;\n"
+"    for (size_t step = 1;; step++) {\n"
+"        unsigned m = set_group_free(s->ctrl + g * SET_GROUP);\n"
+"        if (m) {\n"
+"            int slot = (int)(g * SET_GROUP) + __builtin_ctz(m);\n"
+"            if (s->ctrl[slot] == SET_EMPTY) s->used++;\n"
+"            s->ctrl[slot] = (signed char)(h & 0x7F);\n"
+"            s->keys[slot] = key;\n"
+"            s->size++;\n"
 "            return;\n"
 "        }\n"
+"        g = (g + step) & mask;\n"
 "    }\n"
-"    if (d->size < DICT_MAX) {\n"
-"        d->keys[d->size] = strdup(key);\n"
-"        d->vals[d->size] = val;\n"
-"        d->size++;\n"
+"}\n"
+"\n"
+"static void sset_rehash(StrSet* s, int min_size) {\n"
+"    StrSet n = new_sset_cap(min_size);\n"
+"    for (int i = 0; i < s->cap; i++) {\n"
+"        if (s->ctrl[i] >= 0) sset_insert_new(&n, s->keys[i], hash_str(s->keys[i]));\n"
 "    }\n"
+"    free(s->ctrl);\n"
+"    *s = n;\n"
 "}\n"
 "\n"
-"static int dget(Dict* d, const char* key) {\n"
-"    for (int i = 0; i < d->size; i++) {\n"
-"        if (d->keys[i] && strcmp(d->keys[i], key) == 0) {\n"
-"            return d->vals[i];\n"
+"static bool sset_add(StrSet* s, const char* key) {\n"
+"    if (sset_find(s, key) >= 0) return false;\n"
+"    if ((s->used + 1) * 8 > s->cap * 7) {\n"
+"        sset_rehash(s, s->size * 2 + 1);\n"
+"    }\n"
+"    sset_insert_new(s, strdup(key), hash_str(key));\n"
+"    return true;\n"
+"}\n"
+"\n"
+"static bool sset_remove(StrSet* s, const char* key) {\n"
+"    int slot = sset_find(s, key);\n"
+"    if (slot < 0) return false;\n"
+"    free(s->keys[slot]);\n"
+"    const signed char* group = s->ctrl + (slot & ~(SET_GROUP - 1));\n"
+"    if (set_group_match(group, SET_EMPTY)) {\n"
+"        s->ctrl[slot] = SET_EMPTY;\n"
+"        s->used--;\n"
+"    } else {\n"
+"        s->ctrl[slot] = SET_DELETED;\n"
+"    }\n"
+"    s->size--;\n"
+"    return true;\n"
+"}\n"
+"\n"
+"static int sset_len(const StrSet* s) {\n"
+"    return s->size;\n"
+"}\n"
+"\n"
+"static void sset_clear(StrSet* s) {\n"
+"    for (int i = 0; i < s->cap; i++) {\n"
+"        if (s->ctrl[i] >= 0) free(s->keys[i]);\n"
+"    }\n"
+"    memset(s->ctrl, SET_EMPTY, (size_t)s->cap);\n"
+"    s->size = 0;\n"
+"    s->used = 0;\n"
+"}\n"
+"\n"
+"static StrSet sset_of(int count, ...) {\n"
+"    StrSet s = new_sset_cap(count);\n"
+"    va_list args;\n"
+"    va_start(args, count);\n"
+"    for (int i = 0; i < count; i++) {\n"
+"        sset_add(&s, va_arg(args, const char*));\n"
+"    }\n"
+"    va_end(args);\n"
+"    return s;\n"
+"}\n"
+"\n"
+"static StrSet sset_union(const StrSet* a, const StrSet* b) {\n"
+"    StrSet s = new_sset_cap(a->size + b->size);\n"
+"    for (int i = 0; i < a->cap; i++) {\n"
+"        if (a->ctrl[i] >= 0) sset_insert_new(&s, strdup(a->keys[i]), hash_str(a->keys[i]));\n"
+"    }\n"
+"    for (int i = 0; i < b->cap; i++) {\n"
+"        if (b->ctrl[i] >= 0 && sset_find(&s, b->keys[i]) < 0) {\n"
+"            sset_insert_new(&s, strdup(b->keys[i]), hash_str(b->keys[i]));\n"
 "        }\n"
 "    }\n"
-"    return 0;\n"
+"    return s;\n"
 "}\n"
 "\n"
-"static void dict_free(Dict* d) {\n"
-"    for (int i = 0; i < d->size; i++) {\n"
-"        free(d->keys[i]);\n"
+"static StrSet sset_intersect(const StrSet* a, const StrSet* b) {\n"
+"    if (a->size > b->size) {\n"
+"        const StrSet* t = a; a = b; b = t;\n"
 "    }\n"
-"    d->size = 0;\n"
+"    StrSet s = new_sset_cap(a->size);\n"
+"    for (int i = 0; i < a->cap; i++) {\n"
+"        if (a->ctrl[i] >= 0 && sset_find(b, a->keys[i]) >= 0) {\n"
+"            sset_insert_new(&s, strdup(a->keys[i]), hash_str(a->keys[i]));\n"
+"        }\n"
+"    }\n"
+"    return s;\n"
+"}\n"
+"\n"
+"static void print_sset(const StrSet* s) {\n"
+"    printf(\"{\");\n"
+"    int n = 0;\n"
+"    for (int i = 0; i < s->cap; i++) {\n"
+"        if (s->ctrl[i] < 0) continue;\n"
+"        printf(n++ ? \", %s\" : \"%s\", s->keys[i]);\n"
+"    }\n"
+"    printf(\"}\\n\");\n"
+"}\n"
+"\n"
+"static void sset_free(StrSet* s) {\n"
+"    for (int i = 0; i < s->cap; i++) {\n"
+"        if (s->ctrl[i] >= 0) free(s->keys[i]);\n"
+"    }\n"
+"    free(s->ctrl);\n"
+"    s->ctrl = NULL;\n"
+"    s->keys = NULL;\n"
+"    s->size = 0;\n"
+"    s->used = 0;\n"
+"    s->cap = 0;\n"
 "}\n"
 "\n";
 
@@ -1603,6 +11368,8 @@ static void compile_file(const char* filename) {
     }
     g_current_line = saved_line;
     
+    instantiate_generics();
+    
     if (g_log_mode == LOG_HUMAN) {
         fprintf(stderr, "\n\033[1m========== END OF LOG ==========\033[0m\n\n");
     } else if (g_log_mode == LOG_MACHINE) {
@@ -1610,20 +11377,83 @@ static void compile_file(const char* filename) {
     }
 }
 
+/* Small bodies (a few statements, no loops) are made 'static inline', unless @cold */
+static bool is_small_body(const Function* f) {
+    if (has_func_attr(f->attrs, "cold")) return false;
+    int lines = 0;
+    for (const char* c = f->body; *c; c++) lines += *c == '\n';
+    return lines <= 6 && !strstr(f->body, "for (") && !strstr(f->body, "while (");
+}
+
+/* A generator's code is its step function: bool name__next(Gen_name* _g) */
+static void function_signature(const Function* f, char* out, size_t out_size) {
+    char name[160], params[1024], ret_c[160];
+    snprintf(name, sizeof(name), "%s%s", f->name, f->is_generator ? "__next" : "");
+    snprintf(ret_c, sizeof(ret_c), "%s", f->is_generator ? "bool" : f->ret_c);
+    if (f->is_generator) {
+        snprintf(params, sizeof(params), "Gen_%s* _g", f->name);
+    } else {
+        snprintf(params, sizeof(params), "%s", f->params);
+    }
+    const char* qualifiers = "static ";
+    if (f->inline_mode == INLINE_ALWAYS) {
+        qualifiers = "static inline __attribute__((always_inline)) ";
+    } else if (f->inline_mode == INLINE_NEVER) {
+        qualifiers = "static __attribute__((noinline)) ";
+    } else if (is_small_body(f)) {
+        qualifiers = "static inline ";
+    }
+    if (f->attrs[0]) {
+        snprintf(out, out_size, "%s__attribute__((%s)) %s %s(%s)", qualifiers, f->attrs, ret_c, name, params);
+    } else {
+        snprintf(out, out_size, "%s%s %s(%s)", qualifiers, ret_c, name, params);
+    }
+}
+
+/* Frame struct and constructor of a generator; the constructor only stores the arguments */
+static void generator_frame(const Function* f) {
+    char buf[MAX_LINE];
+    snprintf(buf, sizeof(buf), "typedef struct {\n    int _state;\n    %s _value;\n", f->ret_c);
+    append_output(buf);
+    append_output(f->frame ? f->frame : "");
+    snprintf(buf, sizeof(buf), "} Gen_%s;\n\nstatic inline Gen_%s %s(%s) {\n    Gen_%s _g;\n"
+             "    memset(&_g, 0, sizeof(_g));\n", f->name, f->name, f->name, f->params, f->name);
+    append_output(buf);
+    if (strcmp(f->params, "void") != 0) {
+        char params[1024];
+        snprintf(params, sizeof(params), "%s", f->params);
+        for (char* prm = strtok(params, ","); prm; prm = strtok(NULL, ",")) {
+            char* name = prm + strlen(prm);
+            while (name > prm && is_ident_char(name[-1])) name--;
+            snprintf(buf, sizeof(buf), "    _g.%s = %s;\n", name, name);
+            append_output(buf);
+        }
+    }
+    append_output("    return _g;\n}\n\n");
+}
+
 static void generate_output(void) {
     append_output(STDLIB);
+    append_output(g_decls);
     
     for (int i = 0; i < g_func_count; i++) {
-        append_output("void ");
-        append_output(g_funcs[i].name);
-        append_output("(void);\n");
+        if (g_funcs[i].is_generator) generator_frame(&g_funcs[i]);
+    }
+    
+    char signature[2048];
+    for (int i = 0; i < g_func_count; i++) {
+        function_signature(&g_funcs[i], signature, sizeof(signature));
+        append_output(signature);
+        append_output(";\n");
     }
     append_output("\n");
     
+    if (g_parallel_code) append_output(g_parallel_code);
+    
     for (int i = 0; i < g_func_count; i++) {
-        append_output("void ");
-        append_output(g_funcs[i].name);
-        append_output("(void) {\n");
+        function_signature(&g_funcs[i], signature, sizeof(signature));
+        append_output(signature);
+        append_output(" {\n");
         append_output(g_funcs[i].body);
         append_output("}\n\n");
     }
@@ -1652,19 +11482,20 @@ static void compile_c_to_binary(const char* c_file, CompileMode mode) {
     switch (mode) {
         case MODE_DEBUG:
         case MODE_DEBUG_OPT:
-            flags = "-Ofast -g";
+            flags = "-Ofast -march=native -g";
             break;
         case MODE_RAW:
         case MODE_DEBUG_RAW:
-            flags = "-O1 -g";
+            flags = "-O1 -march=native -g";
             break;
         case MODE_OPTIMIZED:
+        case MODE_CHECKED:
         default:
-            flags = "-Ofast -w";
+            flags = "-Ofast -march=native -w";
             break;
     }
     
-    snprintf(cmd, sizeof(cmd), "gcc %s %s -o program -lm 2>&1", flags, c_file);
+    snprintf(cmd, sizeof(cmd), "gcc %s -fopenmp-simd %s -o program -lm -pthread 2>&1", flags, c_file);
     
     if (g_log_mode == LOG_HUMAN) {
         fprintf(stderr, "\033[36m[GCC]\033[0m Running: %s\n", cmd);
@@ -1697,6 +11528,7 @@ static const char* mode_to_string(CompileMode mode) {
         case MODE_DEBUG: return "debug";
         case MODE_DEBUG_OPT: return "debug_opt";
         case MODE_DEBUG_RAW: return "debug_raw";
+        case MODE_CHECKED: return "checked";
         default: return "unknown";
     }
 }
@@ -1713,6 +11545,7 @@ int main(int argc, char* argv[]) {
         printf("  debug               - Optimized + machine-readable logging + auto-run\n");
         printf("  debug_opt           - Optimized + human-readable logging + auto-run\n");
         printf("  debug_raw           - Raw + human-readable logging + auto-run\n");
+        printf("  checked             - Optimized + list index checks\n");
         printf("\nNew features:\n");
         printf("  - Curly braces: 'if x > 0 {' ... '}'\n");
         printf("  - For-in loops: 'for c in string:', 'for x in list:', 'for k in dict:'\n");
@@ -1738,6 +11571,8 @@ int main(int argc, char* argv[]) {
             g_mode = MODE_RAW;
         } else if (strcmp(argv[2], "optimized") == 0) {
             g_mode = MODE_OPTIMIZED;
+        } else if (strcmp(argv[2], "checked") == 0) {
+            g_mode = MODE_CHECKED;
         } else {
             fprintf(stderr, "Unknown mode: %s\n", argv[2]);
             return 1;
@@ -1753,8 +11588,15 @@ int main(int argc, char* argv[]) {
     g_in_function = false;
     g_main_len = 0;
     g_output_len = 0;
+    g_decls_len = 0;
+    g_ct_const_count = 0;
+    g_ct_data_count = 0;
+    g_pipe_count = 0;
+    g_parallel_count = 0;
+    g_parallel_depth = 0;
     g_main_code[0] = '\0';
     g_output[0] = '\0';
+    g_decls[0] = '\0';
     
     // Compile
     printf("Compiling %s (mode: %s)...\n", input_file, mode_to_string(g_mode));
@@ -0,0 +1,3507 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <math.h>
+#include <time.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <limits.h>
+#include <pthread.h>
+#include <unistd.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE4_2__)
+#include <nmmintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* print() of an integer; hash64 and digest() results are unsigned 64-bit */
+#define print_int(x) _Generic((x), \
+    uint64_t: printf("%llu\n", (unsigned long long)(x)), \
+    default: printf("%lld\n", (long long)(x)))
+
+/* List implementation */
+typedef struct {
+    int* data;
+    int size;
+    int cap;
+} List;
+
+/* List storage is 64-byte aligned from creation and stays aligned as it grows,
+   so simd loops can assume the alignment without touching the list */
+static void* list_alloc_aligned(size_t bytes) {
+    void* p = NULL;
+    if (posix_memalign(&p, 64, bytes ? bytes : 64) != 0) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    return p;
+}
+
+static void* list_realloc_data(void* data, size_t used, size_t bytes) {
+    void* p = list_alloc_aligned(bytes);
+    if (data) memcpy(p, data, used);
+    free(data);
+    return p;
+}
+
+static List new_list(void) {
+    List l;
+    l.cap = 8;
+    l.size = 0;
+    l.data = (int*)list_alloc_aligned(sizeof(int) * l.cap);
+    return l;
+}
+
+static void list_append(List* l, int val) {
+    if (l->size >= l->cap) {
+        l->cap *= 2;
+        l->data = (int*)list_realloc_data(l->data, sizeof(int) * l->size, sizeof(int) * l->cap);
+    }
+    l->data[l->size++] = val;
+}
+
+static void list_reserve(List* l, int n) {
+    if (n <= l->cap) return;
+    l->cap = n;
+    l->data = (int*)list_realloc_data(l->data, sizeof(int) * l->size, sizeof(int) * l->cap);
+}
+
+/* Index checks emitted in checked mode (works for FList too) */
+static void __attribute__((cold, noreturn)) list_index_fail(int i, int size, int line) {
+    fprintf(stderr, "Line %d: list index %d out of range (size %d)\n", line, i, size);
+    exit(1);
+}
+
+static inline int list_check(int i, int size, int line) {
+    if (__builtin_expect((unsigned)i >= (unsigned)size, 0)) list_index_fail(i, size, line);
+    return i;
+}
+
+static void list_free(List* l) {
+    free(l->data);
+    l->data = NULL;
+    l->size = 0;
+    l->cap = 0;
+}
+
+static int list_len(const List* l) {
+    return l->size;
+}
+
+static void print_list(const List* l) {
+    printf("[");
+    for (int i = 0; i < l->size; i++) {
+        printf("%d", l->data[i]);
+        if (i < l->size - 1) printf(", ");
+    }
+    printf("]\n");
+}
+
+/* Float list: same layout as List, used for list[float] */
+typedef struct {
+    float* data;
+    int size;
+    int cap;
+} FList;
+
+static FList new_flist(void) {
+    FList l;
+    l.cap = 8;
+    l.size = 0;
+    l.data = (float*)list_alloc_aligned(sizeof(float) * l.cap);
+    return l;
+}
+
+static void flist_append(FList* l, float val) {
+    if (l->size >= l->cap) {
+        l->cap *= 2;
+        l->data = (float*)list_realloc_data(l->data, sizeof(float) * l->size, sizeof(float) * l->cap);
+    }
+    l->data[l->size++] = val;
+}
+
+static void flist_reserve(FList* l, int n) {
+    if (n <= l->cap) return;
+    l->cap = n;
+    l->data = (float*)list_realloc_data(l->data, sizeof(float) * l->size, sizeof(float) * l->cap);
+}
+
+static void flist_free(FList* l) {
+    free(l->data);
+    l->data = NULL;
+    l->size = 0;
+    l->cap = 0;
+}
+
+static int flist_len(const FList* l) {
+    return l->size;
+}
+
+static void print_flist(const FList* l) {
+    printf("[");
+    for (int i = 0; i < l->size; i++) {
+        printf("%f", l->data[i]);
+        if (i < l->size - 1) printf(", ");
+    }
+    printf("]\n");
+}
+
+static int* slice_arr(int* arr, int start, int end, int* out_len) {
+    *out_len = end - start;
+    int* result = (int*)malloc(sizeof(int) * (*out_len));
+    for (int i = 0; i < *out_len; i++) {
+        result[i] = arr[start + i];
+    }
+    return result;
+}
+
+/* Membership search used by the 'in' operator */
+static bool int_array_contains(const int* data, int n, int x) {
+    int i = 0;
+#if defined(__AVX2__)
+    __m256i needle = _mm256_set1_epi32(x);
+    for (; i + 32 <= n; i += 32) {
+        __m256i a = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(data + i)), needle);
+        __m256i b = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(data + i + 8)), needle);
+        __m256i c = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(data + i + 16)), needle);
+        __m256i d = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(data + i + 24)), needle);
+        __m256i any = _mm256_or_si256(_mm256_or_si256(a, b), _mm256_or_si256(c, d));
+        if (_mm256_movemask_epi8(any)) return true;
+    }
+    for (; i + 8 <= n; i += 8) {
+        __m256i eq = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(data + i)), needle);
+        if (_mm256_movemask_epi8(eq)) return true;
+    }
+#elif defined(__SSE2__)
+    __m128i needle = _mm_set1_epi32(x);
+    for (; i + 4 <= n; i += 4) {
+        __m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(data + i)), needle);
+        if (_mm_movemask_epi8(eq)) return true;
+    }
+#endif
+    for (; i < n; i++) {
+        if (data[i] == x) return true;
+    }
+    return false;
+}
+
+/* Same scan for floats; ordered compares, so NaN matches nothing and -0.0 matches 0.0 as with == */
+static bool float_array_contains(const float* data, int n, float x) {
+    int i = 0;
+#if defined(__AVX2__)
+    __m256 needle = _mm256_set1_ps(x);
+    for (; i + 32 <= n; i += 32) {
+        __m256 a = _mm256_cmp_ps(_mm256_loadu_ps(data + i), needle, _CMP_EQ_OQ);
+        __m256 b = _mm256_cmp_ps(_mm256_loadu_ps(data + i + 8), needle, _CMP_EQ_OQ);
+        __m256 c = _mm256_cmp_ps(_mm256_loadu_ps(data + i + 16), needle, _CMP_EQ_OQ);
+        __m256 d = _mm256_cmp_ps(_mm256_loadu_ps(data + i + 24), needle, _CMP_EQ_OQ);
+        __m256 any = _mm256_or_ps(_mm256_or_ps(a, b), _mm256_or_ps(c, d));
+        if (_mm256_movemask_ps(any)) return true;
+    }
+    for (; i + 8 <= n; i += 8) {
+        __m256 eq = _mm256_cmp_ps(_mm256_loadu_ps(data + i), needle, _CMP_EQ_OQ);
+        if (_mm256_movemask_ps(eq)) return true;
+    }
+#elif defined(__SSE2__)
+    __m128 needle = _mm_set1_ps(x);
+    for (; i + 4 <= n; i += 4) {
+        __m128 eq = _mm_cmpeq_ps(_mm_loadu_ps(data + i), needle);
+        if (_mm_movemask_ps(eq)) return true;
+    }
+#endif
+    for (; i < n; i++) {
+        if (data[i] == x) return true;
+    }
+    return false;
+}
+
+/* Index of the first element >= x in an ascending array */
+static int int_array_lower_bound(const int* data, int n, int x) {
+    if (n <= 0) return 0;
+    const int* base = data;
+    while (n > 1) {
+        int half = n / 2;
+        base = (base[half] < x) ? base + half : base;
+        n -= half;
+    }
+    return (int)(base - data) + (*base < x);
+}
+
+static bool list_contains(const List* l, int x) {
+    return int_array_contains(l->data, l->size, x);
+}
+
+static bool list_contains_sorted(const List* l, int x) {
+    int i = int_array_lower_bound(l->data, l->size, x);
+    return i < l->size && l->data[i] == x;
+}
+
+static bool str_has_char(const char* s, int c) {
+    return s && c != 0 && strchr(s, c) != NULL;
+}
+
+static bool str_contains(const char* s, const char* sub) {
+    return s && sub && strstr(s, sub) != NULL;
+}
+
+static bool flist_contains(const FList* l, float x) {
+    return float_array_contains(l->data, l->size, x);
+}
+
+/* UTF-8: validation (AVX2 lookup tables, ASCII fast path) and code point decoding */
+static bool utf8_valid_scalar(const unsigned char* s, size_t len) {
+    size_t i = 0;
+    while (i < len) {
+        /* ASCII fast path: 8 bytes per step */
+        if (i + 8 <= len) {
+            uint64_t w;
+            memcpy(&w, s + i, 8);
+            if ((w & 0x8080808080808080ULL) == 0) {
+                i += 8;
+                continue;
+            }
+        }
+        unsigned char c = s[i];
+        if (c < 0x80) {
+            i++;
+            continue;
+        }
+        int need;
+        uint32_t cp;
+        if (c >= 0xC2 && c <= 0xDF) { need = 1; cp = c & 0x1F; }
+        else if (c >= 0xE0 && c <= 0xEF) { need = 2; cp = c & 0x0F; }
+        else if (c >= 0xF0 && c <= 0xF4) { need = 3; cp = c & 0x07; }
+        else return false;
+        if (i + need >= len) return false;
+        for (int k = 1; k <= need; k++) {
+            if ((s[i + k] & 0xC0) != 0x80) return false;
+            cp = (cp << 6) | (s[i + k] & 0x3F);
+        }
+        if ((need == 2 && cp < 0x800) || (need == 3 && (cp < 0x10000 || cp > 0x10FFFF)) ||
+            (cp >= 0xD800 && cp <= 0xDFFF)) {
+            return false;
+        }
+        i += need + 1;
+    }
+    return true;
+}
+
+#if defined(__AVX2__)
+/* Keiser-Lemire: each byte is classified from the high nibble of the previous byte, the low
+   nibble of the previous byte and the high nibble of itself; any error bit surviving the AND
+   of the three lookups (or a missing 3rd/4th continuation) marks the input invalid */
+#define U8_TOO_SHORT  (1 << 0)
+#define U8_TOO_LONG   (1 << 1)
+#define U8_OVERLONG_3 (1 << 2)
+#define U8_TOO_LARGE  (1 << 3)
+#define U8_SURROGATE  (1 << 4)
+#define U8_OVERLONG_2 (1 << 5)
+#define U8_TOO_LARGE_1000 (1 << 6)
+#define U8_OVERLONG_4 (1 << 6)
+#define U8_TWO_CONTS  (1 << 7)
+#define U8_CARRY (U8_TOO_SHORT | U8_TOO_LONG | U8_TWO_CONTS)
+
+static inline __m256i utf8_lookup(__m256i nibbles, const int8_t* table) {
+    __m128i t = _mm_loadu_si128((const __m128i*)table);
+    return _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(t), nibbles);
+}
+
+/* The block shifted right by n bytes, with the tail of 'prev' shifted in */
+#define UTF8_PREV(input, prev, n) \
+    _mm256_alignr_epi8((input), _mm256_permute2x128_si256((prev), (input), 0x21), 16 - (n))
+
+static inline __m256i utf8_block_errors(__m256i input, __m256i prev) {
+    static const int8_t byte1_high[16] = {
+        U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG,
+        U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG,
+        U8_TWO_CONTS, U8_TWO_CONTS, U8_TWO_CONTS, U8_TWO_CONTS,
+        U8_TOO_SHORT | U8_OVERLONG_2,
+        U8_TOO_SHORT,
+        U8_TOO_SHORT | U8_OVERLONG_3 | U8_SURROGATE,
+        U8_TOO_SHORT | U8_TOO_LARGE | U8_TOO_LARGE_1000 | U8_OVERLONG_4
+    };
+    static const int8_t byte1_low[16] = {
+        U8_CARRY | U8_OVERLONG_3 | U8_OVERLONG_2 | U8_OVERLONG_4,
+        U8_CARRY | U8_OVERLONG_2,
+        U8_CARRY,
+        U8_CARRY,
+        U8_CARRY | U8_TOO_LARGE,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000 | U8_SURROGATE,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000
+    };
+    static const int8_t byte2_high[16] = {
+        U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT,
+        U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT,
+        U8_TOO_LONG | U8_OVERLONG_2 | U8_TWO_CONTS | U8_OVERLONG_3 | U8_TOO_LARGE_1000 | U8_OVERLONG_4,
+        U8_TOO_LONG | U8_OVERLONG_2 | U8_TWO_CONTS | U8_OVERLONG_3 | U8_TOO_LARGE,
+        U8_TOO_LONG | U8_OVERLONG_2 | U8_TWO_CONTS | U8_SURROGATE | U8_TOO_LARGE,
+        U8_TOO_LONG | U8_OVERLONG_2 | U8_TWO_CONTS | U8_SURROGATE | U8_TOO_LARGE,
+        U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT
+    };
+    const __m256i low4 = _mm256_set1_epi8(0x0F);
+    __m256i prev1 = UTF8_PREV(input, prev, 1);
+    __m256i sc = _mm256_and_si256(
+        _mm256_and_si256(
+            utf8_lookup(_mm256_and_si256(_mm256_srli_epi16(prev1, 4), low4), byte1_high),
+            utf8_lookup(_mm256_and_si256(prev1, low4), byte1_low)),
+        utf8_lookup(_mm256_and_si256(_mm256_srli_epi16(input, 4), low4), byte2_high));
+    /* Bytes two or three after a 3- or 4-byte lead must be continuations */
+    __m256i third = _mm256_subs_epu8(UTF8_PREV(input, prev, 2), _mm256_set1_epi8((char)(0xE0 - 0x80)));
+    __m256i fourth = _mm256_subs_epu8(UTF8_PREV(input, prev, 3), _mm256_set1_epi8((char)(0xF0 - 0x80)));
+    __m256i must23 = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8((char)0x80));
+    return _mm256_xor_si256(must23, sc);
+}
+
+/* Non-zero where the block ends inside a multi-byte sequence */
+static inline __m256i utf8_block_incomplete(__m256i input) {
+    const __m256i max = _mm256_setr_epi8(
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        (char)(0xF0 - 1), (char)(0xE0 - 1), (char)(0xC0 - 1));
+    return _mm256_subs_epu8(input, max);
+}
+
+static bool utf8_valid_bytes(const unsigned char* s, size_t len) {
+    __m256i error = _mm256_setzero_si256();
+    __m256i prev = _mm256_setzero_si256();
+    __m256i prev_incomplete = _mm256_setzero_si256();
+    size_t i = 0;
+    for (;;) {
+        __m256i input;
+        bool last = i + 32 > len;
+        if (!last) {
+            input = _mm256_loadu_si256((const __m256i*)(s + i));
+        } else {
+            /* Zero padding is ASCII, so a sequence cut off by the end shows up as too short */
+            unsigned char tail[32] = {0};
+            memcpy(tail, s + i, len - i);
+            input = _mm256_loadu_si256((const __m256i*)tail);
+        }
+        if (_mm256_movemask_epi8(input) == 0) {
+            error = _mm256_or_si256(error, prev_incomplete);
+        } else {
+            error = _mm256_or_si256(error, utf8_block_errors(input, prev));
+            prev_incomplete = utf8_block_incomplete(input);
+        }
+        prev = input;
+        if (last) break;
+        i += 32;
+    }
+    return _mm256_testz_si256(error, error);
+}
+#else
+static bool utf8_valid_bytes(const unsigned char* s, size_t len) {
+    return utf8_valid_scalar(s, len);
+}
+#endif
+
+static bool utf8_valid(const char* s) {
+    return utf8_valid_bytes((const unsigned char*)s, strlen(s));
+}
+
+/* Number of code points: every byte that is not a continuation starts one */
+static int utf8_len(const char* s) {
+    const unsigned char* p = (const unsigned char*)s;
+    size_t len = strlen(s);
+    int count = 0;
+    for (size_t i = 0; i < len; i++) count += (p[i] & 0xC0) != 0x80;
+    return count;
+}
+
+/* Decodes the code point at s[*i] and advances *i; returns -1 at the end.
+   Malformed bytes decode to U+FFFD one byte at a time. */
+static inline int utf8_next(const unsigned char* s, int* i, int len) {
+    if (*i >= len) return -1;
+    unsigned char c = s[*i];
+    if (c < 0x80) {
+        (*i)++;
+        return c;
+    }
+    int need;
+    uint32_t cp, min;
+    if (c >= 0xC2 && c <= 0xDF) { need = 1; cp = c & 0x1F; min = 0x80; }
+    else if (c >= 0xE0 && c <= 0xEF) { need = 2; cp = c & 0x0F; min = 0x800; }
+    else if (c >= 0xF0 && c <= 0xF4) { need = 3; cp = c & 0x07; min = 0x10000; }
+    else { (*i)++; return 0xFFFD; }
+    if (*i + need >= len) { (*i)++; return 0xFFFD; }
+    for (int k = 1; k <= need; k++) {
+        unsigned char cc = s[*i + k];
+        if ((cc & 0xC0) != 0x80) { (*i)++; return 0xFFFD; }
+        cp = (cp << 6) | (cc & 0x3F);
+    }
+    if (cp < min || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) { (*i)++; return 0xFFFD; }
+    *i += need + 1;
+    return (int)cp;
+}
+
+/* Regex: the compiler builds the DFA tables for every re"..." literal; nothing is
+   compiled at run time and every scan is a single pass of table lookups */
+typedef struct {
+    const uint32_t* trans;  /* row offsets: next = trans[state + classes[byte]] */
+    uint32_t start;
+    uint32_t accept_from;   /* states at or past this offset accept; 0 is dead */
+} ReTable;
+
+typedef struct {
+    const unsigned char* classes;   /* byte -> column */
+    ReTable fwd;                    /* anchored, forward */
+    ReTable search;                 /* unanchored, forward */
+    ReTable rsearch;                /* unanchored, reversed pattern */
+    ReTable rev;                    /* anchored, reversed pattern */
+    const char* prefix;             /* bytes every match starts with */
+    int prefix_len;
+    bool anchor_start, anchor_end;
+} Regex;
+
+#define RE_STEP(t, r, st, c) ((t)->trans[(st) + (r)->classes[(unsigned char)(c)]])
+
+/* Next position >= i where the literal prefix occurs, or -1 */
+static int regex_skip(const Regex* r, const char* s, int i, int len) {
+    if (r->prefix_len == 0) return i;
+    while (i + r->prefix_len <= len) {
+        const char* hit = (const char*)memchr(s + i, r->prefix[0], len - i - r->prefix_len + 1);
+        if (!hit) return -1;
+        i = (int)(hit - s);
+        if (memcmp(hit + 1, r->prefix + 1, r->prefix_len - 1) == 0) return i;
+        i++;
+    }
+    return -1;
+}
+
+/* End of the longest match starting at 'from', or -1 */
+static int regex_longest(const Regex* r, const char* s, int from, int len) {
+    const ReTable* t = &r->fwd;
+    uint32_t st = t->start;
+    int end = st >= t->accept_from ? from : -1;
+    for (int i = from; i < len; i++) {
+        st = RE_STEP(t, r, st, s[i]);
+        if (st == 0) break;
+        if (st >= t->accept_from) end = i + 1;
+    }
+    return end;
+}
+
+/* Leftmost start of a match ending exactly at 'len', or -1 */
+static int regex_start_at_end(const Regex* r, const char* s, int len) {
+    const ReTable* t = &r->rev;
+    uint32_t st = t->start;
+    int start = st >= t->accept_from ? len : -1;
+    for (int i = len - 1; i >= 0; i--) {
+        st = RE_STEP(t, r, st, s[i]);
+        if (st == 0) break;
+        if (st >= t->accept_from) start = i;
+    }
+    return start;
+}
+
+/* Whole string matches the pattern */
+static bool regex_match(const Regex* r, const char* s) {
+    const ReTable* t = &r->fwd;
+    uint32_t st = t->start;
+    for (const unsigned char* p = (const unsigned char*)s; *p && st; p++) {
+        st = RE_STEP(t, r, st, *p);
+    }
+    return st >= t->accept_from;
+}
+
+/* Some substring matches: stops at the first accepting state */
+static bool regex_search(const Regex* r, const char* s) {
+    int len = (int)strlen(s);
+    if (r->anchor_start && r->anchor_end) return regex_match(r, s);
+    if (r->anchor_end) return regex_start_at_end(r, s, len) >= 0;
+    if (r->anchor_start) return regex_longest(r, s, 0, len) >= 0;
+    const ReTable* t = &r->search;
+    uint32_t st = t->start;
+    if (st >= t->accept_from) return true;
+    for (int i = 0; i < len; i++) {
+        if (st == t->start) {
+            // Nothing in flight: the next match can only start at the literal prefix
+            i = regex_skip(r, s, i, len);
+            if (i < 0) return false;
+        }
+        st = RE_STEP(t, r, st, s[i]);
+        if (st >= t->accept_from) return true;
+    }
+    return false;
+}
+
+/* Start of the leftmost match, or -1 */
+static int regex_find(const Regex* r, const char* s) {
+    int len = (int)strlen(s);
+    if (r->anchor_end) {
+        int start = regex_start_at_end(r, s, len);
+        if (r->anchor_start) return start == 0 ? 0 : -1;
+        return start;
+    }
+    if (r->anchor_start) return regex_longest(r, s, 0, len) >= 0 ? 0 : -1;
+    if (!regex_search(r, s)) return -1;
+    // Reverse scan: every accepting position starts some match, the last one seen is leftmost
+    const ReTable* t = &r->rsearch;
+    uint32_t st = t->start;
+    int start = st >= t->accept_from ? len : -1;
+    for (int i = len - 1; i >= 0; i--) {
+        st = RE_STEP(t, r, st, s[i]);
+        if (st >= t->accept_from) start = i;
+    }
+    return start;
+}
+
+/* End of the longest match starting at 'start', or -1 */
+static int regex_match_end(const Regex* r, const char* s, int start) {
+    int len = (int)strlen(s);
+    if (start < 0 || start > len) return -1;
+    if (r->anchor_start && start != 0) return -1;
+    if (r->anchor_end) {
+        const ReTable* t = &r->fwd;
+        uint32_t st = t->start;
+        for (int i = start; i < len && st; i++) st = RE_STEP(t, r, st, s[i]);
+        return st >= t->accept_from ? len : -1;
+    }
+    return regex_longest(r, s, start, len);
+}
+
+/* Starts of all non-overlapping leftmost-longest matches */
+static List regex_findall(const Regex* r, const char* s) {
+    List out = new_list();
+    int len = (int)strlen(s);
+    if (r->anchor_start || r->anchor_end) {
+        int start = regex_find(r, s);
+        if (start >= 0) list_append(&out, start);
+        return out;
+    }
+    if (!regex_search(r, s)) return out;
+    
+    // One reverse pass marks every position where some match starts
+    unsigned char* starts = (unsigned char*)malloc(len + 1);
+    const ReTable* t = &r->rsearch;
+    uint32_t st = t->start;
+    starts[len] = st >= t->accept_from;
+    for (int i = len - 1; i >= 0; i--) {
+        st = RE_STEP(t, r, st, s[i]);
+        starts[i] = st >= t->accept_from;
+    }
+    int p = 0;
+    while (p <= len) {
+        const unsigned char* hit = (const unsigned char*)memchr(starts + p, 1, len + 1 - p);
+        if (!hit) break;
+        int i = (int)(hit - starts);
+        int end = regex_longest(r, s, i, len);
+        list_append(&out, i);
+        p = end > i ? end : i + 1;
+    }
+    free(starts);
+    return out;
+}
+
+static void print_regex(const Regex* r) {
+    printf("<regex prefix \"%.*s\">\n", r->prefix_len, r->prefix);
+}
+
+/* Worker threads: A_THREADS if set, else one per online CPU (at most 256) */
+static int a_thread_count(void) {
+    static int count = 0;
+    if (count == 0) {
+        const char* env = getenv("A_THREADS");
+        long n = env ? strtol(env, NULL, 10) : 0;
+        if (n <= 0) n = sysconf(_SC_NPROCESSORS_ONLN);
+        count = n > 256 ? 256 : n > 0 ? (int)n : 1;
+    }
+    return count;
+}
+
+typedef struct {
+    void (*fn)(void* ctx, int part, int parts);
+    void* ctx;
+    int part;
+    int parts;
+} ThreadPart;
+
+static void* a_thread_part_main(void* arg) {
+    ThreadPart* tp = (ThreadPart*)arg;
+    tp->fn(tp->ctx, tp->part, tp->parts);
+    return NULL;
+}
+
+/* The caller runs part 0, parts 1..n-1 get their own thread. A part whose
+   thread cannot be created runs on the caller instead. */
+static void a_run_parts(int parts, void (*fn)(void* ctx, int part, int parts), void* ctx) {
+    pthread_t threads[256];
+    ThreadPart args[256];
+    bool started[256];
+    if (parts > 256) parts = 256;
+    for (int i = 1; i < parts; i++) {
+        args[i].fn = fn;
+        args[i].ctx = ctx;
+        args[i].part = i;
+        args[i].parts = parts;
+        started[i] = pthread_create(&threads[i], NULL, a_thread_part_main, &args[i]) == 0;
+    }
+    fn(ctx, 0, parts);
+    for (int i = 1; i < parts; i++) {
+        if (started[i]) pthread_join(threads[i], NULL);
+        else fn(ctx, i, parts);
+    }
+}
+
+/* parallel for: a persistent pool of worker threads. Each thread owns a slice
+   of the range and runs chunks from its front, a quarter of what is left each
+   time, so chunks shrink as the slice runs down; a thread whose slice is empty
+   steals the back half of another's. */
+typedef void (*ParBody)(void* ctx, long lo, long hi);
+
+typedef struct {
+    pthread_mutex_t lock;
+    long next;
+    long end;
+    char pad[64];
+} ParSlice;
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t idle;
+    pthread_t threads[256];
+    ParSlice slices[256];
+    bool ready;
+    int started;
+    int parts;
+    int busy;
+    unsigned long round;
+    ParBody body;
+    void* ctx;
+    long grain;
+} a_pool = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER };
+
+/* Set on pool threads: a parallel for inside a parallel body runs serially */
+static __thread bool a_in_parallel = false;
+
+/* Which pool thread this is (0 for the caller), for per-thread reduce partials */
+static __thread int a_thread_index = 0;
+
+/* reduce(sum, pairwise): elements per partial, fixed so results do not depend on the thread count */
+#define A_REDUCE_BLOCK 4096
+
+static bool par_take(ParSlice* s, long grain, long* lo, long* hi) {
+    pthread_mutex_lock(&s->lock);
+    long left = s->end - s->next;
+    if (left <= 0) {
+        pthread_mutex_unlock(&s->lock);
+        return false;
+    }
+    long n = left / 4 > grain ? left / 4 : grain;
+    if (n > left) n = left;
+    *lo = s->next;
+    s->next += n;
+    *hi = s->next;
+    pthread_mutex_unlock(&s->lock);
+    return true;
+}
+
+static bool par_steal(int self) {
+    for (int k = 1; k < a_pool.parts; k++) {
+        ParSlice* v = &a_pool.slices[(self + k) % a_pool.parts];
+        pthread_mutex_lock(&v->lock);
+        long left = v->end - v->next;
+        if (left > a_pool.grain) {
+            long end = v->end;
+            v->end -= left / 2;
+            pthread_mutex_unlock(&v->lock);
+            ParSlice* s = &a_pool.slices[self];
+            pthread_mutex_lock(&s->lock);
+            s->next = end - left / 2;
+            s->end = end;
+            pthread_mutex_unlock(&s->lock);
+            return true;
+        }
+        pthread_mutex_unlock(&v->lock);
+    }
+    return false;
+}
+
+static void par_run(int self) {
+    long lo, hi;
+    do {
+        while (par_take(&a_pool.slices[self], a_pool.grain, &lo, &hi)) a_pool.body(a_pool.ctx, lo, hi);
+    } while (par_steal(self));
+}
+
+static void* par_worker(void* arg) {
+    int self = (int)(intptr_t)arg;
+    unsigned long seen = 0;
+    a_in_parallel = true;
+    a_thread_index = self;
+    for (;;) {
+        pthread_mutex_lock(&a_pool.lock);
+        while (a_pool.round == seen) pthread_cond_wait(&a_pool.wake, &a_pool.lock);
+        seen = a_pool.round;
+        pthread_mutex_unlock(&a_pool.lock);
+        if (self < a_pool.parts) par_run(self);
+        pthread_mutex_lock(&a_pool.lock);
+        if (--a_pool.busy == 0) pthread_cond_signal(&a_pool.idle);
+        pthread_mutex_unlock(&a_pool.lock);
+    }
+    return NULL;
+}
+
+/* Runs body over [lo, hi) on the pool; the calling thread works on slice 0 */
+static void a_parallel_for(long lo, long hi, ParBody body, void* ctx) {
+    long n = hi - lo;
+    if (n <= 0) return;
+    int parts = a_thread_count();
+    if (parts > n) parts = (int)n;
+    if (parts <= 1 || a_in_parallel) {
+        body(ctx, lo, hi);
+        return;
+    }
+    pthread_mutex_lock(&a_pool.lock);
+    if (!a_pool.ready) {
+        int count = a_thread_count();
+        for (int i = 0; i < count; i++) pthread_mutex_init(&a_pool.slices[i].lock, NULL);
+        /* Workers are numbered without gaps, so stop at the first that cannot start */
+        for (int i = 1; i < count; i++) {
+            if (pthread_create(&a_pool.threads[i], NULL, par_worker, (void*)(intptr_t)i) != 0) break;
+            a_pool.started = i;
+        }
+        a_pool.ready = true;
+    }
+    if (parts > a_pool.started + 1) parts = a_pool.started + 1;
+    if (parts <= 1) {
+        pthread_mutex_unlock(&a_pool.lock);
+        body(ctx, lo, hi);
+        return;
+    }
+    a_pool.body = body;
+    a_pool.ctx = ctx;
+    a_pool.parts = parts;
+    a_pool.grain = n / ((long)parts * 64) > 1 ? n / ((long)parts * 64) : 1;
+    for (int i = 0; i < parts; i++) {
+        a_pool.slices[i].next = lo + n * i / parts;
+        a_pool.slices[i].end = lo + n * (i + 1) / parts;
+    }
+    a_pool.busy = a_pool.started;
+    a_pool.round++;
+    pthread_cond_broadcast(&a_pool.wake);
+    pthread_mutex_unlock(&a_pool.lock);
+    a_in_parallel = true;
+    par_run(0);
+    a_in_parallel = false;
+    pthread_mutex_lock(&a_pool.lock);
+    while (a_pool.busy > 0) pthread_cond_wait(&a_pool.idle, &a_pool.lock);
+    pthread_mutex_unlock(&a_pool.lock);
+}
+
+/* Sorting: LSD radix on order-preserving 32-bit keys, parallel for large inputs */
+#define SORT_SMALL 48
+#define SORT_PARALLEL_MIN (1 << 21)
+
+/* Keys alias int and float list storage in place */
+typedef uint32_t __attribute__((may_alias)) sort_u32;
+
+/* Map an int or float bit pattern to an unsigned key with the same ordering */
+static inline uint32_t sort_key_int(uint32_t bits, int desc) {
+    uint32_t k = bits ^ 0x80000000u;
+    return desc ? ~k : k;
+}
+
+static inline uint32_t sort_key_float(uint32_t bits, int desc) {
+    uint32_t k = bits ^ ((uint32_t)((int32_t)bits >> 31) | 0x80000000u);
+    return desc ? ~k : k;
+}
+
+static inline uint32_t sort_unkey_float(uint32_t k) {
+    return k ^ (((k >> 31) - 1) | 0x80000000u);
+}
+
+/* Sorts keys (and optional payload) by 8-bit digits; result ends in keys/vals */
+static void radix_sort_u32(sort_u32* keys, int* vals, int n) {
+    sort_u32* ktmp = (sort_u32*)malloc(sizeof(uint32_t) * (size_t)n);
+    int* vtmp = vals ? (int*)malloc(sizeof(int) * (size_t)n) : NULL;
+    size_t counts[4][256];
+    memset(counts, 0, sizeof(counts));
+    for (int i = 0; i < n; i++) {
+        uint32_t k = keys[i];
+        counts[0][k & 0xFF]++;
+        counts[1][(k >> 8) & 0xFF]++;
+        counts[2][(k >> 16) & 0xFF]++;
+        counts[3][k >> 24]++;
+    }
+    sort_u32* src = keys;
+    sort_u32* dst = ktmp;
+    int* vsrc = vals;
+    int* vdst = vtmp;
+    for (int pass = 0; pass < 4; pass++) {
+        int shift = pass * 8;
+        size_t* c = counts[pass];
+        if (c[(src[0] >> shift) & 0xFF] == (size_t)n) continue;  /* every key shares this digit */
+        size_t sum = 0;
+        for (int d = 0; d < 256; d++) {
+            size_t t = c[d];
+            c[d] = sum;
+            sum += t;
+        }
+        for (int i = 0; i < n; i++) {
+            size_t pos = c[(src[i] >> shift) & 0xFF]++;
+            dst[pos] = src[i];
+            if (vals) vdst[pos] = vsrc[i];
+        }
+        sort_u32* t = src; src = dst; dst = t;
+        int* vt = vsrc; vsrc = vdst; vdst = vt;
+    }
+    if (src != keys) {
+        memcpy(keys, src, sizeof(uint32_t) * (size_t)n);
+        if (vals) memcpy(vals, vsrc, sizeof(int) * (size_t)n);
+    }
+    free(ktmp);
+    free(vtmp);
+}
+
+typedef struct {
+    sort_u32* src;
+    sort_u32* dst;
+    int n;
+    int shift;
+    size_t (*counts)[256];
+} RadixPass;
+
+static void radix_pass_count(void* ctx, int part, int parts) {
+    RadixPass* rp = (RadixPass*)ctx;
+    int lo = (int)((long long)rp->n * part / parts);
+    int hi = (int)((long long)rp->n * (part + 1) / parts);
+    size_t* c = rp->counts[part];
+    memset(c, 0, sizeof(size_t) * 256);
+    for (int i = lo; i < hi; i++) c[(rp->src[i] >> rp->shift) & 0xFF]++;
+}
+
+static void radix_pass_scatter(void* ctx, int part, int parts) {
+    RadixPass* rp = (RadixPass*)ctx;
+    int lo = (int)((long long)rp->n * part / parts);
+    int hi = (int)((long long)rp->n * (part + 1) / parts);
+    size_t* c = rp->counts[part];
+    for (int i = lo; i < hi; i++) {
+        uint32_t k = rp->src[i];
+        rp->dst[c[(k >> rp->shift) & 0xFF]++] = k;
+    }
+}
+
+/* Multithreaded LSD radix: per-thread digit histograms, then a parallel stable scatter */
+static void radix_sort_u32_parallel(sort_u32* keys, int n) {
+    int parts = a_thread_count();
+    if (parts > 64) parts = 64;
+    sort_u32* tmp = (sort_u32*)malloc(sizeof(uint32_t) * (size_t)n);
+    size_t (*counts)[256] = malloc(sizeof(size_t) * 256 * (size_t)parts);
+    RadixPass rp = { keys, tmp, n, 0, counts };
+    for (int pass = 0; pass < 4; pass++) {
+        rp.shift = pass * 8;
+        a_run_parts(parts, radix_pass_count, &rp);
+        size_t sum = 0;
+        for (int d = 0; d < 256; d++) {
+            for (int p = 0; p < parts; p++) {
+                size_t t = counts[p][d];
+                counts[p][d] = sum;
+                sum += t;
+            }
+        }
+        a_run_parts(parts, radix_pass_scatter, &rp);
+        sort_u32* t = rp.src; rp.src = rp.dst; rp.dst = t;
+    }
+    /* Four passes leave the result back in 'keys' */
+    free(tmp);
+    free(counts);
+}
+
+static void insertion_sort_int(int* a, int n, int desc) {
+    for (int i = 1; i < n; i++) {
+        int x = a[i];
+        int* p = a + i;
+        while (p > a && (desc ? p[-1] < x : p[-1] > x)) {
+            *p = p[-1];
+            p--;
+        }
+        *p = x;
+    }
+}
+
+static void list_sort(List* l, int desc) {
+    int n = l->size;
+    if (n <= SORT_SMALL) {
+        insertion_sort_int(l->data, n, desc);
+        return;
+    }
+    sort_u32* keys = (sort_u32*)l->data;
+    for (int i = 0; i < n; i++) keys[i] = sort_key_int(keys[i], desc);
+    if (n >= SORT_PARALLEL_MIN && a_thread_count() > 1) {
+        radix_sort_u32_parallel(keys, n);
+    } else {
+        radix_sort_u32(keys, NULL, n);
+    }
+    for (int i = 0; i < n; i++) keys[i] = sort_key_int(desc ? ~keys[i] : keys[i], 0);
+}
+
+/* Branchless compare-exchange; gcc lowers these networks to minss/maxss */
+#define SORT_CSWAP(a, i, j) do { \
+    float lo_ = (a)[i] < (a)[j] ? (a)[i] : (a)[j]; \
+    float hi_ = (a)[i] < (a)[j] ? (a)[j] : (a)[i]; \
+    (a)[i] = lo_; (a)[j] = hi_; \
+} while (0)
+
+static void sort_network8_float(float* a) {
+    SORT_CSWAP(a, 0, 2); SORT_CSWAP(a, 1, 3); SORT_CSWAP(a, 4, 6); SORT_CSWAP(a, 5, 7);
+    SORT_CSWAP(a, 0, 4); SORT_CSWAP(a, 1, 5); SORT_CSWAP(a, 2, 6); SORT_CSWAP(a, 3, 7);
+    SORT_CSWAP(a, 0, 1); SORT_CSWAP(a, 2, 3); SORT_CSWAP(a, 4, 5); SORT_CSWAP(a, 6, 7);
+    SORT_CSWAP(a, 2, 4); SORT_CSWAP(a, 3, 5);
+    SORT_CSWAP(a, 1, 4); SORT_CSWAP(a, 3, 6);
+    SORT_CSWAP(a, 1, 2); SORT_CSWAP(a, 3, 4); SORT_CSWAP(a, 5, 6);
+}
+
+static void insertion_sort_float(float* a, int n) {
+    for (int i = 1; i < n; i++) {
+        float x = a[i];
+        float* p = a + i;
+        while (p > a && p[-1] > x) {
+            *p = p[-1];
+            p--;
+        }
+        *p = x;
+    }
+}
+
+static void heap_sift_float(float* a, int n, int i) {
+    for (;;) {
+        int c = 2 * i + 1;
+        if (c >= n) return;
+        if (c + 1 < n && a[c + 1] > a[c]) c++;
+        if (a[i] >= a[c]) return;
+        float t = a[i]; a[i] = a[c]; a[c] = t;
+        i = c;
+    }
+}
+
+static void heapsort_float(float* a, int n) {
+    for (int i = n / 2 - 1; i >= 0; i--) heap_sift_float(a, n, i);
+    for (int i = n - 1; i > 0; i--) {
+        float t = a[0]; a[0] = a[i]; a[i] = t;
+        heap_sift_float(a, i, 0);
+    }
+}
+
+/* Introsort: quicksort on a median-of-3 (ninther when large), heapsort after too many bad splits */
+static void introsort_float(float* a, int n, int bad_allowed) {
+    while (n > 24) {
+        int mid = n / 2;
+        if (n > 128) {
+            SORT_CSWAP(a, 0, mid); SORT_CSWAP(a, mid, n - 1); SORT_CSWAP(a, 0, mid);
+            SORT_CSWAP(a, 1, mid - 1); SORT_CSWAP(a, mid - 1, n - 2); SORT_CSWAP(a, 1, mid - 1);
+            SORT_CSWAP(a, 2, mid + 1); SORT_CSWAP(a, mid + 1, n - 3); SORT_CSWAP(a, 2, mid + 1);
+            SORT_CSWAP(a, mid - 1, mid); SORT_CSWAP(a, mid, mid + 1); SORT_CSWAP(a, mid - 1, mid);
+        } else {
+            SORT_CSWAP(a, 0, mid); SORT_CSWAP(a, mid, n - 1); SORT_CSWAP(a, 0, mid);
+        }
+        float pivot = a[mid];
+        int i = 0, j = n - 1;
+        for (;;) {
+            while (a[i] < pivot) i++;
+            while (a[j] > pivot) j--;
+            if (i >= j) break;
+            float t = a[i]; a[i] = a[j]; a[j] = t;
+            i++;
+            j--;
+        }
+        int left = j + 1;
+        int right = n - left;
+        if (left < n / 8 || right < n / 8) {
+            if (--bad_allowed <= 0) {
+                heapsort_float(a, n);
+                return;
+            }
+        }
+        /* Recurse into the smaller side, loop on the larger */
+        if (left < right) {
+            introsort_float(a, left, bad_allowed);
+            a += left;
+            n = right;
+        } else {
+            introsort_float(a + left, right, bad_allowed);
+            n = left;
+        }
+    }
+    /* Presort 8-element blocks with the network so insertion sort only merges them */
+    for (int b = 0; b + 8 <= n; b += 8) sort_network8_float(a + b);
+    insertion_sort_float(a, n);
+}
+
+static void flist_sort(FList* l, int desc) {
+    int n = l->size;
+    if (n >= SORT_PARALLEL_MIN && a_thread_count() > 1) {
+        sort_u32* keys = (sort_u32*)l->data;
+        for (int i = 0; i < n; i++) keys[i] = sort_key_float(keys[i], desc);
+        radix_sort_u32_parallel(keys, n);
+        for (int i = 0; i < n; i++) keys[i] = sort_unkey_float(desc ? ~keys[i] : keys[i]);
+        return;
+    }
+    int bad_allowed = 1;
+    for (int m = n; m > 1; m >>= 1) bad_allowed++;
+    introsort_float(l->data, n, bad_allowed);
+    if (desc) {
+        for (int i = 0, j = n - 1; i < j; i++, j--) {
+            float t = l->data[i]; l->data[i] = l->data[j]; l->data[j] = t;
+        }
+    }
+}
+
+/* Stable: equal elements keep their original relative order */
+static List list_argsort(const List* l) {
+    int n = l->size;
+    List idx = new_list();
+    free(idx.data);
+    idx.data = (int*)list_alloc_aligned(sizeof(int) * (size_t)(n > 0 ? n : 1));
+    idx.size = n;
+    idx.cap = n > 0 ? n : 1;
+    sort_u32* keys = (sort_u32*)malloc(sizeof(uint32_t) * (size_t)(n > 0 ? n : 1));
+    for (int i = 0; i < n; i++) {
+        keys[i] = sort_key_int((uint32_t)l->data[i], 0);
+        idx.data[i] = i;
+    }
+    if (n > 1) radix_sort_u32(keys, idx.data, n);
+    free(keys);
+    return idx;
+}
+
+static List flist_argsort(const FList* l) {
+    int n = l->size;
+    List idx = new_list();
+    free(idx.data);
+    idx.data = (int*)list_alloc_aligned(sizeof(int) * (size_t)(n > 0 ? n : 1));
+    idx.size = n;
+    idx.cap = n > 0 ? n : 1;
+    sort_u32* keys = (sort_u32*)malloc(sizeof(uint32_t) * (size_t)(n > 0 ? n : 1));
+    for (int i = 0; i < n; i++) {
+        uint32_t bits;
+        memcpy(&bits, &l->data[i], sizeof(bits));
+        keys[i] = sort_key_float(bits, 0);
+        idx.data[i] = i;
+    }
+    if (n > 1) radix_sort_u32(keys, idx.data, n);
+    free(keys);
+    return idx;
+}
+
+/* Drops repeated neighbours, so a sorted list becomes its distinct values */
+static List list_unique(const List* l) {
+    List u = new_list();
+    for (int i = 0; i < l->size; i++) {
+        if (i == 0 || l->data[i] != l->data[i - 1]) list_append(&u, l->data[i]);
+    }
+    return u;
+}
+
+static FList flist_unique(const FList* l) {
+    FList u = new_flist();
+    for (int i = 0; i < l->size; i++) {
+        if (i == 0 || l->data[i] != l->data[i - 1]) flist_append(&u, l->data[i]);
+    }
+    return u;
+}
+
+/* Index of x in an ascending list, or -1 */
+static int list_binary_search(const List* l, int x) {
+    int i = int_array_lower_bound(l->data, l->size, x);
+    return (i < l->size && l->data[i] == x) ? i : -1;
+}
+
+static int flist_binary_search(const FList* l, float x) {
+    int lo = 0, hi = l->size;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (l->data[mid] < x) lo = mid + 1;
+        else hi = mid;
+    }
+    return (lo < l->size && l->data[lo] == x) ? lo : -1;
+}
+
+/* Statistics: blocked Welford mean/variance, selection-based quantiles, histograms */
+#define STATS_BLOCK 1024
+
+/* Widens one block of an int or float array into 'out' */
+static inline void stats_load(const void* data, bool is_float, int start, int len, double* out) {
+    if (is_float) {
+        const float* p = (const float*)data + start;
+        for (int i = 0; i < len; i++) out[i] = p[i];
+    } else {
+        const int* p = (const int*)data + start;
+        for (int i = 0; i < len; i++) out[i] = p[i];
+    }
+}
+
+/* Mean and population variance in one pass over memory: each cache-resident block
+   gets an exact two-pass mean/M2 (vectorisable), blocks are combined with Chan's update */
+static void stats_moments(const void* data, bool is_float, int n, double* mean_out, double* var_out) {
+    double block[STATS_BLOCK];
+    double mean = 0.0, m2 = 0.0;
+    long long count = 0;
+    for (int start = 0; start < n; start += STATS_BLOCK) {
+        int len = n - start < STATS_BLOCK ? n - start : STATS_BLOCK;
+        stats_load(data, is_float, start, len, block);
+        double sum = 0.0;
+        for (int i = 0; i < len; i++) sum += block[i];
+        double bmean = sum / len, bm2 = 0.0;
+        for (int i = 0; i < len; i++) bm2 += (block[i] - bmean) * (block[i] - bmean);
+        double delta = bmean - mean;
+        long long total = count + len;
+        mean += delta * len / total;
+        m2 += bm2 + delta * delta * (double)count * len / total;
+        count = total;
+    }
+    *mean_out = mean;
+    *var_out = count > 0 ? m2 / count : 0.0;
+}
+
+static double list_mean(const List* l) { double m, v; stats_moments(l->data, false, l->size, &m, &v); return m; }
+static double list_var(const List* l) { double m, v; stats_moments(l->data, false, l->size, &m, &v); return v; }
+static double list_stddev(const List* l) { return sqrt(list_var(l)); }
+static double flist_mean(const FList* l) { double m, v; stats_moments(l->data, true, l->size, &m, &v); return m; }
+static double flist_var(const FList* l) { double m, v; stats_moments(l->data, true, l->size, &m, &v); return v; }
+static double flist_stddev(const FList* l) { return sqrt(flist_var(l)); }
+
+static int stats_cmp(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+/* Introselect: places the k-th smallest at a[k] with everything after it >= a[k].
+   Quickselect on median-of-3 pivots; a range that stops shrinking gets sorted instead. */
+static void stats_select(double* a, int n, int k) {
+    int lo = 0, hi = n - 1, budget = 2 * (32 - __builtin_clz((unsigned)n | 1));
+    while (hi - lo > 16) {
+        if (budget-- == 0) {
+            qsort(a + lo, hi - lo + 1, sizeof(double), stats_cmp);
+            return;
+        }
+        int mid = lo + (hi - lo) / 2;
+        if (a[mid] < a[lo]) { double t = a[mid]; a[mid] = a[lo]; a[lo] = t; }
+        if (a[hi] < a[lo]) { double t = a[hi]; a[hi] = a[lo]; a[lo] = t; }
+        if (a[hi] < a[mid]) { double t = a[hi]; a[hi] = a[mid]; a[mid] = t; }
+        double pivot = a[mid];
+        int i = lo, j = hi;
+        while (i <= j) {
+            while (a[i] < pivot) i++;
+            while (pivot < a[j]) j--;
+            if (i <= j) {
+                double t = a[i]; a[i] = a[j]; a[j] = t;
+                i++;
+                j--;
+            }
+        }
+        if (k <= j) hi = j;
+        else if (k >= i) lo = i;
+        else return;
+    }
+    for (int i = lo + 1; i <= hi; i++) {
+        double x = a[i];
+        int j = i - 1;
+        while (j >= lo && a[j] > x) { a[j + 1] = a[j]; j--; }
+        a[j + 1] = x;
+    }
+}
+
+/* p-quantile (0 <= p <= 1), interpolating between the closest ranks; works on a copy */
+static double stats_quantile(const void* data, bool is_float, int n, double p) {
+    if (n == 0) return 0.0;
+    if (p < 0.0) p = 0.0;
+    if (p > 1.0) p = 1.0;
+    double* a = (double*)malloc(sizeof(double) * n);
+    for (int start = 0; start < n; start += STATS_BLOCK) {
+        stats_load(data, is_float, start, n - start < STATS_BLOCK ? n - start : STATS_BLOCK, a + start);
+    }
+    double pos = p * (n - 1);
+    int k = (int)pos;
+    stats_select(a, n, k);
+    double q = a[k];
+    if (k + 1 < n && pos > k) {
+        /* Everything right of k is >= a[k]; the next rank is their minimum */
+        double next = a[k + 1];
+        for (int i = k + 2; i < n; i++) next = a[i] < next ? a[i] : next;
+        q += (pos - k) * (next - q);
+    }
+    free(a);
+    return q;
+}
+
+static double list_quantile(const List* l, double p) { return stats_quantile(l->data, false, l->size, p); }
+static double flist_quantile(const FList* l, double p) { return stats_quantile(l->data, true, l->size, p); }
+
+/* Counts over 'bins' equal-width buckets spanning [min, max] */
+static List stats_histogram(const void* data, bool is_float, int n, int bins) {
+    List out = new_list();
+    if (bins < 1) bins = 1;
+    for (int b = 0; b < bins; b++) list_append(&out, 0);
+    if (n == 0) return out;
+    double block[STATS_BLOCK];
+    double lo = is_float ? ((const float*)data)[0] : ((const int*)data)[0], hi = lo;
+    for (int start = 0; start < n; start += STATS_BLOCK) {
+        int len = n - start < STATS_BLOCK ? n - start : STATS_BLOCK;
+        stats_load(data, is_float, start, len, block);
+        for (int i = 0; i < len; i++) {
+            lo = block[i] < lo ? block[i] : lo;
+            hi = block[i] > hi ? block[i] : hi;
+        }
+    }
+    double scale = hi > lo ? bins / (hi - lo) : 0.0;
+    /* Bucket indices are computed a block at a time (vectorisable), then counted into
+       four sub-histograms so runs of one bucket do not serialise on a single counter */
+    int* counts = (int*)calloc((size_t)bins * 4, sizeof(int));
+    int idx[STATS_BLOCK];
+    for (int start = 0; start < n; start += STATS_BLOCK) {
+        int len = n - start < STATS_BLOCK ? n - start : STATS_BLOCK;
+        stats_load(data, is_float, start, len, block);
+        for (int i = 0; i < len; i++) {
+            int b = (int)((block[i] - lo) * scale);
+            idx[i] = b < bins - 1 ? b : bins - 1;
+        }
+        for (int i = 0; i < len; i++) counts[(i & 3) * bins + idx[i]]++;
+    }
+    for (int b = 0; b < bins; b++) {
+        out.data[b] = counts[b] + counts[bins + b] + counts[2 * bins + b] + counts[3 * bins + b];
+    }
+    free(counts);
+    return out;
+}
+
+static List list_histogram(const List* l, int bins) { return stats_histogram(l->data, false, l->size, bins); }
+static List flist_histogram(const FList* l, int bins) { return stats_histogram(l->data, true, l->size, bins); }
+
+/* t-digest: streaming quantile sketch of weighted centroids, densest at the tails.
+   Incoming values are buffered as floats, radix sorted, and merged into the centroids in batches. */
+#define TDIGEST_COMPRESSION 200.0
+#define TDIGEST_BUFFER 2048
+#define TDIGEST_MAX_CENTROIDS ((int)TDIGEST_COMPRESSION + 16)
+
+typedef struct {
+    double mean;
+    double weight;
+} TDCentroid;
+
+typedef struct {
+    TDCentroid* c;      /* sorted by mean */
+    int n;
+    float* buf;         /* unmerged values */
+    int nbuf;
+    TDCentroid* tmp;    /* merge space */
+    double total;       /* weight held by the centroids */
+    double min, max;
+    double run_mean, run_m2;    /* Welford over every value added */
+} TDigest;
+
+static TDigest new_tdigest(void) {
+    TDigest t;
+    t.c = (TDCentroid*)malloc(sizeof(TDCentroid) * TDIGEST_MAX_CENTROIDS);
+    t.buf = (float*)malloc(sizeof(float) * TDIGEST_BUFFER);
+    t.tmp = (TDCentroid*)malloc(sizeof(TDCentroid) * (2 * TDIGEST_MAX_CENTROIDS + TDIGEST_BUFFER));
+    t.n = t.nbuf = 0;
+    t.total = 0.0;
+    t.min = t.max = 0.0;
+    t.run_mean = t.run_m2 = 0.0;
+    return t;
+}
+
+/* Scale function k1: the centroid size limit shrinks towards q = 0 and q = 1 */
+static inline double td_k(double q) {
+    q = q < 0.0 ? 0.0 : (q > 1.0 ? 1.0 : q);
+    return TDIGEST_COMPRESSION / (2.0 * M_PI) * asin(2.0 * q - 1.0);
+}
+
+static inline double td_q(double k) {
+    return (sin(k * 2.0 * M_PI / TDIGEST_COMPRESSION) + 1.0) / 2.0;
+}
+
+/* Greedily merges the m sorted entries of tmp into the centroid array */
+static void td_compress(TDigest* t, int m, double total) {
+    int out = 0;
+    double so_far = 0.0;
+    double limit = total * td_q(td_k(0.0) + 1.0);
+    TDCentroid cur = t->tmp[0];
+    for (int i = 1; i < m; i++) {
+        TDCentroid next = t->tmp[i];
+        if (so_far + cur.weight + next.weight <= limit || out == TDIGEST_MAX_CENTROIDS - 1) {
+            cur.weight += next.weight;
+            cur.mean += (next.mean - cur.mean) * next.weight / cur.weight;
+        } else {
+            so_far += cur.weight;
+            t->c[out++] = cur;
+            limit = total * td_q(td_k(so_far / total) + 1.0);
+            cur = next;
+        }
+    }
+    t->c[out++] = cur;
+    t->n = out;
+    t->total = total;
+}
+
+static void tdigest_flush(TDigest* t) {
+    if (t->nbuf == 0) return;
+    sort_u32* keys = (sort_u32*)t->buf;
+    for (int i = 0; i < t->nbuf; i++) keys[i] = sort_key_float(keys[i], 0);
+    radix_sort_u32(keys, NULL, t->nbuf);
+    for (int i = 0; i < t->nbuf; i++) keys[i] = sort_unkey_float(keys[i]);
+    int m = 0, i = 0, j = 0;
+    while (i < t->nbuf || j < t->n) {
+        if (j == t->n || (i < t->nbuf && t->buf[i] < t->c[j].mean)) {
+            t->tmp[m].mean = t->buf[i++];
+            t->tmp[m].weight = 1.0;
+        } else {
+            t->tmp[m] = t->c[j++];
+        }
+        m++;
+    }
+    td_compress(t, m, t->total + t->nbuf);
+    t->nbuf = 0;
+}
+
+static void tdigest_add(TDigest* t, double x) {
+    double count = t->total + t->nbuf + 1;
+    if (count == 1) t->min = t->max = x;
+    t->min = x < t->min ? x : t->min;
+    t->max = x > t->max ? x : t->max;
+    double delta = x - t->run_mean;
+    t->run_mean += delta / count;
+    t->run_m2 += delta * (x - t->run_mean);
+    if (t->nbuf == TDIGEST_BUFFER) tdigest_flush(t);
+    t->buf[t->nbuf++] = (float)x;
+}
+
+static double tdigest_quantile(TDigest* t, double p) {
+    tdigest_flush(t);
+    if (t->n == 0) return 0.0;
+    if (p <= 0.0) return t->min;
+    if (p >= 1.0) return t->max;
+    double target = p * t->total;
+    TDCentroid* c = t->c;
+    if (target < c[0].weight / 2.0) {
+        return t->min + (c[0].mean - t->min) * target / (c[0].weight / 2.0);
+    }
+    double at = c[0].weight / 2.0;   /* cumulative weight at the centre of centroid i */
+    for (int i = 0; i + 1 < t->n; i++) {
+        double gap = (c[i].weight + c[i + 1].weight) / 2.0;
+        if (target < at + gap) {
+            return c[i].mean + (c[i + 1].mean - c[i].mean) * (target - at) / gap;
+        }
+        at += gap;
+    }
+    double last = c[t->n - 1].weight / 2.0;
+    return c[t->n - 1].mean + (t->max - c[t->n - 1].mean) * (target - at) / last;
+}
+
+/* Adds everything 'other' has seen; 'other' is left unchanged apart from being flushed */
+static void tdigest_merge(TDigest* t, TDigest* other) {
+    tdigest_flush(t);
+    tdigest_flush(other);
+    if (other->n == 0) return;
+    double n1 = t->total, n2 = other->total;
+    int m = 0, i = 0, j = 0;
+    while (i < t->n || j < other->n) {
+        if (j == other->n || (i < t->n && t->c[i].mean < other->c[j].mean)) t->tmp[m++] = t->c[i++];
+        else t->tmp[m++] = other->c[j++];
+    }
+    td_compress(t, m, n1 + n2);
+    double delta = other->run_mean - t->run_mean;
+    t->run_m2 += other->run_m2 + delta * delta * n1 * n2 / (n1 + n2);
+    t->run_mean += delta * n2 / (n1 + n2);
+    t->min = n1 == 0 || other->min < t->min ? other->min : t->min;
+    t->max = n1 == 0 || other->max > t->max ? other->max : t->max;
+}
+
+static int tdigest_len(const TDigest* t) { return (int)(t->total + t->nbuf); }
+static double tdigest_mean(const TDigest* t) { return t->run_mean; }
+static double tdigest_var(const TDigest* t) {
+    double n = t->total + t->nbuf;
+    return n > 0 ? t->run_m2 / n : 0.0;
+}
+
+static void tdigest_clear(TDigest* t) {
+    t->n = t->nbuf = 0;
+    t->total = 0.0;
+    t->min = t->max = 0.0;
+    t->run_mean = t->run_m2 = 0.0;
+}
+
+static void print_tdigest(TDigest* t) {
+    printf("tdigest(n=%d, p50=%g)\n", tdigest_len(t), tdigest_quantile(t, 0.5));
+}
+
+static void tdigest_free(TDigest* t) {
+    free(t->c);
+    free(t->buf);
+    free(t->tmp);
+    t->c = t->tmp = NULL;
+    t->buf = NULL;
+    t->n = t->nbuf = 0;
+}
+
+/* Tuple implementation */
+typedef struct {
+    int* data;
+    int size;
+} Tuple;
+
+static Tuple new_tuple(void) {
+    Tuple t;
+    t.size = 0;
+    t.data = NULL;
+    return t;
+}
+
+static Tuple make_tuple(int count, ...) {
+    Tuple t;
+    t.size = count;
+    t.data = (int*)malloc(sizeof(int) * count);
+    va_list args;
+    va_start(args, count);
+    for (int i = 0; i < count; i++) {
+        t.data[i] = va_arg(args, int);
+    }
+    va_end(args);
+    return t;
+}
+
+static void print_tuple(Tuple* t) {
+    printf("(");
+    for (int i = 0; i < t->size; i++) {
+        printf("%d", t->data[i]);
+        if (i < t->size - 1) printf(", ");
+    }
+    printf(")\n");
+}
+
+static void tuple_free(Tuple* t) {
+    free(t->data);
+    t->data = NULL;
+    t->size = 0;
+}
+
+static bool tuple_contains(const Tuple* t, int x) {
+    return int_array_contains(t->data, t->size, x);
+}
+
+/* Hashing: wyhash-style multiply-fold mixing, shared by dicts, sets, bloom filters and hash64 */
+static const uint64_t wy_p[4] = {
+    0x2d358dccaa6c78a5ULL, 0x8bb84b93962eacc9ULL, 0x4b33a62ed433d4a3ULL, 0x4d5a2da51de1aa47ULL
+};
+
+/* 64x64 -> 128 multiply, folded back to 64 bits */
+static inline uint64_t wy_mum(uint64_t a, uint64_t b) {
+    __uint128_t r = (__uint128_t)a * b;
+    return (uint64_t)r ^ (uint64_t)(r >> 64);
+}
+
+static inline void wy_mum2(uint64_t* a, uint64_t* b) {
+    __uint128_t r = (__uint128_t)*a * *b;
+    *a = (uint64_t)r;
+    *b = (uint64_t)(r >> 64);
+}
+
+static inline uint64_t wy_r8(const uint8_t* p) { uint64_t v; memcpy(&v, p, 8); return v; }
+static inline uint64_t wy_r4(const uint8_t* p) { uint32_t v; memcpy(&v, p, 4); return v; }
+static inline uint64_t wy_r3(const uint8_t* p, size_t k) {
+    return ((uint64_t)p[0] << 16) | ((uint64_t)p[k >> 1] << 8) | p[k - 1];
+}
+
+/* Inputs of up to 16 bytes read as two overlapping words */
+static inline void wy_short(const uint8_t* p, size_t len, uint64_t* a, uint64_t* b) {
+    if (len >= 4) {
+        *a = (wy_r4(p) << 32) | wy_r4(p + ((len >> 3) << 2));
+        *b = (wy_r4(p + len - 4) << 32) | wy_r4(p + len - 4 - ((len >> 3) << 2));
+    } else if (len > 0) {
+        *a = wy_r3(p, len);
+        *b = 0;
+    } else {
+        *a = *b = 0;
+    }
+}
+
+/* Three independent multiply chains per 48-byte block */
+static inline void wy_block(uint64_t* seed, uint64_t* see1, uint64_t* see2, const uint8_t* p) {
+    *seed = wy_mum(wy_r8(p) ^ wy_p[1], wy_r8(p + 8) ^ *seed);
+    *see1 = wy_mum(wy_r8(p + 16) ^ wy_p[2], wy_r8(p + 24) ^ *see1);
+    *see2 = wy_mum(wy_r8(p + 32) ^ wy_p[3], wy_r8(p + 40) ^ *see2);
+}
+
+static inline uint64_t wy_final(uint64_t a, uint64_t b, uint64_t seed, size_t len) {
+    a ^= wy_p[1];
+    b ^= seed;
+    wy_mum2(&a, &b);
+    return wy_mum(a ^ wy_p[0] ^ len, b ^ wy_p[1]);
+}
+
+static uint64_t hash_bytes(const void* key, size_t len, uint64_t seed) {
+    const uint8_t* p = (const uint8_t*)key;
+    uint64_t a, b;
+    seed ^= wy_mum(seed ^ wy_p[0], wy_p[1]);
+    if (len <= 16) {
+        wy_short(p, len, &a, &b);
+    } else {
+        size_t i = len;
+        if (i > 48) {
+            uint64_t see1 = seed, see2 = seed;
+            do {
+                wy_block(&seed, &see1, &see2, p);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = wy_mum(wy_r8(p) ^ wy_p[1], wy_r8(p + 8) ^ seed);
+            p += 16;
+            i -= 16;
+        }
+        a = wy_r8(p + i - 16);
+        b = wy_r8(p + i - 8);
+    }
+    return wy_final(a, b, seed, len);
+}
+
+static inline uint64_t hash_int(int64_t x) {
+    uint64_t a = (uint64_t)x ^ wy_p[0], b = (uint64_t)x ^ wy_p[1];
+    wy_mum2(&a, &b);
+    return wy_mum(a ^ wy_p[2], b ^ wy_p[3]);
+}
+
+static inline uint64_t hash_float(double x) {
+    if (x == 0.0) x = 0.0;   /* -0.0 and 0.0 compare equal */
+    int64_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    return hash_int(bits);
+}
+
+static inline uint64_t hash_str(const char* s) {
+    return hash_bytes(s, strlen(s), 0);
+}
+
+static uint64_t hash_list(const List* l) {
+    return hash_bytes(l->data, sizeof(int) * l->size, 0);
+}
+
+static uint64_t hash_flist(const FList* l) {
+    return hash_bytes(l->data, sizeof(float) * l->size, 0);
+}
+
+#define hash64(x) _Generic((x), \
+    char*: hash_str, const char*: hash_str, \
+    List*: hash_list, const List*: hash_list, FList*: hash_flist, const FList*: hash_flist, \
+    float: hash_float, double: hash_float, \
+    default: hash_int)(x)
+
+/* Streaming hasher: update() in pieces, digest() equals hash_bytes of the concatenation */
+typedef struct {
+    uint64_t seed, see1, see2;
+    uint8_t buf[64];    /* last 16 bytes already consumed, then up to 48 pending */
+    size_t pending;
+    size_t total;
+} Hasher;
+
+static Hasher new_hasher(void) {
+    Hasher h;
+    memset(&h, 0, sizeof(h));
+    h.seed = wy_mum(wy_p[0], wy_p[1]);
+    h.see1 = h.see2 = h.seed;
+    return h;
+}
+
+static void hasher_bytes(Hasher* h, const void* data, size_t len) {
+    const uint8_t* p = (const uint8_t*)data;
+    h->total += len;
+    /* A block is only consumed once more input follows it, as in hash_bytes */
+    if (h->pending == 0 && len > 48) {
+        do {
+            wy_block(&h->seed, &h->see1, &h->see2, p);
+            p += 48;
+            len -= 48;
+        } while (len > 48);
+        memcpy(h->buf, p - 16, 16);
+    }
+    while (len > 0) {
+        if (h->pending == 48) {
+            wy_block(&h->seed, &h->see1, &h->see2, h->buf + 16);
+            memcpy(h->buf, h->buf + 48, 16);
+            h->pending = 0;
+        }
+        size_t n = 48 - h->pending < len ? 48 - h->pending : len;
+        memcpy(h->buf + 16 + h->pending, p, n);
+        h->pending += n;
+        p += n;
+        len -= n;
+    }
+}
+
+static void hasher_update_int(Hasher* h, int x) { hasher_bytes(h, &x, sizeof(x)); }
+static void hasher_update_float(Hasher* h, double x) { float f = (float)x; hasher_bytes(h, &f, sizeof(f)); }
+static void hasher_update_str(Hasher* h, const char* s) { hasher_bytes(h, s, strlen(s)); }
+static void hasher_update_list(Hasher* h, const List* l) { hasher_bytes(h, l->data, sizeof(int) * l->size); }
+static void hasher_update_flist(Hasher* h, const FList* l) { hasher_bytes(h, l->data, sizeof(float) * l->size); }
+
+#define hasher_update(h, x) _Generic((x), \
+    char*: hasher_update_str, const char*: hasher_update_str, \
+    List*: hasher_update_list, const List*: hasher_update_list, \
+    FList*: hasher_update_flist, const FList*: hasher_update_flist, \
+    float: hasher_update_float, double: hasher_update_float, \
+    default: hasher_update_int)(h, x)
+
+static uint64_t hasher_digest(const Hasher* h) {
+    const uint8_t* p = h->buf + 16;
+    size_t i = h->pending;
+    uint64_t seed = h->seed, a, b;
+    if (h->total <= 16) {
+        wy_short(p, h->total, &a, &b);
+    } else {
+        if (h->total > 48) seed ^= h->see1 ^ h->see2;
+        while (i > 16) {
+            seed = wy_mum(wy_r8(p) ^ wy_p[1], wy_r8(p + 8) ^ seed);
+            p += 16;
+            i -= 16;
+        }
+        a = wy_r8(p + i - 16);
+        b = wy_r8(p + i - 8);
+    }
+    return wy_final(a, b, seed, h->total);
+}
+
+static void hasher_reset(Hasher* h) {
+    *h = new_hasher();
+}
+
+/* CRC-32C (Castagnoli): SSE4.2 crc32 instruction, 8 bytes per step */
+static uint32_t crc32c_bytes(uint32_t crc, const void* data, size_t len) {
+    const uint8_t* p = (const uint8_t*)data;
+    crc = ~crc;
+#if defined(__SSE4_2__)
+    uint64_t c = crc;
+    for (; len >= 8; p += 8, len -= 8) c = _mm_crc32_u64(c, wy_r8(p));
+    crc = (uint32_t)c;
+    for (; len > 0; p++, len--) crc = _mm_crc32_u8(crc, *p);
+#else
+    static uint32_t table[256];
+    static bool ready = false;
+    if (!ready) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t v = i;
+            for (int k = 0; k < 8; k++) v = (v >> 1) ^ (0x82F63B78u & (0u - (v & 1)));
+            table[i] = v;
+        }
+        ready = true;
+    }
+    for (; len > 0; p++, len--) crc = table[(crc ^ *p) & 0xFF] ^ (crc >> 8);
+#endif
+    return ~crc;
+}
+
+static uint32_t crc32c_str(const char* s) { return crc32c_bytes(0, s, strlen(s)); }
+static uint32_t crc32c_list(const List* l) { return crc32c_bytes(0, l->data, sizeof(int) * l->size); }
+static uint32_t crc32c_flist(const FList* l) { return crc32c_bytes(0, l->data, sizeof(float) * l->size); }
+
+#define crc32c(x) _Generic((x), \
+    char*: crc32c_str, const char*: crc32c_str, \
+    List*: crc32c_list, const List*: crc32c_list, FList*: crc32c_flist, const FList*: crc32c_flist)(x)
+
+/* Random numbers: xoshiro256++ generators, one independent stream per thread */
+typedef struct {
+    uint64_t s[4];
+} Rng;
+
+static inline uint64_t rng_rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+static inline uint64_t splitmix64(uint64_t* x) {
+    uint64_t z = (*x += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static Rng new_rng(uint64_t seed) {
+    Rng r;
+    for (int i = 0; i < 4; i++) r.s[i] = splitmix64(&seed);
+    return r;
+}
+
+static inline uint64_t rng_next64(Rng* r) {
+    uint64_t* s = r->s;
+    uint64_t out = rng_rotl(s[0] + s[3], 23) + s[0];
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rng_rotl(s[3], 45);
+    return out;
+}
+
+/* Advances by 2^128 steps: streams split off with jump() never overlap */
+static void rng_jump(Rng* r) {
+    static const uint64_t jump[4] = {
+        0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL, 0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL
+    };
+    uint64_t s[4] = {0, 0, 0, 0};
+    for (int i = 0; i < 4; i++) {
+        for (int b = 0; b < 64; b++) {
+            if (jump[i] & (1ULL << b)) {
+                for (int k = 0; k < 4; k++) s[k] ^= r->s[k];
+            }
+            rng_next64(r);
+        }
+    }
+    memcpy(r->s, s, sizeof(s));
+}
+
+/* Copy of the current stream; this generator jumps ahead so the two never overlap */
+static Rng rng_fork(Rng* r) {
+    Rng child = *r;
+    rng_jump(r);
+    return child;
+}
+
+/* Seed from A_SEED when set, so runs can be reproduced */
+static uint64_t a_rng_seed(void) {
+    static uint64_t seed;
+    static bool ready = false;
+    if (!ready) {
+        const char* env = getenv("A_SEED");
+        seed = env ? strtoull(env, NULL, 10) : ((uint64_t)time(NULL) << 20) ^ (uint64_t)getpid();
+        ready = true;
+    }
+    return seed;
+}
+
+/* Stream n of the program: the base generator jumped n times. The last
+   stream handed out is kept, so each new one costs a single jump. */
+static Rng new_rng_stream(void) {
+    static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    static Rng last;
+    static bool started = false;
+    pthread_mutex_lock(&lock);
+    if (started) {
+        rng_jump(&last);
+    } else {
+        last = new_rng(a_rng_seed());
+        started = true;
+    }
+    Rng r = last;
+    pthread_mutex_unlock(&lock);
+    return r;
+}
+
+/* Unbiased integer in [lo, hi] (Lemire's multiply-shift with rejection) */
+static inline int rng_bounded(Rng* r, uint32_t x, int lo, uint64_t span) {
+    if (span > UINT32_MAX) return (int)((int64_t)lo + x);
+    uint64_t m = (uint64_t)x * span;
+    uint32_t low = (uint32_t)m;
+    if (low < span) {
+        uint32_t threshold = (uint32_t)(-(uint32_t)span) % (uint32_t)span;
+        while (low < threshold) {
+            m = (uint64_t)(uint32_t)(rng_next64(r) >> 32) * span;
+            low = (uint32_t)m;
+        }
+    }
+    return (int)((int64_t)lo + (int64_t)(m >> 32));
+}
+
+static int rng_range(Rng* r, int lo, int hi) {
+    if (hi < lo) return lo;
+    return rng_bounded(r, (uint32_t)(rng_next64(r) >> 32), lo, (uint64_t)((int64_t)hi - lo) + 1);
+}
+
+/* Uniform in [0, 1) */
+static float rng_uniform(Rng* r) {
+    return (float)(rng_next64(r) >> 40) * (1.0f / 16777216.0f);
+}
+
+static int rng_next(Rng* r) {
+    return (int)(rng_next64(r) >> 33);
+}
+
+/* Four interleaved generators; the lane loop compiles to 256-bit integer ops */
+#define RNG_LANES 4
+#define RNG_BATCH 256
+
+typedef struct {
+    uint64_t s0[RNG_LANES], s1[RNG_LANES], s2[RNG_LANES], s3[RNG_LANES];
+} RngLanes;
+
+/* Lanes are seeded from the parent stream; jumping each would cost more than small fills */
+static RngLanes rng_lanes_from(Rng* r) {
+    RngLanes g;
+    for (int l = 0; l < RNG_LANES; l++) {
+        Rng lane = new_rng(rng_next64(r));
+        g.s0[l] = lane.s[0];
+        g.s1[l] = lane.s[1];
+        g.s2[l] = lane.s[2];
+        g.s3[l] = lane.s[3];
+    }
+    return g;
+}
+
+/* Writes n (a multiple of RNG_LANES) random 64-bit words */
+static void rng_lanes_fill(RngLanes* g, uint64_t* out, size_t n) {
+    uint64_t s0[RNG_LANES], s1[RNG_LANES], s2[RNG_LANES], s3[RNG_LANES];
+    memcpy(s0, g->s0, sizeof(s0));
+    memcpy(s1, g->s1, sizeof(s1));
+    memcpy(s2, g->s2, sizeof(s2));
+    memcpy(s3, g->s3, sizeof(s3));
+    for (size_t i = 0; i < n; i += RNG_LANES) {
+        for (int l = 0; l < RNG_LANES; l++) {
+            out[i + l] = rng_rotl(s0[l] + s3[l], 23) + s0[l];
+            uint64_t t = s1[l] << 17;
+            s2[l] ^= s0[l];
+            s3[l] ^= s1[l];
+            s1[l] ^= s2[l];
+            s0[l] ^= s3[l];
+            s2[l] ^= t;
+            s3[l] = rng_rotl(s3[l], 45);
+        }
+    }
+    memcpy(g->s0, s0, sizeof(s0));
+    memcpy(g->s1, s1, sizeof(s1));
+    memcpy(g->s2, s2, sizeof(s2));
+    memcpy(g->s3, s3, sizeof(s3));
+}
+
+/* Overwrites every element with a value in [lo, hi] */
+static void rng_fill_list(Rng* r, List* l, int lo, int hi) {
+    if (hi < lo) hi = lo;
+    uint64_t span = (uint64_t)((int64_t)hi - lo) + 1;
+    RngLanes g = rng_lanes_from(r);
+    uint64_t buf[RNG_BATCH];
+    for (int i = 0; i < l->size; i += 2 * RNG_BATCH) {
+        rng_lanes_fill(&g, buf, RNG_BATCH);
+        int n = l->size - i < 2 * RNG_BATCH ? l->size - i : 2 * RNG_BATCH;
+        for (int j = 0; j < n; j++) {
+            uint32_t x = (uint32_t)(buf[j >> 1] >> (32 * (j & 1)));
+            l->data[i + j] = rng_bounded(r, x, lo, span);
+        }
+    }
+}
+
+/* Overwrites every element with a value in [lo, hi) */
+static void rng_fill_flist(Rng* r, FList* l, double lo, double hi) {
+    float scale = (float)(hi - lo) * (1.0f / 16777216.0f);
+    RngLanes g = rng_lanes_from(r);
+    uint64_t buf[RNG_BATCH];
+    for (int i = 0; i < l->size; i += 2 * RNG_BATCH) {
+        rng_lanes_fill(&g, buf, RNG_BATCH);
+        int n = l->size - i < 2 * RNG_BATCH ? l->size - i : 2 * RNG_BATCH;
+        for (int j = 0; j < n; j++) {
+            uint32_t x = (uint32_t)(buf[j >> 1] >> (32 * (j & 1))) >> 8;
+            l->data[i + j] = (float)lo + (float)x * scale;
+        }
+    }
+}
+
+#define rng_fill(r, l, lo, hi) _Generic((l), List*: rng_fill_list, FList*: rng_fill_flist)(r, l, lo, hi)
+
+/* Fisher-Yates swap targets for positions i, i-1, ... (one batch); returns how many */
+static int rng_shuffle_batch(Rng* r, RngLanes* g, int i, int* out) {
+    uint64_t buf[RNG_BATCH];
+    rng_lanes_fill(g, buf, RNG_BATCH);
+    int n = i < 2 * RNG_BATCH ? i : 2 * RNG_BATCH;
+    for (int k = 0; k < n; k++) {
+        uint32_t x = (uint32_t)(buf[k >> 1] >> (32 * (k & 1)));
+        out[k] = rng_bounded(r, x, 0, (uint64_t)(i - k) + 1);
+    }
+    return n;
+}
+
+static void rng_shuffle_list(Rng* r, List* l) {
+    RngLanes g = rng_lanes_from(r);
+    int swap[2 * RNG_BATCH];
+    for (int i = l->size - 1; i > 0; ) {
+        int n = rng_shuffle_batch(r, &g, i, swap);
+        for (int k = 0; k < n; k++, i--) {
+            int t = l->data[i];
+            l->data[i] = l->data[swap[k]];
+            l->data[swap[k]] = t;
+        }
+    }
+}
+
+static void rng_shuffle_flist(Rng* r, FList* l) {
+    RngLanes g = rng_lanes_from(r);
+    int swap[2 * RNG_BATCH];
+    for (int i = l->size - 1; i > 0; ) {
+        int n = rng_shuffle_batch(r, &g, i, swap);
+        for (int k = 0; k < n; k++, i--) {
+            float t = l->data[i];
+            l->data[i] = l->data[swap[k]];
+            l->data[swap[k]] = t;
+        }
+    }
+}
+
+#define rng_shuffle(r, l) _Generic((l), List*: rng_shuffle_list, FList*: rng_shuffle_flist)(r, l)
+
+/* The calling thread's own stream, created on first use */
+static Rng* a_thread_rng(void) {
+    static __thread Rng rng;
+    static __thread bool ready = false;
+    if (!ready) {
+        rng = new_rng_stream();
+        ready = true;
+    }
+    return &rng;
+}
+
+static void list_fill_random(List* l, int lo, int hi) { rng_fill_list(a_thread_rng(), l, lo, hi); }
+static void flist_fill_random(FList* l, double lo, double hi) { rng_fill_flist(a_thread_rng(), l, lo, hi); }
+static void list_shuffle(List* l) { rng_shuffle_list(a_thread_rng(), l); }
+static void flist_shuffle(FList* l) { rng_shuffle_flist(a_thread_rng(), l); }
+
+static void print_rng(const Rng* r) {
+    printf("rng(%016llx)\n", (unsigned long long)r->s[0]);
+}
+
+/* Dictionary implementation: insertion-ordered entries plus a hash index */
+#define DICT_MAX 256
+#define DICT_INDEX (DICT_MAX * 2)
+
+typedef struct {
+    char* keys[DICT_MAX];
+    int vals[DICT_MAX];
+    short index[DICT_INDEX];    /* entry + 1, 0 = empty */
+    int size;
+} Dict;
+
+static Dict new_dict(void) {
+    Dict d;
+    d.size = 0;
+    for (int i = 0; i < DICT_MAX; i++) {
+        d.keys[i] = NULL;
+    }
+    memset(d.index, 0, sizeof(d.index));
+    return d;
+}
+
+/* Index slot holding 'key', or the empty slot where it would go */
+static int dict_slot(const Dict* d, const char* key) {
+    int slot = (int)(hash_str(key) & (DICT_INDEX - 1));
+    while (d->index[slot] && strcmp(d->keys[d->index[slot] - 1], key) != 0) {
+        slot = (slot + 1) & (DICT_INDEX - 1);
+    }
+    return slot;
+}
+
+static void dset(Dict* d, const char* key, int val) {
+    int slot = dict_slot(d, key);
+    if (d->index[slot]) {
+        d->vals[d->index[slot] - 1] = val;
+        return;
+    }
+    if (d->size < DICT_MAX) {
+        d->keys[d->size] = strdup(key);
+        d->vals[d->size] = val;
+        d->size++;
+        d->index[slot] = (short)d->size;
+    }
+}
+
+static int dget(Dict* d, const char* key) {
+    int slot = dict_slot(d, key);
+    return d->index[slot] ? d->vals[d->index[slot] - 1] : 0;
+}
+
+static bool dict_has(const Dict* d, const char* key) {
+    return d->index[dict_slot(d, key)] != 0;
+}
+
+static void dict_free(Dict* d) {
+    for (int i = 0; i < d->size; i++) {
+        free(d->keys[i]);
+    }
+    d->size = 0;
+    memset(d->index, 0, sizeof(d->index));
+}
+
+/* Deque implementation: power-of-two ring buffer */
+typedef struct {
+    int* data;
+    int head;       /* slot of the front element */
+    int size;
+    int mask;       /* capacity - 1 */
+    int limit;      /* fixed capacity, 0 = unbounded; a full window evicts from the opposite end */
+} Deque;
+
+static Deque new_deque_cap(int cap, int limit) {
+    Deque q;
+    int c = 8;
+    while (c < cap) c *= 2;
+    q.data = (int*)malloc(sizeof(int) * c);
+    q.head = 0;
+    q.size = 0;
+    q.mask = c - 1;
+    q.limit = limit;
+    return q;
+}
+
+static Deque new_deque(void) {
+    return new_deque_cap(8, 0);
+}
+
+/* Sliding window of at most 'cap' elements */
+static Deque new_deque_fixed(int cap) {
+    return new_deque_cap(cap, cap > 0 ? cap : 1);
+}
+
+/* The elements as at most two contiguous runs: [a, a+na) then [b, b+nb) */
+static void deque_segments(const Deque* q, int** a, int* na, int** b, int* nb) {
+    int cap = q->mask + 1;
+    int first = cap - q->head;
+    if (first > q->size) first = q->size;
+    *a = q->data + q->head;
+    *na = first;
+    *b = q->data;
+    *nb = q->size - first;
+}
+
+static void deque_grow(Deque* q) {
+    int cap = q->mask + 1;
+    int* data = (int*)malloc(sizeof(int) * cap * 2);
+    int *a, *b, na, nb;
+    deque_segments(q, &a, &na, &b, &nb);
+    memcpy(data, a, sizeof(int) * na);
+    memcpy(data + na, b, sizeof(int) * nb);
+    free(q->data);
+    q->data = data;
+    q->head = 0;
+    q->mask = cap * 2 - 1;
+}
+
+static void deque_push_back(Deque* q, int val) {
+    if (q->limit && q->size == q->limit) {
+        q->head = (q->head + 1) & q->mask;
+        q->size--;
+    } else if (q->size > q->mask) {
+        deque_grow(q);
+    }
+    q->data[(q->head + q->size) & q->mask] = val;
+    q->size++;
+}
+
+static void deque_push_front(Deque* q, int val) {
+    if (q->limit && q->size == q->limit) {
+        q->size--;
+    } else if (q->size > q->mask) {
+        deque_grow(q);
+    }
+    q->head = (q->head - 1) & q->mask;
+    q->data[q->head] = val;
+    q->size++;
+}
+
+static int deque_pop_front(Deque* q) {
+    if (q->size == 0) return 0;
+    int val = q->data[q->head];
+    q->head = (q->head + 1) & q->mask;
+    q->size--;
+    return val;
+}
+
+static int deque_pop_back(Deque* q) {
+    if (q->size == 0) return 0;
+    q->size--;
+    return q->data[(q->head + q->size) & q->mask];
+}
+
+static int deque_front(const Deque* q) {
+    return q->size ? q->data[q->head] : 0;
+}
+
+static int deque_back(const Deque* q) {
+    return q->size ? q->data[(q->head + q->size - 1) & q->mask] : 0;
+}
+
+static int deque_get(const Deque* q, int i) {
+    return q->data[(q->head + i) & q->mask];
+}
+
+static int deque_len(const Deque* q) {
+    return q->size;
+}
+
+static bool deque_empty(const Deque* q) {
+    return q->size == 0;
+}
+
+static bool deque_full(const Deque* q) {
+    return q->limit && q->size == q->limit;
+}
+
+static void deque_clear(Deque* q) {
+    q->head = 0;
+    q->size = 0;
+}
+
+static List deque_to_list(const Deque* q) {
+    List l = new_list();
+    int *a, *b, na, nb;
+    deque_segments(q, &a, &na, &b, &nb);
+    for (int i = 0; i < na; i++) list_append(&l, a[i]);
+    for (int i = 0; i < nb; i++) list_append(&l, b[i]);
+    return l;
+}
+
+static void print_deque(const Deque* q) {
+    int *a, *b, na, nb;
+    deque_segments(q, &a, &na, &b, &nb);
+    printf("[");
+    for (int i = 0; i < na; i++) printf(i ? ", %d" : "%d", a[i]);
+    for (int i = 0; i < nb; i++) printf(na + i ? ", %d" : "%d", b[i]);
+    printf("]\n");
+}
+
+static void deque_free(Deque* q) {
+    free(q->data);
+    q->data = NULL;
+    q->head = 0;
+    q->size = 0;
+    q->mask = 0;
+}
+
+/* Priority queue: 4-ary heap of keys with an int payload */
+#define HEAP_ARITY 4
+#define HEAP_PAD 3      /* element i lives at slot i + 3, so each group of 4 siblings is 16-byte aligned */
+
+typedef struct {
+    int* keys;
+    int* vals;
+    int size;
+    int cap;
+    bool max;
+} IntHeap;
+
+static void* heap_alloc(int cap, size_t elem_size) {
+    size_t bytes = ((size_t)(cap + HEAP_PAD) * elem_size + 63) & ~(size_t)63;
+    return (char*)aligned_alloc(64, bytes) + HEAP_PAD * elem_size;
+}
+
+static void heap_release(void* base, size_t elem_size) {
+    if (base) free((char*)base - HEAP_PAD * elem_size);
+}
+
+static IntHeap new_iheap(bool max) {
+    IntHeap h;
+    h.cap = 16;
+    h.size = 0;
+    h.max = max;
+    h.keys = (int*)heap_alloc(h.cap, sizeof(int));
+    h.vals = (int*)heap_alloc(h.cap, sizeof(int));
+    return h;
+}
+
+static inline bool iheap_before(const IntHeap* h, int a, int b) {
+    return h->max ? a > b : a < b;
+}
+
+static void iheap_sift_down(IntHeap* h, int i) {
+    int key = h->keys[i];
+    int val = h->vals[i];
+    for (;;) {
+        int first = HEAP_ARITY * i + 1;
+        if (first >= h->size) break;
+        int last = first + HEAP_ARITY < h->size ? first + HEAP_ARITY : h->size;
+        int best = first;
+        for (int c = first + 1; c < last; c++) {
+            if (iheap_before(h, h->keys[c], h->keys[best])) best = c;
+        }
+        if (!iheap_before(h, h->keys[best], key)) break;
+        h->keys[i] = h->keys[best];
+        h->vals[i] = h->vals[best];
+        i = best;
+    }
+    h->keys[i] = key;
+    h->vals[i] = val;
+}
+
+static void iheap_push(IntHeap* h, int key, int val) {
+    if (h->size >= h->cap) {
+        int cap = h->cap * 2;
+        int* keys = (int*)heap_alloc(cap, sizeof(int));
+        int* vals = (int*)heap_alloc(cap, sizeof(int));
+        memcpy(keys, h->keys, sizeof(int) * h->size);
+        memcpy(vals, h->vals, sizeof(int) * h->size);
+        heap_release(h->keys, sizeof(int));
+        heap_release(h->vals, sizeof(int));
+        h->keys = keys;
+        h->vals = vals;
+        h->cap = cap;
+    }
+    int i = h->size++;
+    while (i > 0) {
+        int parent = (i - 1) / HEAP_ARITY;
+        if (!iheap_before(h, key, h->keys[parent])) break;
+        h->keys[i] = h->keys[parent];
+        h->vals[i] = h->vals[parent];
+        i = parent;
+    }
+    h->keys[i] = key;
+    h->vals[i] = val;
+}
+
+/* Removes the top entry and returns its payload (0 when empty) */
+static int iheap_pop(IntHeap* h) {
+    if (h->size == 0) return 0;
+    int val = h->vals[0];
+    h->size--;
+    if (h->size > 0) {
+        h->keys[0] = h->keys[h->size];
+        h->vals[0] = h->vals[h->size];
+        iheap_sift_down(h, 0);
+    }
+    return val;
+}
+
+static int iheap_peek(const IntHeap* h) {
+    return h->size ? h->keys[0] : 0;
+}
+
+static int iheap_peek_val(const IntHeap* h) {
+    return h->size ? h->vals[0] : 0;
+}
+
+static int iheap_len(const IntHeap* h) {
+    return h->size;
+}
+
+static bool iheap_empty(const IntHeap* h) {
+    return h->size == 0;
+}
+
+static void iheap_clear(IntHeap* h) {
+    h->size = 0;
+}
+
+/* Replaces the contents with the list's values (payload = index), built bottom-up in O(n) */
+static void iheap_heapify(IntHeap* h, const List* l) {
+    heap_release(h->keys, sizeof(int));
+    heap_release(h->vals, sizeof(int));
+    h->cap = l->size > 16 ? l->size : 16;
+    h->keys = (int*)heap_alloc(h->cap, sizeof(int));
+    h->vals = (int*)heap_alloc(h->cap, sizeof(int));
+    memcpy(h->keys, l->data, sizeof(int) * l->size);
+    for (int i = 0; i < l->size; i++) h->vals[i] = i;
+    h->size = l->size;
+    for (int i = (h->size - 2) / HEAP_ARITY; i >= 0; i--) iheap_sift_down(h, i);
+}
+
+static void print_iheap(const IntHeap* h) {
+    printf("[");
+    for (int i = 0; i < h->size; i++) printf(i ? ", %d" : "%d", h->keys[i]);
+    printf("]\n");
+}
+
+static void iheap_free(IntHeap* h) {
+    heap_release(h->keys, sizeof(int));
+    heap_release(h->vals, sizeof(int));
+    h->keys = NULL;
+    h->vals = NULL;
+    h->size = 0;
+    h->cap = 0;
+}
+
+typedef struct {
+    float* keys;
+    int* vals;
+    int size;
+    int cap;
+    bool max;
+} FloatHeap;
+
+static FloatHeap new_fheap(bool max) {
+    FloatHeap h;
+    h.cap = 16;
+    h.size = 0;
+    h.max = max;
+    h.keys = (float*)heap_alloc(h.cap, sizeof(float));
+    h.vals = (int*)heap_alloc(h.cap, sizeof(int));
+    return h;
+}
+
+static inline bool fheap_before(const FloatHeap* h, float a, float b) {
+    return h->max ? a > b : a < b;
+}
+
+static void fheap_sift_down(FloatHeap* h, int i) {
+    float key = h->keys[i];
+    int val = h->vals[i];
+    for (;;) {
+        int first = HEAP_ARITY * i + 1;
+        if (first >= h->size) break;
+        int last = first + HEAP_ARITY < h->size ? first + HEAP_ARITY : h->size;
+        int best = first;
+        for (int c = first + 1; c < last; c++) {
+            if (fheap_before(h, h->keys[c], h->keys[best])) best = c;
+        }
+        if (!fheap_before(h, h->keys[best], key)) break;
+        h->keys[i] = h->keys[best];
+        h->vals[i] = h->vals[best];
+        i = best;
+    }
+    h->keys[i] = key;
+    h->vals[i] = val;
+}
+
+static void fheap_push(FloatHeap* h, float key, int val) {
+    if (h->size >= h->cap) {
+        int cap = h->cap * 2;
+        float* keys = (float*)heap_alloc(cap, sizeof(float));
+        int* vals = (int*)heap_alloc(cap, sizeof(int));
+        memcpy(keys, h->keys, sizeof(float) * h->size);
+        memcpy(vals, h->vals, sizeof(int) * h->size);
+        heap_release(h->keys, sizeof(float));
+        heap_release(h->vals, sizeof(int));
+        h->keys = keys;
+        h->vals = vals;
+        h->cap = cap;
+    }
+    int i = h->size++;
+    while (i > 0) {
+        int parent = (i - 1) / HEAP_ARITY;
+        if (!fheap_before(h, key, h->keys[parent])) break;
+        h->keys[i] = h->keys[parent];
+        h->vals[i] = h->vals[parent];
+        i = parent;
+    }
+    h->keys[i] = key;
+    h->vals[i] = val;
+}
+
+static int fheap_pop(FloatHeap* h) {
+    if (h->size == 0) return 0;
+    int val = h->vals[0];
+    h->size--;
+    if (h->size > 0) {
+        h->keys[0] = h->keys[h->size];
+        h->vals[0] = h->vals[h->size];
+        fheap_sift_down(h, 0);
+    }
+    return val;
+}
+
+static float fheap_peek(const FloatHeap* h) {
+    return h->size ? h->keys[0] : 0.0f;
+}
+
+static int fheap_peek_val(const FloatHeap* h) {
+    return h->size ? h->vals[0] : 0;
+}
+
+static int fheap_len(const FloatHeap* h) {
+    return h->size;
+}
+
+static bool fheap_empty(const FloatHeap* h) {
+    return h->size == 0;
+}
+
+static void fheap_clear(FloatHeap* h) {
+    h->size = 0;
+}
+
+static void fheap_heapify(FloatHeap* h, const FList* l) {
+    heap_release(h->keys, sizeof(float));
+    heap_release(h->vals, sizeof(int));
+    h->cap = l->size > 16 ? l->size : 16;
+    h->keys = (float*)heap_alloc(h->cap, sizeof(float));
+    h->vals = (int*)heap_alloc(h->cap, sizeof(int));
+    memcpy(h->keys, l->data, sizeof(float) * l->size);
+    for (int i = 0; i < l->size; i++) h->vals[i] = i;
+    h->size = l->size;
+    for (int i = (h->size - 2) / HEAP_ARITY; i >= 0; i--) fheap_sift_down(h, i);
+}
+
+static void print_fheap(const FloatHeap* h) {
+    printf("[");
+    for (int i = 0; i < h->size; i++) printf(i ? ", %f" : "%f", h->keys[i]);
+    printf("]\n");
+}
+
+static void fheap_free(FloatHeap* h) {
+    heap_release(h->keys, sizeof(float));
+    heap_release(h->vals, sizeof(int));
+    h->keys = NULL;
+    h->vals = NULL;
+    h->size = 0;
+    h->cap = 0;
+}
+
+/* The k largest values, largest first: a size-k min-heap over one pass, O(n log k) */
+static List list_topk(const List* l, int k) {
+    if (k > l->size) k = l->size;
+    if (k < 0) k = 0;
+    IntHeap h = new_iheap(false);
+    for (int i = 0; i < l->size; i++) {
+        int x = l->data[i];
+        if (h.size < k) {
+            iheap_push(&h, x, i);
+        } else if (k > 0 && x > h.keys[0]) {
+            h.keys[0] = x;
+            h.vals[0] = i;
+            iheap_sift_down(&h, 0);
+        }
+    }
+    List out = new_list();
+    for (int i = 0; i < k; i++) list_append(&out, 0);
+    for (int i = k - 1; i >= 0; i--) {
+        out.data[i] = h.keys[0];
+        iheap_pop(&h);
+    }
+    iheap_free(&h);
+    return out;
+}
+
+static FList flist_topk(const FList* l, int k) {
+    if (k > l->size) k = l->size;
+    if (k < 0) k = 0;
+    FloatHeap h = new_fheap(false);
+    for (int i = 0; i < l->size; i++) {
+        float x = l->data[i];
+        if (h.size < k) {
+            fheap_push(&h, x, i);
+        } else if (k > 0 && x > h.keys[0]) {
+            h.keys[0] = x;
+            h.vals[0] = i;
+            fheap_sift_down(&h, 0);
+        }
+    }
+    FList out = new_flist();
+    for (int i = 0; i < k; i++) flist_append(&out, 0.0f);
+    for (int i = k - 1; i >= 0; i--) {
+        out.data[i] = h.keys[0];
+        fheap_pop(&h);
+    }
+    fheap_free(&h);
+    return out;
+}
+
+/* Ordered map: B+ tree of int keys, leaves linked for in-order scans */
+#define BT_KEYS 32      /* 128 bytes of keys per node, scanned with SIMD compares */
+
+typedef struct BTNode {
+    int keys[BT_KEYS];  /* unused slots hold INT_MAX */
+    int n;
+    bool leaf;
+    struct BTNode* next;
+    union {
+        int vals[BT_KEYS];
+        struct BTNode* child[BT_KEYS + 1];
+    } u;
+} BTNode;
+
+typedef struct {
+    BTNode* root;
+    int size;
+} OrdMap;
+
+static BTNode* bt_new_node(bool leaf) {
+    BTNode* node = (BTNode*)aligned_alloc(64, (sizeof(BTNode) + 63) & ~(size_t)63);
+    for (int i = 0; i < BT_KEYS; i++) node->keys[i] = INT_MAX;
+    node->n = 0;
+    node->leaf = leaf;
+    node->next = NULL;
+    return node;
+}
+
+static OrdMap new_ordmap(void) {
+    OrdMap m;
+    m.root = bt_new_node(true);
+    m.size = 0;
+    return m;
+}
+
+/* Number of keys in the node that are < x (lower bound) */
+static inline int bt_rank(const BTNode* node, int x) {
+#if defined(__AVX2__)
+    __m256i needle = _mm256_set1_epi32(x);
+    int count = 0;
+    for (int i = 0; i < BT_KEYS; i += 8) {
+        __m256i k = _mm256_load_si256((const __m256i*)(node->keys + i));
+        count += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(needle, k))));
+    }
+    return count;
+#else
+    int count = 0;
+    for (int i = 0; i < BT_KEYS; i++) count += node->keys[i] < x;
+    return count;
+#endif
+}
+
+/* Child to descend into: keys >= separator i live right of it */
+static inline int bt_child_index(const BTNode* node, int x) {
+    int r = bt_rank(node, x);
+    return (r < node->n && node->keys[r] == x) ? r + 1 : r;
+}
+
+static BTNode* bt_find_leaf(const OrdMap* m, int key) {
+    BTNode* node = m->root;
+    while (!node->leaf) node = node->u.child[bt_child_index(node, key)];
+    return node;
+}
+
+static bool ordmap_has(const OrdMap* m, int key) {
+    BTNode* leaf = bt_find_leaf(m, key);
+    int r = bt_rank(leaf, key);
+    return r < leaf->n && leaf->keys[r] == key;
+}
+
+static int ordmap_get(const OrdMap* m, int key) {
+    BTNode* leaf = bt_find_leaf(m, key);
+    int r = bt_rank(leaf, key);
+    return (r < leaf->n && leaf->keys[r] == key) ? leaf->u.vals[r] : 0;
+}
+
+/* Inserts below 'node'; if it splits, returns the new right sibling and its separator */
+static BTNode* bt_insert(BTNode* node, int key, int val, int* sep, bool* added) {
+    if (node->leaf) {
+        int r = bt_rank(node, key);
+        if (r < node->n && node->keys[r] == key) {
+            node->u.vals[r] = val;
+            return NULL;
+        }
+        *added = true;
+        BTNode* target = node;
+        BTNode* right = NULL;
+        if (node->n == BT_KEYS) {
+            right = bt_new_node(true);
+            int half = BT_KEYS / 2;
+            right->n = BT_KEYS - half;
+            memcpy(right->keys, node->keys + half, sizeof(int) * right->n);
+            memcpy(right->u.vals, node->u.vals + half, sizeof(int) * right->n);
+            for (int i = half; i < BT_KEYS; i++) node->keys[i] = INT_MAX;
+            node->n = half;
+            right->next = node->next;
+            node->next = right;
+            if (r > half) {
+                target = right;
+                r -= half;
+            }
+        }
+        memmove(target->keys + r + 1, target->keys + r, sizeof(int) * (target->n - r));
+        memmove(target->u.vals + r + 1, target->u.vals + r, sizeof(int) * (target->n - r));
+        target->keys[r] = key;
+        target->u.vals[r] = val;
+        target->n++;
+        if (right) *sep = right->keys[0];
+        return right;
+    }
+    
+    int ci = bt_child_index(node, key);
+    int child_sep;
+    BTNode* split = bt_insert(node->u.child[ci], key, val, &child_sep, added);
+    if (!split) return NULL;
+    
+    if (node->n < BT_KEYS) {
+        memmove(node->keys + ci + 1, node->keys + ci, sizeof(int) * (node->n - ci));
+        memmove(node->u.child + ci + 2, node->u.child + ci + 1, sizeof(BTNode*) * (node->n - ci));
+        node->keys[ci] = child_sep;
+        node->u.child[ci + 1] = split;
+        node->n++;
+        return NULL;
+    }
+    
+    /* Full internal node: split around the middle separator, which moves up */
+    int keys[BT_KEYS + 1];
+    BTNode* child[BT_KEYS + 2];
+    memcpy(keys, node->keys, sizeof(int) * ci);
+    keys[ci] = child_sep;
+    memcpy(keys + ci + 1, node->keys + ci, sizeof(int) * (BT_KEYS - ci));
+    memcpy(child, node->u.child, sizeof(BTNode*) * (ci + 1));
+    child[ci + 1] = split;
+    memcpy(child + ci + 2, node->u.child + ci + 1, sizeof(BTNode*) * (BT_KEYS - ci));
+    
+    int mid = (BT_KEYS + 1) / 2;
+    BTNode* right = bt_new_node(false);
+    for (int i = 0; i < BT_KEYS; i++) node->keys[i] = INT_MAX;
+    memcpy(node->keys, keys, sizeof(int) * mid);
+    memcpy(node->u.child, child, sizeof(BTNode*) * (mid + 1));
+    node->n = mid;
+    right->n = BT_KEYS - mid;
+    memcpy(right->keys, keys + mid + 1, sizeof(int) * right->n);
+    memcpy(right->u.child, child + mid + 1, sizeof(BTNode*) * (right->n + 1));
+    *sep = keys[mid];
+    return right;
+}
+
+static void ordmap_set(OrdMap* m, int key, int val) {
+    int sep;
+    bool added = false;
+    BTNode* right = bt_insert(m->root, key, val, &sep, &added);
+    if (right) {
+        BTNode* root = bt_new_node(false);
+        root->keys[0] = sep;
+        root->u.child[0] = m->root;
+        root->u.child[1] = right;
+        root->n = 1;
+        m->root = root;
+    }
+    if (added) m->size++;
+}
+
+/* Leaves may underflow after removal; separators stay valid bounds, so lookups are unaffected */
+static bool ordmap_remove(OrdMap* m, int key) {
+    BTNode* leaf = bt_find_leaf(m, key);
+    int r = bt_rank(leaf, key);
+    if (r >= leaf->n || leaf->keys[r] != key) return false;
+    memmove(leaf->keys + r, leaf->keys + r + 1, sizeof(int) * (leaf->n - r - 1));
+    memmove(leaf->u.vals + r, leaf->u.vals + r + 1, sizeof(int) * (leaf->n - r - 1));
+    leaf->n--;
+    leaf->keys[leaf->n] = INT_MAX;
+    m->size--;
+    return true;
+}
+
+static int ordmap_len(const OrdMap* m) {
+    return m->size;
+}
+
+static bool bt_first(const BTNode* node, int* key) {
+    if (node->leaf) {
+        if (node->n == 0) return false;
+        *key = node->keys[0];
+        return true;
+    }
+    for (int i = 0; i <= node->n; i++) {
+        if (bt_first(node->u.child[i], key)) return true;
+    }
+    return false;
+}
+
+static bool bt_last(const BTNode* node, int* key) {
+    if (node->leaf) {
+        if (node->n == 0) return false;
+        *key = node->keys[node->n - 1];
+        return true;
+    }
+    for (int i = node->n; i >= 0; i--) {
+        if (bt_last(node->u.child[i], key)) return true;
+    }
+    return false;
+}
+
+/* Smallest and largest keys (0 when empty) */
+static int ordmap_first(const OrdMap* m) {
+    int key = 0;
+    bt_first(m->root, &key);
+    return key;
+}
+
+static int ordmap_last(const OrdMap* m) {
+    int key = 0;
+    bt_last(m->root, &key);
+    return key;
+}
+
+/* In-order cursor over keys in [lo, hi] */
+typedef struct {
+    const BTNode* leaf;
+    int pos;
+    int hi;
+    int key;
+    int val;
+} OrdIter;
+
+static OrdIter ordmap_iter(const OrdMap* m, int lo, int hi) {
+    OrdIter it;
+    it.leaf = bt_find_leaf(m, lo);
+    it.pos = bt_rank(it.leaf, lo);
+    it.hi = hi;
+    it.key = 0;
+    it.val = 0;
+    return it;
+}
+
+static bool ordmap_next(OrdIter* it) {
+    while (it->leaf && it->pos >= it->leaf->n) {
+        it->leaf = it->leaf->next;
+        it->pos = 0;
+    }
+    if (!it->leaf || it->leaf->keys[it->pos] > it->hi) return false;
+    it->key = it->leaf->keys[it->pos];
+    it->val = it->leaf->u.vals[it->pos];
+    it->pos++;
+    return true;
+}
+
+static void print_ordmap(const OrdMap* m) {
+    OrdIter it = ordmap_iter(m, INT_MIN, INT_MAX);
+    printf("{");
+    for (int n = 0; ordmap_next(&it); n++) {
+        printf(n ? ", %d: %d" : "%d: %d", it.key, it.val);
+    }
+    printf("}\n");
+}
+
+static void bt_free(BTNode* node) {
+    if (!node->leaf) {
+        for (int i = 0; i <= node->n; i++) bt_free(node->u.child[i]);
+    }
+    free(node);
+}
+
+static void ordmap_free(OrdMap* m) {
+    if (m->root) bt_free(m->root);
+    m->root = NULL;
+    m->size = 0;
+}
+
+/* LRU cache: fixed slab of entries on a recency list, indexed by a chained hash table */
+typedef struct {
+    int key;
+    int val;
+    int prev, next;     /* recency list, most recent at head */
+    int chain;          /* next entry in the same hash bucket */
+} LruEntry;
+
+typedef struct {
+    LruEntry* slab;
+    int* buckets;
+    int bucket_mask;
+    int cap;
+    int size;
+    int head, tail;
+    int free_list;
+    long long hits;
+    long long misses;
+} Lru;
+
+static Lru new_lru(int cap) {
+    Lru c;
+    if (cap < 1) cap = 1;
+    c.cap = cap;
+    c.size = 0;
+    c.head = c.tail = -1;
+    c.free_list = -1;
+    c.hits = c.misses = 0;
+    int nb = 16;
+    while (nb < cap * 2) nb *= 2;
+    c.bucket_mask = nb - 1;
+    c.slab = (LruEntry*)malloc(sizeof(LruEntry) * cap);
+    c.buckets = (int*)malloc(sizeof(int) * nb);
+    memset(c.buckets, 0xff, sizeof(int) * nb);
+    return c;
+}
+
+static inline int* lru_bucket(Lru* c, int key) {
+    return &c->buckets[hash_int(key) & c->bucket_mask];
+}
+
+static int lru_find(Lru* c, int key) {
+    for (int i = *lru_bucket(c, key); i >= 0; i = c->slab[i].chain) {
+        if (c->slab[i].key == key) return i;
+    }
+    return -1;
+}
+
+static inline void lru_unlink(Lru* c, int i) {
+    LruEntry* e = &c->slab[i];
+    if (e->prev >= 0) c->slab[e->prev].next = e->next; else c->head = e->next;
+    if (e->next >= 0) c->slab[e->next].prev = e->prev; else c->tail = e->prev;
+}
+
+static inline void lru_push_front(Lru* c, int i) {
+    c->slab[i].prev = -1;
+    c->slab[i].next = c->head;
+    if (c->head >= 0) c->slab[c->head].prev = i; else c->tail = i;
+    c->head = i;
+}
+
+static void lru_unchain(Lru* c, int i) {
+    int* link = lru_bucket(c, c->slab[i].key);
+    while (*link != i) link = &c->slab[*link].chain;
+    *link = c->slab[i].chain;
+}
+
+static bool lru_has(Lru* c, int key) {
+    return lru_find(c, key) >= 0;
+}
+
+/* Value for key (0 when missing); a hit makes the entry most recent */
+static int lru_get(Lru* c, int key) {
+    int i = lru_find(c, key);
+    if (i < 0) {
+        c->misses++;
+        return 0;
+    }
+    c->hits++;
+    if (i != c->head) {
+        lru_unlink(c, i);
+        lru_push_front(c, i);
+    }
+    return c->slab[i].val;
+}
+
+/* Inserts or updates; when full the least recently used entry is evicted */
+static void lru_put(Lru* c, int key, int val) {
+    int i = lru_find(c, key);
+    if (i >= 0) {
+        c->slab[i].val = val;
+        if (i != c->head) {
+            lru_unlink(c, i);
+            lru_push_front(c, i);
+        }
+        return;
+    }
+    if (c->free_list >= 0) {
+        i = c->free_list;
+        c->free_list = c->slab[i].next;
+        c->size++;
+    } else if (c->size < c->cap) {
+        i = c->size++;
+    } else {
+        i = c->tail;
+        lru_unlink(c, i);
+        lru_unchain(c, i);
+    }
+    int* bucket = lru_bucket(c, key);
+    c->slab[i].key = key;
+    c->slab[i].val = val;
+    c->slab[i].chain = *bucket;
+    *bucket = i;
+    lru_push_front(c, i);
+}
+
+static bool lru_remove(Lru* c, int key) {
+    int i = lru_find(c, key);
+    if (i < 0) return false;
+    lru_unlink(c, i);
+    lru_unchain(c, i);
+    c->slab[i].next = c->free_list;
+    c->free_list = i;
+    c->size--;
+    return true;
+}
+
+static int lru_len(Lru* c) {
+    return c->size;
+}
+
+static void lru_clear(Lru* c) {
+    memset(c->buckets, 0xff, sizeof(int) * (c->bucket_mask + 1));
+    c->size = 0;
+    c->head = c->tail = -1;
+    c->free_list = -1;
+    c->hits = c->misses = 0;
+}
+
+/* Entries from most to least recently used */
+static void print_lru(Lru* c) {
+    printf("{");
+    for (int i = c->head; i >= 0; i = c->slab[i].next) {
+        printf("%d: %d", c->slab[i].key, c->slab[i].val);
+        if (c->slab[i].next >= 0) printf(", ");
+    }
+    printf("}\n");
+}
+
+static void lru_free(Lru* c) {
+    free(c->slab);
+    free(c->buckets);
+    c->slab = NULL;
+    c->buckets = NULL;
+    c->size = c->cap = 0;
+}
+
+/* Blocked Bloom filter: every key sets k bits inside one 64-byte block */
+#define BLOOM_BLOCK_BITS 512
+
+typedef struct {
+    uint64_t* bits;
+    uint32_t blocks;
+    int k;
+} Bloom;
+
+static Bloom new_bloom(long long items, double fp_rate) {
+    Bloom b;
+    if (items < 1) items = 1;
+    if (fp_rate <= 0.0 || fp_rate >= 1.0) fp_rate = 0.01;
+    /* Blocking costs a little accuracy, so size ~10% above the classic optimum */
+    double bits = -(double)items * log(fp_rate) / (M_LN2 * M_LN2) * 1.1;
+    b.blocks = (uint32_t)(bits / BLOOM_BLOCK_BITS) + 1;
+    b.k = (int)(bits / (double)items * M_LN2 + 0.5);
+    if (b.k < 1) b.k = 1;
+    if (b.k > 16) b.k = 16;
+    b.bits = (uint64_t*)aligned_alloc(64, (size_t)b.blocks * 64);
+    memset(b.bits, 0, (size_t)b.blocks * 64);
+    return b;
+}
+
+static inline void bloom_add_hash(Bloom* b, uint64_t h) {
+    uint64_t* block = b->bits + (size_t)(((h >> 32) * b->blocks) >> 32) * 8;
+    uint32_t h1 = (uint32_t)h, h2 = (uint32_t)(h >> 41) | 1;
+    for (int i = 0; i < b->k; i++) {
+        uint32_t bit = (h1 + (uint32_t)i * h2) & (BLOOM_BLOCK_BITS - 1);
+        block[bit >> 6] |= 1ULL << (bit & 63);
+    }
+}
+
+static inline bool bloom_has_hash(const Bloom* b, uint64_t h) {
+    const uint64_t* block = b->bits + (size_t)(((h >> 32) * b->blocks) >> 32) * 8;
+    uint32_t h1 = (uint32_t)h, h2 = (uint32_t)(h >> 41) | 1;
+    bool hit = true;
+    for (int i = 0; i < b->k; i++) {
+        uint32_t bit = (h1 + (uint32_t)i * h2) & (BLOOM_BLOCK_BITS - 1);
+        hit &= (block[bit >> 6] >> (bit & 63)) & 1;
+    }
+    return hit;
+}
+
+static void bloom_add_int(Bloom* b, int key) { bloom_add_hash(b, hash_int(key)); }
+static void bloom_add_str(Bloom* b, const char* key) { bloom_add_hash(b, hash_str(key)); }
+static bool bloom_contains_int(const Bloom* b, int key) { return bloom_has_hash(b, hash_int(key)); }
+static bool bloom_contains_str(const Bloom* b, const char* key) { return bloom_has_hash(b, hash_str(key)); }
+
+#define bloom_add(b, key) _Generic((key), char*: bloom_add_str, const char*: bloom_add_str, default: bloom_add_int)(b, key)
+#define bloom_contains(b, key) _Generic((key), char*: bloom_contains_str, const char*: bloom_contains_str, default: bloom_contains_int)(b, key)
+
+/* Union of two filters built with the same parameters */
+static bool bloom_merge(Bloom* b, const Bloom* other) {
+    if (b->blocks != other->blocks || b->k != other->k) return false;
+    size_t words = (size_t)b->blocks * 8;
+    for (size_t i = 0; i < words; i++) b->bits[i] |= other->bits[i];
+    return true;
+}
+
+static void bloom_clear(Bloom* b) {
+    memset(b->bits, 0, (size_t)b->blocks * 64);
+}
+
+/* Binary snapshot: magic, k, block count, raw blocks */
+static bool bloom_save(const Bloom* b, const char* path) {
+    FILE* fp = fopen(path, "wb");
+    if (!fp) return false;
+    uint32_t header[3] = { 0x4D4C4241u /* "ABLM" */, (uint32_t)b->k, b->blocks };
+    bool ok = fwrite(header, sizeof(header), 1, fp) == 1 &&
+              fwrite(b->bits, 64, b->blocks, fp) == b->blocks;
+    return fclose(fp) == 0 && ok;
+}
+
+static bool bloom_load(Bloom* b, const char* path) {
+    FILE* fp = fopen(path, "rb");
+    if (!fp) return false;
+    uint32_t header[3];
+    bool ok = fread(header, sizeof(header), 1, fp) == 1 && header[0] == 0x4D4C4241u && header[2] > 0;
+    if (ok) {
+        uint64_t* bits = (uint64_t*)aligned_alloc(64, (size_t)header[2] * 64);
+        ok = fread(bits, 64, header[2], fp) == header[2];
+        if (ok) {
+            free(b->bits);
+            b->bits = bits;
+            b->k = (int)header[1];
+            b->blocks = header[2];
+        } else {
+            free(bits);
+        }
+    }
+    fclose(fp);
+    return ok;
+}
+
+static void print_bloom(const Bloom* b) {
+    printf("bloom(%u bits, k=%d)\n", b->blocks * BLOOM_BLOCK_BITS, b->k);
+}
+
+static void bloom_free(Bloom* b) {
+    free(b->bits);
+    b->bits = NULL;
+    b->blocks = 0;
+}
+
+/* Count-min sketch: 'depth' rows of 'width' counters, estimates never undercount */
+typedef struct {
+    uint32_t* counts;
+    uint32_t width;     /* power of two */
+    int depth;
+} CountMin;
+
+static CountMin new_cms(int width, int depth) {
+    CountMin c;
+    c.width = 16;
+    while ((int)c.width < width) c.width *= 2;
+    c.depth = depth < 1 ? 1 : (depth > 16 ? 16 : depth);
+    c.counts = (uint32_t*)calloc((size_t)c.width * c.depth, sizeof(uint32_t));
+    return c;
+}
+
+static inline void cms_add_hash(CountMin* c, uint64_t h, uint32_t n) {
+    uint32_t h1 = (uint32_t)h, h2 = (uint32_t)(h >> 32) | 1;
+    for (int r = 0; r < c->depth; r++) {
+        c->counts[(size_t)r * c->width + ((h1 + (uint32_t)r * h2) & (c->width - 1))] += n;
+    }
+}
+
+static inline int cms_count_hash(const CountMin* c, uint64_t h) {
+    uint32_t h1 = (uint32_t)h, h2 = (uint32_t)(h >> 32) | 1;
+    uint32_t best = UINT32_MAX;
+    for (int r = 0; r < c->depth; r++) {
+        uint32_t v = c->counts[(size_t)r * c->width + ((h1 + (uint32_t)r * h2) & (c->width - 1))];
+        if (v < best) best = v;
+    }
+    return (int)best;
+}
+
+static void cms_add_int(CountMin* c, int key) { cms_add_hash(c, hash_int(key), 1); }
+static void cms_add_str(CountMin* c, const char* key) { cms_add_hash(c, hash_str(key), 1); }
+static int cms_count_int(const CountMin* c, int key) { return cms_count_hash(c, hash_int(key)); }
+static int cms_count_str(const CountMin* c, const char* key) { return cms_count_hash(c, hash_str(key)); }
+
+#define cms_add(c, key) _Generic((key), char*: cms_add_str, const char*: cms_add_str, default: cms_add_int)(c, key)
+#define cms_count(c, key) _Generic((key), char*: cms_count_str, const char*: cms_count_str, default: cms_count_int)(c, key)
+
+static bool cms_merge(CountMin* c, const CountMin* other) {
+    if (c->width != other->width || c->depth != other->depth) return false;
+    size_t n = (size_t)c->width * c->depth;
+    for (size_t i = 0; i < n; i++) c->counts[i] += other->counts[i];
+    return true;
+}
+
+static void cms_clear(CountMin* c) {
+    memset(c->counts, 0, sizeof(uint32_t) * (size_t)c->width * c->depth);
+}
+
+static bool cms_save(const CountMin* c, const char* path) {
+    FILE* fp = fopen(path, "wb");
+    if (!fp) return false;
+    size_t n = (size_t)c->width * c->depth;
+    uint32_t header[3] = { 0x534D4341u /* "ACMS" */, c->width, (uint32_t)c->depth };
+    bool ok = fwrite(header, sizeof(header), 1, fp) == 1 &&
+              fwrite(c->counts, sizeof(uint32_t), n, fp) == n;
+    return fclose(fp) == 0 && ok;
+}
+
+static bool cms_load(CountMin* c, const char* path) {
+    FILE* fp = fopen(path, "rb");
+    if (!fp) return false;
+    uint32_t header[3];
+    bool ok = fread(header, sizeof(header), 1, fp) == 1 && header[0] == 0x534D4341u &&
+              header[1] > 0 && header[2] > 0 && header[2] <= 16;
+    if (ok) {
+        size_t n = (size_t)header[1] * header[2];
+        uint32_t* counts = (uint32_t*)malloc(sizeof(uint32_t) * n);
+        ok = fread(counts, sizeof(uint32_t), n, fp) == n;
+        if (ok) {
+            free(c->counts);
+            c->counts = counts;
+            c->width = header[1];
+            c->depth = (int)header[2];
+        } else {
+            free(counts);
+        }
+    }
+    fclose(fp);
+    return ok;
+}
+
+static void print_cms(const CountMin* c) {
+    printf("cms(width=%u, depth=%d)\n", c->width, c->depth);
+}
+
+static void cms_free(CountMin* c) {
+    free(c->counts);
+    c->counts = NULL;
+}
+
+/* Hash set implementation: open addressing with 16-byte control groups */
+#define SET_GROUP 16
+#define SET_EMPTY ((signed char)-128)
+#define SET_DELETED ((signed char)-2)
+
+/* Bitmask of the slots in a group whose control byte equals 'tag' */
+static inline unsigned set_group_match(const signed char* group, signed char tag) {
+#if defined(__SSE2__)
+    __m128i ctrl = _mm_load_si128((const __m128i*)group);
+    return (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(tag)));
+#else
+    unsigned mask = 0;
+    for (int i = 0; i < SET_GROUP; i++) mask |= (unsigned)(group[i] == tag) << i;
+    return mask;
+#endif
+}
+
+/* Bitmask of the empty or deleted slots in a group */
+static inline unsigned set_group_free(const signed char* group) {
+#if defined(__SSE2__)
+    return (unsigned)_mm_movemask_epi8(_mm_load_si128((const __m128i*)group));
+#else
+    unsigned mask = 0;
+    for (int i = 0; i < SET_GROUP; i++) mask |= (unsigned)(group[i] < 0) << i;
+    return mask;
+#endif
+}
+
+/* Control bytes and keys share one 64-byte aligned block */
+static void* set_alloc(int cap, size_t key_size, signed char** ctrl) {
+    size_t bytes = (size_t)cap + (size_t)cap * key_size;
+    bytes = (bytes + 63) & ~(size_t)63;
+    char* block = (char*)aligned_alloc(64, bytes);
+    memset(block, SET_EMPTY, (size_t)cap);
+    *ctrl = (signed char*)block;
+    return block + cap;
+}
+
+typedef struct {
+    signed char* ctrl;
+    int* keys;
+    int size;
+    int used;
+    int cap;
+} IntSet;
+
+static IntSet new_iset_cap(int cap) {
+    IntSet s;
+    s.cap = SET_GROUP;
+    while (s.cap * 7 < cap * 8) s.cap *= 2;
+    s.size = 0;
+    s.used = 0;
+    s.keys = (int*)set_alloc(s.cap, sizeof(int), &s.ctrl);
+    return s;
+}
+
+static IntSet new_iset(void) {
+    return new_iset_cap(SET_GROUP);
+}
+
+static int iset_find(const IntSet* s, int key) {
+    uint64_t h = hash_int(key);
+    signed char tag = (signed char)(h & 0x7F);
+    size_t mask = (size_t)s->cap / SET_GROUP - 1;
+    size_t g = (h >> 7) & mask;
+    for (size_t step = 1;; step++) {
+        const signed char* group = s->ctrl + g * SET_GROUP;
+        unsigned m = set_group_match(group, tag);
+        while (m) {
+            int slot = (int)(g * SET_GROUP) + __builtin_ctz(m);
+            if (s->keys[slot] == key) return slot;
+            m &= m - 1;
+        }
+        if (set_group_match(group, SET_EMPTY)) return -1;
+        g = (g + step) & mask;
+    }
+}
+
+static bool iset_contains(const IntSet* s, int key) {
+    return iset_find(s, key) >= 0;
+}
+
+static void iset_insert_new(IntSet* s, int key, uint64_t h) {
+    size_t mask = (size_t)s->cap / SET_GROUP - 1;
+    size_t g = (h >> 7) & mask;
+    for (size_t step = 1;; step++) {
+        unsigned m = set_group_free(s->ctrl + g * SET_GROUP);
+        if (m) {
+            int slot = (int)(g * SET_GROUP) + __builtin_ctz(m);
+            if (s->ctrl[slot] == SET_EMPTY) s->used++;
+            s->ctrl[slot] = (signed char)(h & 0x7F);
+            s->keys[slot] = key;
+            s->size++;
+            return;
+        }
+        g = (g + step) & mask;
+    }
+}
+
+static void iset_rehash(IntSet* s, int min_size) {
+    IntSet n = new_iset_cap(min_size);
+    for (int i = 0; i < s->cap; i++) {
+        if (s->ctrl[i] >= 0) iset_insert_new(&n, s->keys[i], hash_int(s->keys[i]));
+    }
+    free(s->ctrl);
+    *s = n;
+}
+
+static bool iset_add(IntSet* s, int key) {
+    if (iset_find(s, key) >= 0) return false;
+    if ((s->used + 1) * 8 > s->cap * 7) {
+        iset_rehash(s, s->size * 2 + 1);
+    }
+    iset_insert_new(s, key, hash_int(key));
+    return true;
+}
+
+static bool iset_remove(IntSet* s, int key) {
+    int slot = iset_find(s, key);
+    if (slot < 0) return false;
+    /* A group that still has an empty slot never made a probe move past it */
+    const signed char* group = s->ctrl + (slot & ~(SET_GROUP - 1));
+    if (set_group_match(group, SET_EMPTY)) {
+        s->ctrl[slot] = SET_EMPTY;
+        s->used--;
+    } else {
+        s->ctrl[slot] = SET_DELETED;
+    }
+    s->size--;
+    return true;
+}
+
+static int iset_len(const IntSet* s) {
+    return s->size;
+}
+
+static void iset_clear(IntSet* s) {
+    memset(s->ctrl, SET_EMPTY, (size_t)s->cap);
+    s->size = 0;
+    s->used = 0;
+}
+
+static IntSet iset_of(int count, ...) {
+    IntSet s = new_iset_cap(count);
+    va_list args;
+    va_start(args, count);
+    for (int i = 0; i < count; i++) {
+        iset_add(&s, va_arg(args, int));
+    }
+    va_end(args);
+    return s;
+}
+
+static IntSet iset_union(const IntSet* a, const IntSet* b) {
+    if (a->size < b->size) {
+        const IntSet* t = a; a = b; b = t;
+    }
+    IntSet s = new_iset_cap(a->size + b->size);
+    for (int i = 0; i < a->cap; i++) {
+        if (a->ctrl[i] >= 0) iset_insert_new(&s, a->keys[i], hash_int(a->keys[i]));
+    }
+    for (int i = 0; i < b->cap; i++) {
+        if (b->ctrl[i] >= 0 && iset_find(&s, b->keys[i]) < 0) {
+            iset_insert_new(&s, b->keys[i], hash_int(b->keys[i]));
+        }
+    }
+    return s;
+}
+
+static IntSet iset_intersect(const IntSet* a, const IntSet* b) {
+    if (a->size > b->size) {
+        const IntSet* t = a; a = b; b = t;
+    }
+    IntSet s = new_iset_cap(a->size);
+    for (int i = 0; i < a->cap; i++) {
+        if (a->ctrl[i] >= 0 && iset_find(b, a->keys[i]) >= 0) {
+            iset_insert_new(&s, a->keys[i], hash_int(a->keys[i]));
+        }
+    }
+    return s;
+}
+
+static List iset_to_list(const IntSet* s) {
+    List l = new_list();
+    for (int i = 0; i < s->cap; i++) {
+        if (s->ctrl[i] >= 0) list_append(&l, s->keys[i]);
+    }
+    return l;
+}
+
+static void print_iset(const IntSet* s) {
+    printf("{");
+    int n = 0;
+    for (int i = 0; i < s->cap; i++) {
+        if (s->ctrl[i] < 0) continue;
+        printf(n++ ? ", %d" : "%d", s->keys[i]);
+    }
+    printf("}\n");
+}
+
+static void iset_free(IntSet* s) {
+    free(s->ctrl);
+    s->ctrl = NULL;
+    s->keys = NULL;
+    s->size = 0;
+    s->used = 0;
+    s->cap = 0;
+}
+
+typedef struct {
+    signed char* ctrl;
+    char** keys;
+    int size;
+    int used;
+    int cap;
+} StrSet;
+
+static StrSet new_sset_cap(int cap) {
+    StrSet s;
+    s.cap = SET_GROUP;
+    while (s.cap * 7 < cap * 8) s.cap *= 2;
+    s.size = 0;
+    s.used = 0;
+    s.keys = (char**)set_alloc(s.cap, sizeof(char*), &s.ctrl);
+    return s;
+}
+
+static StrSet new_sset(void) {
+    return new_sset_cap(SET_GROUP);
+}
+
+static int sset_find(const StrSet* s, const char* key) {
+    uint64_t h = hash_str(key);
+    signed char tag = (signed char)(h & 0x7F);
+    size_t mask = (size_t)s->cap / SET_GROUP - 1;
+    size_t g = (h >> 7) & mask;
+    for (size_t step = 1;; step++) {
+        const signed char* group = s->ctrl + g * SET_GROUP;
+        unsigned m = set_group_match(group, tag);
+        while (m) {
+            int slot = (int)(g * SET_GROUP) + __builtin_ctz(m);
+            if (strcmp(s->keys[slot], key) == 0) return slot;
+            m &= m - 1;
+        }
+        if (set_group_match(group, SET_EMPTY)) return -1;
+        g = (g + step) & mask;
+    }
+}
+
+static bool sset_contains(const StrSet* s, const char* key) {
+    return sset_find(s, key) >= 0;
+}
+
+/* Takes ownership of 'key' */
+static void sset_insert_new(StrSet* s, char* key, uint64_t h) {
+    size_t mask = (size_t)s->cap / SET_GROUP - 1;
+    size_t g = (h >> 7) & mask;
+    for (size_t step = 1;; step++) {
+        unsigned m = set_group_free(s->ctrl + g * SET_GROUP);
+        if (m) {
+            int slot = (int)(g * SET_GROUP) + __builtin_ctz(m);
+            if (s->ctrl[slot] == SET_EMPTY) s->used++;
+            s->ctrl[slot] = (signed char)(h & 0x7F);
+            s->keys[slot] = key;
+            s->size++;
+            return;
+        }
+        g = (g + step) & mask;
+    }
+}
+
+static void sset_rehash(StrSet* s, int min_size) {
+    StrSet n = new_sset_cap(min_size);
+    for (int i = 0; i < s->cap; i++) {
+        if (s->ctrl[i] >= 0) sset_insert_new(&n, s->keys[i], hash_str(s->keys[i]));
+    }
+    free(s->ctrl);
+    *s = n;
+}
+
+static bool sset_add(StrSet* s, const char* key) {
+    if (sset_find(s, key) >= 0) return false;
+    if ((s->used + 1) * 8 > s->cap * 7) {
+        sset_rehash(s, s->size * 2 + 1);
+    }
+    sset_insert_new(s, strdup(key), hash_str(key));
+    return true;
+}
+
+static bool sset_remove(StrSet* s, const char* key) {
+    int slot = sset_find(s, key);
+    if (slot < 0) return false;
+    free(s->keys[slot]);
+    const signed char* group = s->ctrl + (slot & ~(SET_GROUP - 1));
+    if (set_group_match(group, SET_EMPTY)) {
+        s->ctrl[slot] = SET_EMPTY;
+        s->used--;
+    } else {
+        s->ctrl[slot] = SET_DELETED;
+    }
+    s->size--;
+    return true;
+}
+
+static int sset_len(const StrSet* s) {
+    return s->size;
+}
+
+static void sset_clear(StrSet* s) {
+    for (int i = 0; i < s->cap; i++) {
+        if (s->ctrl[i] >= 0) free(s->keys[i]);
+    }
+    memset(s->ctrl, SET_EMPTY, (size_t)s->cap);
+    s->size = 0;
+    s->used = 0;
+}
+
+static StrSet sset_of(int count, ...) {
+    StrSet s = new_sset_cap(count);
+    va_list args;
+    va_start(args, count);
+    for (int i = 0; i < count; i++) {
+        sset_add(&s, va_arg(args, const char*));
+    }
+    va_end(args);
+    return s;
+}
+
+static StrSet sset_union(const StrSet* a, const StrSet* b) {
+    StrSet s = new_sset_cap(a->size + b->size);
+    for (int i = 0; i < a->cap; i++) {
+        if (a->ctrl[i] >= 0) sset_insert_new(&s, strdup(a->keys[i]), hash_str(a->keys[i]));
+    }
+    for (int i = 0; i < b->cap; i++) {
+        if (b->ctrl[i] >= 0 && sset_find(&s, b->keys[i]) < 0) {
+            sset_insert_new(&s, strdup(b->keys[i]), hash_str(b->keys[i]));
+        }
+    }
+    return s;
+}
+
+static StrSet sset_intersect(const StrSet* a, const StrSet* b) {
+    if (a->size > b->size) {
+        const StrSet* t = a; a = b; b = t;
+    }
+    StrSet s = new_sset_cap(a->size);
+    for (int i = 0; i < a->cap; i++) {
+        if (a->ctrl[i] >= 0 && sset_find(b, a->keys[i]) >= 0) {
+            sset_insert_new(&s, strdup(a->keys[i]), hash_str(a->keys[i]));
+        }
+    }
+    return s;
+}
+
+static void print_sset(const StrSet* s) {
+    printf("{");
+    int n = 0;
+    for (int i = 0; i < s->cap; i++) {
+        if (s->ctrl[i] < 0) continue;
+        printf(n++ ? ", %s" : "%s", s->keys[i]);
+    }
+    printf("}\n");
+}
+
+static void sset_free(StrSet* s) {
+    for (int i = 0; i < s->cap; i++) {
+        if (s->ctrl[i] >= 0) free(s->keys[i]);
+    }
+    free(s->ctrl);
+    s->ctrl = NULL;
+    s->keys = NULL;
+    s->size = 0;
+    s->used = 0;
+    s->cap = 0;
+}
+
+
+int main(void) {
+Dict D = new_dict();
+D[3] = 4;
+IntSet S = new_iset();
+iset_add(&S, 3);
+Deque Q = new_deque();
+deque_push_back(&Q, 1);
+    return 0;
+}